@@ -6,6 +6,7 @@
  */
 
 #include "hal.h"
+#include "halParallel.h"
 #include <algorithm>
 #include <cstdlib>
 #include <fstream>
@@ -36,16 +37,29 @@ using namespace hal;
  * alignment depth.
  */
 
-/** Print the alignment depth wiggle for a subrange of a given sequence to
- * the output stream. */
-static void printSequence(ostream &outStream, const Sequence *sequence, const set<const Genome *> &targetSet, hal_size_t start,
-                          hal_size_t length, hal_size_t step, bool countDupes, bool noAncestors);
-
-/** If given genome-relative coordinates, map them to a series of
- * sequence subranges */
-static void printGenome(ostream &outStream, const Genome *genome, const Sequence *sequence,
-                        const set<const Genome *> &targetSet, hal_size_t start, hal_size_t length, hal_size_t step,
-                        bool countDupes, bool noAncestors);
+/** A subrange of a sequence whose wiggle is computed independently. */
+struct DepthTile {
+    const Sequence *_sequence;
+    hal_size_t _start;
+    hal_size_t _length;
+    bool _first; // print the wiggle header
+    bool _last;  // last tile of the range
+};
+
+/** Print the alignment depth wiggle for a tile to the output stream (the
+ * header is only printed for the first tile of a range). */
+static void printTile(ostream &outStream, const DepthTile &tile, const set<const Genome *> &targetSet, hal_size_t step,
+                      bool countDupes, bool noAncestors);
+
+/** Get the tiles for a range of the reference genome, or of sequence if
+ * it isn't NULL.  Genome-relative coordinates are mapped to a series of
+ * sequence subranges, and each is split into tiles of tileSize bases
+ * (which must be a multiple of step), or not split if tileSize is 0. */
+static void getGenomeTiles(const Genome *genome, const Sequence *sequence, hal_size_t start, hal_size_t length,
+                           hal_size_t tileSize, vector<DepthTile> &tiles);
+
+/* default --tileSize */
+static const hal_size_t DefaultTileSize = 1000000;
 
 static const hal_size_t StringBufferSize = 1024;
 
@@ -78,6 +92,10 @@ static void initParser(CLParser &optionsParser) {
                                               "height of the MAF column created with hal2maf.",
                                 false);
     optionsParser.addOptionFlag("noAncestors", "do not count ancestral genomes.", false);
+    optionsParser.addOption("tileSize", "with --numThreads > 1, the reference is split into tiles of about this "
+                                        "many bases, which are computed in parallel",
+                            DefaultTileSize);
+    addNumThreadsOption(optionsParser);
     optionsParser.setDescription("Make alignment depth wiggle plot for a genome. "
                                  "By default, this is a count of the number of "
                                  "other unique genomes each base aligns to, "
@@ -99,6 +117,8 @@ int main(int argc, char **argv) {
     hal_size_t step;
     bool countDupes;
     bool noAncestors;
+    hal_size_t tileSize;
+    size_t numThreads;
     try {
         optionsParser.parseOptions(argc, argv);
         halPath = optionsParser.getArgument<string>("halPath");
@@ -112,7 +132,15 @@ int main(int argc, char **argv) {
         step = optionsParser.getOption<hal_size_t>("step");
         countDupes = optionsParser.getFlag("countDupes");
         noAncestors = optionsParser.getFlag("noAncestors");
+        tileSize = optionsParser.getOption<hal_size_t>("tileSize");
+        numThreads = optionsParser.getOption<size_t>("numThreads");
 
+        if (step == 0) {
+            throw hal_exception("--step must be positive");
+        }
+        if (tileSize == 0) {
+            throw hal_exception("--tileSize must be positive");
+        }
         if (rootGenomeName != "\"\"" && targetGenomes != "\"\"") {
             throw hal_exception("--rootGenome and --targetGenomes options are "
                                 " mutually exclusive");
@@ -196,7 +224,22 @@ int main(int argc, char **argv) {
             }
         }
 
-        printGenome(outStream, refGenome, refSequence, targetSet, start, length, step, countDupes, noAncestors);
+        numThreads = getNumThreads(alignment.get(), numThreads, "halAlignmentDepth");
+        // tiles start on a step, so the columns are the same as in one pass
+        hal_size_t stepTileSize = numThreads > 1 ? max(tileSize / step, (hal_size_t)1) * step : 0;
+        vector<DepthTile> tiles;
+        getGenomeTiles(refGenome, refSequence, start, length, stepTileSize, tiles);
+        if (numThreads > 1) {
+            parallelOrderedOutput(tiles.size(), numThreads,
+                                  [&](size_t i, ostream &tileStream) {
+                                      printTile(tileStream, tiles[i], targetSet, step, countDupes, noAncestors);
+                                  },
+                                  outStream);
+        } else {
+            for (size_t i = 0; i < tiles.size(); ++i) {
+                printTile(outStream, tiles[i], targetSet, step, countDupes, noAncestors);
+            }
+        }
 
     } catch (hal_exception &e) {
         cerr << "hal exception caught: " << e.what() << endl;
@@ -209,30 +252,14 @@ int main(int argc, char **argv) {
     return 0;
 }
 
-/** Given a Sequence (chromosome) and a (sequence-relative) coordinate
- * range, print the alignmability wiggle with respect to the genomes
- * in the target set */
-void printSequence(ostream &outStream, const Sequence *sequence, const set<const Genome *> &targetSet, hal_size_t start,
-                   hal_size_t length, hal_size_t step, bool countDupes, bool noAncestors) {
-    hal_size_t seqLen = sequence->getSequenceLength();
-    if (seqLen == 0) {
-        return;
-    }
-    /** If the length is 0, we do from the start position until the end
-     * of the sequence */
-    if (length == 0) {
-        length = seqLen - start;
-    }
-    hal_size_t last = start + length;
-    if (last > seqLen) {
-        throw hal_exception("Specified range [" + std::to_string(start) + "," + std::to_string(length) + "] is" +
-                            "out of range for sequence " + sequence->getName() + ", which has length " +
-                            std::to_string(seqLen));
-    }
-
-    const Genome *genome = sequence->getGenome();
-    string sequenceName = sequence->getName();
-    string genomeName = genome->getName();
+/** Given a tile of a Sequence (chromosome), that is a (sequence-relative)
+ * coordinate range, print the alignmability wiggle with respect to the
+ * genomes in the target set */
+void printTile(ostream &outStream, const DepthTile &tile, const set<const Genome *> &targetSet, hal_size_t step,
+               bool countDupes, bool noAncestors) {
+    const Sequence *sequence = tile._sequence;
+    hal_size_t start = tile._start;
+    hal_size_t last = start + tile._length;
 
     /** The ColumnIterator is fundamental structure used in this example to
      * traverse the alignment.  It essientially generates the multiple alignment
@@ -243,8 +270,10 @@ void printSequence(ostream &outStream, const Sequence *sequence, const set<const
      * duplications out of the desired range while we are iterating. */
     hal_size_t pos = start;
     ColumnIteratorPtr colIt = sequence->getColumnIterator(&targetSet, 0, pos, last - 1, false, noAncestors);
-    // note wig coordinates are 1-based for some reason so we shift to right
-    outStream << "fixedStep chrom=" << sequenceName << " start=" << start + 1 << " step=" << step << "\n";
+    if (tile._first) {
+        // note wig coordinates are 1-based for some reason so we shift to right
+        outStream << "fixedStep chrom=" << sequence->getName() << " start=" << start + 1 << " step=" << step << "\n";
+    }
 
     /** Since the column iterator stores coordinates in Genome coordinates
      * internally, we have to switch back to genome coordinates.  */
@@ -253,7 +282,9 @@ void printSequence(ostream &outStream, const Sequence *sequence, const set<const
     last += sequence->getStartPosition();
     // keep track of unique genomes
     set<const Genome *> genomeSet;
-    while (pos <= last) {
+    // the end test is odd, but changing it would change the output of the
+    // last tile when length is a multiple of step
+    while (tile._last ? pos <= last : pos < last) {
         genomeSet.clear();
         hal_size_t count = 0;
         /** ColumnIterator::ColumnMap maps a Sequence to a list of bases
@@ -301,12 +332,42 @@ void printSequence(ostream &outStream, const Sequence *sequence, const set<const
                 colIt->defragment();
             }
         } else {
-            /** Reset the iterator to a non-contiguous position */
-            colIt->toSite(pos, last);
+            /** Reset the iterator to a non-contiguous position, stopping
+             * if we've stepped past the range (last is exclusive) */
+            if (pos >= last) {
+                break;
+            }
+            colIt->toSite(pos, last - 1);
         }
     }
 }
 
+/** Split a (sequence-relative) range of a sequence into tiles */
+static void getSequenceTiles(const Sequence *sequence, hal_size_t start, hal_size_t length, hal_size_t tileSize,
+                             vector<DepthTile> &tiles) {
+    hal_size_t seqLen = sequence->getSequenceLength();
+    if (seqLen == 0) {
+        return;
+    }
+    /** If the length is 0, we do from the start position until the end
+     * of the sequence */
+    if (length == 0) {
+        length = seqLen - start;
+    }
+    if (start + length > seqLen) {
+        throw hal_exception("Specified range [" + std::to_string(start) + "," + std::to_string(length) + "] is" +
+                            "out of range for sequence " + sequence->getName() + ", which has length " +
+                            std::to_string(seqLen));
+    }
+    if (tileSize == 0) {
+        tileSize = length;
+    }
+    for (hal_size_t offset = 0; offset < length; offset += tileSize) {
+        hal_size_t tileLength = min(tileSize, length - offset);
+        tiles.push_back({sequence, start + offset, tileLength, offset == 0, offset + tileLength == length});
+    }
+}
+
 /** Map a range of genome-level coordinates to potentially multiple sequence
  * ranges.  For example, if a genome contains two chromosomes ChrA and ChrB,
  * both of which are of length 500, then the genome-coordinates would be
@@ -315,10 +376,10 @@ void printSequence(ostream &outStream, const Sequence *sequence, const set<const
  * for the hal::Sequence interface.  We can convert between the two by
  * adding or subtracting the sequence start position (in the example it woudl
  * be 0 for ChrA and 500 for ChrB) */
-void printGenome(ostream &outStream, const Genome *genome, const Sequence *sequence, const set<const Genome *> &targetSet,
-                 hal_size_t start, hal_size_t length, hal_size_t step, bool countDupes, bool noAncestors) {
+void getGenomeTiles(const Genome *genome, const Sequence *sequence, hal_size_t start, hal_size_t length,
+                    hal_size_t tileSize, vector<DepthTile> &tiles) {
     if (sequence != NULL) {
-        printSequence(outStream, sequence, targetSet, start, length, step, countDupes, noAncestors);
+        getSequenceTiles(sequence, start, length, tileSize, tiles);
     } else {
         if (start + length > genome->getSequenceLength()) {
             throw hal_exception("Specified range [" + std::to_string(start) + "," + std::to_string(length) + "] is" +
@@ -339,7 +400,8 @@ void printGenome(ostream &outStream, const Genome *genome, const Sequence *seque
                 hal_size_t readStart = seqStart >= start ? 0 : start - seqStart;
                 hal_size_t readLen = min(seqLen - readStart, length);
                 readLen = min(readLen, length - runningLength);
-                printSequence(outStream, sequence, targetSet, readStart, readLen, step, countDupes, noAncestors);
+                // the iterator's sequence doesn't outlive it, the genome's does
+                getSequenceTiles(genome->getSequence(sequence->getName()), readStart, readLen, tileSize, tiles);
                 runningLength += readLen;
             }
         }
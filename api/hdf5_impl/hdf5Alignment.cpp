@@ -8,6 +8,7 @@
 #include "hdf5Alignment.h"
 #include "halCLParser.h"
 #include "halCommon.h"
+#include "halPerfStats.h"
 #include "halSequenceIterator.h"
 #include "hdf5Common.h"
 #include "hdf5Genome.h"
@@ -45,6 +46,7 @@ const hsize_t Hdf5Alignment::DefaultCacheRDCElems = 599999;
 const hsize_t Hdf5Alignment::DefaultCacheRDCBytes = 15728640;
 const double Hdf5Alignment::DefaultCacheW0 = 0.75;
 const bool Hdf5Alignment::DefaultInMemory = false;
+const hsize_t Hdf5Alignment::DefaultArrayCacheChunks = 8;
 
 /* check if first bit of file has HDF5 header */
 bool hal::Hdf5Alignment::isHdf5File(const std::string &initialBytes) {
@@ -67,7 +69,7 @@ Hdf5Alignment::Hdf5Alignment(const string &alignmentPath, unsigned mode, const H
                              const H5::FileAccPropList &fileAccessProps, const H5::DSetCreatPropList &datasetCreateProps,
                              bool inMemory)
     : _alignmentPath(alignmentPath), _mode(halDefaultAccessMode(mode)), _file(NULL), _flags(hdf5DefaultFlags(_mode)),
-      _inMemory(inMemory), _metaData(NULL), _tree(NULL), _dirty(false) {
+      _inMemory(inMemory), _arrayCacheChunks(DefaultArrayCacheChunks), _metaData(NULL), _tree(NULL), _dirty(false) {
     _cprops.copy(fileCreateProps);
     _aprops.copy(fileAccessProps);
     _dcprops.copy(datasetCreateProps);
@@ -83,7 +85,7 @@ Hdf5Alignment::Hdf5Alignment(const string &alignmentPath, unsigned mode, const H
 
 Hdf5Alignment::Hdf5Alignment(const std::string &alignmentPath, unsigned mode, const CLParser *parser)
     : _alignmentPath(alignmentPath), _mode(halDefaultAccessMode(mode)), _file(NULL), _flags(hdf5DefaultFlags(_mode)),
-      _inMemory(false), _metaData(NULL), _tree(NULL), _dirty(false) {
+      _inMemory(false), _arrayCacheChunks(DefaultArrayCacheChunks), _metaData(NULL), _tree(NULL), _dirty(false) {
     initializeFromOptions(parser);
     if (_inMemory) {
         setInMemory();
@@ -121,6 +123,10 @@ void Hdf5Alignment::defineOptions(CLParser *parser, unsigned mode) {
     parser->addOption("hdf5CacheW0", "w0 parameter for hdf5 cache", DefaultCacheW0);
     parser->addOption("cacheW0", "obsolete name for --hdf5CacheW0", DefaultCacheW0);
 
+    parser->addOption("hdf5ArrayCacheChunks", "number of chunks of each genome array kept in memory, so that "
+                                              "alternating between parts of an array doesn't reread them",
+                      DefaultArrayCacheChunks);
+
     parser->addOptionFlag("hdf5InMemory", "load all data in memory (and disable hdf5 cache)", DefaultInMemory);
     parser->addOptionFlag("inMemory", "obsolete name for --hdf5InMemory", DefaultInMemory);
 }
@@ -131,6 +137,7 @@ void Hdf5Alignment::initializeFromOptions(const CLParser *parser) {
     _dcprops.copy(H5::DSetCreatPropList::DEFAULT);
     _aprops.copy(H5::FileAccPropList::DEFAULT);
     _inMemory = parser->getFlagAlt("hdf5InMemory", "inMemory");
+    _arrayCacheChunks = parser->getOption<hsize_t>("hdf5ArrayCacheChunks");
     if ((_mode & CREATE_ACCESS) || (_mode & WRITE_ACCESS)) {
         // these are only available on create
         hsize_t chunk = parser->getOptionAlt<hsize_t>("hdf5Chunk", "chunk");
@@ -206,6 +213,7 @@ void Hdf5Alignment::open() {
 }
 
 void Hdf5Alignment::close() {
+    clearMappingPaths();
     if (_file != NULL) {
         if (not isReadOnly()) {
             writeTree();
@@ -247,6 +255,7 @@ void Hdf5Alignment::close() {
 
 Genome *Hdf5Alignment::insertGenome(const string &name, const string &parentName, const string &childName,
                                     double upperBranchLength) {
+    clearMappingPaths();
     if (name.empty() == true || parentName.empty() || childName.empty()) {
         throw hal_exception("name can't be empty");
     }
@@ -272,6 +281,15 @@ Genome *Hdf5Alignment::insertGenome(const string &name, const string &parentName
     double lowerBranchLength = existingBranchLength - upperBranchLength;
     stTree_setParent(child, newNode);
     stTree_setBranchLength(child, lowerBranchLength);
+    // the parent and child may have cached each other
+    map<string, Hdf5Genome *>::iterator mapIt = _openGenomes.find(parentName);
+    if (mapIt != _openGenomes.end()) {
+        mapIt->second->resetBranchCaches();
+    }
+    mapIt = _openGenomes.find(childName);
+    if (mapIt != _openGenomes.end()) {
+        mapIt->second->resetBranchCaches();
+    }
 
     Hdf5Genome *genome = new Hdf5Genome(name, this, _file, _dcprops, _inMemory);
     _openGenomes.insert(pair<string, Hdf5Genome *>(name, genome));
@@ -280,6 +298,7 @@ Genome *Hdf5Alignment::insertGenome(const string &name, const string &parentName
 }
 
 Genome *Hdf5Alignment::addLeafGenome(const string &name, const string &parentName, double branchLength) {
+    clearMappingPaths();
     if (name.empty() == true || parentName.empty()) {
         throw hal_exception("name can't be empty");
     }
@@ -305,6 +324,7 @@ Genome *Hdf5Alignment::addLeafGenome(const string &name, const string &parentNam
 }
 
 Genome *Hdf5Alignment::addRootGenome(const string &name, double branchLength) {
+    clearMappingPaths();
     if (name.empty() == true) {
         throw hal_exception("name can't be empty");
     }
@@ -330,6 +350,7 @@ Genome *Hdf5Alignment::addRootGenome(const string &name, double branchLength) {
 // May only make sense to remove a leaf genome
 // (so that's what is done here right now)
 void Hdf5Alignment::removeGenome(const string &name) {
+    clearMappingPaths();
     map<string, stTree *>::iterator findIt = _nodeMap.find(name);
     if (findIt == _nodeMap.end()) {
         throw hal_exception("node " + name + " does not exist");
@@ -432,11 +453,14 @@ Genome *Hdf5Alignment::openGenome(const string &name) {
     if (_nodeMap.find(name) != _nodeMap.end()) {
         genome = new Hdf5Genome(name, this, _file, _dcprops, _inMemory);
         _openGenomes.insert(pair<string, Hdf5Genome *>(name, genome));
+        perfCount(PERF_GENOME_OPENS);
     }
     return genome;
 }
 
 void Hdf5Alignment::closeGenome(const Genome *genome) const {
+    perfCount(PERF_GENOME_CLOSES);
+    clearMappingPaths();
     string name = genome->getName();
     map<string, Hdf5Genome *>::iterator mapIt = _openGenomes.find(name);
     if (mapIt == _openGenomes.end()) {
@@ -646,6 +670,7 @@ void Hdf5Alignment::loadTree() {
 }
 
 void Hdf5Alignment::replaceNewickTree(const string &newNewickString) {
+    clearMappingPaths();
     _nodeMap.clear();
     HDF5MetaData treeMeta(_file, TreeGroupName);
     treeMeta.set(TreeGroupName, newNewickString);
@@ -81,6 +81,16 @@ namespace hal {
 
         bool isReadOnly() const;
 
+        /* number of pages (chunks) of each genome array kept in memory */
+        hsize_t getArrayCacheChunks() const {
+            return _arrayCacheChunks;
+        }
+
+        /* HDF5 library and the external array paging are not thread-safe */
+        bool supportsConcurrentReads() const {
+            return false;
+        }
+
         void replaceNewickTree(const std::string &newNewickString);
 
       private:
@@ -109,6 +119,7 @@ namespace hal {
         static const hsize_t DefaultCacheRDCBytes;
         static const double DefaultCacheW0;
         static const bool DefaultInMemory;
+        static const hsize_t DefaultArrayCacheChunks;
 
         static const H5std_string MetaGroupName;
         static const H5std_string TreeGroupName;
@@ -122,6 +133,7 @@ namespace hal {
         H5::H5File *_file;
         int _flags;
         bool _inMemory;
+        hsize_t _arrayCacheChunks;
         H5::FileCreatPropList _cprops;
         H5::FileAccPropList _aprops;
         H5::DSetCreatPropList _dcprops;
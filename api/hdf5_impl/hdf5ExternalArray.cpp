@@ -6,35 +6,62 @@
  */
 
 #include "hdf5ExternalArray.h"
+#include "halPerfStats.h"
+#include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <vector>
 
 using namespace hal;
 using namespace H5;
 using namespace std;
 
+/* approximate number of bytes copyTo() moves at a time */
+static const hsize_t COPY_BLOCK_BYTES = 64 << 20;
+
+/* approximate number of bytes in a page of an array that isn't chunked */
+static const hsize_t UNCHUNKED_PAGE_BYTES = 1 << 20;
+
+/* _bufPage when no page is buffered */
+static const size_t NO_PAGE = (size_t)-1;
+
 /** Constructor */
 Hdf5ExternalArray::Hdf5ExternalArray()
-    : _file(NULL), _size(0), _chunkSize(0), _bufStart(0), _bufEnd(0), _bufSize(0), _buf(NULL), _dirty(false) {
+    : _file(NULL), _size(0), _chunkSize(0), _bufStart(0), _bufEnd(0), _bufSize(0), _buf(NULL), _dirty(false), _pageSize(0),
+      _maxPages(1), _bufPage(NO_PAGE), _useCount(0), _numCacheHits(0), _numCacheMisses(0) {
 }
 
 /** Destructor */
 Hdf5ExternalArray::~Hdf5ExternalArray() {
-    delete[] _buf;
 }
 
-/* initialize the internal data buffer */
-void Hdf5ExternalArray::initBuf() {
-    _bufSize = _chunkSize > 1 ? _chunkSize : _size;
-    _bufStart = 0;
-    _bufEnd = _bufSize - 1;
-    delete[] _buf;
-    _buf = new char[_bufSize * _dataSize];
+/* initialize the page cache, with no page buffered */
+void Hdf5ExternalArray::initBuf(hsize_t chunksInBuffer, hsize_t numBuffers) {
+    if (chunksInBuffer == 0 || _size == 0) {
+        _pageSize = _size;
+    } else if (_chunkSize == 0) {
+        _pageSize = min(_size, max(UNCHUNKED_PAGE_BYTES / _dataSize, (hsize_t)1));
+    } else {
+        _pageSize = min(_size, _chunkSize * chunksInBuffer);
+    }
+    _maxPages = max(numBuffers, (hsize_t)1);
+    _pages.clear();
+    _pageIndex.clear();
+    _bufPage = NO_PAGE;
+    _bufStart = 1; // empty range, so that the first access pages
+    _bufEnd = 0;
+    _bufSize = 0;
+    _buf = NULL;
+    _dirty = false;
+    _useCount = 0;
+    _numCacheHits = 0;
+    _numCacheMisses = 0;
 }
 
 // Create a new dataset in specifed location
 void Hdf5ExternalArray::create(PortableH5Location *file, const H5std_string &path, const DataType &dataType,
-                               hsize_t numElements, const DSetCreatPropList *inCparms, hsize_t chunksInBuffer) {
+                               hsize_t numElements, const DSetCreatPropList *inCparms, hsize_t chunksInBuffer,
+                               hsize_t numBuffers) {
     // copy in parameters
     _file = file;
     _path = path;
@@ -61,23 +88,22 @@ void Hdf5ExternalArray::create(PortableH5Location *file, const H5std_string &pat
             _chunkSize = _size;
             cparms.setChunk(1, &_chunkSize);
         }
-        _chunkSize *= chunksInBuffer;
     } else {
         _chunkSize = 0;
     }
 
-    // create the internal data buffer
-    initBuf();
+    // create the page cache
+    initBuf(chunksInBuffer, numBuffers);
 
     // create the hdf5 array
     _dataSet = _file->createDataSet(_path, _dataType, _dataSpace, cparms);
-    _chunkSpace = DataSpace(1, &_bufSize);
     assert(getSize() == numElements);
-    assert(_bufSize > 0 || _size == 0);
+    assert(_pageSize > 0 || _size == 0);
 }
 
 // Load an existing dataset into memory
-void Hdf5ExternalArray::load(PortableH5Location *file, const H5std_string &path, hsize_t chunksInBuffer) {
+void Hdf5ExternalArray::load(PortableH5Location *file, const H5std_string &path, hsize_t chunksInBuffer,
+                             hsize_t numBuffers) {
     // load up the parameters
     _file = file;
     _path = path;
@@ -93,49 +119,187 @@ void Hdf5ExternalArray::load(PortableH5Location *file, const H5std_string &path,
     // resolve chunking size (0 = do not chunk)
     if (cparms.getLayout() == H5D_CHUNKED) {
         cparms.getChunk(1, &_chunkSize);
-        _chunkSize *= chunksInBuffer;
-        if (_chunkSize == 1) {
+        if (_chunkSize * chunksInBuffer == 1) {
             throw hal_exception("Hdf5ExternalArray::create: "
                                 "chunkSize of 1 not supported");
         }
-        if (_chunkSize > _size) {
+        if (_chunkSize * chunksInBuffer > _size) {
             throw hal_exception("Hdf5ExternalArray::create: "
                                 "chunkSize > array size is not supported");
         }
     } else {
         _chunkSize = 0;
     }
-    initBuf();
-    _bufStart = _bufEnd + 1; // set out of range to ensure page happens
-    _chunkSpace = DataSpace(1, &_bufSize);
-    assert(_bufSize > 0 || _size == 0);
+    initBuf(chunksInBuffer, numBuffers);
+    assert(_pageSize > 0 || _size == 0);
 }
 
-// Write the memory buffer back to the file
+// Write the modified pages back to the file
 void Hdf5ExternalArray::write() {
-    if (_dirty) {
-        _dataSpace.selectHyperslab(H5S_SELECT_SET, &_bufSize, &_bufStart);
-        _dataSet.write(_buf, _dataType, _chunkSpace, _dataSpace);
-        _dirty = false;
+    if (_bufPage != NO_PAGE) {
+        _pages[_bufPage]._dirty = _dirty;
+    }
+    for (size_t i = 0; i < _pages.size(); ++i) {
+        writePage(_pages[i]);
+    }
+    _dirty = false;
+}
+
+/* read a page from the file, dropping any changes */
+void Hdf5ExternalArray::readPage(Page &page) {
+    perfCount(PERF_HDF5_PAGE_LOADS);
+    PerfTimerScope timer(PERF_TIME_HDF5_READ);
+    DataSpace pageSpace(1, &page._size);
+    _dataSpace.selectHyperslab(H5S_SELECT_SET, &page._size, &page._start);
+    _dataSet.read(page._buf.data(), _dataType, pageSpace, _dataSpace);
+    page._dirty = false;
+}
+
+/* write a page to the file if it was modified */
+void Hdf5ExternalArray::writePage(Page &page) {
+    if (page._dirty) {
+        DataSpace pageSpace(1, &page._size);
+        _dataSpace.selectHyperslab(H5S_SELECT_SET, &page._size, &page._start);
+        _dataSet.write(page._buf.data(), _dataType, pageSpace, _dataSpace);
+        page._dirty = false;
     }
 }
 
 // Page chunk containing index i into memory
 void Hdf5ExternalArray::page(hsize_t i) {
-    if (_dirty) {
-        write();
+    assert(i < _size);
+    hsize_t start = (i / _pageSize) * _pageSize;
+    if (_bufPage != NO_PAGE) {
+        _pages[_bufPage]._dirty = _dirty;
+        if (_pages[_bufPage]._start == start) {
+            return;
+        }
     }
-    _bufStart = (i / _bufSize) * _bufSize; // todo: review
+    size_t pageIdx;
+    unordered_map<hsize_t, size_t>::const_iterator found = _pageIndex.find(start);
+    if (found != _pageIndex.end()) {
+        ++_numCacheHits;
+        pageIdx = found->second;
+    } else {
+        ++_numCacheMisses;
+        if (_pages.size() < _maxPages) {
+            pageIdx = _pages.size();
+            _pages.push_back(Page());
+            _pages.back()._buf.resize(_pageSize * _dataSize);
+        } else {
+            // evict the least recently used page
+            pageIdx = 0;
+            for (size_t j = 1; j < _pages.size(); ++j) {
+                if (_pages[j]._lastUse < _pages[pageIdx]._lastUse) {
+                    pageIdx = j;
+                }
+            }
+            writePage(_pages[pageIdx]);
+            _pageIndex.erase(_pages[pageIdx]._start);
+        }
+        Page &page = _pages[pageIdx];
+        page._start = start;
+        page._size = min(_pageSize, _size - start);
+        readPage(page);
+        _pageIndex[start] = pageIdx;
+    }
+    Page &page = _pages[pageIdx];
+    page._lastUse = ++_useCount;
+    _bufPage = pageIdx;
+    _bufStart = page._start;
+    _bufSize = page._size;
     _bufEnd = _bufStart + _bufSize - 1;
+    _buf = page._buf.data();
+    _dirty = page._dirty;
+    assert(_bufSize > 0 || _size == 0);
+}
 
-    if (_bufEnd >= _size) {
-        _bufEnd = _size - 1;
-        _bufSize = _bufEnd - _bufStart + 1;
-        _chunkSpace = DataSpace(1, &_bufSize);
+// Reread the pages in memory, dropping any changes
+void Hdf5ExternalArray::reread() {
+    for (size_t i = 0; i < _pages.size(); ++i) {
+        readPage(_pages[i]);
     }
-
-    _dataSpace.selectHyperslab(H5S_SELECT_SET, &_bufSize, &_bufStart);
-    _dataSet.read(_buf, _dataType, _chunkSpace, _dataSpace);
     _dirty = false;
-    assert(_bufSize > 0 || _size == 0);
+}
+
+// Copy the array to another, a block at a time
+void Hdf5ExternalArray::copyTo(Hdf5ExternalArray &dest) {
+    if (dest._size != _size || dest._dataSize != _dataSize) {
+        throw hal_exception("Hdf5ExternalArray::copyTo: arrays " + _path + " and " + dest._path +
+                            " have different dimensions");
+    }
+    // the datasets must be up to date before going around the buffers
+    write();
+    dest.write();
+
+    if (copyStoredChunks(dest)) {
+        dest.reread();
+        return;
+    }
+
+    // whole destination chunks, to avoid rewriting them
+    hsize_t blockSize = max(COPY_BLOCK_BYTES / _dataSize, (hsize_t)1);
+    if (dest._chunkSize > 1) {
+        blockSize = max(blockSize / dest._chunkSize, (hsize_t)1) * dest._chunkSize;
+    }
+    blockSize = min(blockSize, _size);
+    vector<char> block(blockSize * _dataSize);
+    for (hsize_t start = 0; start < _size; start += blockSize) {
+        hsize_t count = min(blockSize, _size - start);
+        DataSpace blockSpace(1, &count);
+        // read as the destination type, so HDF5 converts if the file
+        // representations differ
+        _dataSpace.selectHyperslab(H5S_SELECT_SET, &count, &start);
+        _dataSet.read(block.data(), dest._dataType, blockSpace, _dataSpace);
+        dest._dataSpace.selectHyperslab(H5S_SELECT_SET, &count, &start);
+        dest._dataSet.write(block.data(), dest._dataType, blockSpace, dest._dataSpace);
+    }
+    dest.reread();
+}
+
+/* Copy the chunks as they are stored in the file, if the two datasets have
+ * the same chunking, filters and file datatype, returning false otherwise */
+bool Hdf5ExternalArray::copyStoredChunks(Hdf5ExternalArray &dest) {
+#if H5_VERSION_GE(1, 10, 3)
+    DSetCreatPropList cparms = _dataSet.getCreatePlist();
+    DSetCreatPropList destCparms = dest._dataSet.getCreatePlist();
+    if (_size == 0 || cparms.getLayout() != H5D_CHUNKED || destCparms.getLayout() != H5D_CHUNKED ||
+        !(_dataSet.getDataType() == dest._dataSet.getDataType())) {
+        return false;
+    }
+    hsize_t chunkSize, destChunkSize;
+    cparms.getChunk(1, &chunkSize);
+    destCparms.getChunk(1, &destChunkSize);
+    int numFilters = cparms.getNfilters();
+    if (chunkSize != destChunkSize || numFilters != destCparms.getNfilters()) {
+        return false;
+    }
+    for (int i = 0; i < numFilters; ++i) {
+        if (H5Pget_filter2(cparms.getId(), i, NULL, NULL, NULL, 0, NULL, NULL) !=
+            H5Pget_filter2(destCparms.getId(), i, NULL, NULL, NULL, 0, NULL, NULL)) {
+            return false;
+        }
+    }
+    vector<char> chunk;
+    for (hsize_t offset = 0; offset < _size; offset += chunkSize) {
+        hsize_t storedSize = 0;
+        if (H5Dget_chunk_storage_size(_dataSet.getId(), &offset, &storedSize) < 0) {
+            throw hal_exception("Hdf5ExternalArray::copyTo: can't get size of chunk at " + std::to_string(offset) +
+                                " in " + _path);
+        }
+        if (storedSize == 0) {
+            continue; // never written
+        }
+        chunk.resize(storedSize);
+        uint32_t filterMask = 0;
+        if (H5Dread_chunk(_dataSet.getId(), H5P_DEFAULT, &offset, &filterMask, chunk.data()) < 0 ||
+            H5Dwrite_chunk(dest._dataSet.getId(), H5P_DEFAULT, filterMask, &offset, storedSize, chunk.data()) < 0) {
+            throw hal_exception("Hdf5ExternalArray::copyTo: can't copy chunk at " + std::to_string(offset) + " of " +
+                                _path + " to " + dest._path);
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
 }
@@ -11,6 +11,8 @@
 #include "halDefs.h"
 #include <H5Cpp.h>
 #include <cassert>
+#include <unordered_map>
+#include <vector>
 
 // Hack to compile with various versions of HDF5 that aren't themselves compatible
 namespace H5 {
@@ -34,6 +36,12 @@ namespace hal {
      * We can't use compiler tpying of the input objects (and instead just
      * expose the raw void* data) because the elements' sizes are not known
      * at compile time, and we don't want to move it around once its read.
+     *
+     * The most recently used pages are kept in memory, so that access that
+     * alternates between a few distant parts of the array doesn't reread
+     * them.  The buffer (getBuf() etc) is the last page accessed.  Page
+     * buffers are reused rather than freed when a page is evicted, so a
+     * pointer into one stays valid, but may then see another page.
      */
     class Hdf5ExternalArray {
       public:
@@ -53,9 +61,10 @@ namespace hal {
           * 0: load entire array into buffer
           * 1: use default chunking (from dataset)
           * N: buffersize will be N chunks.
+         * @param numBuffers Number of buffers (pages) kept in memory
           */
         void create(H5::PortableH5Location *file, const H5std_string &path, const H5::DataType &dataType, hsize_t numElements,
-                    const H5::DSetCreatPropList *inCparms = NULL, hsize_t chunksInBuffer = 1);
+                    const H5::DSetCreatPropList *inCparms = NULL, hsize_t chunksInBuffer = 1, hsize_t numBuffers = 1);
 
         /** Load an existing dataset into memory
           * @param file Pointer to the HDF5 file in which to create array
@@ -64,12 +73,23 @@ namespace hal {
           * 0: load entire array into buffer
           * 1: use default chunking (from dataset)
           * N: buffersize will be N chunks.
+          * @param numBuffers Number of buffers (pages) kept in memory
           */
-        void load(H5::PortableH5Location *file, const H5std_string &path, hsize_t chunksInBuffer = 1);
+        void load(H5::PortableH5Location *file, const H5std_string &path, hsize_t chunksInBuffer = 1,
+                  hsize_t numBuffers = 1);
 
-        /** Write the memory buffer back to the file */
+        /** Write the modified memory buffers back to the file */
         void write();
 
+        /** Copy the contents of this array to another of the same size and
+         * element layout, in large blocks that go directly between the
+         * datasets rather than through the memory buffers.  If both are
+         * chunked the same way with the same filters, the stored chunks are
+         * copied without being decompressed.  The destination buffer is
+         * reread afterwards, so pointers into it stay valid.
+         * @param dest Array to copy to */
+        void copyTo(Hdf5ExternalArray &dest);
+
         /** Access the raw data at given index
          * @param i index of element to retrieve for reading
          */
@@ -128,11 +148,36 @@ namespace hal {
             _dirty = true;
         }
 
-        /** Read chunk from file */
+        /** Make the page containing index i the buffer, reading it from
+         * the file if it isn't in memory */
         void page(hsize_t i);
 
+        /** Number of page() calls that found the page in memory.  Access
+         * to the current buffer isn't counted */
+        hsize_t getNumCacheHits() const {
+            return _numCacheHits;
+        }
+
+        /** Number of page() calls that read the page from the file */
+        hsize_t getNumCacheMisses() const {
+            return _numCacheMisses;
+        }
+
       private:
-        void initBuf();
+        /* a page of the array in memory */
+        struct Page {
+            hsize_t _start;
+            hsize_t _size;
+            bool _dirty;
+            hsize_t _lastUse;
+            std::vector<char> _buf;
+        };
+
+        void initBuf(hsize_t chunksInBuffer, hsize_t numBuffers);
+        void readPage(Page &page);
+        void writePage(Page &page);
+        void reread();
+        bool copyStoredChunks(Hdf5ExternalArray &dest);
 
         /** Pointer to file that owns this dataset */
         H5::PortableH5Location *_file;
@@ -146,7 +191,7 @@ namespace hal {
         H5::DataSet _dataSet;
         /** Number of elements in the array (fixed length)*/
         hsize_t _size;
-        /** Size of chunk in elements */
+        /** Size of chunk in elements, 0 if the dataset isn't chunked */
         hsize_t _chunkSize;
         /** Size of datatype in bytes */
         hsize_t _dataSize;
@@ -158,11 +203,21 @@ namespace hal {
         hsize_t _bufSize;
         /** In-memory buffer */
         char *_buf;
-        /** Dimensional information for in-memory buffer */
-        H5::DataSpace _chunkSpace;
         /** Flag saying we should write to disk on write
          * or page-out calls (set by getUpdate()) */
         bool _dirty;
+        /** Number of elements in a page (the last one can be shorter) */
+        hsize_t _pageSize;
+        /** Maximum number of pages in memory */
+        hsize_t _maxPages;
+        /** Pages in memory, and the index of the buffer in them */
+        std::vector<Page> _pages;
+        size_t _bufPage;
+        /** Index in _pages of each page in memory, by start */
+        std::unordered_map<hsize_t, size_t> _pageIndex;
+        hsize_t _useCount;
+        hsize_t _numCacheHits;
+        hsize_t _numCacheMisses;
 
       private:
         Hdf5ExternalArray(const Hdf5ExternalArray &);
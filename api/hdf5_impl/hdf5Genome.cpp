@@ -38,7 +38,8 @@ const double Hdf5Genome::dnaChunkScale = 10.;
 Hdf5Genome::Hdf5Genome(const string &name, Hdf5Alignment *alignment, PortableH5Location *h5Parent,
                        const DSetCreatPropList &dcProps, bool inMemory)
     : Genome(alignment, name), _alignment(alignment), _h5Parent(h5Parent), _name(name), _numChildrenInBottomArray(0),
-      _totalSequenceLength(0), _numChunksInArrayBuffer(inMemory ? 0 : 1) {
+      _totalSequenceLength(0), _numChunksInArrayBuffer(inMemory ? 0 : 1),
+      _numArrayBuffers(alignment->getArrayCacheChunks()) {
     _dcprops.copy(dcProps);
     assert(!name.empty());
     assert(alignment != NULL && h5Parent != NULL);
@@ -129,15 +130,15 @@ void Hdf5Genome::setDimensions(const vector<Sequence::Info> &sequenceDimensions,
         DSetCreatPropList dnaDC;
         dnaDC.copy(_dcprops);
         dnaDC.setChunk(1, &chunk);
-        _dnaArray.create(&_group, dnaArrayName, dnaDataType(), arrayLength, &dnaDC, _numChunksInArrayBuffer);
+        _dnaArray.create(&_group, dnaArrayName, dnaDataType(), arrayLength, &dnaDC, _numChunksInArrayBuffer, _numArrayBuffers);
         _dnaAccess = DnaAccessPtr(new HDF5DnaAccess(this, &_dnaArray, 0));
     }
     if (totalSeq > 0) {
         _sequenceIdxArray.create(&_group, sequenceIdxArrayName, Hdf5Sequence::idxDataType(), totalSeq + 1, &_dcprops,
-                                 _numChunksInArrayBuffer);
+                                 _numChunksInArrayBuffer, _numArrayBuffers);
 
         _sequenceNameArray.create(&_group, sequenceNameArrayName, Hdf5Sequence::nameDataType(maxName + 1), totalSeq, &_dcprops,
-                                  _numChunksInArrayBuffer);
+                                  _numChunksInArrayBuffer, _numArrayBuffers);
 
         writeSequences(sequenceDimensions);
     }
@@ -288,7 +289,8 @@ void Hdf5Genome::setGenomeTopDimensions(const vector<Sequence::UpdateInfo> &topD
         _group.unlink(topArrayName);
     } catch (H5::Exception &) {
     }
-    _topArray.create(&_group, topArrayName, Hdf5TopSegment::dataType(), numTopSegments + 1, &_dcprops, _numChunksInArrayBuffer);
+    _topArray.create(&_group, topArrayName, Hdf5TopSegment::dataType(), numTopSegments + 1, &_dcprops, _numChunksInArrayBuffer,
+                     _numArrayBuffers);
     reload();
 }
 
@@ -316,7 +318,7 @@ void Hdf5Genome::setGenomeBottomDimensions(const vector<Sequence::UpdateInfo> &b
     botDC.setChunk(1, &chunk);
 
     _bottomArray.create(&_group, bottomArrayName, Hdf5BottomSegment::dataType(numChildren), numBottomSegments + 1, &botDC,
-                        _numChunksInArrayBuffer);
+                        _numChunksInArrayBuffer, _numArrayBuffers);
     reload();
 }
 
@@ -386,6 +388,43 @@ Alignment *Hdf5Genome::getAlignment() {
     return _alignment;
 }
 
+bool Hdf5Genome::copyDnaArray(Genome *dest) const {
+    Hdf5Genome *h5Dest = dynamic_cast<Hdf5Genome *>(dest);
+    if (h5Dest == NULL || h5Dest->_totalSequenceLength != _totalSequenceLength ||
+        h5Dest->_dnaArray.getSize() != _dnaArray.getSize()) {
+        return false;
+    }
+    // pending changes in the DNA buffers must reach the arrays first
+    if (_dnaAccess) {
+        _dnaAccess->flush();
+    }
+    if (h5Dest->_dnaAccess) {
+        h5Dest->_dnaAccess->flush();
+    }
+    const_cast<Hdf5ExternalArray &>(_dnaArray).copyTo(h5Dest->_dnaArray);
+    return true;
+}
+
+bool Hdf5Genome::copyTopSegmentArray(Genome *dest) const {
+    Hdf5Genome *h5Dest = dynamic_cast<Hdf5Genome *>(dest);
+    if (h5Dest == NULL || h5Dest->_topArray.getSize() != _topArray.getSize()) {
+        return false;
+    }
+    const_cast<Hdf5ExternalArray &>(_topArray).copyTo(h5Dest->_topArray);
+    return true;
+}
+
+bool Hdf5Genome::copyBottomSegmentArray(Genome *dest) const {
+    Hdf5Genome *h5Dest = dynamic_cast<Hdf5Genome *>(dest);
+    if (h5Dest == NULL || h5Dest->_bottomArray.getSize() != _bottomArray.getSize() ||
+        h5Dest->getNumChildren() != getNumChildren() ||
+        h5Dest->_bottomArray.getDataType().getSize() != _bottomArray.getDataType().getSize()) {
+        return false;
+    }
+    const_cast<Hdf5ExternalArray &>(_bottomArray).copyTo(h5Dest->_bottomArray);
+    return true;
+}
+
 // SEGMENTED SEQUENCE INTERFACE
 
 const string &Hdf5Genome::getName() const {
@@ -484,6 +523,16 @@ void Hdf5Genome::getSubString(string &outString, hal_size_t start, hal_size_t le
     dnaIt->readString(outString, length);
 }
 
+void Hdf5Genome::getSubString(char *outBuffer, hal_size_t start, hal_size_t length, bool reverseComplement,
+                              bool upperCase) const {
+    if (length == 0) {
+        return;
+    }
+    DnaIteratorPtr dnaIt(getDnaIterator(reverseComplement ? start + length - 1 : start));
+    dnaIt->setReversed(reverseComplement);
+    dnaIt->readBases(outBuffer, length, upperCase);
+}
+
 void Hdf5Genome::setSubString(const string &inString, hal_size_t start, hal_size_t length) {
     if (length != inString.length()) {
         throw hal_exception(string("setString: input string has different") + "length from target string in genome");
@@ -531,7 +580,7 @@ void Hdf5Genome::read() {
     try {
         HDF5DisableExceptionPrinting prDisable;
         _group.openDataSet(dnaArrayName);
-        _dnaArray.load(&_group, dnaArrayName, _numChunksInArrayBuffer);
+        _dnaArray.load(&_group, dnaArrayName, _numChunksInArrayBuffer, _numArrayBuffers);
         dnaLoaded = true;
     } catch (H5::Exception &) {
     }
@@ -539,13 +588,13 @@ void Hdf5Genome::read() {
     try {
         HDF5DisableExceptionPrinting prDisable;
         _group.openDataSet(topArrayName);
-        _topArray.load(&_group, topArrayName, _numChunksInArrayBuffer);
+        _topArray.load(&_group, topArrayName, _numChunksInArrayBuffer, _numArrayBuffers);
     } catch (H5::Exception &) {
     }
     try {
         HDF5DisableExceptionPrinting prDisable;
         _group.openDataSet(bottomArrayName);
-        _bottomArray.load(&_group, bottomArrayName, _numChunksInArrayBuffer);
+        _bottomArray.load(&_group, bottomArrayName, _numChunksInArrayBuffer, _numArrayBuffers);
         _numChildrenInBottomArray = Hdf5BottomSegment::numChildrenFromDataType(_bottomArray.getDataType());
     } catch (H5::Exception &) {
     }
@@ -554,13 +603,13 @@ void Hdf5Genome::read() {
     try {
         HDF5DisableExceptionPrinting prDisable;
         _group.openDataSet(sequenceIdxArrayName);
-        _sequenceIdxArray.load(&_group, sequenceIdxArrayName, _numChunksInArrayBuffer);
+        _sequenceIdxArray.load(&_group, sequenceIdxArrayName, _numChunksInArrayBuffer, _numArrayBuffers);
     } catch (H5::Exception &) {
     }
     try {
         HDF5DisableExceptionPrinting prDisable;
         _group.openDataSet(sequenceNameArrayName);
-        _sequenceNameArray.load(&_group, sequenceNameArrayName, _numChunksInArrayBuffer);
+        _sequenceNameArray.load(&_group, sequenceNameArrayName, _numChunksInArrayBuffer, _numArrayBuffers);
     } catch (H5::Exception &) {
     }
 
@@ -688,7 +737,7 @@ void Hdf5Genome::writeSequences(const vector<Sequence::Info> &sequenceDimensions
 
 void Hdf5Genome::resetBranchCaches() {
     _parentCache = NULL;
-    _childCache.clear();
+    _childCache = std::vector<std::atomic<Genome *>>(_numChildren);
 }
 
 void Hdf5Genome::rename(const string &newName) {
@@ -729,7 +778,7 @@ void Hdf5Genome::resizeNameArray(size_t newMaxSize) {
         }
 
         _sequenceNameArray.create(&_group, sequenceNameArrayName, Hdf5Sequence::nameDataType(newMaxSize + 1), numSequences,
-                                  &_dcprops, _numChunksInArrayBuffer);
+                                  &_dcprops, _numChunksInArrayBuffer, _numArrayBuffers);
         for (size_t i = 0; i < numSequences; i++) {
             char *arrayBuffer = _sequenceNameArray.getUpdate(i);
             strcpy(arrayBuffer, names[i].c_str());
@@ -75,6 +75,12 @@ namespace hal {
 
         void rename(const std::string &newName);
 
+        bool copyDnaArray(Genome *dest) const;
+
+        bool copyTopSegmentArray(Genome *dest) const;
+
+        bool copyBottomSegmentArray(Genome *dest) const;
+
         // SEGMENTED SEQUENCE INTERFACE
 
         hal_size_t getSequenceLength() const;
@@ -105,6 +111,9 @@ namespace hal {
 
         void getSubString(std::string &outString, hal_size_t start, hal_size_t length) const;
 
+        void getSubString(char *outBuffer, hal_size_t start, hal_size_t length, bool reverseComplement,
+                          bool upperCase) const;
+
         void setSubString(const std::string &intString, hal_size_t start, hal_size_t length);
 
         RearrangementPtr getRearrangement(hal_index_t position, hal_size_t gapLengthThreshold, double nThreshold,
@@ -156,6 +165,7 @@ namespace hal {
         hal_size_t _numChildrenInBottomArray;
         hal_size_t _totalSequenceLength;
         hal_size_t _numChunksInArrayBuffer;
+        hal_size_t _numArrayBuffers;
 
         mutable std::map<hal_size_t, Hdf5Sequence *> _sequencePosCache;
         mutable std::vector<Hdf5Sequence *> _zeroLenPosCache;
@@ -175,6 +175,16 @@ void Hdf5Sequence::getSubString(std::string &outString, hal_size_t start, hal_si
     dnaIt->readString(outString, length);
 }
 
+void Hdf5Sequence::getSubString(char *outBuffer, hal_size_t start, hal_size_t length, bool reverseComplement,
+                                bool upperCase) const {
+    if (length == 0) {
+        return;
+    }
+    DnaIteratorPtr dnaIt(getDnaIterator(reverseComplement ? start + length - 1 : start));
+    dnaIt->setReversed(reverseComplement);
+    dnaIt->readBases(outBuffer, length, upperCase);
+}
+
 void Hdf5Sequence::setSubString(const std::string &inString, hal_size_t start, hal_size_t length) {
     if (length != inString.length()) {
         throw hal_exception("setString: input string of length " + std::to_string(inString.length()) +
@@ -12,7 +12,7 @@ int hdf5RunAllTests(void) {
     CuString *output = CuStringNew();
     CuSuite *suite = CuSuiteNew();
     // CuSuiteAddSuite(suite, hdf5TestSuite());
-    // CuSuiteAddSuite(suite, hdf5ExternalArrayTestSuite());
+    CuSuiteAddSuite(suite, hdf5ExternalArrayTestSuite());
     // CuSuiteAddSuite(suite, hdf5DNATypeTestSuite());
     // CuSuiteAddSuite(suite, hdf5SegmentTypeTestSuite());
     // CuSuiteAddSuite(suite, hdf5SequenceTypeTestSuite());
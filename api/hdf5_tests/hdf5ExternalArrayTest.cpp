@@ -131,10 +131,66 @@ void hdf5ExternalArrayTestCompression(CuTest *testCase) {
     }
 }
 
+/* alternating between the two ends of the array reads each chunk once if
+ * two are kept in memory */
+void hdf5ExternalArrayTestCache(CuTest *testCase) {
+    const hsize_t chunkSize = 1000;
+    setup();
+    try {
+        writeNumbers(chunkSize);
+        H5File file(H5std_string(fileName), H5F_ACC_RDONLY);
+        Hdf5ExternalArray myArray;
+        myArray.load(&file, datasetName, 1, 2);
+        for (hsize_t i = 0; i < N / 2; ++i) {
+            CuAssertTrue(testCase, *reinterpret_cast<const int64_t *>(myArray.get(i)) == numbers[i]);
+            CuAssertTrue(testCase, *reinterpret_cast<const int64_t *>(myArray.get(N - 1 - i)) == numbers[N - 1 - i]);
+        }
+        CuAssertTrue(testCase, myArray.getNumCacheMisses() == N / chunkSize);
+        CuAssertTrue(testCase, myArray.getNumCacheHits() == N - N / chunkSize);
+    } catch (Exception &exception) {
+        cerr << exception.getCDetailMsg() << endl;
+        CuAssertTrue(testCase, 0);
+    } catch (...) {
+        CuAssertTrue(testCase, 0);
+    }
+    teardown();
+}
+
+/* modified chunks are written when they are evicted and by write() */
+void hdf5ExternalArrayTestCacheWrite(CuTest *testCase) {
+    const hsize_t chunkSize = 1000;
+    setup();
+    try {
+        IntType datatype(PredType::NATIVE_HSIZE);
+        H5File file(H5std_string(fileName), H5F_ACC_TRUNC);
+        Hdf5ExternalArray myArray;
+        DSetCreatPropList cparms;
+        cparms.setDeflate(2);
+        cparms.setChunk(1, &chunkSize);
+        myArray.create(&file, datasetName, datatype, N, &cparms, 1, 3);
+        for (hsize_t i = 0; i < N / 2; ++i) {
+            *reinterpret_cast<hsize_t *>(myArray.getUpdate(i)) = i;
+            *reinterpret_cast<hsize_t *>(myArray.getUpdate(N - 1 - i)) = N - 1 - i;
+        }
+        myArray.write();
+        file.flush(H5F_SCOPE_LOCAL);
+        file.close();
+        checkNumbers(testCase);
+    } catch (Exception &exception) {
+        cerr << exception.getCDetailMsg() << endl;
+        CuAssertTrue(testCase, 0);
+    } catch (...) {
+        CuAssertTrue(testCase, 0);
+    }
+    teardown();
+}
+
 CuSuite *hdf5ExternalArrayTestSuite(void) {
     CuSuite *suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, hdf5ExternalArrayTestCreate);
     SUITE_ADD_TEST(suite, hdf5ExternalArrayTestLoad);
     SUITE_ADD_TEST(suite, hdf5ExternalArrayTestCompression);
+    SUITE_ADD_TEST(suite, hdf5ExternalArrayTestCache);
+    SUITE_ADD_TEST(suite, hdf5ExternalArrayTestCacheWrite);
     return suite;
 }
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+#include "halAlignment.h"
+#include "halCommon.h"
+#include "halGenome.h"
+
+using namespace std;
+using namespace hal;
+
+MappingPathConstPtr Alignment::getMappingPath(const Genome *srcGenome, const Genome *tgtGenome,
+                                              const Genome *coalescenceLimit) const {
+    assert(srcGenome != NULL && tgtGenome != NULL);
+    MappingPathKey key(srcGenome, tgtGenome, coalescenceLimit);
+    {
+        lock_guard<mutex> lock(_mappingPathMutex);
+        map<MappingPathKey, MappingPathConstPtr>::const_iterator i = _mappingPaths.find(key);
+        if (i != _mappingPaths.end()) {
+            return i->second;
+        }
+    }
+    // computed outside the lock, as it opens genomes; if two threads race,
+    // the first to finish is kept
+    MappingPath *path = new MappingPath();
+    MappingPathConstPtr pathPtr(path);
+    set<const Genome *> inputSet;
+    inputSet.insert(srcGenome);
+    inputSet.insert(tgtGenome);
+    path->_mrca = getLowestCommonAncestor(inputSet);
+    path->_coalescenceLimit = coalescenceLimit != NULL ? coalescenceLimit : path->_mrca;
+    inputSet.clear();
+    inputSet.insert(tgtGenome);
+    inputSet.insert(path->_coalescenceLimit);
+    getGenomesInSpanningTree(inputSet, path->_genomesOnPath);
+
+    lock_guard<mutex> lock(_mappingPathMutex);
+    return _mappingPaths.insert(make_pair(key, pathPtr)).first->second;
+}
+
+void Alignment::clearMappingPaths() const {
+    lock_guard<mutex> lock(_mappingPathMutex);
+    _mappingPaths.clear();
+}
@@ -69,8 +69,27 @@ Alignment *hal::hdf5AlignmentInstance(const std::string &alignmentPath, unsigned
     return new Hdf5Alignment(alignmentPath, mode, fileCreateProps, fileAccessProps, datasetCreateProps, inMemory);
 }
 
-Alignment *hal::mmapAlignmentInstance(const std::string &alignmentPath, unsigned mode, size_t fileSize) {
-    return new MMapAlignment(alignmentPath, mode, fileSize);
+bool hal::hdf5IsThreadSafe() {
+#ifdef H5_HAVE_THREADSAFE
+    return true;
+#else
+    return false;
+#endif
+}
+
+Alignment *hal::mmapAlignmentInstance(const std::string &alignmentPath, unsigned mode, size_t fileSize,
+                                      MMapDnaEncoding dnaEncoding, MMapSegmentLayout segmentLayout) {
+    return new MMapAlignment(alignmentPath, mode, fileSize, dnaEncoding, segmentLayout);
+}
+
+void hal::getMMapAlignmentLayout(const Alignment *alignment, MMapDnaEncoding &dnaEncoding,
+                                 MMapSegmentLayout &segmentLayout) {
+    const MMapAlignment *mmapAlignment = dynamic_cast<const MMapAlignment *>(alignment);
+    if (mmapAlignment == NULL) {
+        throw hal_exception("not an mmap alignment");
+    }
+    dnaEncoding = mmapAlignment->getMMapFile()->getDnaEncoding();
+    segmentLayout = mmapAlignment->getMMapFile()->getSegmentLayout();
 }
 
 static const int DETECT_INITIAL_NUM_BYTES = 64;
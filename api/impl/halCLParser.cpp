@@ -5,6 +5,7 @@
  * Released under the MIT license, see LICENSE.txt
  */
 #include "halCLParser.h"
+#include "halPerfStats.h"
 #include "hdf5Alignment.h"
 #include "mmapAlignment.h"
 #include <cassert>
@@ -28,6 +29,11 @@ CLParser::CLParser(unsigned mode) : _prefix("--"), _maxArgLen(0), _maxOptLen(0)
     addOption("udcCacheDir", "udc cache path for *input* hal file(s).", "");
     addOptionFlag("udcVerbose", "enable verbose output from UDC", false);
 #endif
+#ifndef HAL_DISABLE_PERF_STATS
+    addOption("perfStats", "write counts and times of HAL's I/O and iterator operations to stderr at exit, as a "
+                           "\"table\" or \"json\"",
+              "");
+#endif
 }
 
 void CLParser::setOptionPrefix(const string &prefix) {
@@ -153,6 +159,12 @@ void CLParser::parseOptions(int argc, char **argv) {
         udc2VerboseSetLevel(100);
     }
 #endif
+#ifndef HAL_DISABLE_PERF_STATS
+    const string &perfStats = getOption<const string &>("perfStats");
+    if (not perfStats.empty()) {
+        enablePerfStats(perfStats);
+    }
+#endif
 }
 
 void CLParser::printUsage(ostream &os) const {
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "halCommon.h"
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAL_DNA_UNPACK_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace hal;
+
+/* nibble code to character tables, indexed by [reverseComplement][upperCase].
+ * The complement tables keep the case bit, so soft-masking survives.  These
+ * are also the lookup tables for the shuffle kernels, hence the alignment. */
+alignas(16) static const char unpackTables[2][2][16] = {
+    {{'a', 'c', 'g', 't', 'n', '\x00', '\x00', '\x00', 'A', 'C', 'G', 'T', 'N', '\x00', '\x00', '\x00'},
+     {'A', 'C', 'G', 'T', 'N', '\x00', '\x00', '\x00', 'A', 'C', 'G', 'T', 'N', '\x00', '\x00', '\x00'}},
+    {{'t', 'g', 'c', 'a', 'n', '\x00', '\x00', '\x00', 'T', 'G', 'C', 'A', 'N', '\x00', '\x00', '\x00'},
+     {'T', 'G', 'C', 'A', 'N', '\x00', '\x00', '\x00', 'T', 'G', 'C', 'A', 'N', '\x00', '\x00', '\x00'}}};
+
+/* Decode numBytes whole packed bytes (two bases each).  Forward, base i is
+ * written to out[i]; reversed, out points one past the end of the output and
+ * base i goes to out[-1 - i].  Returns the number of bytes decoded, which
+ * can be less than numBytes for the vector kernels; the caller finishes the
+ * rest. */
+typedef hal_size_t (*UnpackBytesFunc)(const uint8_t *packed, hal_size_t numBytes, const char *table, char *out,
+                                      bool reversed);
+
+static hal_size_t unpackBytesScalar(const uint8_t *packed, hal_size_t numBytes, const char *table, char *out,
+                                    bool reversed) {
+    if (not reversed) {
+        for (hal_size_t i = 0; i < numBytes; ++i) {
+            out[2 * i] = table[packed[i] >> 4];
+            out[2 * i + 1] = table[packed[i] & 0x0F];
+        }
+    } else {
+        for (hal_size_t i = 0; i < numBytes; ++i) {
+            out[-1 - 2 * (hal_index_t)i] = table[packed[i] >> 4];
+            out[-2 - 2 * (hal_index_t)i] = table[packed[i] & 0x0F];
+        }
+    }
+    return numBytes;
+}
+
+#ifdef HAL_DNA_UNPACK_X86
+/* 16 packed bytes to 32 bases at a time: split the nibbles, interleave them
+ * back into base order and look up the characters with a byte shuffle */
+__attribute__((target("ssse3"))) static hal_size_t unpackBytesSsse3(const uint8_t *packed, hal_size_t numBytes,
+                                                                      const char *table, char *out, bool reversed) {
+    const __m128i lookup = _mm_load_si128(reinterpret_cast<const __m128i *>(table));
+    const __m128i lowMask = _mm_set1_epi8(0x0F);
+    const __m128i reverseBytes = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    hal_size_t numBlocks = numBytes / 16;
+    for (hal_size_t b = 0; b < numBlocks; ++b) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(packed + 16 * b));
+        __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), lowMask);
+        __m128i low = _mm_and_si128(bytes, lowMask);
+        __m128i first = _mm_shuffle_epi8(lookup, _mm_unpacklo_epi8(high, low));
+        __m128i second = _mm_shuffle_epi8(lookup, _mm_unpackhi_epi8(high, low));
+        if (not reversed) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 32 * b), first);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 32 * b + 16), second);
+        } else {
+            char *dest = out - 32 * (hal_index_t)(b + 1);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest), _mm_shuffle_epi8(second, reverseBytes));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 16), _mm_shuffle_epi8(first, reverseBytes));
+        }
+    }
+    return numBlocks * 16;
+}
+
+/* as above with 32 packed bytes to 64 bases.  The unpack and shuffle
+ * instructions work within 128-bit lanes, so the halves are put back in
+ * order with cross-lane permutes */
+__attribute__((target("avx2"))) static hal_size_t unpackBytesAvx2(const uint8_t *packed, hal_size_t numBytes,
+                                                                    const char *table, char *out, bool reversed) {
+    const __m256i lookup = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i *>(table)));
+    const __m256i lowMask = _mm256_set1_epi8(0x0F);
+    const __m256i reverseBytes = _mm256_broadcastsi128_si256(
+        _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+    hal_size_t numBlocks = numBytes / 32;
+    for (hal_size_t b = 0; b < numBlocks; ++b) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(packed + 32 * b));
+        __m256i high = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), lowMask);
+        __m256i low = _mm256_and_si256(bytes, lowMask);
+        // lane 0 has bases 0-15 and 16-31, lane 1 has 32-47 and 48-63
+        __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_unpacklo_epi8(high, low));
+        __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_unpackhi_epi8(high, low));
+        __m256i first = _mm256_permute2x128_si256(lo, hi, 0x20);
+        __m256i second = _mm256_permute2x128_si256(lo, hi, 0x31);
+        if (not reversed) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 64 * b), first);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + 64 * b + 32), second);
+        } else {
+            char *dest = out - 64 * (hal_index_t)(b + 1);
+            second = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(second, reverseBytes), 0x4E);
+            first = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(first, reverseBytes), 0x4E);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest), second);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + 32), first);
+        }
+    }
+    return numBlocks * 32;
+}
+#endif
+
+/* pick the widest kernel the CPU supports */
+static UnpackBytesFunc selectUnpackBytes() {
+#ifdef HAL_DNA_UNPACK_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return unpackBytesAvx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        return unpackBytesSsse3;
+    }
+#endif
+    return unpackBytesScalar;
+}
+
+void hal::dnaUnpackRange(const char *packed, hal_index_t index, hal_size_t length, char *outBuffer,
+                         bool reverseComplement, bool upperCase) {
+    static const UnpackBytesFunc unpackBytes = selectUnpackBytes();
+    if (length == 0) {
+        return;
+    }
+    const char *table = unpackTables[reverseComplement][upperCase];
+    const uint8_t *in = reinterpret_cast<const uint8_t *>(packed) + index / 2;
+    // out is where the next base goes, stepping backwards for reverse
+    char *out = reverseComplement ? outBuffer + length - 1 : outBuffer;
+    hal_index_t step = reverseComplement ? -1 : 1;
+    hal_size_t remaining = length;
+
+    if (index & 1) {
+        *out = table[*in++ & 0x0F];
+        out += step;
+        --remaining;
+    }
+    hal_size_t numBytes = remaining / 2;
+    hal_size_t done = unpackBytes(in, numBytes, table, reverseComplement ? out + 1 : out, reverseComplement);
+    unpackBytesScalar(in + done, numBytes - done, table, reverseComplement ? out + 1 - 2 * (hal_index_t)done
+                                                                                  : out + 2 * done,
+                              reverseComplement);
+    in += numBytes;
+    out += step * 2 * (hal_index_t)numBytes;
+    if (remaining & 1) {
+        *out = table[*in >> 4];
+    }
+}
@@ -1,17 +1,47 @@
 #include "halGenome.h"
 #include "halAlignment.h"
 #include "halBottomSegmentIterator.h"
-#include "halDnaIterator.h"
 #include "halMetaData.h"
 #include "halSegmentIterator.h"
 #include "halSequenceIterator.h"
 #include "halTopSegmentIterator.h"
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <map>
 using namespace std;
 using namespace hal;
 
+/* number of bases copySequence() moves at a time when the DNA can't be
+ * copied as a block */
+static const hal_size_t COPY_DNA_CHUNK_SIZE = 1 << 20;
+
+/* Do two genomes have the same sequences, in the same order, with the
+ * same top (or bottom) segments?  If so, segment indices into one are
+ * valid in the other. */
+static bool sameSegmentLayout(const Genome *genome1, const Genome *genome2, bool top) {
+    if (genome1->getNumSequences() != genome2->getNumSequences()) {
+        return false;
+    }
+    SequenceIteratorPtr seqIt1 = genome1->getSequenceIterator();
+    SequenceIteratorPtr seqIt2 = genome2->getSequenceIterator();
+    for (; not seqIt1->atEnd(); seqIt1->toNext(), seqIt2->toNext()) {
+        const Sequence *seq1 = seqIt1->getSequence();
+        const Sequence *seq2 = seqIt2->getSequence();
+        if (seq1->getName() != seq2->getName() || seq1->getStartPosition() != seq2->getStartPosition() ||
+            seq1->getSequenceLength() != seq2->getSequenceLength()) {
+            return false;
+        }
+        if (top ? (seq1->getTopSegmentArrayIndex() != seq2->getTopSegmentArrayIndex() ||
+                   seq1->getNumTopSegments() != seq2->getNumTopSegments())
+                : (seq1->getBottomSegmentArrayIndex() != seq2->getBottomSegmentArrayIndex() ||
+                   seq1->getNumBottomSegments() != seq2->getNumBottomSegments())) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void hal::Genome::copy(Genome *dest) const {
     copyDimensions(dest);
     copySequence(dest);
@@ -82,6 +112,12 @@ void hal::Genome::copyTopSegments(Genome *dest) const {
         return;
     }
 
+    // If the indices don't need to be translated, copy the whole array
+    if (sameSegmentLayout(this, dest, true) && sameSegmentLayout(inParent, outParent, false) &&
+        copyTopSegmentArray(dest)) {
+        return;
+    }
+
     BottomSegmentIteratorPtr inParentBottomSegIt = inParent->getBottomSegmentIterator();
     BottomSegmentIteratorPtr outParentBottomSegIt = outParent->getBottomSegmentIterator();
 
@@ -177,6 +213,17 @@ void hal::Genome::copyBottomSegments(Genome *dest) const {
         }
     }
 
+    // If the indices don't need to be translated, copy the whole array
+    if (inNc == outNc && inChildNames == outChildNames && sameSegmentLayout(this, dest, false)) {
+        bool sameChildLayouts = true;
+        for (hal_size_t child = 0; child < inNc && sameChildLayouts; ++child) {
+            sameChildLayouts = sameSegmentLayout(getChild(child), dest->getChild(child), true);
+        }
+        if (sameChildLayouts && copyBottomSegmentArray(dest)) {
+            return;
+        }
+    }
+
     // Go through each sequence in this genome, find the matching
     // sequence in the dest genome, then copy over the segments for each
     // sequence.
@@ -242,14 +289,19 @@ void hal::Genome::copyBottomSegments(Genome *dest) const {
 }
 
 void hal::Genome::copySequence(Genome *dest) const {
-    DnaIteratorPtr inDna = getDnaIterator();
-    DnaIteratorPtr outDna = dest->getDnaIterator();
     hal_size_t n = getSequenceLength();
     assert(n == dest->getSequenceLength());
-    for (; (hal_size_t)inDna->getArrayIndex() < n; inDna->toRight(), outDna->toRight()) {
-        outDna->setBase(inDna->getBase());
+    if (copyDnaArray(dest)) {
+        return;
+    }
+    // different storage formats, decode and re-encode a chunk at a time
+    string buffer;
+    for (hal_size_t start = 0; start < n; start += COPY_DNA_CHUNK_SIZE) {
+        hal_size_t length = min(COPY_DNA_CHUNK_SIZE, n - start);
+        buffer.resize(length);
+        getSubString(&buffer[0], start, length);
+        dest->setSubString(buffer, start, length);
     }
-    outDna->flush();
 }
 
 void hal::Genome::copyMetadata(Genome *dest) const {
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "halParallel.h"
+#include "halAlignment.h"
+#include "halCLParser.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace hal;
+
+/* number of tasks per thread that parallelOrderedOutput lets run ahead of
+ * the output */
+static const size_t ORDERED_WINDOW_PER_THREAD = 4;
+
+void hal::addNumThreadsOption(CLParser &optionsParser) {
+    optionsParser.addOption("numThreads", "number of threads to use (0 for one per core). Only "
+                                          "read-only mmap alignments can be read by more than one thread",
+                            (size_t)1);
+}
+
+size_t hal::getNumThreads(const Alignment *alignment, size_t requested, const string &toolName) {
+    size_t numThreads = requested;
+    if (numThreads == 0) {
+        numThreads = max(thread::hardware_concurrency(), 1u);
+    }
+    if ((numThreads > 1) && !alignment->supportsConcurrentReads()) {
+        cerr << toolName << ": warning: alignment does not support concurrent reads "
+             << "(only read-only mmap files do), using a single thread" << endl;
+        numThreads = 1;
+    }
+    return numThreads;
+}
+
+void hal::parallelFor(size_t numTasks, size_t numThreads, const function<void(size_t)> &task) {
+    numThreads = min(numThreads, numTasks);
+    if (numThreads <= 1) {
+        for (size_t i = 0; i < numTasks; ++i) {
+            task(i);
+        }
+        return;
+    }
+    atomic<size_t> nextTask(0);
+    atomic<bool> failed(false);
+    exception_ptr error;
+    mutex errorMutex;
+    auto worker = [&]() {
+        for (size_t i = nextTask++; i < numTasks && !failed; i = nextTask++) {
+            try {
+                task(i);
+            } catch (...) {
+                lock_guard<mutex> lock(errorMutex);
+                if (!failed) {
+                    error = current_exception();
+                    failed = true;
+                }
+            }
+        }
+    };
+    vector<thread> threads;
+    for (size_t t = 0; t < numThreads; ++t) {
+        threads.push_back(thread(worker));
+    }
+    for (size_t t = 0; t < numThreads; ++t) {
+        threads[t].join();
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+namespace {
+    /* shared state of an ordered output run.  Tasks are claimed and read in
+     * order, but no further than the window past the next task to be
+     * written, and their output is kept in a ring of window buffers */
+    struct OrderedOutputState {
+        OrderedOutputState(size_t window)
+            : _window(window), _numTasks(numeric_limits<size_t>::max()), _nextTask(0), _nextOutput(0), _failed(false),
+              _buffers(window), _done(window, false) {
+        }
+        size_t _window;
+        size_t _numTasks; // unknown until the last task is read
+        size_t _nextTask;
+        size_t _nextOutput;
+        bool _failed;
+        exception_ptr _error;
+        vector<string> _buffers;
+        vector<bool> _done;
+        mutex _mutex;
+        mutex _readMutex;
+        condition_variable _taskReady;
+        condition_variable _outputReady;
+
+        void fail() {
+            lock_guard<mutex> lock(_mutex);
+            if (!_failed) {
+                _error = current_exception();
+                _failed = true;
+            }
+            _taskReady.notify_all();
+            _outputReady.notify_all();
+        }
+    };
+}
+
+static void orderedOutputWorker(OrderedOutputState &state, const function<bool(size_t)> &readTask,
+                                const function<void(size_t, ostream &)> &task) {
+    while (true) {
+        size_t i;
+        try {
+            // claiming and reading under the read lock keeps the reads in order
+            lock_guard<mutex> readLock(state._readMutex);
+            {
+                unique_lock<mutex> lock(state._mutex);
+                state._taskReady.wait(lock, [&state]() {
+                    return state._failed || state._nextTask >= state._numTasks ||
+                           state._nextTask < state._nextOutput + state._window;
+                });
+                if (state._failed || state._nextTask >= state._numTasks) {
+                    return;
+                }
+                i = state._nextTask++;
+            }
+            if (!readTask(i)) {
+                lock_guard<mutex> lock(state._mutex);
+                state._numTasks = i;
+                state._taskReady.notify_all();
+                state._outputReady.notify_all();
+                return;
+            }
+        } catch (...) {
+            state.fail();
+            return;
+        }
+        ostringstream buffer;
+        try {
+            task(i, buffer);
+        } catch (...) {
+            state.fail();
+            return;
+        }
+        lock_guard<mutex> lock(state._mutex);
+        state._buffers[i % state._window] = buffer.str();
+        state._done[i % state._window] = true;
+        state._outputReady.notify_all();
+    }
+}
+
+size_t hal::getOrderedWindow(size_t numThreads) {
+    return max(numThreads, (size_t)1) * ORDERED_WINDOW_PER_THREAD;
+}
+
+void hal::parallelOrderedStream(size_t numThreads, const function<bool(size_t)> &readTask,
+                                const function<void(size_t, ostream &)> &task, ostream &outStream) {
+    if (numThreads <= 1) {
+        for (size_t i = 0; readTask(i); ++i) {
+            task(i, outStream);
+        }
+        return;
+    }
+    OrderedOutputState state(getOrderedWindow(numThreads));
+    vector<thread> threads;
+    for (size_t t = 0; t < numThreads; ++t) {
+        threads.push_back(thread(orderedOutputWorker, ref(state), cref(readTask), cref(task)));
+    }
+    // the calling thread does the writing
+    while (true) {
+        string buffer;
+        {
+            unique_lock<mutex> lock(state._mutex);
+            state._outputReady.wait(lock, [&state]() {
+                return state._failed || state._nextOutput >= state._numTasks ||
+                       state._done[state._nextOutput % state._window];
+            });
+            if (state._failed || state._nextOutput >= state._numTasks) {
+                break;
+            }
+            buffer.swap(state._buffers[state._nextOutput % state._window]);
+            state._done[state._nextOutput % state._window] = false;
+            ++state._nextOutput;
+            state._taskReady.notify_all();
+        }
+        outStream << buffer;
+    }
+    for (size_t t = 0; t < numThreads; ++t) {
+        threads[t].join();
+    }
+    if (state._error) {
+        rethrow_exception(state._error);
+    }
+}
+
+void hal::parallelOrderedOutput(size_t numTasks, size_t numThreads, const function<void(size_t, ostream &)> &task,
+                                ostream &outStream) {
+    parallelOrderedStream(min(numThreads, numTasks), [numTasks](size_t i) { return i < numTasks; }, task, outStream);
+}
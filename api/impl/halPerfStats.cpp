@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "halPerfStats.h"
+#include "halCommon.h"
+#include <cstdlib>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <sys/resource.h>
+#include <vector>
+
+using namespace std;
+using namespace hal;
+
+thread_local PerfThreadStats hal::perfThreadStats;
+atomic<bool> hal::perfStatsEnabled(false);
+
+static const char *const counterNames[PERF_NUM_COUNTERS] = {"segmentMoves", "segmentSiteLookups", "dnaFetches",
+                                                            "mmapFetches",  "udcBytesFetched",    "hdf5PageLoads",
+                                                            "genomeOpens",  "genomeCloses"};
+static const char *const timerNames[PERF_NUM_TIMERS] = {"mmapFetchSeconds", "hdf5ReadSeconds"};
+
+namespace {
+    /* statistics of the exited threads, and the running ones */
+    struct PerfRegistry {
+        mutex _mutex;
+        hal_size_t _counts[PERF_NUM_COUNTERS];
+        hal_size_t _nanoseconds[PERF_NUM_TIMERS];
+        vector<PerfThreadStats *> _threads;
+        chrono::steady_clock::time_point _start = chrono::steady_clock::now();
+        string _format;
+    };
+
+    /* never destroyed, as threads may exit after static destructors are run */
+    PerfRegistry &getRegistry() {
+        static PerfRegistry *registry = new PerfRegistry();
+        return *registry;
+    }
+
+    /* merges a thread's statistics into the registry when it exits */
+    struct PerfThreadExit {
+        ~PerfThreadExit() {
+            PerfRegistry &registry = getRegistry();
+            lock_guard<mutex> lock(registry._mutex);
+            for (size_t i = 0; i < PERF_NUM_COUNTERS; ++i) {
+                registry._counts[i] += perfThreadStats._counts[i].load(memory_order_relaxed);
+                perfThreadStats._counts[i].store(0, memory_order_relaxed);
+            }
+            for (size_t i = 0; i < PERF_NUM_TIMERS; ++i) {
+                registry._nanoseconds[i] += perfThreadStats._nanoseconds[i].load(memory_order_relaxed);
+                perfThreadStats._nanoseconds[i].store(0, memory_order_relaxed);
+            }
+            for (size_t i = 0; i < registry._threads.size(); ++i) {
+                if (registry._threads[i] == &perfThreadStats) {
+                    registry._threads.erase(registry._threads.begin() + i);
+                    break;
+                }
+            }
+        }
+    };
+}
+
+void hal::registerPerfThread() {
+    // counts made in this thread after its exit handler has run are lost
+    static thread_local PerfThreadExit threadExit;
+    PerfRegistry &registry = getRegistry();
+    lock_guard<mutex> lock(registry._mutex);
+    registry._threads.push_back(&perfThreadStats);
+    perfThreadStats._registered = true;
+}
+
+static void writePerfStatsAtExit() {
+    writePerfStats(cerr, getRegistry()._format);
+}
+
+void hal::enablePerfStats(const string &format) {
+    if (format != "table" && format != "json") {
+        throw hal_exception("invalid --perfStats format " + format + ", expected table or json");
+    }
+    PerfRegistry &registry = getRegistry();
+    {
+        lock_guard<mutex> lock(registry._mutex);
+        bool enabled = !registry._format.empty();
+        registry._format = format;
+        if (enabled) {
+            return;
+        }
+        registry._start = chrono::steady_clock::now();
+    }
+    perfStatsEnabled = true;
+    atexit(writePerfStatsAtExit);
+}
+
+void hal::setPerfStatsEnabled(bool enabled) {
+    perfStatsEnabled = enabled;
+}
+
+PerfStats hal::getPerfStats() {
+    PerfRegistry &registry = getRegistry();
+    lock_guard<mutex> lock(registry._mutex);
+    PerfStats stats;
+    for (size_t i = 0; i < PERF_NUM_COUNTERS; ++i) {
+        stats._counts[i] = registry._counts[i];
+        for (PerfThreadStats *threadStats : registry._threads) {
+            stats._counts[i] += threadStats->_counts[i].load(memory_order_relaxed);
+        }
+    }
+    for (size_t i = 0; i < PERF_NUM_TIMERS; ++i) {
+        hal_size_t nanoseconds = registry._nanoseconds[i];
+        for (PerfThreadStats *threadStats : registry._threads) {
+            nanoseconds += threadStats->_nanoseconds[i].load(memory_order_relaxed);
+        }
+        stats._seconds[i] = nanoseconds / 1e9;
+    }
+    return stats;
+}
+
+void hal::writePerfStats(ostream &os, const string &format) {
+    PerfStats stats = getPerfStats();
+    double wallSeconds;
+    {
+        PerfRegistry &registry = getRegistry();
+        lock_guard<mutex> lock(registry._mutex);
+        wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - registry._start).count();
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double userSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    double sysSeconds = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+
+    stringstream ss;
+    if (format == "json") {
+        ss << "{\"wallSeconds\": " << wallSeconds << ", \"userSeconds\": " << userSeconds
+           << ", \"sysSeconds\": " << sysSeconds << ", \"peakRssKb\": " << usage.ru_maxrss;
+        for (size_t i = 0; i < PERF_NUM_COUNTERS; ++i) {
+            ss << ", \"" << counterNames[i] << "\": " << stats._counts[i];
+        }
+        for (size_t i = 0; i < PERF_NUM_TIMERS; ++i) {
+            ss << ", \"" << timerNames[i] << "\": " << stats._seconds[i];
+        }
+        ss << "}\n";
+    } else {
+        ss << "HAL performance statistics\n";
+        ss << left << setw(20) << "wallSeconds" << wallSeconds << "\n";
+        ss << left << setw(20) << "userSeconds" << userSeconds << "\n";
+        ss << left << setw(20) << "sysSeconds" << sysSeconds << "\n";
+        ss << left << setw(20) << "peakRssKb" << usage.ru_maxrss << "\n";
+        for (size_t i = 0; i < PERF_NUM_COUNTERS; ++i) {
+            ss << left << setw(20) << counterNames[i] << stats._counts[i] << "\n";
+        }
+        for (size_t i = 0; i < PERF_NUM_TIMERS; ++i) {
+            ss << left << setw(20) << timerNames[i] << stats._seconds[i] << "\n";
+        }
+    }
+    os << ss.str();
+    os.flush();
+}
+
+const char *hal::getPerfCounterName(PerfCounter counter) {
+    return counterNames[counter];
+}
+
+const char *hal::getPerfTimerName(PerfTimer timer) {
+    return timerNames[timer];
+}
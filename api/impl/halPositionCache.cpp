@@ -5,64 +5,161 @@
  * Released under the MIT license, see LICENSE.txt
  */
 #include "halPositionCache.h"
+#include <algorithm>
 
 using namespace std;
 using namespace hal;
 
-bool PositionCache::insert(hal_index_t pos) {
-    IntervalSet::iterator i;
-    if (_prev != _set.end() && _prev->first == pos - 1) {
-        ++_prev;
-        i = _prev;
-        assert(i == _set.lower_bound(pos));
+/* a chunk that grows past this is split in two, bounding the cost of
+ * inserting into it */
+static const size_t MAX_CHUNK_SIZE = 512;
+
+/* index of the first interval in chunk whose last index is >= pos, which
+ * must exist.  The search gallops out from hint, so it takes a few
+ * comparisons when pos is near it. */
+static size_t gallopLowerBound(const PositionCache::IntervalSet::Chunk &chunk, size_t hint, hal_index_t pos) {
+    size_t n = chunk.size();
+    assert(n > 0 && chunk.back().first >= pos);
+    hint = min(hint, n - 1);
+    size_t lo, hi; // answer is in (lo, hi]
+    if (chunk[hint].first >= pos) {
+        // search left of the hint
+        hi = hint;
+        size_t step = 1;
+        while (true) {
+            if (step > hi) {
+                lo = 0;
+                if (chunk[0].first >= pos) {
+                    return 0;
+                }
+                break;
+            }
+            lo = hi - step;
+            if (chunk[lo].first < pos) {
+                break;
+            }
+            hi = lo;
+            step *= 2;
+        }
     } else {
-        i = _set.lower_bound(pos);
+        // search right of the hint
+        lo = hint;
+        size_t step = 1;
+        while (true) {
+            if (lo + step >= n) {
+                hi = n - 1;
+                break;
+            }
+            hi = lo + step;
+            if (chunk[hi].first >= pos) {
+                break;
+            }
+            lo = hi;
+            step *= 2;
+        }
     }
-    _prev = i;
+    PositionCache::IntervalSet::Chunk::const_iterator i =
+        lower_bound(chunk.begin() + lo + 1, chunk.begin() + hi, pos,
+                    [](const PositionCache::IntervalSet::value_type &interval, hal_index_t p) {
+                        return interval.first < p;
+                    });
+    return i - chunk.begin();
+}
 
-    IntervalSet::iterator j;
-    if (i != _set.end() && i->second <= pos) {
-        assert(i->first >= pos);
-        return false;
+/* first interval whose last index is >= pos.  The chunk last inserted
+ * into is tried first. */
+PositionCache::Location PositionCache::lowerBound(hal_index_t pos) const {
+    const vector<IntervalSet::Chunk> &chunks = _set._chunks;
+    size_t numChunks = chunks.size();
+    if (numChunks == 0) {
+        return Location(0, 0);
+    }
+    size_t c = min(_prev._chunk, numChunks - 1);
+    if (chunks[c].back().first >= pos && (c == 0 || chunks[c - 1].back().first < pos)) {
+        return Location(c, gallopLowerBound(chunks[c], _prev._index, pos));
     }
+    c = lower_bound(chunks.begin(), chunks.end(), pos,
+                    [](const IntervalSet::Chunk &chunk, hal_index_t p) { return chunk.back().first < p; }) -
+        chunks.begin();
+    if (c == numChunks) {
+        return Location(numChunks, 0);
+    }
+    return Location(c, gallopLowerBound(chunks[c], pos < chunks[c].front().first ? 0 : chunks[c].size() / 2, pos));
+}
 
-    // merge to beginning of existing interval
-    if (i != _set.end() && i->second == pos + 1) {
-        --i->second;
-    } else {
-        // set hint to position before pos in set.  according to the docs, the
-        // hint works differently in C++11 where it wants the position *after*
-        // so we try to detect the compiler below...
-        j = i;
-#if __cplusplus < 201103L
-        if (j != _set.begin()) {
-            --j;
-        }
-#endif
-        // create new unit interval
-        i = _set.insert(j, pair<hal_index_t, hal_index_t>(pos, pos));
-        _prev = i;
+/* insert interval before loc, returning where it went */
+PositionCache::Location PositionCache::insertInterval(Location loc, const IntervalSet::value_type &interval) {
+    vector<IntervalSet::Chunk> &chunks = _set._chunks;
+    ++_set._size;
+    if (chunks.empty()) {
+        chunks.push_back(IntervalSet::Chunk(1, interval));
+        return Location(0, 0);
     }
-    assert(i->second <= i->first);
-    // merge abutting left interval
-    if (i != _set.begin()) {
-        j = i;
-        --j;
-        if (j->first == i->second - 1) {
-            i->second = j->second;
-            assert(i->second <= i->first);
-            _set.erase(j);
+    if (loc._chunk == chunks.size()) {
+        // append to the last chunk
+        loc = Location(chunks.size() - 1, chunks.back().size());
+    }
+    IntervalSet::Chunk &chunk = chunks[loc._chunk];
+    chunk.insert(chunk.begin() + loc._index, interval);
+    if (chunk.size() > MAX_CHUNK_SIZE) {
+        size_t half = chunk.size() / 2;
+        IntervalSet::Chunk tail(chunk.begin() + half, chunk.end());
+        chunk.resize(half);
+        chunks.insert(chunks.begin() + loc._chunk + 1, std::move(tail));
+        if (loc._index >= half) {
+            loc = Location(loc._chunk + 1, loc._index - half);
         }
     }
+    return loc;
+}
+
+void PositionCache::eraseInterval(Location loc) {
+    vector<IntervalSet::Chunk> &chunks = _set._chunks;
+    --_set._size;
+    IntervalSet::Chunk &chunk = chunks[loc._chunk];
+    chunk.erase(chunk.begin() + loc._index);
+    if (chunk.empty()) {
+        chunks.erase(chunks.begin() + loc._chunk);
+    }
+}
+
+bool PositionCache::insert(hal_index_t pos) {
+    vector<IntervalSet::Chunk> &chunks = _set._chunks;
+    Location i = lowerBound(pos);
+    IntervalSet::value_type *right = i._chunk < chunks.size() ? &chunks[i._chunk][i._index] : NULL;
+    if (right != NULL && right->second <= pos) {
+        assert(right->first >= pos);
+        _prev = i;
+        return false;
+    }
 
-    // merge abutting right interval
-    j = i;
-    ++j;
-    if (j != _set.end() && j->second == i->first + 1) {
-        j->second = i->second;
-        assert(j->second <= j->first);
-        _set.erase(i);
+    Location left(i._chunk, i._index - 1);
+    if (i._index == 0) {
+        left = i._chunk > 0 ? Location(i._chunk - 1, chunks[i._chunk - 1].size() - 1) : Location(chunks.size(), 0);
+    }
+    bool mergeLeft = left._chunk < chunks.size() && chunks[left._chunk][left._index].first == pos - 1;
+    bool mergeRight = right != NULL && right->second == pos + 1;
+    if (mergeLeft && mergeRight) {
+        // pos fills the gap between two intervals
+        right->second = chunks[left._chunk][left._index].second;
+        size_t numChunks = chunks.size();
+        eraseInterval(left);
+        if (left._chunk == i._chunk) {
+            --i._index;
+        } else if (chunks.size() < numChunks) {
+            --i._chunk;
+        }
+    } else if (mergeLeft) {
+        i = left;
+        chunks[i._chunk][i._index].first = pos;
+    } else if (mergeRight) {
+        right->second = pos;
+    } else {
+        // create new unit interval
+        i = insertInterval(i, IntervalSet::value_type(pos, pos));
     }
+    assert(chunks[i._chunk][i._index].second <= chunks[i._chunk][i._index].first);
+    _prev = i;
 
     ++_size;
     assert(find(pos) == true);
@@ -70,24 +167,29 @@ bool PositionCache::insert(hal_index_t pos) {
 }
 
 bool PositionCache::find(hal_index_t pos) const {
-    IntervalSet::const_iterator i = _set.lower_bound(pos);
-    if (i != _set.end() && i->second <= pos) {
-        return true;
-    }
-    return false;
+    Location i = lowerBound(pos);
+    return i._chunk < _set._chunks.size() && _set._chunks[i._chunk][i._index].second <= pos;
 }
 
 void PositionCache::clear() {
-    _set.clear();
+    _set._chunks.clear();
+    _set._size = 0;
     _size = 0;
-    _prev = _set.begin();
+    _prev = Location();
 }
 
 // for debugging
 bool PositionCache::check() const {
     hal_size_t size = 0;
+    hal_size_t numIntervals = 0;
+    for (size_t c = 0; c < _set._chunks.size(); ++c) {
+        if (_set._chunks[c].empty()) {
+            return false;
+        }
+    }
     for (IntervalSet::const_iterator i = _set.begin(); i != _set.end(); ++i) {
         size += (i->first + 1) - i->second;
+        ++numIntervals;
         IntervalSet::const_iterator j = i;
         ++j;
         if (j != _set.end()) {
@@ -101,5 +203,5 @@ bool PositionCache::check() const {
             }
         }
     }
-    return size == _size;
+    return size == _size && numIntervals == _set.size();
 }
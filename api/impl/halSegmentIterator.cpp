@@ -8,6 +8,7 @@
 #include "halCommon.h"
 #include "halGenome.h"
 #include "halMappedSegment.h"
+#include "halPerfStats.h"
 #include <algorithm>
 #include <cassert>
 #include <iostream>
@@ -175,6 +176,7 @@ bool SegmentIterator::getReversed() const {
 // SEGMENT ITERATOR INTERFACE
 //////////////////////////////////////////////////////////////////////////////
 void SegmentIterator::toLeft(hal_index_t leftCutoff) {
+    perfCount(PERF_SEGMENT_MOVES);
     if (_reversed == false) {
         if (_startOffset == 0) {
             getSegment()->setArrayIndex(getGenome(), getSegment()->getArrayIndex() - 1);
@@ -206,6 +208,7 @@ void SegmentIterator::toLeft(hal_index_t leftCutoff) {
 }
 
 void SegmentIterator::toRight(hal_index_t rightCutoff) {
+    perfCount(PERF_SEGMENT_MOVES);
     if (_reversed == false) {
         if (_endOffset == 0) {
             getSegment()->setArrayIndex(getGenome(), getSegment()->getArrayIndex() + 1);
@@ -238,6 +241,7 @@ void SegmentIterator::toRight(hal_index_t rightCutoff) {
 }
 
 void SegmentIterator::toSite(hal_index_t position, bool slice) {
+    perfCount(PERF_SEGMENT_SITE_LOOKUPS);
     Genome *genome = getGenome();
     hal_index_t len = (hal_index_t)genome->getSequenceLength();
     hal_index_t nseg = (hal_index_t)getNumSegmentsInGenome();
@@ -5,12 +5,15 @@
  * Released under the MIT license, see LICENSE.txt
  */
 #include "halSegmentMapper.h"
+#include "halBottomSegment.h"
 #include "halBottomSegmentIterator.h"
 #include "halCommon.h"
 #include "halMappedSegment.h"
 #include "halSegment.h"
 #include "halSegmentIterator.h"
+#include "halTopSegment.h"
 #include "halTopSegmentIterator.h"
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 
@@ -19,316 +22,6 @@ using namespace hal;
 
 enum OverlapCat { Same, Disjoint, AContainsB, BContainsA, AOverlapsLeftOfB, BOverlapsLeftOfA };
 
-static hal_size_t mapSelf(MappedSegmentPtr mappedSeg, list<MappedSegmentPtr> &results, hal_size_t minLength);
-
-// note: takes smart pointer as it maybe added to the results
-static hal_size_t mapUp(MappedSegmentPtr mappedSeg, list<MappedSegmentPtr> &results, bool doDupes, hal_size_t minLength) {
-    const Genome *parent = mappedSeg->getGenome()->getParent();
-    assert(parent != NULL);
-    hal_size_t added = 0;
-    if (mappedSeg->isTop() == true) {
-        BottomSegmentIteratorPtr botSegIt = parent->getBottomSegmentIterator();
-        TopSegmentIteratorPtr topSegIt = mappedSeg->targetAsTop();
-        if (topSegIt->tseg()->hasParent() == true && topSegIt->getLength() >= minLength &&
-            (doDupes == true || topSegIt->tseg()->isCanonicalParalog() == true)) {
-            botSegIt->toParent(topSegIt);
-            mappedSeg->setTarget(std::dynamic_pointer_cast<SegmentIterator>(botSegIt));
-            results.push_back(mappedSeg);
-            ++added;
-        }
-    } else {
-        hal_index_t rightCutoff = mappedSeg->getEndPosition();
-        BottomSegmentIteratorPtr botSegIt = mappedSeg->targetAsBottom();
-        hal_index_t startOffset = (hal_index_t)botSegIt->getStartOffset();
-        hal_index_t endOffset = (hal_index_t)botSegIt->getEndOffset();
-        TopSegmentIteratorPtr topSegIt = mappedSeg->getGenome()->getTopSegmentIterator();
-        topSegIt->toParseUp(botSegIt);
-        do {
-            TopSegmentIteratorPtr newTopSegIt = topSegIt->clone();
-
-            // we map the new target back to see how the offsets have
-            // changed.  these changes are then applied to the source segment
-            // as deltas
-            BottomSegmentIteratorPtr backBotSegIt = botSegIt->clone();
-            backBotSegIt->toParseDown(newTopSegIt);
-            hal_index_t startBack = (hal_index_t)backBotSegIt->getStartOffset();
-            hal_index_t endBack = (hal_index_t)backBotSegIt->getEndOffset();
-            assert(startBack >= startOffset);
-            assert(endBack >= endOffset);
-            SegmentIteratorPtr newSourceSegIt = mappedSeg->sourceClone();
-            hal_index_t startDelta = startBack - startOffset;
-            hal_index_t endDelta = endBack - endOffset;
-            assert((hal_index_t)newSourceSegIt->getLength() > startDelta + endDelta);
-            newSourceSegIt->slice(newSourceSegIt->getStartOffset() + startDelta, newSourceSegIt->getEndOffset() + endDelta);
-
-            MappedSegmentPtr newMappedSeg(new MappedSegment(newSourceSegIt, newTopSegIt));
-
-            assert(newMappedSeg->isTop() == true);
-            assert(newMappedSeg->getSource()->getGenome() == mappedSeg->getSource()->getGenome());
-
-            added += mapUp(newMappedSeg, results, doDupes, minLength);
-            // stupid that we have to make this check but odn't want to
-            // make fundamental api change now
-            if (topSegIt->getEndPosition() != rightCutoff) {
-                topSegIt->toRight(rightCutoff);
-            } else {
-                break;
-            }
-        } while (true);
-    }
-    return added;
-}
-
-// Map the input segments up until reaching the target genome. If the
-// target genome is below the source genome, fail miserably.
-// Destructive to any data in the input or results list.
-static hal_size_t mapRecursiveUp(list<MappedSegmentPtr> &input, list<MappedSegmentPtr> &results, const Genome *tgtGenome,
-                                 hal_size_t minLength) {
-    list<MappedSegmentPtr> *inputPtr = &input;
-    list<MappedSegmentPtr> *outputPtr = &results;
-
-    if (inputPtr->empty() || (*inputPtr->begin())->getGenome() == tgtGenome) {
-        results = *inputPtr;
-        return 0;
-    }
-
-    const Genome *curGenome = (*inputPtr->begin())->getGenome();
-    assert(curGenome != NULL);
-    const Genome *nextGenome = curGenome->getParent();
-
-    if (nextGenome == NULL) {
-        throw hal_exception("Reached top of tree when attempting to recursively map up from " + curGenome->getName() + " to " +
-                            tgtGenome->getName());
-    }
-
-    // Map all segments to the parent.
-    list<MappedSegmentPtr>::iterator i = inputPtr->begin();
-    for (; i != inputPtr->end(); ++i) {
-        assert((*i)->getGenome() == curGenome);
-        mapUp(*i, *outputPtr, true, minLength);
-    }
-
-    if (nextGenome != tgtGenome) {
-        // Continue the recursion.
-        swap(inputPtr, outputPtr);
-        outputPtr->clear();
-        mapRecursiveUp(*inputPtr, *outputPtr, tgtGenome, minLength);
-    }
-
-    if (outputPtr != &results) {
-        results = *outputPtr;
-    }
-
-    results.sort(MappedSegment::LessSourcePtr());
-    results.unique(MappedSegment::EqualToPtr());
-    return results.size();
-}
-
-// note: takes smart pointer as it maybe added to the results
-static hal_size_t mapDown(MappedSegmentPtr mappedSeg, hal_size_t childIndex, list<MappedSegmentPtr> &results,
-                          hal_size_t minLength) {
-    const Genome *child = mappedSeg->getGenome()->getChild(childIndex);
-    assert(child != NULL);
-    hal_size_t added = 0;
-    if (mappedSeg->isTop() == false) {
-        TopSegmentIteratorPtr topSegIt = child->getTopSegmentIterator();
-        SegmentIteratorPtr targetSegIt = mappedSeg->getTargetIteratorPtr();
-        BottomSegmentIteratorPtr botSegIt = std::dynamic_pointer_cast<BottomSegmentIterator>(targetSegIt);
-
-        if (botSegIt->bseg()->hasChild(childIndex) == true && botSegIt->getLength() >= minLength) {
-            topSegIt->toChild(botSegIt, childIndex);
-            mappedSeg->setTarget(std::dynamic_pointer_cast<SegmentIterator>(topSegIt));
-            results.push_back(MappedSegmentPtr(mappedSeg));
-            ++added;
-        }
-    } else {
-        hal_index_t rightCutoff = mappedSeg->getEndPosition();
-        TopSegmentIteratorPtr topSegIt = mappedSeg->targetAsTop();
-        hal_index_t startOffset = (hal_index_t)topSegIt->getStartOffset();
-        hal_index_t endOffset = (hal_index_t)topSegIt->getEndOffset();
-        BottomSegmentIteratorPtr botSegIt = mappedSeg->getGenome()->getBottomSegmentIterator();
-        botSegIt->toParseDown(topSegIt);
-        do {
-            BottomSegmentIteratorPtr newBotSegIt = botSegIt->clone();
-
-            // we map the new target back to see how the offsets have
-            // changed.  these changes are then applied to the source segment
-            // as deltas
-            TopSegmentIteratorPtr backTopSegIt = topSegIt->clone();
-            backTopSegIt->toParseUp(newBotSegIt);
-            hal_index_t startBack = (hal_index_t)backTopSegIt->getStartOffset();
-            hal_index_t endBack = (hal_index_t)backTopSegIt->getEndOffset();
-            assert(startBack >= startOffset);
-            assert(endBack >= endOffset);
-            SegmentIteratorPtr newSourceSegIt = mappedSeg->sourceClone();
-            hal_index_t startDelta = startBack - startOffset;
-            hal_index_t endDelta = endBack - endOffset;
-            assert((hal_index_t)newSourceSegIt->getLength() > startDelta + endDelta);
-            newSourceSegIt->slice(newSourceSegIt->getStartOffset() + startDelta, newSourceSegIt->getEndOffset() + endDelta);
-
-            MappedSegmentPtr newMappedSeg(new MappedSegment(newSourceSegIt, newBotSegIt));
-
-            assert(newMappedSeg->isTop() == false);
-            assert(newMappedSeg->getSource()->getGenome() == mappedSeg->getSource()->getGenome());
-
-            added += mapDown(newMappedSeg, childIndex, results, minLength);
-
-            // stupid that we have to make this check but odn't want to
-            // make fundamental api change now
-            if (botSegIt->getEndPosition() != rightCutoff) {
-                botSegIt->toRight(rightCutoff);
-            } else {
-                break;
-            }
-        } while (true);
-    }
-    return added;
-}
-
-// Map the input segments down until reaching the target genome. If the
-// target genome is above the source genome, fail miserably.
-// Destructive to any data in the input or results list.
-static hal_size_t mapRecursiveDown(list<MappedSegmentPtr> &input, list<MappedSegmentPtr> &results, const Genome *tgtGenome,
-                                   const set<string> &namesOnPath, bool doDupes, hal_size_t minLength) {
-    list<MappedSegmentPtr> *inputPtr = &input;
-    list<MappedSegmentPtr> *outputPtr = &results;
-
-    if (inputPtr->empty()) {
-        results = *inputPtr;
-        return 0;
-    }
-
-    const Genome *curGenome = (*inputPtr->begin())->getGenome();
-    assert(curGenome != NULL);
-    if (curGenome == tgtGenome) {
-        results = *inputPtr;
-        return 0;
-    }
-
-    // Find the correct child to move down into.
-    const Genome *nextGenome = NULL;
-    hal_size_t nextChildIndex = numeric_limits<hal_size_t>::max();
-    const Alignment *alignment = curGenome->getAlignment();
-    vector<string> childNames = alignment->getChildNames(curGenome->getName());
-    for (hal_size_t child = 0; nextGenome == NULL && child < childNames.size(); ++child) {
-        if (childNames[child] == tgtGenome->getName() || namesOnPath.find(childNames[child]) != namesOnPath.end()) {
-            const Genome *childGenome = curGenome->getChild(child);
-            nextGenome = childGenome;
-            nextChildIndex = child;
-        }
-    }
-
-    if (nextGenome == NULL) {
-        throw hal_exception("Could not find correct child that leads from " + curGenome->getName() + " to " +
-                            tgtGenome->getName());
-    }
-
-    assert(nextGenome->getParent() == curGenome);
-
-    // Map the actual segments down.
-    list<MappedSegmentPtr>::iterator i = inputPtr->begin();
-    for (; i != inputPtr->end(); ++i) {
-        assert((*i)->getGenome() == curGenome);
-        mapDown(*i, nextChildIndex, *outputPtr, minLength);
-    }
-
-    // Find paralogs.
-    if (doDupes == true) {
-        swap(inputPtr, outputPtr);
-        outputPtr->clear();
-        list<MappedSegmentPtr>::iterator i = inputPtr->begin();
-        for (; i != inputPtr->end(); ++i) {
-            assert((*i)->getGenome() == nextGenome);
-            mapSelf(*i, *outputPtr, minLength);
-        }
-    }
-
-    if (nextGenome != tgtGenome) {
-        // Continue the recursion.
-        swap(inputPtr, outputPtr);
-        outputPtr->clear();
-        mapRecursiveDown(*inputPtr, *outputPtr, tgtGenome, namesOnPath, doDupes, minLength);
-    }
-
-    if (outputPtr != &results) {
-        results = *outputPtr;
-    }
-
-    results.sort(MappedSegment::LessSourcePtr());
-    results.unique(MappedSegment::EqualToPtr());
-    return results.size();
-}
-
-// note: takes smart pointer as it maybe added to the results
-static hal_size_t mapSelf(MappedSegmentPtr mappedSeg, list<MappedSegmentPtr> &results, hal_size_t minLength) {
-    hal_size_t added = 0;
-    if (mappedSeg->isTop() == true) {
-        SegmentIteratorPtr target = mappedSeg->getTargetIteratorPtr();
-        SegmentIteratorPtr source = mappedSeg->getSourceIteratorPtr();
-        TopSegmentIteratorPtr top = std::dynamic_pointer_cast<TopSegmentIterator>(target);
-        TopSegmentIteratorPtr topCopy = top->clone();
-        do {
-            // FIXME: why isn't clone() polymorphic?
-            SegmentIteratorPtr newSource;
-            if (source->isTop()) {
-                newSource = std::dynamic_pointer_cast<TopSegmentIterator>(source)->clone();
-            } else {
-                newSource = std::dynamic_pointer_cast<BottomSegmentIterator>(source)->clone();
-            }
-            TopSegmentIteratorPtr newTop = topCopy->clone();
-            MappedSegmentPtr newMappedSeg(new MappedSegment(newSource, newTop));
-            assert(newMappedSeg->getGenome() == mappedSeg->getGenome());
-            assert(newMappedSeg->getSource()->getGenome() == mappedSeg->getSource()->getGenome());
-            results.push_back(newMappedSeg);
-            ++added;
-            if (topCopy->tseg()->hasNextParalogy()) {
-                topCopy->toNextParalogy();
-            }
-        } while (topCopy->tseg()->hasNextParalogy() == true && topCopy->getLength() >= minLength &&
-                 topCopy->getArrayIndex() != top->getArrayIndex());
-    } else if (mappedSeg->getGenome()->getParent() != NULL) {
-        hal_index_t rightCutoff = mappedSeg->getEndPosition();
-        BottomSegmentIteratorPtr bottom = mappedSeg->targetAsBottom();
-        hal_index_t startOffset = (hal_index_t)bottom->getStartOffset();
-        hal_index_t endOffset = (hal_index_t)bottom->getEndOffset();
-        TopSegmentIteratorPtr top = mappedSeg->getGenome()->getTopSegmentIterator();
-        top->toParseUp(bottom);
-        do {
-            TopSegmentIteratorPtr topNew = top->clone();
-
-            // we map the new target back to see how the offsets have
-            // changed.  these changes are then applied to the source segment
-            // as deltas
-            BottomSegmentIteratorPtr bottomBack = bottom->clone();
-            bottomBack->toParseDown(topNew);
-            hal_index_t startBack = (hal_index_t)bottomBack->getStartOffset();
-            hal_index_t endBack = (hal_index_t)bottomBack->getEndOffset();
-            assert(startBack >= startOffset);
-            assert(endBack >= endOffset);
-            SegmentIteratorPtr newSource = mappedSeg->sourceClone();
-            hal_index_t startDelta = startBack - startOffset;
-            hal_index_t endDelta = endBack - endOffset;
-            assert((hal_index_t)newSource->getLength() > startDelta + endDelta);
-            newSource->slice(newSource->getStartOffset() + startDelta, newSource->getEndOffset() + endDelta);
-
-            MappedSegmentPtr newMappedSeg(new MappedSegment(newSource, topNew));
-
-            assert(newMappedSeg->isTop() == true);
-            assert(newMappedSeg->getSource()->getGenome() == mappedSeg->getSource()->getGenome());
-
-            added += mapSelf(newMappedSeg, results, minLength);
-            // stupid that we have to make this check but odn't want to
-            // make fundamental api change now
-            if (top->getEndPosition() != rightCutoff) {
-                top->toRight(rightCutoff);
-            } else {
-                break;
-            }
-        } while (true);
-    }
-    return added;
-}
-
 static OverlapCat slowOverlap(const SlicedSegment *sA, const SlicedSegment *sB) {
     hal_index_t startA = sA->getStartPosition();
     hal_index_t endA = sA->getEndPosition();
@@ -519,154 +212,813 @@ static void insertAndBreakOverlaps(MappedSegmentPtr seg, MappedSegmentSet &resul
     results.insert(inputSegs.begin(), inputSegs.end());
 }
 
-// Map all segments from the input to any segments in the same genome
+/* A work list borrowed from the mapper for the duration of a scope.  Lists
+ * are handed out and returned in stack order, and keep their capacity. */
+class SegmentMapper::ScratchList {
+  public:
+    ScratchList(SegmentMapper *mapper) : _mapper(mapper) {
+        if (_mapper->_numListsUsed == _mapper->_lists.size()) {
+            _mapper->_lists.push_back(unique_ptr<MappingList>(new MappingList()));
+        }
+        _list = _mapper->_lists[_mapper->_numListsUsed++].get();
+        _list->clear();
+    }
+    ~ScratchList() {
+        --_mapper->_numListsUsed;
+    }
+    MappingList &get() {
+        return *_list;
+    }
+
+  private:
+    SegmentMapper *_mapper;
+    MappingList *_list;
+};
+
+static SegmentSlice toSlice(const SegmentIterator *segIt) {
+    SegmentSlice slice = {segIt->getGenome(),      segIt->isTop(),         segIt->getArrayIndex(),
+                          segIt->getStartOffset(), segIt->getEndOffset(), segIt->getReversed()};
+    return slice;
+}
+
+static SegmentIteratorPtr toIterator(const SegmentSlice &slice) {
+    SegmentIteratorPtr segIt;
+    if (slice._top) {
+        segIt = slice._genome->getTopSegmentIterator(slice._arrayIndex);
+    } else {
+        segIt = slice._genome->getBottomSegmentIterator(slice._arrayIndex);
+    }
+    if (slice._reversed) {
+        segIt->toReverse();
+    }
+    segIt->slice(slice._startOffset, slice._endOffset);
+    return segIt;
+}
+
+static MappedSegmentPtr toMappedSegment(const SegmentSlice &source, const SegmentSlice &target) {
+    return MappedSegmentPtr(new MappedSegment(toIterator(source), toIterator(target)));
+}
+
+SegmentMapper::SegmentMapper() : _numListsUsed(0), _childrenTgtGenome(NULL), _manySrcGenome(NULL) {
+}
+
+SegmentMapper::~SegmentMapper() {
+}
+
+hal_size_t SegmentMapper::mapSegment(const SegmentIterator *source, vector<MappedRange> &outRanges,
+                                     const Genome *tgtGenome, const set<const Genome *> *genomesOnPath, bool doDupes,
+                                     hal_size_t minLength, const Genome *coalescenceLimit, const Genome *mrca) {
+    assert(source != NULL);
+    return mapSegment(toSlice(source), outRanges, tgtGenome, genomesOnPath, doDupes, minLength, coalescenceLimit, mrca);
+}
+
+hal_size_t SegmentMapper::mapSegment(const SegmentSlice &source, vector<MappedRange> &outRanges,
+                                     const Genome *tgtGenome, const set<const Genome *> *genomesOnPath, bool doDupes,
+                                     hal_size_t minLength, const Genome *coalescenceLimit, const Genome *mrca) {
+    mapToList(source, _output, tgtGenome, genomesOnPath, doDupes, minLength, coalescenceLimit, mrca);
+    size_t first = outRanges.size();
+    outRanges.resize(first + _output.size());
+    for (size_t i = 0; i < _output.size(); ++i) {
+        toRange(_output[i], outRanges[first + i]);
+    }
+    return _output.size();
+}
+
+hal_size_t SegmentMapper::mapSegment(const SegmentIterator *source, MappedSegmentSet &outSegments,
+                                     const Genome *tgtGenome, const set<const Genome *> *genomesOnPath, bool doDupes,
+                                     hal_size_t minLength, const Genome *coalescenceLimit, const Genome *mrca) {
+    assert(source != NULL);
+    mapToList(toSlice(source), _output, tgtGenome, genomesOnPath, doDupes, minLength, coalescenceLimit, mrca);
+    for (size_t i = 0; i < _output.size(); ++i) {
+        insertAndBreakOverlaps(toMappedSegment(_output[i]._source, _output[i]._target), outSegments);
+    }
+    return _output.size();
+}
+
+hal_size_t SegmentMapper::mapSegmentToMany(const SegmentIterator *source, const vector<const Genome *> &tgtGenomes,
+                                           vector<vector<MappedRange>> &outRanges, bool doDupes, hal_size_t minLength) {
+    assert(source != NULL);
+    mapToMany(toSlice(source), tgtGenomes, doDupes, minLength);
+    outRanges.resize(tgtGenomes.size());
+    hal_size_t numMappings = 0;
+    for (size_t t = 0; t < tgtGenomes.size(); ++t) {
+        const MappingList &output = _manyOutput[t];
+        vector<MappedRange> &ranges = outRanges[t];
+        size_t first = ranges.size();
+        ranges.resize(first + output.size());
+        for (size_t i = 0; i < output.size(); ++i) {
+            toRange(output[i], ranges[first + i]);
+        }
+        numMappings += output.size();
+    }
+    return numMappings;
+}
+
+hal_size_t SegmentMapper::mapSegmentToMany(const SegmentIterator *source, const vector<const Genome *> &tgtGenomes,
+                                           vector<MappedSegmentSet> &outSegments, bool doDupes, hal_size_t minLength) {
+    assert(source != NULL);
+    mapToMany(toSlice(source), tgtGenomes, doDupes, minLength);
+    outSegments.resize(tgtGenomes.size());
+    hal_size_t numMappings = 0;
+    for (size_t t = 0; t < tgtGenomes.size(); ++t) {
+        const MappingList &output = _manyOutput[t];
+        for (size_t i = 0; i < output.size(); ++i) {
+            insertAndBreakOverlaps(toMappedSegment(output[i]._source, output[i]._target), outSegments[t]);
+        }
+        numMappings += output.size();
+    }
+    return numMappings;
+}
+
+// Map the source segment to every target genome, leaving the mappings to
+// tgtGenomes[i] in _manyOutput[i].  Each list is what mapToList would give
+// with the default path and coalescence limit: the lists mapped up are the
+// same as mapRecursiveUp's at each level, and those mapped down the same as
+// mapRecursiveDown's at each genome.
+void SegmentMapper::mapToMany(const SegmentSlice &source, const vector<const Genome *> &tgtGenomes, bool doDupes,
+                              hal_size_t minLength) {
+    setManyTargets(source._genome, tgtGenomes);
+    _manyOutput.resize(tgtGenomes.size());
+    for (size_t t = 0; t < _manyOutput.size(); ++t) {
+        _manyOutput[t].clear();
+    }
+
+    ScratchList level(this);
+    ScratchList nextLevel(this);
+    ScratchList upResults(this);
+    Mapping start = {source, source};
+    level.get().push_back(start);
+    size_t begin = 0;
+    for (size_t steps = 0; begin < _manyOrder.size() && !level.get().empty(); ++steps) {
+        if (steps > 0) {
+            nextLevel.get().clear();
+            for (size_t i = 0; i < level.get().size(); ++i) {
+                mapUp(level.get()[i], nextLevel.get(), true, minLength);
+            }
+            level.get().swap(nextLevel.get());
+        }
+        size_t end = begin;
+        while (end < _manyOrder.size() && _manyLevels[_manyOrder[end]] == steps) {
+            ++end;
+        }
+        if (end > begin) {
+            // targets whose MRCA with the source is this genome
+            upResults.get() = level.get();
+            if (steps > 0) {
+                sortAndUnique(upResults.get());
+            }
+            mapDownToMany(upResults.get(), 0, begin, end, doDupes, minLength);
+        }
+        begin = end;
+    }
+}
+
+// Find the path from the MRCA down to each target, unless the source genome
+// and targets are the same as last time.
+void SegmentMapper::setManyTargets(const Genome *srcGenome, const vector<const Genome *> &tgtGenomes) {
+    if (srcGenome == _manySrcGenome && tgtGenomes == _manyTargets) {
+        return;
+    }
+    _manySrcGenome = srcGenome;
+    _manyTargets = tgtGenomes;
+    _manyPaths.resize(tgtGenomes.size());
+    _manyLevels.resize(tgtGenomes.size());
+    _manyOrder.resize(tgtGenomes.size());
+    const Alignment *alignment = srcGenome->getAlignment();
+    for (size_t t = 0; t < tgtGenomes.size(); ++t) {
+        assert(tgtGenomes[t] != NULL);
+        const Genome *mrca = alignment->getMappingPath(srcGenome, tgtGenomes[t])->_mrca;
+        vector<const Genome *> &path = _manyPaths[t];
+        path.clear();
+        for (const Genome *genome = tgtGenomes[t]; genome != mrca; genome = genome->getParent()) {
+            path.push_back(genome);
+        }
+        path.push_back(mrca);
+        reverse(path.begin(), path.end());
+        _manyLevels[t] = 0;
+        for (const Genome *genome = srcGenome; genome != mrca; genome = genome->getParent()) {
+            ++_manyLevels[t];
+        }
+        _manyOrder[t] = t;
+    }
+    stable_sort(_manyOrder.begin(), _manyOrder.end(), [this](size_t t1, size_t t2) {
+        return _manyLevels[t1] < _manyLevels[t2] ||
+               (_manyLevels[t1] == _manyLevels[t2] && _manyPaths[t1] < _manyPaths[t2]);
+    });
+}
+
+// Map input, whose targets are in genome _manyPaths[t][depth] for each of
+// the targets t in _manyOrder[begin, end), on down to each of them.  Targets
+// ending in this genome sort first; the rest are grouped by the child they
+// are under, and each child is mapped to once for its group.
+void SegmentMapper::mapDownToMany(MappingList &input, size_t depth, size_t begin, size_t end, bool doDupes,
+                                  hal_size_t minLength) {
+    const Genome *genome = _manyPaths[_manyOrder[begin]][depth];
+    for (; begin < end && _manyPaths[_manyOrder[begin]].size() == depth + 1; ++begin) {
+        MappingList &output = _manyOutput[_manyOrder[begin]];
+        output = input;
+        if (depth > 0) {
+            sortAndUnique(output);
+        }
+    }
+    if (input.empty()) {
+        return;
+    }
+    while (begin < end) {
+        const Genome *child = _manyPaths[_manyOrder[begin]][depth + 1];
+        size_t groupEnd = begin + 1;
+        while (groupEnd < end && _manyPaths[_manyOrder[groupEnd]][depth + 1] == child) {
+            ++groupEnd;
+        }
+        hal_size_t childIndex = 0;
+        while (genome->getChild(childIndex) != child) {
+            ++childIndex;
+        }
+        ScratchList results(this);
+        for (size_t i = 0; i < input.size(); ++i) {
+            mapDown(input[i], childIndex, results.get(), minLength);
+        }
+        if (doDupes == true) {
+            ScratchList paralogs(this);
+            for (size_t i = 0; i < results.get().size(); ++i) {
+                mapSelf(results.get()[i], paralogs.get(), minLength);
+            }
+            mapDownToMany(paralogs.get(), depth + 1, begin, groupEnd, doDupes, minLength);
+        } else {
+            mapDownToMany(results.get(), depth + 1, begin, groupEnd, doDupes, minLength);
+        }
+        begin = groupEnd;
+    }
+}
+
+// Map the source segment to the target genome, leaving the mappings in
+// output (which may overlap in the target).
+void SegmentMapper::mapToList(const SegmentSlice &source, MappingList &output, const Genome *tgtGenome,
+                              const set<const Genome *> *genomesOnPath, bool doDupes, hal_size_t minLength,
+                              const Genome *coalescenceLimit, const Genome *mrca) {
+    assert(tgtGenome != NULL);
+    MappingPathConstPtr path;
+    if (mrca == NULL || genomesOnPath == NULL) {
+        path = source._genome->getAlignment()->getMappingPath(source._genome, tgtGenome, coalescenceLimit);
+        if (mrca == NULL) {
+            mrca = path->_mrca;
+        }
+        if (genomesOnPath == NULL) {
+            genomesOnPath = &path->_genomesOnPath;
+        }
+    }
+    setPath(tgtGenome, genomesOnPath);
+    if (coalescenceLimit == NULL) {
+        coalescenceLimit = mrca;
+    }
+
+    // the target starts out as the source itself
+    ScratchList input(this);
+    Mapping start = {source, source};
+    input.get().push_back(start);
+
+    // Map all segments up to the MRCA of src and tgt.
+    ScratchList upResults(this);
+    if (source._genome != mrca) {
+        mapRecursiveUp(input.get(), upResults.get(), mrca, minLength);
+    } else {
+        upResults.get().swap(input.get());
+    }
+
+    // Map to all paralogs that coalesce in or below the coalescenceLimit.
+    ScratchList paralogResults(this);
+    if (mrca != coalescenceLimit && doDupes) {
+        mapRecursiveParalogies(mrca, upResults.get(), paralogResults.get(), coalescenceLimit, minLength);
+    } else {
+        paralogResults.get().swap(upResults.get());
+    }
+
+    // Finally, map back down to the target genome.
+    output.clear();
+    if (tgtGenome != mrca) {
+        mapRecursiveDown(paralogResults.get(), output, tgtGenome, doDupes, minLength);
+    } else {
+        output.swap(paralogResults.get());
+    }
+}
+
+// Keep the names of the genomes on the path from the coalescence limit to
+// the target (necessary for choosing which children to move through to get to
+// the target), and the children chosen, until the target or path changes.
+void SegmentMapper::setPath(const Genome *tgtGenome, const set<const Genome *> *genomesOnPath) {
+    if (*genomesOnPath != _pathGenomes || _namesOnPath.empty()) {
+        _pathGenomes = *genomesOnPath;
+        _namesOnPath.clear();
+        for (set<const Genome *>::const_iterator i = _pathGenomes.begin(); i != _pathGenomes.end(); ++i) {
+            _namesOnPath.insert((*i)->getName());
+        }
+        _childrenOnPath.clear();
+    }
+    if (tgtGenome != _childrenTgtGenome) {
+        _childrenOnPath.clear();
+        _childrenTgtGenome = tgtGenome;
+    }
+}
+
+// Find the correct child to move down into.
+hal_size_t SegmentMapper::getChildOnPath(const Genome *genome, const Genome *tgtGenome) {
+    for (size_t i = 0; i < _childrenOnPath.size(); ++i) {
+        if (_childrenOnPath[i].first == genome) {
+            return _childrenOnPath[i].second;
+        }
+    }
+    const Alignment *alignment = genome->getAlignment();
+    vector<string> childNames = alignment->getChildNames(genome->getName());
+    for (hal_size_t child = 0; child < childNames.size(); ++child) {
+        if (childNames[child] == tgtGenome->getName() || _namesOnPath.find(childNames[child]) != _namesOnPath.end()) {
+            _childrenOnPath.push_back(make_pair(genome, child));
+            return child;
+        }
+    }
+    throw hal_exception("Could not find correct child that leads from " + genome->getName() + " to " +
+                        tgtGenome->getName());
+}
+
+void SegmentMapper::mapUp(const Mapping &mapping, MappingList &results, bool doDupes, hal_size_t minLength) {
+    const SegmentSlice &target = mapping._target;
+    const Genome *parent = target._genome->getParent();
+    assert(parent != NULL);
+    if (target._top == true) {
+        const TopSegment *topSeg = getTopSegment(target._genome, target._arrayIndex);
+        if (topSeg->hasParent() == true && topSeg->getLength() - target._startOffset - target._endOffset >= minLength &&
+            (doDupes == true || topSeg->isCanonicalParalog() == true)) {
+            Mapping up = {mapping._source,
+                          {parent, false, topSeg->getParentIndex(), target._startOffset, target._endOffset,
+                           target._reversed != topSeg->getParentReversed()}};
+            results.push_back(up);
+        }
+    } else {
+        hal_index_t rightCutoff = getEndPosition(target);
+        SegmentSlice top = toParseUp(target);
+        do {
+            // we map the new target back to see how the offsets have
+            // changed.  these changes are then applied to the source segment
+            // as deltas
+            SegmentSlice back = toParseDown(top);
+            assert(back._startOffset >= target._startOffset);
+            assert(back._endOffset >= target._endOffset);
+            Mapping next = {mapping._source, top};
+            next._source._startOffset += back._startOffset - target._startOffset;
+            next._source._endOffset += back._endOffset - target._endOffset;
+            mapUp(next, results, doDupes, minLength);
+            if (getEndPosition(top) != rightCutoff) {
+                toRight(top, rightCutoff);
+            } else {
+                break;
+            }
+        } while (true);
+    }
+}
+
+void SegmentMapper::mapDown(const Mapping &mapping, hal_size_t childIndex, MappingList &results, hal_size_t minLength) {
+    const SegmentSlice &target = mapping._target;
+    const Genome *child = target._genome->getChild(childIndex);
+    assert(child != NULL);
+    if (target._top == false) {
+        const BottomSegment *botSeg = getBottomSegment(target._genome, target._arrayIndex);
+        if (botSeg->hasChild(childIndex) == true &&
+            botSeg->getLength() - target._startOffset - target._endOffset >= minLength) {
+            Mapping down = {mapping._source,
+                            {child, true, botSeg->getChildIndex(childIndex), target._startOffset, target._endOffset,
+                             target._reversed != botSeg->getChildReversed(childIndex)}};
+            results.push_back(down);
+        }
+    } else {
+        hal_index_t rightCutoff = getEndPosition(target);
+        SegmentSlice bottom = toParseDown(target);
+        do {
+            SegmentSlice back = toParseUp(bottom);
+            assert(back._startOffset >= target._startOffset);
+            assert(back._endOffset >= target._endOffset);
+            Mapping next = {mapping._source, bottom};
+            next._source._startOffset += back._startOffset - target._startOffset;
+            next._source._endOffset += back._endOffset - target._endOffset;
+            mapDown(next, childIndex, results, minLength);
+            if (getEndPosition(bottom) != rightCutoff) {
+                toRight(bottom, rightCutoff);
+            } else {
+                break;
+            }
+        } while (true);
+    }
+}
+
+void SegmentMapper::mapSelf(const Mapping &mapping, MappingList &results, hal_size_t minLength) {
+    const SegmentSlice &target = mapping._target;
+    if (target._top == true) {
+        Mapping paralog = mapping;
+        SegmentSlice &cur = paralog._target;
+        bool hasNext;
+        do {
+            results.push_back(paralog);
+            const TopSegment *topSeg = getTopSegment(cur._genome, cur._arrayIndex);
+            hasNext = topSeg->hasNextParalogy();
+            if (hasNext) {
+                bool parentReversed = topSeg->getParentReversed();
+                cur._arrayIndex = topSeg->getNextParalogyIndex();
+                topSeg = getTopSegment(cur._genome, cur._arrayIndex);
+                if (topSeg->getParentReversed() != parentReversed) {
+                    cur._reversed = !cur._reversed;
+                }
+                hasNext = topSeg->hasNextParalogy();
+            }
+        } while (hasNext == true && getLength(cur) >= minLength && cur._arrayIndex != target._arrayIndex);
+    } else if (target._genome->getParent() != NULL) {
+        hal_index_t rightCutoff = getEndPosition(target);
+        SegmentSlice top = toParseUp(target);
+        do {
+            SegmentSlice back = toParseDown(top);
+            assert(back._startOffset >= target._startOffset);
+            assert(back._endOffset >= target._endOffset);
+            Mapping next = {mapping._source, top};
+            next._source._startOffset += back._startOffset - target._startOffset;
+            next._source._endOffset += back._endOffset - target._endOffset;
+            mapSelf(next, results, minLength);
+            if (getEndPosition(top) != rightCutoff) {
+                toRight(top, rightCutoff);
+            } else {
+                break;
+            }
+        } while (true);
+    }
+}
+
+// Map the input mappings up until reaching the target genome. If the
+// target genome is below the source genome, fail miserably.
+// Destructive to any data in the input or results list.
+void SegmentMapper::mapRecursiveUp(MappingList &input, MappingList &results, const Genome *tgtGenome,
+                                   hal_size_t minLength) {
+    results.clear();
+    if (input.empty() || input.front()._target._genome == tgtGenome) {
+        results.swap(input);
+        return;
+    }
+    while (true) {
+        const Genome *curGenome = input.front()._target._genome;
+        const Genome *nextGenome = curGenome->getParent();
+        if (nextGenome == NULL) {
+            throw hal_exception("Reached top of tree when attempting to recursively map up from " + curGenome->getName() +
+                                " to " + tgtGenome->getName());
+        }
+        // Map all segments to the parent.
+        for (size_t i = 0; i < input.size(); ++i) {
+            assert(input[i]._target._genome == curGenome);
+            mapUp(input[i], results, true, minLength);
+        }
+        if (nextGenome == tgtGenome || results.empty()) {
+            break;
+        }
+        input.swap(results);
+        results.clear();
+    }
+    sortAndUnique(results);
+}
+
+// Map the input mappings down until reaching the target genome. If the
+// target genome is above the source genome, fail miserably.
+// Destructive to any data in the input or results list.
+void SegmentMapper::mapRecursiveDown(MappingList &input, MappingList &results, const Genome *tgtGenome, bool doDupes,
+                                     hal_size_t minLength) {
+    results.clear();
+    if (input.empty() || input.front()._target._genome == tgtGenome) {
+        results.swap(input);
+        return;
+    }
+    while (true) {
+        const Genome *curGenome = input.front()._target._genome;
+        hal_size_t nextChildIndex = getChildOnPath(curGenome, tgtGenome);
+        const Genome *nextGenome = curGenome->getChild(nextChildIndex);
+        assert(nextGenome->getParent() == curGenome);
+
+        // Map the actual segments down.
+        for (size_t i = 0; i < input.size(); ++i) {
+            assert(input[i]._target._genome == curGenome);
+            mapDown(input[i], nextChildIndex, results, minLength);
+        }
+
+        // Find paralogs.
+        if (doDupes == true) {
+            input.swap(results);
+            results.clear();
+            for (size_t i = 0; i < input.size(); ++i) {
+                assert(input[i]._target._genome == nextGenome);
+                mapSelf(input[i], results, minLength);
+            }
+        }
+        if (nextGenome == tgtGenome || results.empty()) {
+            break;
+        }
+        input.swap(results);
+        results.clear();
+    }
+    sortAndUnique(results);
+}
+
+// Map all mappings from the input to any segments in the same genome
 // that coalesce in or before the given "coalescence limit" genome.
 // Destructive to any data in the input list.
-static hal_size_t mapRecursiveParalogies(const Genome *srcGenome, list<MappedSegmentPtr> &input,
-                                         list<MappedSegmentPtr> &results, const set<string> &namesOnPath,
-                                         const Genome *coalescenceLimit, hal_size_t minLength) {
+void SegmentMapper::mapRecursiveParalogies(const Genome *srcGenome, MappingList &input, MappingList &results,
+                                           const Genome *coalescenceLimit, hal_size_t minLength) {
     if (input.empty()) {
-        results = input;
-        return 0;
+        return;
     }
-
-    const Genome *curGenome = (*input.begin())->getGenome();
-    assert(curGenome != NULL);
+    const Genome *curGenome = input.front()._target._genome;
     if (curGenome == coalescenceLimit) {
-        results = input;
-        return 0;
+        results.swap(input);
+        return;
     }
-
     const Genome *nextGenome = curGenome->getParent();
-
     if (nextGenome == NULL) {
         throw hal_exception("Hit root genome when attempting to map paralogies");
     }
-    list<MappedSegmentPtr> paralogs;
+
     // Map to any paralogs in the current genome.
-    // FIXME: I think the original segments are included in this, which is a waste.
-    list<MappedSegmentPtr>::iterator i = input.begin();
-    for (; i != input.end(); ++i) {
-        assert((*i)->getGenome() == curGenome);
-        mapSelf(*i, paralogs, minLength);
+    ScratchList paralogs(this);
+    for (size_t i = 0; i < input.size(); ++i) {
+        assert(input[i]._target._genome == curGenome);
+        mapSelf(input[i], paralogs.get(), minLength);
     }
 
     if (nextGenome != coalescenceLimit) {
-        list<MappedSegmentPtr> nextSegments;
-        // Map all of the original segments (not the paralogs, which is a
-        // waste) up to the next genome.
-        i = input.begin();
-        for (; i != input.end(); ++i) {
-            assert((*i)->getGenome() == curGenome);
-            mapUp(*i, nextSegments, true, minLength);
+        // Map all of the original segments (not the paralogs) up to the next
+        // genome, and recurse on them.
+        ScratchList nextSegments(this);
+        for (size_t i = 0; i < input.size(); ++i) {
+            mapUp(input[i], nextSegments.get(), true, minLength);
         }
-
-        // Recurse on the mapped segments.
-        mapRecursiveParalogies(srcGenome, nextSegments, results, namesOnPath, coalescenceLimit, minLength);
+        mapRecursiveParalogies(srcGenome, nextSegments.get(), results, coalescenceLimit, minLength);
     }
 
-    // Map all the paralogs we found in this genome back to the source.
-    list<MappedSegmentPtr> paralogsMappedToSrc;
-    mapRecursiveDown(paralogs, paralogsMappedToSrc, srcGenome, namesOnPath, false, minLength);
+    // Map all the paralogs we found in this genome back to the source, and
+    // put them in front of the results.
+    ScratchList paralogsMappedToSrc(this);
+    mapRecursiveDown(paralogs.get(), paralogsMappedToSrc.get(), srcGenome, false, minLength);
+    results.insert(results.begin(), paralogsMappedToSrc.get().begin(), paralogsMappedToSrc.get().end());
+    sortAndUnique(results);
+}
 
-    results.splice(results.begin(), paralogsMappedToSrc);
-    results.sort(MappedSegment::LessSourcePtr());
-    results.unique(MappedSegment::EqualToPtr());
-    return results.size();
+// Sort by source, then target, and remove duplicates, as MappedSegment's
+// LessSourcePtr and EqualToPtr do.
+void SegmentMapper::sortAndUnique(MappingList &mappings) {
+    stable_sort(mappings.begin(), mappings.end(), [this](const Mapping &m1, const Mapping &m2) {
+        int res = compare(m1._source, m2._source);
+        if (res == 0) {
+            res = compare(m1._target, m2._target);
+        }
+        return res == -1;
+    });
+    mappings.erase(unique(mappings.begin(), mappings.end(),
+                          [this](const Mapping &m1, const Mapping &m2) {
+                              return compare(m1._source, m2._source) == 0 && compare(m1._target, m2._target) == 0;
+                          }),
+                   mappings.end());
 }
 
-static hal_size_t mapSource(const SegmentIterator *source, MappedSegmentSet &results, const Genome *tgtGenome,
-                            const set<const Genome *> *genomesOnPath, bool doDupes, hal_size_t minLength,
-                            const Genome *coalescenceLimit, const Genome *mrca) {
-    assert(source != NULL);
+// Same as MappedSegment::fastComp
+int SegmentMapper::compare(const SegmentSlice &s1, const SegmentSlice &s2) {
+    assert(s1._genome == s2._genome);
+    int res = 0;
+    if (s1._top != s2._top) {
+        res = boundCompare(s1, s2);
+        if (res == 0) {
+            res = positionCompare(s1, s2);
+        }
+    } else if (s1._arrayIndex < s2._arrayIndex) {
+        res = -1;
+    } else if (s1._arrayIndex > s2._arrayIndex) {
+        res = 1;
+    } else {
+        hal_offset_t so1 = s1._reversed ? s1._endOffset : s1._startOffset;
+        hal_offset_t eo1 = s1._reversed ? s1._startOffset : s1._endOffset;
+        hal_offset_t so2 = s2._reversed ? s2._endOffset : s2._startOffset;
+        hal_offset_t eo2 = s2._reversed ? s2._startOffset : s2._endOffset;
+        if (so1 < so2) {
+            res = -1;
+        } else if (so1 > so2) {
+            res = 1;
+        } else if (eo1 > eo2) {
+            res = -1;
+        } else if (eo1 < eo2) {
+            res = 1;
+        }
+    }
+    assert(res == positionCompare(s1, s2));
+    return res;
+}
 
-    // FIXME: why does target start out as source??  This is all a bit clunky
-    SegmentIteratorPtr startSourceSegIt;
-    SegmentIteratorPtr startTargetSegIt;
-    if (source->isTop()) {
-        startSourceSegIt = dynamic_cast<const TopSegmentIterator *>(source)->clone();
-        startTargetSegIt = dynamic_cast<const TopSegmentIterator *>(source)->clone();
+// Same as MappedSegment::boundComp
+int SegmentMapper::boundCompare(const SegmentSlice &s1, const SegmentSlice &s2) {
+    hal_index_t lb, ub;
+    if (s2._top == false) {
+        lb = ub = getBottomSegment(s2._genome, s2._arrayIndex)->getTopParseIndex();
+        if ((hal_size_t)s2._arrayIndex < s2._genome->getNumBottomSegments() - 1) {
+            ub = getBottomSegment(s2._genome, s2._arrayIndex + 1)->getTopParseIndex();
+        }
     } else {
-        startSourceSegIt = dynamic_cast<const BottomSegmentIterator *>(source)->clone();
-        startTargetSegIt = dynamic_cast<const BottomSegmentIterator *>(source)->clone();
+        lb = ub = getTopSegment(s2._genome, s2._arrayIndex)->getBottomParseIndex();
+        if ((hal_size_t)s2._arrayIndex < s2._genome->getNumTopSegments() - 1) {
+            ub = getTopSegment(s2._genome, s2._arrayIndex + 1)->getBottomParseIndex();
+        }
+    }
+    if (s1._arrayIndex < lb) {
+        return -1;
+    } else if (s1._arrayIndex > ub) {
+        return 1;
     }
+    return 0;
+}
 
-    MappedSegmentPtr newMappedSeg(new MappedSegment(startSourceSegIt, startTargetSegIt));
+// Same as MappedSegment::slowComp
+int SegmentMapper::positionCompare(const SegmentSlice &s1, const SegmentSlice &s2) {
+    hal_index_t sp1 = getStartPosition(s1);
+    hal_index_t ep1 = getEndPosition(s1);
+    hal_index_t sp2 = getStartPosition(s2);
+    hal_index_t ep2 = getEndPosition(s2);
+    if (s1._reversed) {
+        swap(sp1, ep1);
+    }
+    if (s2._reversed) {
+        swap(sp2, ep2);
+    }
+    if (sp1 < sp2) {
+        return -1;
+    } else if (sp1 > sp2) {
+        return 1;
+    } else if (ep1 < ep2) {
+        return -1;
+    } else if (ep1 > ep2) {
+        return 1;
+    }
+    return 0;
+}
 
-    list<MappedSegmentPtr> input;
-    input.push_back(newMappedSeg);
-    list<MappedSegmentPtr> output;
+SegmentMapper::SegmentReader &SegmentMapper::getReader(const Genome *genome) {
+    for (size_t i = 0; i < _readers.size(); ++i) {
+        if (_readers[i]._genome == genome) {
+            return _readers[i];
+        }
+    }
+    SegmentReader reader;
+    reader._genome = genome;
+    _readers.push_back(reader);
+    return _readers.back();
+}
 
-    set<string> namesOnPath;
-    assert(genomesOnPath != NULL);
-    for (set<const Genome *>::const_iterator i = genomesOnPath->begin(); i != genomesOnPath->end(); ++i) {
-        namesOnPath.insert((*i)->getName());
+// The returned segment is only valid until the next segment of the same
+// genome is read.
+const TopSegment *SegmentMapper::getTopSegment(const Genome *genome, hal_index_t arrayIndex) {
+    SegmentReader &reader = getReader(genome);
+    if (reader._top == NULL) {
+        reader._top = genome->getTopSegmentIterator(arrayIndex);
+    } else {
+        reader._top->setArrayIndex(reader._top->getGenome(), arrayIndex);
     }
+    return reader._top->tseg();
+}
 
-    // FIXME: using multiple lists is probably much slower than just
-    // reusing the results list over and over.
-    list<MappedSegmentPtr> upResults;
-    // Map all segments up to the MRCA of src and tgt.
-    if (source->getGenome() != mrca) {
-        mapRecursiveUp(input, upResults, mrca, minLength);
+const BottomSegment *SegmentMapper::getBottomSegment(const Genome *genome, hal_index_t arrayIndex) {
+    SegmentReader &reader = getReader(genome);
+    if (reader._bottom == NULL) {
+        reader._bottom = genome->getBottomSegmentIterator(arrayIndex);
     } else {
-        upResults = input;
+        reader._bottom->setArrayIndex(reader._bottom->getGenome(), arrayIndex);
     }
+    return reader._bottom->bseg();
+}
 
-    list<MappedSegmentPtr> paralogResults;
-    // Map to all paralogs that coalesce in or below the coalescenceLimit.
-    if (mrca != coalescenceLimit && doDupes) {
-        mapRecursiveParalogies(mrca, upResults, paralogResults, namesOnPath, coalescenceLimit, minLength);
+const Segment *SegmentMapper::getSegment(const SegmentSlice &slice) {
+    if (slice._top) {
+        return getTopSegment(slice._genome, slice._arrayIndex);
     } else {
-        paralogResults = upResults;
+        return getBottomSegment(slice._genome, slice._arrayIndex);
     }
+}
 
-    // Finally, map back down to the target genome.
-    if (tgtGenome != mrca) {
-        mapRecursiveDown(paralogResults, output, tgtGenome, namesOnPath, doDupes, minLength);
+hal_index_t SegmentMapper::getStartPosition(const SegmentSlice &slice) {
+    const Segment *segment = getSegment(slice);
+    if (not slice._reversed) {
+        return segment->getStartPosition() + slice._startOffset;
     } else {
-        output = paralogResults;
+        return segment->getStartPosition() + segment->getLength() - slice._startOffset - 1;
     }
+}
 
-    list<MappedSegmentPtr>::iterator outIt = output.begin();
-    for (; outIt != output.end(); ++outIt) {
-        insertAndBreakOverlaps(*outIt, results);
+hal_index_t SegmentMapper::getEndPosition(const SegmentSlice &slice) {
+    const Segment *segment = getSegment(slice);
+    if (not slice._reversed) {
+        return segment->getStartPosition() + segment->getLength() - slice._endOffset - 1;
+    } else {
+        return segment->getStartPosition() + slice._endOffset;
     }
+}
 
-    return output.size();
+hal_size_t SegmentMapper::getLength(const SegmentSlice &slice) {
+    return getSegment(slice)->getLength() - slice._startOffset - slice._endOffset;
 }
 
-hal_size_t hal::halMapSegment(const SegmentIterator *source, MappedSegmentSet &outSegments, const Genome *tgtGenome,
-                              const set<const Genome *> *genomesOnPath, bool doDupes, hal_size_t minLength,
-                              const Genome *coalescenceLimit, const Genome *mrca) {
-    assert(tgtGenome != NULL);
+// Same as SegmentIterator::overlaps
+bool SegmentMapper::overlaps(const SegmentSlice &slice, hal_index_t genomePos) {
+    hal_index_t start = getStartPosition(slice);
+    hal_index_t length = (hal_index_t)getLength(slice);
+    if (slice._reversed == false) {
+        return start + length > genomePos && start <= genomePos;
+    } else {
+        return start >= genomePos && start - length < genomePos;
+    }
+}
 
-    if (mrca == NULL) {
-        set<const Genome *> inputSet;
-        inputSet.insert(source->getGenome());
-        inputSet.insert(tgtGenome);
-        mrca = getLowestCommonAncestor(inputSet);
+// Same as TopSegmentIterator::toParseUp
+SegmentSlice SegmentMapper::toParseUp(const SegmentSlice &bottom) {
+    const BottomSegment *botSeg = getBottomSegment(bottom._genome, bottom._arrayIndex);
+    SegmentSlice top = {bottom._genome, true, botSeg->getTopParseIndex(), 0, 0, bottom._reversed};
+    hal_index_t startPos = getStartPosition(bottom);
+    hal_index_t botLength = (hal_index_t)getLength(bottom);
+    const TopSegment *topSeg = getTopSegment(top._genome, top._arrayIndex);
+    while (startPos >= topSeg->getStartPosition() + (hal_index_t)topSeg->getLength()) {
+        topSeg = getTopSegment(top._genome, ++top._arrayIndex);
+    }
+    hal_index_t topStart = topSeg->getStartPosition();
+    hal_index_t topLength = (hal_index_t)topSeg->getLength();
+    if (top._reversed == false) {
+        top._startOffset = startPos - topStart;
+        top._endOffset = max((hal_index_t)0, (topStart + topLength) - (startPos + botLength));
+    } else {
+        top._startOffset = topStart + topLength - 1 - startPos;
+        top._endOffset = max((hal_index_t)0, (startPos - botLength + 1) - topStart);
     }
+    assert(top._startOffset + top._endOffset <= (hal_size_t)topLength);
+    return top;
+}
 
-    if (coalescenceLimit == NULL) {
-        coalescenceLimit = mrca;
+// Same as BottomSegmentIterator::toParseDown
+SegmentSlice SegmentMapper::toParseDown(const SegmentSlice &top) {
+    const TopSegment *topSeg = getTopSegment(top._genome, top._arrayIndex);
+    SegmentSlice bottom = {top._genome, false, topSeg->getBottomParseIndex(), 0, 0, top._reversed};
+    hal_index_t startPos = getStartPosition(top);
+    hal_index_t topLength = (hal_index_t)getLength(top);
+    const BottomSegment *botSeg = getBottomSegment(bottom._genome, bottom._arrayIndex);
+    while (startPos >= botSeg->getStartPosition() + (hal_index_t)botSeg->getLength()) {
+        botSeg = getBottomSegment(bottom._genome, ++bottom._arrayIndex);
+    }
+    hal_index_t botStart = botSeg->getStartPosition();
+    hal_index_t botLength = (hal_index_t)botSeg->getLength();
+    if (bottom._reversed == false) {
+        bottom._startOffset = startPos - botStart;
+        bottom._endOffset = max((hal_index_t)0, (botStart + botLength) - (startPos + topLength));
+    } else {
+        bottom._startOffset = botStart + botLength - 1 - startPos;
+        bottom._endOffset = max((hal_index_t)0, (startPos - topLength + 1) - botStart);
     }
+    assert(bottom._startOffset + bottom._endOffset <= (hal_size_t)botLength);
+    return bottom;
+}
 
-    // Get the path from the coalescence limit to the target (necessary
-    // for choosing which children to move through to get to the
-    // target).
-    set<const Genome *> pathSet;
-    if (genomesOnPath == NULL) {
-        set<const Genome *> inputSet;
-        inputSet.insert(tgtGenome);
-        inputSet.insert(mrca);
-        getGenomesInSpanningTree(inputSet, pathSet);
-        genomesOnPath = &pathSet;
+// Same as SegmentIterator::toRight(rightCutoff)
+void SegmentMapper::toRight(SegmentSlice &slice, hal_index_t rightCutoff) {
+    hal_size_t numSegments = slice._top ? slice._genome->getNumTopSegments() : slice._genome->getNumBottomSegments();
+    if (slice._endOffset == 0) {
+        slice._arrayIndex += slice._reversed ? -1 : 1;
+        slice._startOffset = 0;
+    } else {
+        slice._startOffset = getSegment(slice)->getLength() - slice._endOffset;
+        slice._endOffset = 0;
+    }
+    if (slice._arrayIndex >= 0 && (hal_size_t)slice._arrayIndex < numSegments && overlaps(slice, rightCutoff)) {
+        const Segment *segment = getSegment(slice);
+        if (slice._reversed == false) {
+            slice._endOffset = segment->getStartPosition() + segment->getLength() - rightCutoff - 1;
+        } else {
+            slice._endOffset = rightCutoff - segment->getStartPosition();
+        }
     }
+}
 
-    hal_size_t numResults =
-        mapSource(source, outSegments, tgtGenome, genomesOnPath, doDupes, minLength, coalescenceLimit, mrca);
-    return numResults;
+void SegmentMapper::toRange(const Mapping &mapping, MappedRange &range) {
+    range._source = mapping._source;
+    range._target = mapping._target;
+    range._genome = mapping._target._genome;
+    range._length = getLength(mapping._target);
+    range._reversed = mapping._source._reversed != mapping._target._reversed;
+    range._start = mapping._target._reversed ? getEndPosition(mapping._target) : getStartPosition(mapping._target);
+    range._srcStart = mapping._source._reversed ? getEndPosition(mapping._source) : getStartPosition(mapping._source);
+    range._sequence = range._genome->getSequenceBySite(range._start);
+    assert(range._length == getLength(mapping._source));
+}
+
+hal_size_t hal::halMapSegment(const SegmentIterator *source, MappedSegmentSet &outSegments, const Genome *tgtGenome,
+                              const set<const Genome *> *genomesOnPath, bool doDupes, hal_size_t minLength,
+                              const Genome *coalescenceLimit, const Genome *mrca) {
+    SegmentMapper mapper;
+    return mapper.mapSegment(source, outSegments, tgtGenome, genomesOnPath, doDupes, minLength, coalescenceLimit, mrca);
+}
+
+void hal::halAddMappedRange(const MappedRange &range, MappedSegmentSet &outSegments) {
+    insertAndBreakOverlaps(toMappedSegment(range._source, range._target), outSegments);
 }
 
 /* call main function with smart pointer */
@@ -675,3 +1027,146 @@ hal_size_t hal::halMapSegmentSP(const SegmentIteratorPtr &source, MappedSegmentS
                                 const Genome *coalescenceLimit, const Genome *mrca) {
     return halMapSegment(source.get(), outSegments, tgtGenome, genomesOnPath, doDupes, minLength, coalescenceLimit, mrca);
 }
+
+hal_size_t hal::halMapSegmentToMany(const SegmentIterator *source, const vector<const Genome *> &tgtGenomes,
+                                    vector<MappedSegmentSet> &outSegments, bool doDupes, hal_size_t minLength) {
+    SegmentMapper mapper;
+    return mapper.mapSegmentToMany(source, tgtGenomes, outSegments, doDupes, minLength);
+}
+
+IntervalMapper::IntervalMapper(const Genome *srcGenome, const Genome *tgtGenome, bool doDupes, hal_size_t minLength,
+                               const Genome *coalescenceLimit, const Genome *mrca)
+    : _srcGenome(srcGenome), _tgtGenome(tgtGenome), _doDupes(doDupes), _minLength(minLength),
+      _coalescenceLimit(coalescenceLimit), _mrca(mrca) {
+    assert(srcGenome != NULL && tgtGenome != NULL);
+    const Alignment *alignment = _srcGenome->getAlignment();
+    if (_mrca == NULL) {
+        _mrca = alignment->getMappingPath(_srcGenome, _tgtGenome)->_mrca;
+    }
+    if (_coalescenceLimit == NULL) {
+        _coalescenceLimit = _mrca;
+    }
+    // paralogs found above the MRCA are mapped back down through it, so the
+    // path has to start at the coalescence limit
+    _genomesOnPath = alignment->getMappingPath(_srcGenome, _tgtGenome, _coalescenceLimit)->_genomesOnPath;
+
+    if (_srcGenome->getNumTopSegments() > 0) {
+        _srcSegIt = _srcGenome->getTopSegmentIterator();
+        _numSrcSegments = (hal_index_t)_srcGenome->getNumTopSegments();
+    } else {
+        _srcSegIt = _srcGenome->getBottomSegmentIterator();
+        _numSrcSegments = (hal_index_t)_srcGenome->getNumBottomSegments();
+    }
+    _cache[0]._arrayIndex = NULL_INDEX;
+    _cache[1]._arrayIndex = NULL_INDEX;
+}
+
+const vector<IntervalMapper::CachedMapping> &IntervalMapper::getSegmentMappings(bool reversed) {
+    CachedSegment &cached = _cache[reversed];
+    if (cached._arrayIndex != _srcSegIt->getArrayIndex()) {
+        SegmentSlice source = toSlice(_srcSegIt.get());
+        source._startOffset = source._endOffset = 0;
+        source._reversed = reversed;
+        _ranges.clear();
+        _mapper.mapSegment(source, _ranges, _tgtGenome, &_genomesOnPath, _doDupes, _minLength, _coalescenceLimit, _mrca);
+
+        cached._mappings.clear();
+        for (size_t i = 0; i < _ranges.size(); ++i) {
+            hal_index_t srcStart = _ranges[i]._srcStart;
+            cached._mappings.push_back({srcStart, srcStart + (hal_index_t)_ranges[i]._length - 1, 0, _ranges[i]});
+        }
+        std::stable_sort(cached._mappings.begin(), cached._mappings.end(),
+                         [](const CachedMapping &m1, const CachedMapping &m2) { return m1._srcStart < m2._srcStart; });
+        hal_index_t maxSrcEnd = NULL_INDEX;
+        for (size_t i = 0; i < cached._mappings.size(); ++i) {
+            maxSrcEnd = max(maxSrcEnd, cached._mappings[i]._srcEnd);
+            cached._mappings[i]._maxSrcEnd = maxSrcEnd;
+        }
+        cached._arrayIndex = _srcSegIt->getArrayIndex();
+    }
+    return cached._mappings;
+}
+
+// Clip a mapping so that its source lies within [start, end], which it must
+// overlap
+static void clipToSource(MappedRange &range, hal_index_t start, hal_index_t end) {
+    hal_index_t srcEnd = range._srcStart + (hal_index_t)range._length - 1;
+    assert(range._srcStart <= end && srcEnd >= start);
+    hal_index_t leftTrim = max(start - range._srcStart, (hal_index_t)0);
+    hal_index_t rightTrim = max(srcEnd - end, (hal_index_t)0);
+    // the slices' offsets are counted from their iteration start, which is
+    // the right end of a reversed slice
+    SegmentSlice &source = range._source;
+    SegmentSlice &target = range._target;
+    source._startOffset += source._reversed ? rightTrim : leftTrim;
+    source._endOffset += source._reversed ? leftTrim : rightTrim;
+    // the target's bases run along the source's, or against it if reversed
+    target._startOffset += source._reversed ? rightTrim : leftTrim;
+    target._endOffset += source._reversed ? leftTrim : rightTrim;
+    range._srcStart += leftTrim;
+    range._start += range._reversed ? rightTrim : leftTrim;
+    range._length -= leftTrim + rightTrim;
+}
+
+hal_size_t IntervalMapper::mapInterval(hal_index_t start, hal_index_t end, bool reversed,
+                                       MappedSegmentSet &outSegments) {
+    assert(start <= end);
+    // sorted input usually stays in the current segment
+    hal_index_t curIndex = _srcSegIt->getArrayIndex();
+    if (curIndex < 0 || curIndex >= _numSrcSegments || !_srcSegIt->overlaps(start)) {
+        _srcSegIt->toSite(start, false);
+    }
+    hal_size_t numResults = 0;
+    for (; _srcSegIt->getArrayIndex() < _numSrcSegments && _srcSegIt->getStartPosition() <= end;
+         _srcSegIt->toRight()) {
+        list<MappedSegmentPtr> output;
+        _ranges.clear();
+        if (_minLength == 0) {
+            // walk back from the last mapping starting in the interval until
+            // no earlier mapping can reach it
+            const vector<CachedMapping> &mappings = getSegmentMappings(reversed);
+            vector<CachedMapping>::const_iterator i = std::upper_bound(
+                mappings.begin(), mappings.end(), end,
+                [](hal_index_t pos, const CachedMapping &mapping) { return pos < mapping._srcStart; });
+            while (i != mappings.begin() && (i - 1)->_maxSrcEnd >= start) {
+                --i;
+                if (i->_srcEnd >= start) {
+                    MappedRange clipped = i->_range;
+                    clipToSource(clipped, start, end);
+                    output.push_front(toMappedSegment(clipped._source, clipped._target));
+                }
+            }
+            output.sort(MappedSegment::LessSourcePtr());
+            output.unique(MappedSegment::EqualToPtr());
+        } else {
+            SegmentSlice source = toSlice(_srcSegIt.get());
+            hal_offset_t leftTrim = max(start - _srcSegIt->getStartPosition(), (hal_index_t)0);
+            hal_offset_t rightTrim = max(_srcSegIt->getEndPosition() - end, (hal_index_t)0);
+            source._startOffset = reversed ? rightTrim : leftTrim;
+            source._endOffset = reversed ? leftTrim : rightTrim;
+            source._reversed = reversed;
+            _mapper.mapSegment(source, _ranges, _tgtGenome, &_genomesOnPath, _doDupes, _minLength, _coalescenceLimit,
+                               _mrca);
+            for (size_t i = 0; i < _ranges.size(); ++i) {
+                output.push_back(toMappedSegment(_ranges[i]._source, _ranges[i]._target));
+            }
+        }
+        for (list<MappedSegmentPtr>::iterator outIt = output.begin(); outIt != output.end(); ++outIt) {
+            insertAndBreakOverlaps(*outIt, outSegments);
+        }
+        numResults += output.size();
+    }
+    return numResults;
+}
+
+void hal::halMapIntervals(const Genome *srcGenome, const vector<MapInterval> &intervals, const Genome *tgtGenome,
+                          const function<void(size_t, MappedSegmentSet &)> &resultFunc, bool doDupes,
+                          hal_size_t minLength, const Genome *coalescenceLimit, const Genome *mrca) {
+    IntervalMapper mapper(srcGenome, tgtGenome, doDupes, minLength, coalescenceLimit, mrca);
+    MappedSegmentSet mappedSegments;
+    for (size_t i = 0; i < intervals.size(); ++i) {
+        mappedSegments.clear();
+        mapper.mapInterval(intervals[i]._start, intervals[i]._end, intervals[i]._reversed, mappedSegments);
+        resultFunc(i, mappedSegments);
+    }
+}
@@ -45,6 +45,7 @@
 #include "cheapcgi.h"
 #include "udc2.h"
 #include "hex.h"
+#include "errCatch.h"
 #include <openssl/sha.h>
 
 /* The stdio stream we'll use to output statistics on file i/o.  Off by default. */
@@ -1391,14 +1392,37 @@ if (endPos > startPos)
     
     int actualSize = file->prot->fetchData(file->url, startPos, readSize, buf, file);
     if (actualSize != readSize)
+	{
+	freez(&buf);  // errAbort may be caught by udc2MMapTryFetch
 	errAbort("unable to fetch %lld bytes from %s @%lld (got %d bytes)",
 		 readSize, file->url, startPos, actualSize);
+	}
     ourMustLseek(&file->ios.sparse, file->fdSparse, startPos, SEEK_SET);
     ourMustWrite(&file->ios.sparse, file->fdSparse, buf, readSize);
     freez(&buf);
     }
 }
 
+static void bitSetRangeShared(Bits *b, int startIx, int bitCount)
+/* Set a range of bits, like bitSetRange, with an atomic OR per byte.  The
+ * bitmap is mapped shared, so other handles, threads and processes may set
+ * neighbouring bits in the same bytes at the same time. */
+{
+if (bitCount <= 0)
+    return;
+int endIx = startIx + bitCount;
+int startByte = startIx >> 3;
+int endByte = (endIx - 1) >> 3;
+int i;
+for (i = startByte; i <= endByte; ++i)
+    {
+    int first = (i == startByte) ? (startIx & 7) : 0;
+    int last = (i == endByte) ? ((endIx - 1) & 7) + 1 : 8;
+    Bits mask = (Bits)((0xff >> first) & (0xff << (8 - last)));
+    __atomic_fetch_or(&b[i], mask, __ATOMIC_RELEASE);
+    }
+}
+
 static boolean fetchMissingBits(struct udc2File *file, struct udcBitmap *bits,
 	bits64 start, bits64 end, bits64 *retFetchedStart, bits64 *retFetchedEnd)
 /* Scan through relevant parts of bitmap, fetching blocks we don't already have. */
@@ -1420,7 +1444,7 @@ for (;;)
     int clearSize =  nextSetBit - nextClearBit;
 
     fetchMissingBlocks(file, bits, nextClearBit, clearSize, bits->blockSize);
-    bitSetRange(bits->bits, nextClearBit, clearSize);
+    bitSetRangeShared(bits->bits, nextClearBit, clearSize);
     if (nextSetBit >= e)
         break;
     s = nextSetBit;
@@ -1966,6 +1990,37 @@ if (udc2CacheEnabled() && !sameString(file->protocol, "transparent"))
 return ((char*)file->mmapBase) + offset;
 }
 
+boolean udc2MMapTryFetch(struct udc2File *file, bits64 offset, bits64 size, char **retError)
+/* Like udc2MMapFetch, but return FALSE rather than aborting if the range
+ * can't be fetched, for speculative reads such as read-ahead.  If retError
+ * is not NULL, it is set to the error message, to be freed with
+ * udc2FreeMem, or NULL on success.  Safe on read-ahead threads, as kent
+ * keeps the errAbort handler and errCatch stacks in pthread-specific data,
+ * so an abort only jumps to a catch on its own thread. */
+{
+boolean ok = TRUE;
+if (retError != NULL)
+    *retError = NULL;
+struct errCatch *errCatch = errCatchNew();
+if (errCatchStart(errCatch))
+    udc2MMapFetch(file, offset, size);
+errCatchEnd(errCatch);
+if (errCatch->gotError)
+    {
+    ok = FALSE;
+    if (retError != NULL)
+        *retError = cloneString(errCatch->message->string);
+    }
+errCatchFree(&errCatch);
+return ok;
+}
+
+bits64 udc2NetBytesRead(struct udc2File *file)
+/* Return the number of bytes read over the network by this handle. */
+{
+return file->ios.net.bytesRead;
+}
+
 void udc2VerboseSetLevel(int l)
 /* set the verbose level; */
 {
@@ -9,7 +9,11 @@
 #define _HALALIGNMENT_H
 
 #include "halDefs.h"
+#include <map>
+#include <mutex>
+#include <set>
 #include <string>
+#include <tuple>
 #include <vector>
 
 namespace hal {
@@ -21,6 +25,18 @@ namespace hal {
         }
     };
 
+    /** Genomes involved in mapping segments from one genome to another, as
+     * used by halMapSegment.  See Alignment::getMappingPath. */
+    struct MappingPath {
+        /* lowest common ancestor of the source and target */
+        const Genome *_mrca;
+        /* paralogs coalescing in or below this genome are mapped */
+        const Genome *_coalescenceLimit;
+        /* spanning tree of the coalescence limit and the target */
+        std::set<const Genome *> _genomesOnPath;
+    };
+    typedef std::shared_ptr<const MappingPath> MappingPathConstPtr;
+
     /**
      * Interface for a hierarhcical alignment.  Responsible for creating
      * and accessing genomes and tree information.  Accesssing a HAL file must
@@ -157,8 +173,34 @@ namespace hal {
         /** Is this file open for read-only? */
         virtual bool isReadOnly() const = 0;
 
+        /** Can this alignment object be shared by multiple threads without
+         * external locking?  When true, genomes may be opened and iterators,
+         * column iterators and segment mappers created and used concurrently
+         * from any number of threads.  Iterators themselves are not shared
+         * and each thread must create its own. This is only ever true for
+         * alignments open with READ_ACCESS. */
+        virtual bool supportsConcurrentReads() const = 0;
+
         /** Replace the newick tree with a new string */
         virtual void replaceNewickTree(const std::string &newick) = 0;
+
+        /** Get the MRCA and path used to map segments from srcGenome to
+         * tgtGenome.  If coalescenceLimit is NULL, it is the MRCA.  Each path
+         * is computed once and kept until the tree changes or a genome is
+         * closed.  Can be called from several threads at once when the
+         * alignment supportsConcurrentReads(). */
+        MappingPathConstPtr getMappingPath(const Genome *srcGenome, const Genome *tgtGenome,
+                                           const Genome *coalescenceLimit = NULL) const;
+
+      protected:
+        /** Forget all cached mapping paths.  Called by implementations when
+         * the tree changes or genomes are closed. */
+        void clearMappingPaths() const;
+
+      private:
+        typedef std::tuple<const Genome *, const Genome *, const Genome *> MappingPathKey;
+        mutable std::mutex _mappingPathMutex;
+        mutable std::map<MappingPathKey, MappingPathConstPtr> _mappingPaths;
     };
 }
 #endif
@@ -32,6 +32,14 @@ namespace hal {
 
     /*
      * Open modes for files.
+     *
+     * Concurrency: an mmap alignment opened with only READ_ACCESS may be
+     * shared between threads without locking; genome opening and the
+     * parent/child/sequence caches are internally synchronized and all other
+     * data is read directly from the mapped file.  Each thread must use its
+     * own iterators.  HDF5 alignments and any alignment open for writing must
+     * be serialized by the caller.  Use Alignment::supportsConcurrentReads()
+     * to check at run time.
      */
     enum {
         READ_ACCESS = 0x01,  // read-access
@@ -55,10 +63,29 @@ namespace hal {
     }
 
     /*
-     * MMap file default size when opening file for write access.
+     * MMap file default initial size when opening file for write access.
+     * The file grows as needed and is trimmed to the space used on close.
      */
-    static const size_t MMAP_DEFAULT_FILE_SIZE_GB = 64;
-    static const size_t MMAP_DEFAULT_FILE_SIZE = 64 * GIGABYTE;
+    static const size_t MMAP_DEFAULT_FILE_SIZE_GB = 1;
+    static const size_t MMAP_DEFAULT_FILE_SIZE = 1 * GIGABYTE;
+
+    /*
+     * Encodings for DNA in mmap files, selected when the file is created.
+     * MMAP_DNA_NIBBLE stores one base per nibble.  MMAP_DNA_TWO_BIT stores
+     * four bases per byte, plus tables of N and soft-masked runs.  This is
+     * about half the size, but DNA of genomes being written is held in memory
+     * until the file is closed.
+     */
+    enum MMapDnaEncoding { MMAP_DNA_NIBBLE = 0, MMAP_DNA_TWO_BIT = 1 };
+
+    /*
+     * Layouts of segments in mmap files, selected when the file is created.
+     * MMAP_SEGMENTS_ROW stores each segment as a record.  MMAP_SEGMENTS_COLUMNAR
+     * stores each segment field as a separate array, with the reversed flags
+     * packed one bit per segment.  This is smaller and faster for scans that
+     * only look at a few fields.
+     */
+    enum MMapSegmentLayout { MMAP_SEGMENTS_ROW = 0, MMAP_SEGMENTS_COLUMNAR = 1 };
 
     /* get default FileCreatPropList with HAL default properties set */
     const H5::FileCreatPropList &hdf5DefaultFileCreatPropList();
@@ -88,13 +115,27 @@ namespace hal {
      */
     Alignment *hdf5AlignmentInstance(const std::string &alignmentPath, unsigned mode, const CLParser *parser);
 
+    /** Is the HDF5 library built thread-safe?  If so, HDF5 alignments that
+     * are opened separately can be read from different threads, one thread
+     * per alignment.  The library serializes its own calls. */
+    bool hdf5IsThreadSafe();
+
     /** Get an instance of an mmap-implemented Alignment.
      * @param alignmentPath Path to file or URL for UDC access.
      * @param mode Access mode bit map
-     * @param fileSize Size to allocate when creating new file (CREATE_ACCESS)
+     * @param fileSize Initial size when creating new file (CREATE_ACCESS), or
+     * space to add to an existing one (WRITE_ACCESS).  The file grows as needed.
+     * @param dnaEncoding DNA encoding for a new file (CREATE_ACCESS)
+     * @param segmentLayout Segment layout for a new file (CREATE_ACCESS)
      */
     Alignment *mmapAlignmentInstance(const std::string &alignmentPath, unsigned mode = hal::READ_ACCESS,
-                                     size_t fileSize = hal::MMAP_DEFAULT_FILE_SIZE);
+                                     size_t fileSize = hal::MMAP_DEFAULT_FILE_SIZE,
+                                     MMapDnaEncoding dnaEncoding = MMAP_DNA_NIBBLE,
+                                     MMapSegmentLayout segmentLayout = MMAP_SEGMENTS_ROW);
+
+    /** Get the DNA encoding and segment layout of an open mmap alignment,
+     * to create another file like it.  Throws if it isn't an mmap alignment. */
+    void getMMapAlignmentLayout(const Alignment *alignment, MMapDnaEncoding &dnaEncoding, MMapSegmentLayout &segmentLayout);
 
     /** Attempt to detect HAL alignment format, or return empty string if it doesn't
      * appear to be a hal file */
@@ -189,6 +189,13 @@ namespace hal {
         return dnaUnpackMap[code];
     }
 
+    /** Unpack length nibble-packed bases, starting at base index of packed,
+     * into outBuffer, which isn't null-terminated.  The bases are reverse
+     * complemented and/or upper-cased if requested.  Uses SSSE3 or AVX2 when
+     * the CPU has them. */
+    void dnaUnpackRange(const char *packed, hal_index_t index, hal_size_t length, char *outBuffer,
+                        bool reverseComplement = false, bool upperCase = false);
+
     /** Pack a DNA character */
     inline unsigned char dnaPack(char unpackedChar, hal_index_t index, unsigned char packedChar) {
         uint8_t code = dnaPackMap[uint8_t(unpackedChar)];
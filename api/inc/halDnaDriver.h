@@ -8,6 +8,8 @@
 #ifndef _HALDNADRIVER_H
 #define _HALDNADRIVER_H
 #include "halCommon.h"
+#include "halPerfStats.h"
+#include <algorithm>
 
 namespace hal {
     /**
@@ -34,6 +36,20 @@ namespace hal {
             return dnaUnpack(relIndex, _buffer[relIndex / 2]);
         }
 
+        /* copy the bases [index, index + length) to outBuffer, a buffer at a
+         * time, reverse complemented and/or upper-cased if requested. */
+        inline void getBases(hal_index_t index, hal_size_t length, char *outBuffer, bool reverseComplement,
+                             bool upperCase) const {
+            hal_index_t end = index + length;
+            for (hal_index_t pos = index; pos < end;) {
+                hal_index_t relIndex = access(pos);
+                hal_size_t chunk = std::min(end, _endIndex) - pos;
+                char *out = outBuffer + (reverseComplement ? end - pos - chunk : pos - index);
+                dnaUnpackRange(_buffer, relIndex, chunk, out, reverseComplement, upperCase);
+                pos += chunk;
+            }
+        }
+
         /* set a base at the specified index. */
         inline void setBase(hal_index_t index, char base) {
             hal_index_t relIndex = access(index);
@@ -50,6 +66,7 @@ namespace hal {
         /* refresh the buffer if needed and return relative index */
         inline hal_index_t access(hal_index_t index) const {
             if ((index < _startIndex) or (index >= _endIndex)) {
+                perfCount(PERF_DNA_FETCHES);
                 fetch(index);
             }
             return index - _startIndex;
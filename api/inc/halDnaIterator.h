@@ -108,6 +108,11 @@ namespace hal {
         /* read a DNA string */
         void readString(std::string &outString, hal_size_t length);
 
+        /* read length bases in the direction of movement into outBuffer,
+         * decoding them in bulk rather than a base at a time.  The
+         * iterator is left just past the last base read. */
+        void readBases(char *outBuffer, hal_size_t length, bool upperCase = false);
+
         /* write a DNA string */
         void writeString(const std::string &inString, hal_size_t length);
 
@@ -163,13 +168,21 @@ namespace hal {
     }
 
     inline void DnaIterator::readString(std::string &outString, hal_size_t length) {
-        assert(length == 0 || inRange() == true);
         outString.resize(length);
+        readBases(&outString[0], length);
+    }
 
-        for (hal_size_t i = 0; i < length; ++i) {
-            outString[i] = getBase();
-            toRight();
+    inline void DnaIterator::readBases(char *outBuffer, hal_size_t length, bool upperCase) {
+        if (length == 0) {
+            return;
+        }
+        hal_index_t first = _reversed ? _index - (hal_index_t)length + 1 : _index;
+        if ((first < 0) || (first + length > _genome->getSequenceLength())) {
+            throw hal_exception("DNA range of length " + std::to_string(length) + " at " + std::to_string(_index) +
+                                " out of range for genome " + _genome->getName());
         }
+        _dnaAccess->getBases(first, length, outBuffer, _reversed, upperCase);
+        _index += _reversed ? -(hal_index_t)length : (hal_index_t)length;
     }
 
     inline void DnaIterator::writeString(const std::string &inString, hal_size_t length) {
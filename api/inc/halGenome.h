@@ -12,6 +12,7 @@
 #include "halDefs.h"
 #include "halSegmentedSequence.h"
 #include "halSequence.h"
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -34,7 +35,8 @@ namespace hal {
       public:
         /* Constructor */
         Genome(Alignment *alignment, const std::string &name)
-            : _alignment(alignment), _name(name), _numChildren(alignment->getChildNames(name).size()), _parentCache(NULL){};
+            : _alignment(alignment), _name(name), _numChildren(alignment->getChildNames(name).size()), _parentCache(NULL),
+              _childCache(_numChildren){};
 
         /** Destructor */
         virtual ~Genome() {
@@ -194,6 +196,28 @@ namespace hal {
          * @param dest Genome to be copied to */
         void copyMetadata(Genome *dest) const;
 
+        /** Copy the packed DNA array of this genome to another as a block
+         * rather than a base at a time.  This is only possible if both
+         * genomes are stored in the same format and have the same length.
+         * @param dest Genome to be copied to
+         * @return false, without copying anything, if it isn't possible */
+        virtual bool copyDnaArray(Genome *dest) const = 0;
+
+        /** Copy the top segment array of this genome to another as a block,
+         * if both are stored in the same format and have the same number of
+         * top segments.  The segment indices are copied as they are, so they
+         * must be valid in the destination.
+         * @param dest Genome to be copied to
+         * @return false, without copying anything, if it isn't possible */
+        virtual bool copyTopSegmentArray(Genome *dest) const = 0;
+
+        /** Copy the bottom segment array of this genome to another as a
+         * block, as for copyTopSegmentArray.  The genomes must also have
+         * the same number of children.
+         * @param dest Genome to be copied to
+         * @return false, without copying anything, if it isn't possible */
+        virtual bool copyBottomSegmentArray(Genome *dest) const = 0;
+
         /** Recompute parse info for this genome. */
         void fixParseInfo();
 
@@ -203,7 +227,7 @@ namespace hal {
         /** Reload the genome after some aspect has changed, clearing any caches. */
         void reload() {
             _numChildren = _alignment->getChildNames(_name).size();
-            _childCache.empty();
+            _childCache = std::vector<std::atomic<Genome *>>(_numChildren);
             _parentCache = NULL;
         };
 
@@ -211,33 +235,30 @@ namespace hal {
         Alignment *_alignment;
         std::string _name;
         hal_index_t _numChildren;
-        mutable Genome *_parentCache;
-        mutable std::vector<Genome *> _childCache;
+
+        /* The parent and child caches are atomic so that they can be filled
+         * in lazily by concurrent readers (see supportsConcurrentReads()).
+         * Racing threads will store the same pointer, as openGenome()
+         * returns a single object per genome. */
+        mutable std::atomic<Genome *> _parentCache;
+        mutable std::vector<std::atomic<Genome *>> _childCache;
     };
 
     inline Genome *Genome::getChild(hal_size_t childIdx) {
-        if (_childCache.size() <= childIdx) {
-            _childCache.assign(_numChildren, NULL);
-        }
-        if (_childCache[childIdx] == NULL) {
-            std::vector<std::string> childNames = _alignment->getChildNames(_name);
-            _childCache[childIdx] = _alignment->openGenome(childNames.at(childIdx));
-        }
-        return _childCache[childIdx];
+        return const_cast<Genome *>(static_cast<const Genome *>(this)->getChild(childIdx));
     }
 
     inline const Genome *Genome::getChild(hal_size_t childIdx) const {
         if (childIdx >= _numChildren) {
             throw hal_exception("Genome::getChild() - child out of range");
         }
-        if (_childCache.size() < _numChildren) {
-            _childCache.assign(_numChildren, NULL);
-        }
-        if (_childCache[childIdx] == NULL) {
+        Genome *child = _childCache[childIdx].load(std::memory_order_acquire);
+        if (child == NULL) {
             std::vector<std::string> childNames = _alignment->getChildNames(_name);
-            _childCache[childIdx] = _alignment->openGenome(childNames.at(childIdx));
+            child = _alignment->openGenome(childNames.at(childIdx));
+            _childCache[childIdx].store(child, std::memory_order_release);
         }
-        return _childCache[childIdx];
+        return child;
     }
 
     inline hal_size_t Genome::getNumChildren() const {
@@ -256,23 +277,19 @@ namespace hal {
     }
 
     inline Genome *Genome::getParent() {
-        if (_parentCache == NULL) {
-            std::string parName = _alignment->getParentName(_name);
-            if (parName.empty() == false) {
-                _parentCache = _alignment->openGenome(parName);
-            }
-        }
-        return _parentCache;
+        return const_cast<Genome *>(static_cast<const Genome *>(this)->getParent());
     }
 
     inline const Genome *Genome::getParent() const {
-        if (_parentCache == NULL) {
+        Genome *parent = _parentCache.load(std::memory_order_acquire);
+        if (parent == NULL) {
             std::string parName = _alignment->getParentName(_name);
             if (parName.empty() == false) {
-                _parentCache = _alignment->openGenome(parName);
+                parent = _alignment->openGenome(parName);
+                _parentCache.store(parent, std::memory_order_release);
             }
         }
-        return _parentCache;
+        return parent;
     }
 }
 #endif
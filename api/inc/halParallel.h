@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef _HALPARALLEL_H
+#define _HALPARALLEL_H
+
+#include "halDefs.h"
+#include <functional>
+#include <iostream>
+#include <string>
+
+namespace hal {
+    class Alignment;
+    class CLParser;
+
+    /** Add the standard --numThreads option to a tool's parser */
+    void addNumThreadsOption(CLParser &optionsParser);
+
+    /** Number of threads a tool should actually use on an alignment.
+     * A request of 0 means one per hardware core.  Alignments that can't be
+     * read concurrently (see Alignment::supportsConcurrentReads()) get a
+     * warning on stderr and one thread. */
+    size_t getNumThreads(const Alignment *alignment, size_t requested, const std::string &toolName);
+
+    /** Run task(i) for i in [0, numTasks) on up to numThreads threads.  Tasks
+     * are started in index order.  The first exception thrown by a task stops
+     * any unstarted tasks and is rethrown in the calling thread once all
+     * threads are finished.  With one thread, everything runs in the calling
+     * thread. */
+    void parallelFor(size_t numTasks, size_t numThreads, const std::function<void(size_t)> &task);
+
+    /** Like parallelFor, but each task writes to its own buffer, which is
+     * copied to outStream in task order, as soon as all preceding tasks are
+     * done.  The output is therefore the same as running the tasks serially
+     * on outStream.  At most a few tasks per thread are run ahead of the
+     * oldest unwritten one, which bounds the memory held in buffers. */
+    void parallelOrderedOutput(size_t numTasks, size_t numThreads, const std::function<void(size_t, std::ostream &)> &task,
+                               std::ostream &outStream);
+
+    /** Like parallelOrderedOutput, but for a stream of tasks whose number
+     * isn't known in advance, such as input from a pipe.  readTask(i) is
+     * called for i = 0, 1, ..., one call at a time and in order, and returns
+     * false when there are no more tasks; it typically reads task i's input.
+     * No more than getOrderedWindow(numThreads) tasks are read ahead of the
+     * oldest unwritten one, so task i can keep its input in slot
+     * i % getOrderedWindow(numThreads) of a ring buffer. */
+    void parallelOrderedStream(size_t numThreads, const std::function<bool(size_t)> &readTask,
+                               const std::function<void(size_t, std::ostream &)> &task, std::ostream &outStream);
+
+    /** Number of tasks parallelOrderedStream can have in flight */
+    size_t getOrderedWindow(size_t numThreads);
+}
+
+#endif
+// Local Variables:
+// mode: c++
+// End:
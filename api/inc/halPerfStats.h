@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef _HALPERFSTATS_H
+#define _HALPERFSTATS_H
+
+#include "halDefs.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+/* Counters and timers on the hot paths of the API, to tell whether a slow
+ * run is bound by I/O or by CPU.  Each thread counts into its own
+ * statistics, which are added to the process totals when the thread exits.
+ * Nothing is counted or timed until enablePerfStats() is called, which
+ * tools do for --perfStats, so otherwise each hot path only tests one
+ * global flag.  Building with -DHAL_DISABLE_PERF_STATS
+ * (make DISABLE_PERF_STATS=1) compiles them all out. */
+
+namespace hal {
+    enum PerfCounter {
+        PERF_SEGMENT_MOVES,        // SegmentIterator::toLeft and toRight
+        PERF_SEGMENT_SITE_LOOKUPS, // SegmentIterator::toSite
+        PERF_DNA_FETCHES,          // DnaAccess buffer refills
+        PERF_MMAP_FETCHES,         // MMapFile::fetch calls, made for URLs only
+        PERF_UDC_BYTES_FETCHED,    // bytes UDC read over the network
+        PERF_HDF5_PAGE_LOADS,      // Hdf5ExternalArray pages read from the file
+        PERF_GENOME_OPENS,         // genomes loaded by openGenome
+        PERF_GENOME_CLOSES,        // closeGenome calls
+        PERF_NUM_COUNTERS
+    };
+
+    enum PerfTimer {
+        PERF_TIME_MMAP_FETCH, // in MMapFile::fetch
+        PERF_TIME_HDF5_READ,  // reading Hdf5ExternalArray pages
+        PERF_NUM_TIMERS
+    };
+
+    /* Statistics of one thread.  They are only written by their thread, and
+     * are atomic so the totals can be read while it runs. */
+    struct PerfThreadStats {
+        std::atomic<hal_size_t> _counts[PERF_NUM_COUNTERS];
+        std::atomic<hal_size_t> _nanoseconds[PERF_NUM_TIMERS];
+        bool _registered;
+    };
+
+    /* process totals, as returned by getPerfStats */
+    struct PerfStats {
+        hal_size_t _counts[PERF_NUM_COUNTERS];
+        double _seconds[PERF_NUM_TIMERS];
+    };
+
+    extern thread_local PerfThreadStats perfThreadStats;
+    extern std::atomic<bool> perfStatsEnabled;
+
+    /* include the calling thread's statistics in the totals, merging them
+     * in when the thread exits */
+    void registerPerfThread();
+
+    inline void perfAdd(std::atomic<hal_size_t> &stat, hal_size_t n) {
+        // only this thread writes it, so no need for an atomic add
+        stat.store(stat.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    /* count n events, if enabled */
+    inline void perfCount(PerfCounter counter, hal_size_t n = 1) {
+#ifndef HAL_DISABLE_PERF_STATS
+        if (!perfStatsEnabled.load(std::memory_order_relaxed)) {
+            return;
+        }
+        PerfThreadStats &stats = perfThreadStats;
+        if (!stats._registered) {
+            registerPerfThread();
+        }
+        perfAdd(stats._counts[counter], n);
+#endif
+    }
+
+    /* Adds the time it is in scope to a timer, if enabled */
+    class PerfTimerScope {
+      public:
+        PerfTimerScope(PerfTimer timer) {
+#ifndef HAL_DISABLE_PERF_STATS
+            _timer = timer;
+            _running = perfStatsEnabled.load(std::memory_order_relaxed);
+            if (_running) {
+                _start = std::chrono::steady_clock::now();
+            }
+#endif
+        }
+        ~PerfTimerScope() {
+#ifndef HAL_DISABLE_PERF_STATS
+            if (_running) {
+                PerfThreadStats &stats = perfThreadStats;
+                if (!stats._registered) {
+                    registerPerfThread();
+                }
+                perfAdd(stats._nanoseconds[_timer],
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start)
+                            .count());
+            }
+#endif
+        }
+
+      private:
+#ifndef HAL_DISABLE_PERF_STATS
+        PerfTimer _timer;
+        bool _running;
+        std::chrono::steady_clock::time_point _start;
+#endif
+    };
+
+    /** Start counting and timing and write the statistics to stderr at
+     * exit, in format "table" or "json".  Called by CLParser::parseOptions
+     * when --perfStats is given. */
+    void enablePerfStats(const std::string &format);
+
+    /** Start or stop counting and timing, without writing the statistics
+     * at exit, for callers that read them with getPerfStats() */
+    void setPerfStatsEnabled(bool enabled);
+
+    /** Totals over the threads that have exited and those still running */
+    PerfStats getPerfStats();
+
+    /** Write the statistics as a table or JSON, along with the elapsed time
+     * since enablePerfStats and the CPU time and peak RSS of the process */
+    void writePerfStats(std::ostream &os, const std::string &format);
+
+    const char *getPerfCounterName(PerfCounter counter);
+    const char *getPerfTimerName(PerfTimer timer);
+}
+
+#endif
+// Local Variables:
+// mode: c++
+// End:
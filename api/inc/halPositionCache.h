@@ -10,7 +10,7 @@
 
 #include "halDefs.h"
 #include <cassert>
-#include <map>
+#include <iterator>
 #include <string>
 #include <vector>
 
@@ -19,16 +19,91 @@ namespace hal {
     /** keep track of bases by storing 2d intervals
      * For example, if we want to flag positions in a genome
      * that we have visited, this structure will be fairly
-     * efficient provided positions are clustered into intervals */
+     * efficient provided positions are clustered into intervals
+     *
+     * The intervals are kept sorted in a list of chunks, each a small
+     * sorted vector, so adding or removing an interval only shifts part of
+     * one chunk.  Positions are mostly inserted next to the last one, as
+     * when walking columns, so the search starts from the last interval
+     * inserted into and gallops outwards, and most inserts just extend an
+     * interval in place. */
     class PositionCache {
       public:
-        PositionCache() : _size(0), _prev(_set.begin()) {
-        }
-        PositionCache(const PositionCache &positionCache)
-            : _set(*positionCache.getIntervalSet()), _size(positionCache.size()), _prev(_set.begin()) {
+        /* Sorted intervals, each (last, first), iterated like the
+         * std::map they used to be stored in */
+        class IntervalSet {
+          public:
+            typedef std::pair<hal_index_t, hal_index_t> value_type;
+            typedef std::vector<value_type> Chunk;
+
+            class const_iterator {
+              public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef IntervalSet::value_type value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef const value_type *pointer;
+                typedef const value_type &reference;
+
+                const_iterator() : _chunks(NULL), _chunk(0), _index(0) {
+                }
+                const_iterator(const std::vector<Chunk> *chunks, size_t chunk, size_t index)
+                    : _chunks(chunks), _chunk(chunk), _index(index) {
+                }
+                reference operator*() const {
+                    return (*_chunks)[_chunk][_index];
+                }
+                pointer operator->() const {
+                    return &(*_chunks)[_chunk][_index];
+                }
+                const_iterator &operator++() {
+                    if (++_index == (*_chunks)[_chunk].size()) {
+                        ++_chunk;
+                        _index = 0;
+                    }
+                    return *this;
+                }
+                const_iterator operator++(int) {
+                    const_iterator i = *this;
+                    ++*this;
+                    return i;
+                }
+                bool operator==(const const_iterator &other) const {
+                    return _chunk == other._chunk && _index == other._index;
+                }
+                bool operator!=(const const_iterator &other) const {
+                    return !(*this == other);
+                }
+
+              private:
+                const std::vector<Chunk> *_chunks;
+                size_t _chunk;
+                size_t _index;
+            };
+
+            IntervalSet() : _size(0) {
+            }
+            const_iterator begin() const {
+                return const_iterator(&_chunks, 0, 0);
+            }
+            const_iterator end() const {
+                return const_iterator(&_chunks, _chunks.size(), 0);
+            }
+            size_t size() const {
+                return _size;
+            }
+            bool empty() const {
+                return _size == 0;
+            }
+
+          private:
+            friend class PositionCache;
+            // no chunk is empty
+            std::vector<Chunk> _chunks;
+            size_t _size;
+        };
+
+        PositionCache() : _size(0) {
         }
-        // sorted by last index, so each interval is (last, first)
-        typedef std::map<hal_index_t, hal_index_t> IntervalSet;
 
         bool insert(hal_index_t pos);
         bool find(hal_index_t pos) const;
@@ -46,9 +121,22 @@ namespace hal {
         }
 
       private:
+        /* an interval, as its chunk and index in the chunk, with
+         * _chunk == number of chunks for the end */
+        struct Location {
+            Location(size_t chunk = 0, size_t index = 0) : _chunk(chunk), _index(index) {
+            }
+            size_t _chunk;
+            size_t _index;
+        };
+
+        Location lowerBound(hal_index_t pos) const;
+        Location insertInterval(Location loc, const IntervalSet::value_type &interval);
+        void eraseInterval(Location loc);
+
         IntervalSet _set;
         hal_size_t _size;
-        IntervalSet::iterator _prev;
+        Location _prev; // interval last inserted into
     };
 }
 
@@ -9,7 +9,12 @@
 #define _HALSEGMENTMAPPER_H
 #include "halDefs.h"
 #include "halSegmentIterator.h"
+#include <functional>
+#include <list>
+#include <memory>
 #include <set>
+#include <string>
+#include <vector>
 
 namespace hal {
     class Segment;
@@ -24,10 +29,8 @@ namespace hal {
       * @param tgtGenome  Target genome to map to.  Can be the same as current.
       * @param genomesOnPath Intermediate genomes that must be visited
       * on the way down from coalescenceLimit to tgt.  If this is
-      * specified as NULL, then the path will be computed automatically
-      * (using hal::getGenomesInSpanningTree(coalescenceLimit, tgtGenome)).
-      * Specifying this can avoid recomputing the path over and over again
-      * when, say, calling halMapSegment repeatedly for the same
+      * specified as NULL, then the path is taken from
+      * Alignment::getMappingPath, which computes it once for each
       * source and target.
       * @param doDupes  Specify whether paralogy edges are followed
       * @param minLength Minimum length of segments to consider.  It is
@@ -38,7 +41,7 @@ namespace hal {
       * this genome will be mapped to the target as well. Must be the
       * MRCA or higher. By default, the coalescenceLimit is the MRCA.
       * @param mrca The MRCA of the source and target genomes. By
-      * default, it is computed automatically. */
+      * default, it is taken from Alignment::getMappingPath. */
     hal_size_t halMapSegment(const SegmentIterator *source, MappedSegmentSet &outSegments, const Genome *tgtGenome,
                              const std::set<const Genome *> *genomesOnPath = NULL, bool doDupes = true,
                              hal_size_t minLength = 0, const Genome *coalescenceLimit = NULL, const Genome *mrca = NULL);
@@ -47,5 +50,251 @@ namespace hal {
     hal_size_t halMapSegmentSP(const SegmentIteratorPtr &source, MappedSegmentSet &outSegments, const Genome *tgtGenome,
                                const std::set<const Genome *> *genomesOnPath = NULL, bool doDupes = true,
                                hal_size_t minLength = 0, const Genome *coalescenceLimit = NULL, const Genome *mrca = NULL);
+
+    /** Map source to each genome in tgtGenomes in one walk of the tree,
+     * adding the segments mapped to tgtGenomes[i] to outSegments[i].
+     * outSegments is resized to the number of targets.  The result for each
+     * target is the same as halMapSegment with the default path, MRCA and
+     * coalescence limit.  Returns the total number of mapped segments.  See
+     * SegmentMapper::mapSegmentToMany. */
+    hal_size_t halMapSegmentToMany(const SegmentIterator *source, const std::vector<const Genome *> &tgtGenomes,
+                                   std::vector<MappedSegmentSet> &outSegments, bool doDupes = true,
+                                   hal_size_t minLength = 0);
+
+    /** A segment iterator's position as a plain value: a top or bottom
+     * segment, trimmed by _startOffset and _endOffset bases from its
+     * iteration start and end, and read on the reverse strand if _reversed
+     * is set.  The offsets have the same meaning as in SegmentIterator. */
+    struct SegmentSlice {
+        const Genome *_genome;
+        bool _top;
+        hal_index_t _arrayIndex;
+        hal_offset_t _startOffset;
+        hal_offset_t _endOffset;
+        bool _reversed;
+    };
+
+    /** One alignment found by SegmentMapper: _length bases of the target
+     * genome starting at _start in _sequence, aligned to the source bases
+     * starting at _srcStart.  Both starts are the leftmost base in genome
+     * coordinates.  If _reversed is false, source base _srcStart + i is
+     * aligned to target base _start + i, otherwise to _start + _length - 1 -
+     * i.  _source and _target are the same ranges as segment slices, from
+     * which segment iterators can be made. */
+    struct MappedRange {
+        const Genome *_genome;
+        const Sequence *_sequence;
+        hal_index_t _start;
+        hal_size_t _length;
+        bool _reversed;
+        hal_index_t _srcStart;
+        SegmentSlice _source;
+        SegmentSlice _target;
+    };
+
+    /** Add a mapping found by SegmentMapper::mapSegment to outSegments,
+     * breaking up overlaps as halMapSegment does.  Adding all of a source
+     * segment's mappings, in order, gives the same set as halMapSegment, so
+     * mappings can be kept and added again later instead of remapped. */
+    void halAddMappedRange(const MappedRange &range, MappedSegmentSet &outSegments);
+
+    /** Maps segments through the tree without the per-step allocations of
+     * iterator-based mapping.  Mappings in progress are pairs of segment
+     * slices kept in work lists, and segments are read through one iterator
+     * per genome, all of which are kept between calls, as is the path to the
+     * last target.  Results are flat MappedRanges appended to a vector the
+     * caller can reuse.  halMapSegment is built on this class.
+     *
+     * A mapper is not thread-safe, and must not be used once the genomes it
+     * has read are closed. */
+    class SegmentMapper {
+      public:
+        SegmentMapper();
+        ~SegmentMapper();
+
+        /** Map source to tgtGenome, appending the mappings to outRanges,
+         * which is not cleared first.  Returns the number of mappings added.
+         * Unlike halMapSegment, mappings that overlap in the target are not
+         * broken up; they are sorted along the *source*.  The other
+         * parameters are as for halMapSegment. */
+        hal_size_t mapSegment(const SegmentIterator *source, std::vector<MappedRange> &outRanges, const Genome *tgtGenome,
+                              const std::set<const Genome *> *genomesOnPath = NULL, bool doDupes = true,
+                              hal_size_t minLength = 0, const Genome *coalescenceLimit = NULL,
+                              const Genome *mrca = NULL);
+        hal_size_t mapSegment(const SegmentSlice &source, std::vector<MappedRange> &outRanges, const Genome *tgtGenome,
+                              const std::set<const Genome *> *genomesOnPath = NULL, bool doDupes = true,
+                              hal_size_t minLength = 0, const Genome *coalescenceLimit = NULL,
+                              const Genome *mrca = NULL);
+
+        /** Map source to tgtGenome as halMapSegment does, adding the mapped
+         * segments to outSegments. */
+        hal_size_t mapSegment(const SegmentIterator *source, MappedSegmentSet &outSegments, const Genome *tgtGenome,
+                              const std::set<const Genome *> *genomesOnPath = NULL, bool doDupes = true,
+                              hal_size_t minLength = 0, const Genome *coalescenceLimit = NULL,
+                              const Genome *mrca = NULL);
+
+        /** Map source to each genome in tgtGenomes, appending the mappings
+         * to tgtGenomes[i] to outRanges[i] as mapSegment would with the
+         * default path, MRCA and coalescence limit.  outRanges is resized
+         * to the number of targets.  Rather than walking up to the MRCA and
+         * back down for each target, the tree is walked once: the mappings
+         * into each ancestor of the source are shared by all targets whose
+         * MRCA with the source is at or above it, and the mappings into each
+         * genome on the way down by all targets below it.  Returns the total
+         * number of mappings added. */
+        hal_size_t mapSegmentToMany(const SegmentIterator *source, const std::vector<const Genome *> &tgtGenomes,
+                                    std::vector<std::vector<MappedRange>> &outRanges, bool doDupes = true,
+                                    hal_size_t minLength = 0);
+
+        /** Map source to each genome in tgtGenomes as halMapSegmentToMany
+         * does. */
+        hal_size_t mapSegmentToMany(const SegmentIterator *source, const std::vector<const Genome *> &tgtGenomes,
+                                    std::vector<MappedSegmentSet> &outSegments, bool doDupes = true,
+                                    hal_size_t minLength = 0);
+
+      private:
+        SegmentMapper(const SegmentMapper &);
+        SegmentMapper &operator=(const SegmentMapper &);
+
+        /* a source slice and the slice of some genome it is aligned to */
+        struct Mapping {
+            SegmentSlice _source;
+            SegmentSlice _target;
+        };
+        typedef std::vector<Mapping> MappingList;
+        class ScratchList;
+
+        /* iterators used to read one genome's segments */
+        struct SegmentReader {
+            const Genome *_genome;
+            TopSegmentIteratorPtr _top;
+            BottomSegmentIteratorPtr _bottom;
+        };
+
+        void mapToList(const SegmentSlice &source, MappingList &output, const Genome *tgtGenome,
+                       const std::set<const Genome *> *genomesOnPath, bool doDupes, hal_size_t minLength,
+                       const Genome *coalescenceLimit, const Genome *mrca);
+        void mapToMany(const SegmentSlice &source, const std::vector<const Genome *> &tgtGenomes, bool doDupes,
+                       hal_size_t minLength);
+        void setManyTargets(const Genome *srcGenome, const std::vector<const Genome *> &tgtGenomes);
+        void mapDownToMany(MappingList &input, size_t depth, size_t begin, size_t end, bool doDupes,
+                           hal_size_t minLength);
+        void setPath(const Genome *tgtGenome, const std::set<const Genome *> *genomesOnPath);
+        hal_size_t getChildOnPath(const Genome *genome, const Genome *tgtGenome);
+        void mapUp(const Mapping &mapping, MappingList &results, bool doDupes, hal_size_t minLength);
+        void mapDown(const Mapping &mapping, hal_size_t childIndex, MappingList &results, hal_size_t minLength);
+        void mapSelf(const Mapping &mapping, MappingList &results, hal_size_t minLength);
+        void mapRecursiveUp(MappingList &input, MappingList &results, const Genome *tgtGenome, hal_size_t minLength);
+        void mapRecursiveDown(MappingList &input, MappingList &results, const Genome *tgtGenome, bool doDupes,
+                              hal_size_t minLength);
+        void mapRecursiveParalogies(const Genome *srcGenome, MappingList &input, MappingList &results,
+                                    const Genome *coalescenceLimit, hal_size_t minLength);
+        void sortAndUnique(MappingList &mappings);
+        int compare(const SegmentSlice &s1, const SegmentSlice &s2);
+        int boundCompare(const SegmentSlice &s1, const SegmentSlice &s2);
+        int positionCompare(const SegmentSlice &s1, const SegmentSlice &s2);
+
+        SegmentReader &getReader(const Genome *genome);
+        const TopSegment *getTopSegment(const Genome *genome, hal_index_t arrayIndex);
+        const BottomSegment *getBottomSegment(const Genome *genome, hal_index_t arrayIndex);
+        const Segment *getSegment(const SegmentSlice &slice);
+        hal_index_t getStartPosition(const SegmentSlice &slice);
+        hal_index_t getEndPosition(const SegmentSlice &slice);
+        hal_size_t getLength(const SegmentSlice &slice);
+        bool overlaps(const SegmentSlice &slice, hal_index_t genomePos);
+        SegmentSlice toParseUp(const SegmentSlice &bottom);
+        SegmentSlice toParseDown(const SegmentSlice &top);
+        void toRight(SegmentSlice &slice, hal_index_t rightCutoff);
+        void toRange(const Mapping &mapping, MappedRange &range);
+
+        std::vector<SegmentReader> _readers;
+        std::vector<std::unique_ptr<MappingList>> _lists;
+        size_t _numListsUsed;
+        MappingList _output;
+
+        // path to the last target, and the children found on it
+        std::set<const Genome *> _pathGenomes;
+        std::set<std::string> _namesOnPath;
+        std::vector<std::pair<const Genome *, hal_size_t>> _childrenOnPath;
+        const Genome *_childrenTgtGenome;
+
+        // targets of the last mapToMany, with the genomes from the MRCA down
+        // to each, and the number of steps up from the source to the MRCA.
+        // _manyOrder sorts the targets by MRCA then path, so that the
+        // targets below any genome on the way down are contiguous in it.
+        const Genome *_manySrcGenome;
+        std::vector<const Genome *> _manyTargets;
+        std::vector<std::vector<const Genome *>> _manyPaths;
+        std::vector<size_t> _manyLevels;
+        std::vector<size_t> _manyOrder;
+        std::vector<MappingList> _manyOutput;
+    };
+
+    /** Interval of a source genome for halMapIntervals: the closed range
+     * [_start, _end] in genome (not sequence) coordinates, mapped from the
+     * reverse strand if _reversed is set. */
+    struct MapInterval {
+        hal_index_t _start;
+        hal_index_t _end;
+        bool _reversed;
+    };
+
+    /** Maps intervals of one source genome to one target genome.  The result
+     * of mapInterval() is the same as calling halMapSegment on each slice of
+     * a source segment covering the interval, but the MRCA and paths are only
+     * computed once, and a source segment overlapping several intervals is
+     * only mapped through the tree once: its mappings are cached and clipped
+     * to each interval.  Intervals should be given in sorted order to get the
+     * benefit of the cache (unsorted input is mapped correctly, just more
+     * slowly).  When minLength is nonzero, the cache is not used since
+     * clipping a mapping changes which segments pass the filter.  Parameters
+     * are as for halMapSegment. */
+    class IntervalMapper {
+      public:
+        IntervalMapper(const Genome *srcGenome, const Genome *tgtGenome, bool doDupes = true, hal_size_t minLength = 0,
+                       const Genome *coalescenceLimit = NULL, const Genome *mrca = NULL);
+
+        /** Map [start, end] of the source genome, adding the mapped
+         * segments to outSegments.  Returns the number of mapped segments
+         * found. */
+        hal_size_t mapInterval(hal_index_t start, hal_index_t end, bool reversed, MappedSegmentSet &outSegments);
+
+      private:
+        /* a mapping of a whole source segment, with the forward range of its
+         * source and the maximum _srcEnd of it and all mappings before it */
+        struct CachedMapping {
+            hal_index_t _srcStart;
+            hal_index_t _srcEnd;
+            hal_index_t _maxSrcEnd;
+            MappedRange _range;
+        };
+        /* mappings of the current source segment in one orientation, sorted
+         * by _srcStart */
+        struct CachedSegment {
+            hal_index_t _arrayIndex;
+            std::vector<CachedMapping> _mappings;
+        };
+        const std::vector<CachedMapping> &getSegmentMappings(bool reversed);
+
+        const Genome *_srcGenome;
+        const Genome *_tgtGenome;
+        bool _doDupes;
+        hal_size_t _minLength;
+        const Genome *_coalescenceLimit;
+        const Genome *_mrca;
+        std::set<const Genome *> _genomesOnPath;
+        SegmentMapper _mapper;
+        std::vector<MappedRange> _ranges;
+        SegmentIteratorPtr _srcSegIt;
+        hal_index_t _numSrcSegments;
+        CachedSegment _cache[2];
+    };
+
+    /** Map a batch of intervals of srcGenome to tgtGenome with an
+     * IntervalMapper, which see.  resultFunc(i, mappedSegments) is called
+     * with the segments mapped from intervals[i], in order. */
+    void halMapIntervals(const Genome *srcGenome, const std::vector<MapInterval> &intervals, const Genome *tgtGenome,
+                         const std::function<void(size_t, MappedSegmentSet &)> &resultFunc, bool doDupes = true,
+                         hal_size_t minLength = 0, const Genome *coalescenceLimit = NULL, const Genome *mrca = NULL);
 }
 #endif
@@ -159,6 +159,17 @@ namespace hal {
          * @param length Length of substring */
         virtual void getSubString(std::string &outString, hal_size_t start, hal_size_t length) const = 0;
 
+        /** Get a substring into a caller-provided buffer, decoding it in bulk,
+         * which is much faster than going through a DnaIterator a base at a
+         * time.  The buffer isn't null-terminated.
+         * @param outBuffer Buffer of at least length characters
+         * @param start First position of substring
+         * @param length Length of substring
+         * @param reverseComplement Get the reverse complement of the substring
+         * @param upperCase Upper-case the bases */
+        virtual void getSubString(char *outBuffer, hal_size_t start, hal_size_t length, bool reverseComplement = false,
+                                  bool upperCase = false) const = 0;
+
         /** Set the character string underlying the sequence
           * @param inString input string to copy
           * @param start First position of substring
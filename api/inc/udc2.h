@@ -201,6 +201,15 @@ void *udc2MMapFetch(struct udc2File *file, bits64 offset, bits64 size);
  * maybe returned.  Maybe called multiple times on a range or overlapping
  * returns. */
 
+boolean udc2MMapTryFetch(struct udc2File *file, bits64 offset, bits64 size, char **retError);
+/* Like udc2MMapFetch, but return FALSE rather than aborting if the range
+ * can't be fetched, for speculative reads such as read-ahead.  If retError
+ * is not NULL, it is set to the error message, to be freed with
+ * udc2FreeMem, or NULL on success. */
+
+bits64 udc2NetBytesRead(struct udc2File *file);
+/* Return the number of bytes read over the network by this handle. */
+
     
 /* below are added to avoid comflicts with including common.h */
 void udc2VerboseSetLevel(int l);
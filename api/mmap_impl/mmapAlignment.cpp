@@ -1,15 +1,19 @@
 #include "mmapAlignment.h"
+#include "halBottomSegmentIterator.h"
 #include "halCLParser.h"
+#include "halSequenceIterator.h"
 #include "mmapGenome.h"
+#include <algorithm>
 
 using namespace hal;
 using namespace std;
 
 static const int NAME_HASH_GROWTH_FACTOR = 1024; // allow lots of initial space
 
-MMapAlignment::MMapAlignment(const std::string &alignmentPath, unsigned mode, size_t fileSize)
-    : _alignmentPath(alignmentPath), _mode(mode), _fileSize(fileSize), _file(NULL), _data(NULL), _genomeNameHash(NULL),
-      _tree(NULL) {
+MMapAlignment::MMapAlignment(const std::string &alignmentPath, unsigned mode, size_t fileSize, MMapDnaEncoding dnaEncoding,
+                             MMapSegmentLayout segmentLayout)
+    : _alignmentPath(alignmentPath), _mode(mode), _fileSize(fileSize), _dnaEncoding(dnaEncoding),
+      _segmentLayout(segmentLayout), _file(NULL), _data(NULL), _genomeNameHash(NULL), _tree(NULL) {
     _file = MMapFile::factory(alignmentPath, mode, fileSize);
     if (mode & CREATE_ACCESS) {
         create();
@@ -19,8 +23,8 @@ MMapAlignment::MMapAlignment(const std::string &alignmentPath, unsigned mode, si
 }
 
 MMapAlignment::MMapAlignment(const std::string &alignmentPath, unsigned mode, const CLParser *parser)
-    : _alignmentPath(alignmentPath), _mode(halDefaultAccessMode(mode)), _fileSize(0), _file(NULL), _data(NULL),
-      _genomeNameHash(NULL), _tree(NULL) {
+    : _alignmentPath(alignmentPath), _mode(halDefaultAccessMode(mode)), _fileSize(0), _dnaEncoding(MMAP_DNA_NIBBLE),
+      _segmentLayout(MMAP_SEGMENTS_ROW), _file(NULL), _data(NULL), _genomeNameHash(NULL), _tree(NULL) {
     initializeFromOptions(parser);
     _file = MMapFile::factory(alignmentPath, _mode, _fileSize);
     if (mode & CREATE_ACCESS) {
@@ -31,6 +35,14 @@ MMapAlignment::MMapAlignment(const std::string &alignmentPath, unsigned mode, co
 }
 
 void MMapAlignment::close() {
+    clearMappingPaths();
+    // DNA of genomes written in the two-bit encoding is held in memory
+    // until they are closed
+    if (!_file->isReadOnly()) {
+        for (auto kv : _openGenomes) {
+            kv.second->encodeStagedDna();
+        }
+    }
     // Free the memory used by all open genomes.
     for (auto kv : _openGenomes) {
         delete kv.second;
@@ -41,11 +53,28 @@ void MMapAlignment::close() {
     _file->close();
 }
 
+void MMapAlignment::closeGenome(const Genome *genome) const {
+    perfCount(PERF_GENOME_CLOSES);
+    if (!_file->isReadOnly()) {
+        lock_guard<mutex> lock(_openGenomesMutex);
+        map<string, MMapGenome *>::iterator mapIt = _openGenomes.find(genome->getName());
+        if (mapIt != _openGenomes.end()) {
+            mapIt->second->encodeStagedDna();
+        }
+    }
+}
+
 void MMapAlignment::defineOptions(CLParser *parser, unsigned mode) {
     if (mode & CREATE_ACCESS) {
-        parser->addOption("mmapFileSize", "mmap HAL file initial size (in gigabytes)", MMAP_DEFAULT_FILE_SIZE_GB);
+        parser->addOption("mmapFileSize", "mmap HAL file initial size (in gigabytes), it grows as needed", MMAP_DEFAULT_FILE_SIZE_GB);
+        parser->addOption("mmapDnaEncoding", "DNA encoding of new mmap HAL file: 4bit, or 2bit which is about half "
+                                             "the size but holds the DNA of genomes being written in memory",
+                          "4bit");
+        parser->addOption("mmapSegmentLayout", "segment layout of new mmap HAL file: row, or columnar which stores "
+                                               "each segment field separately, for faster scans",
+                          "row");
     } else if (mode & WRITE_ACCESS) {
-        parser->addOption("mmapSizeIncrease", "additional space to reserve at end of file (in gigabytes)", 1);
+        parser->addOption("mmapSizeIncrease", "initial additional space at end of file (in gigabytes), it grows as needed", 1);
     }
 }
 
@@ -53,6 +82,22 @@ void MMapAlignment::defineOptions(CLParser *parser, unsigned mode) {
 void MMapAlignment::initializeFromOptions(const CLParser *parser) {
     if (_mode & CREATE_ACCESS) {
         _fileSize = GIGABYTE * parser->get<size_t>("mmapFileSize");
+        string dnaEncoding = parser->getOption<string>("mmapDnaEncoding");
+        if (dnaEncoding == "4bit") {
+            _dnaEncoding = MMAP_DNA_NIBBLE;
+        } else if (dnaEncoding == "2bit") {
+            _dnaEncoding = MMAP_DNA_TWO_BIT;
+        } else {
+            throw hal_exception("invalid --mmapDnaEncoding " + dnaEncoding + ", expected 4bit or 2bit");
+        }
+        string segmentLayout = parser->getOption<string>("mmapSegmentLayout");
+        if (segmentLayout == "row") {
+            _segmentLayout = MMAP_SEGMENTS_ROW;
+        } else if (segmentLayout == "columnar") {
+            _segmentLayout = MMAP_SEGMENTS_COLUMNAR;
+        } else {
+            throw hal_exception("invalid --mmapSegmentLayout " + segmentLayout + ", expected row or columnar");
+        }
     } else if (_mode & WRITE_ACCESS) {
         // TODO: this causes _fileSize's meaning to be far too
         // overloaded: sometimes (CREATE_ACCESS) it is a requested
@@ -65,6 +110,8 @@ void MMapAlignment::initializeFromOptions(const CLParser *parser) {
 }
 
 void MMapAlignment::create() {
+    _file->setDnaEncoding(_dnaEncoding);
+    _file->setSegmentLayout(_segmentLayout);
     _file->allocMem(sizeof(MMapAlignmentData), true);
     _data = static_cast<MMapAlignmentData *>(resolveOffset(_file->getRootOffset(), sizeof(MMapAlignmentData)));
     _data->_numGenomes = 0;
@@ -129,22 +176,21 @@ void MMapAlignment::addGenomeToNameHash(const MMapGenome *genome, vector<string>
 }
 
 Genome *MMapAlignment::addLeafGenome(const string &name, const string &parentName, double branchLength) {
-    _childNames.clear();
+    clearMappingPaths();
+    clearChildNames();
     stTree *parentNode = getGenomeNode(parentName);
     stTree *childNode = stTree_construct();
     stTree_setLabel(childNode, name.c_str());
     stTree_setParent(childNode, parentNode);
     stTree_setBranchLength(childNode, branchLength);
     writeTree();
-    vector<string> existingNames = _data->getGenomeNames(this);
-    MMapGenome *genome = _data->addGenome(this, name);
-    addGenomeToNameHash(genome, existingNames);
-    _openGenomes[name] = genome;
-    return genome;
+    reloadOpenGenome(parentName);
+    return addNewGenome(name);
 }
 
 Genome *MMapAlignment::addRootGenome(const string &name, double branchLength) {
-    _childNames.clear();
+    clearMappingPaths();
+    clearChildNames();
     stTree *newRoot = stTree_construct();
     stTree_setLabel(newRoot, name.c_str());
     if (_tree != NULL) {
@@ -153,6 +199,55 @@ Genome *MMapAlignment::addRootGenome(const string &name, double branchLength) {
     }
     _tree = newRoot;
     writeTree();
+    return addNewGenome(name);
+}
+
+Genome *MMapAlignment::insertGenome(const string &name, const string &parentName, const string &childName,
+                                    double upperBranchLength) {
+    clearMappingPaths();
+    if (name.empty() || parentName.empty() || childName.empty()) {
+        throw hal_exception("name can't be empty");
+    }
+    if (stTree_findChild(_tree, name.c_str()) != NULL) {
+        throw hal_exception("node " + name + " already exists");
+    }
+    stTree *childNode = getGenomeNode(childName);
+    stTree *parentNode = stTree_getParent(childNode);
+    if (parentNode == NULL || stTree_getLabel(parentNode) != parentName) {
+        throw hal_exception("no edge between " + parentName + " and " + childName);
+    }
+    double lowerBranchLength = stTree_getBranchLength(childNode) - upperBranchLength;
+    stTree *newNode = stTree_construct();
+    stTree_setLabel(newNode, name.c_str());
+    stTree_setParent(newNode, parentNode);
+    stTree_setBranchLength(newNode, upperBranchLength);
+    stTree_setParent(childNode, newNode);
+    stTree_setBranchLength(childNode, lowerBranchLength);
+    writeTree();
+    reloadOpenGenome(parentName);
+    reloadOpenGenome(childName);
+    return addNewGenome(name);
+}
+
+void MMapAlignment::removeGenome(const string &name) {
+    clearMappingPaths();
+    stTree *node = getGenomeNode(name);
+    if (stTree_getChildNumber(node) != 0) {
+        throw hal_exception("node " + name + " has a child");
+    }
+    stTree *parentNode = stTree_getParent(node);
+    if (parentNode == NULL) {
+        throw hal_exception("can't remove " + name + ", the only genome in the alignment");
+    }
+    MMapGenome *parent = static_cast<MMapGenome *>(openGenome(stTree_getLabel(parentNode)));
+    removeChildFromBottomSegments(parent, node);
+    stTree_destruct(node);
+    removeFromGenomeArray(name);
+}
+
+/* add a genome that is already in the tree to the genome array and the
+ * name hash */
+MMapGenome *MMapAlignment::addNewGenome(const string &name) {
     vector<string> existingNames = _data->getGenomeNames(this);
     MMapGenome *genome = _data->addGenome(this, name);
     addGenomeToNameHash(genome, existingNames);
@@ -160,10 +255,109 @@ Genome *MMapAlignment::addRootGenome(const string &name, double branchLength) {
     return genome;
 }
 
+/* Detach a leaf from the tree and drop its column from the parent's bottom
+ * segments.  The number of children is part of the bottom segment layout,
+ * so the segments are saved and written back to a new array. */
+void MMapAlignment::removeChildFromBottomSegments(MMapGenome *parent, stTree *childNode) {
+    vector<string> childNames = getChildNames(parent->getName());
+    hal_size_t numChildren = childNames.size();
+    hal_size_t removedChild = find(childNames.begin(), childNames.end(), stTree_getLabel(childNode)) - childNames.begin();
+    assert(removedChild < numChildren);
+    hal_size_t n = parent->getNumBottomSegments();
+
+    vector<hal_index_t> starts(n);
+    vector<hal_size_t> lengths(n);
+    vector<hal_index_t> topParseIndexes(n);
+    vector<hal_index_t> childIndexes;
+    vector<bool> childReversed;
+    childIndexes.reserve(n * (numChildren - 1));
+    childReversed.reserve(n * (numChildren - 1));
+    BottomSegmentIteratorPtr botIt = parent->getBottomSegmentIterator(0);
+    for (hal_size_t i = 0; i < n; ++i, botIt->toRight()) {
+        starts[i] = botIt->getStartPosition();
+        lengths[i] = botIt->getLength();
+        topParseIndexes[i] = botIt->bseg()->getTopParseIndex();
+        for (hal_size_t child = 0; child < numChildren; ++child) {
+            if (child != removedChild) {
+                childIndexes.push_back(botIt->bseg()->getChildIndex(child));
+                childReversed.push_back(botIt->bseg()->getChildReversed(child));
+            }
+        }
+    }
+
+    stTree_setParent(childNode, NULL);
+    writeTree();
+    parent->reload();
+
+    vector<Sequence::UpdateInfo> bottomDimensions;
+    for (SequenceIteratorPtr seqIt = parent->getSequenceIterator(0); not seqIt->atEnd(); seqIt->toNext()) {
+        const Sequence *sequence = seqIt->getSequence();
+        bottomDimensions.push_back(Sequence::UpdateInfo(sequence->getName(), sequence->getNumBottomSegments()));
+    }
+    parent->updateBottomDimensions(bottomDimensions);
+    botIt = parent->getBottomSegmentIterator(0);
+    for (hal_size_t i = 0, j = 0; i < n; ++i, botIt->toRight()) {
+        botIt->setCoordinates(starts[i], lengths[i]);
+        for (hal_size_t child = 0; child < numChildren - 1; ++child, ++j) {
+            botIt->bseg()->setChildIndex(child, childIndexes[j]);
+            botIt->bseg()->setChildReversed(child, childReversed[j]);
+        }
+        botIt->bseg()->setTopParseIndex(topParseIndexes[i]);
+    }
+}
+
+/* Close a removed genome and shift the genomes after it down the array.
+ * Its data is left in the file as dead space. */
+void MMapAlignment::removeFromGenomeArray(const string &name) {
+    hal_index_t index = _genomeNameHash->getIndex(name);
+    MMapGenomeData *genomeArray = getGenomeArray();
+    assert(genomeArray[index].getName(this) == name);
+    auto openGenomeIt = _openGenomes.find(name);
+    if (openGenomeIt != _openGenomes.end()) {
+        delete openGenomeIt->second;
+        _openGenomes.erase(openGenomeIt);
+    }
+    memmove(genomeArray + index, genomeArray + index + 1, (_data->_numGenomes - index - 1) * sizeof(MMapGenomeData));
+    _data->_numGenomes--;
+    for (auto &name_genome : _openGenomes) {
+        MMapGenome *genome = name_genome.second;
+        if (genome->getArrayIndex() > index) {
+            genome->updateArrayIndex(genomeArray, genome->getArrayIndex() - 1);
+        }
+    }
+    rebuildGenomeNameHash();
+}
+
+/* rehash the names in the genome array, reusing the table's space */
+void MMapAlignment::rebuildGenomeNameHash() {
+    vector<string> names = _data->getGenomeNames(this);
+    _data->_genomeNameHashOffset = _genomeNameHash->addKeys(vector<string>(), names);
+    for (size_t i = 0; i < names.size(); i++) {
+        _genomeNameHash->setIndex(names[i], i);
+    }
+}
+
+/* an open genome caches its parent and children, which have to be looked
+ * up again when the tree changes around it */
+void MMapAlignment::reloadOpenGenome(const string &name) {
+    auto openGenomeIt = _openGenomes.find(name);
+    if (openGenomeIt != _openGenomes.end()) {
+        openGenomeIt->second->reload();
+    }
+}
+
+MMapGenomeData *MMapAlignment::getGenomeArray() const {
+    return static_cast<MMapGenomeData *>(
+        resolveOffset(_data->_genomeArrayOffset, _data->_numGenomes * sizeof(MMapGenomeData)));
+}
+
 Genome *MMapAlignment::_openGenome(const string &name) const {
-    if (_openGenomes.find(name) != _openGenomes.end()) {
+    // held while constructing, so concurrent readers get the same object
+    std::lock_guard<std::mutex> lock(_openGenomesMutex);
+    auto openGenomeIt = _openGenomes.find(name);
+    if (openGenomeIt != _openGenomes.end()) {
         // Already loaded.
-        return _openGenomes[name];
+        return openGenomeIt->second;
     }
     if (_genomeNameHash == NULL) {
         return NULL;
@@ -172,13 +366,12 @@ Genome *MMapAlignment::_openGenome(const string &name) const {
     if (genomeIndex == NULL_INDEX) {
         return NULL;
     }
-    // FIXME: put this in a function
-    MMapGenomeData *genomeDataArray =
-        (MMapGenomeData *)resolveOffset(_data->_genomeArrayOffset, _data->_numGenomes * sizeof(MMapGenomeData));
+    MMapGenomeData *genomeDataArray = getGenomeArray();
     if (genomeDataArray[genomeIndex].getName(const_cast<MMapAlignment *>(this)) != name) {
         return NULL; // name not in perfect hash
     }
     MMapGenome *genome = new MMapGenome(const_cast<MMapAlignment *>(this), &genomeDataArray[genomeIndex], genomeIndex);
     _openGenomes[name] = genome;
+    perfCount(PERF_GENOME_OPENS);
     return genome;
 }
@@ -1,16 +1,19 @@
 #ifndef _MMAPALIGNMENT_H
 #define _MMAPALIGNMENT_H
 #include "halAlignment.h"
+#include "halPerfStats.h"
 #include "mmapFile.h"
 #include "mmapPerfectHashTable.h"
 #include "sonLib.h"
 #include <deque>
 #include <map>
+#include <mutex>
 
 namespace hal {
     class CLParser;
     class MMapAlignment;
     class MMapGenome;
+    class MMapGenomeData;
     class MMapAlignmentData {
         friend class MMapAlignment;
 
@@ -35,7 +38,8 @@ namespace hal {
 
       public:
         /* constructor with all arguments specified */
-        MMapAlignment(const std::string &alignmentPath, unsigned mode = READ_ACCESS, size_t fileSize = MMAP_DEFAULT_FILE_SIZE);
+        MMapAlignment(const std::string &alignmentPath, unsigned mode = READ_ACCESS, size_t fileSize = MMAP_DEFAULT_FILE_SIZE,
+                      MMapDnaEncoding dnaEncoding = MMAP_DNA_NIBBLE, MMapSegmentLayout segmentLayout = MMAP_SEGMENTS_ROW);
 
         /* constructor from command line options */
         MMapAlignment(const std::string &alignmentPath, unsigned mode, const CLParser *parser);
@@ -63,21 +67,20 @@ namespace hal {
         MMapFile *getMMapFile() {
             return _file;
         }
+        const MMapFile *getMMapFile() const {
+            return _file;
+        }
 
         Genome *addLeafGenome(const std::string &name, const std::string &parentName, double branchLength);
 
         Genome *addRootGenome(const std::string &name, double branchLength);
 
-        void removeGenome(const std::string &name) {
-            // FIXME
-            throw hal_exception("unimplemented; don't want to deal with this right now.");
-        };
+        /* Only leaves can be removed.  The space used by the genome isn't
+         * reclaimed until the file is rewritten (see halCompact). */
+        void removeGenome(const std::string &name);
 
         Genome *insertGenome(const std::string &name, const std::string &parentName, const std::string &childName,
-                             double upperBranchLength) {
-            // FIXME
-            throw hal_exception("unimplemented; don't want to deal with this right now.");
-        };
+                             double upperBranchLength);
 
         const Genome *openGenome(const std::string &name) const {
             return const_cast<const Genome *>(_openGenome(name));
@@ -87,9 +90,10 @@ namespace hal {
             return _openGenome(name);
         }
 
-        void closeGenome(const Genome *genome) const {
-            // Intentionally left blank.
-        };
+        /* Genomes stay open until the alignment is closed, but the DNA of
+         * a two-bit genome being written is encoded into the file now
+         * rather than kept in memory. */
+        void closeGenome(const Genome *genome) const;
 
         std::string getRootName() const {
             return stTree_getLabel(_tree);
@@ -125,31 +129,30 @@ namespace hal {
         };
 
         std::vector<std::string> getChildNames(const std::string &name) const {
-            if (_childNames.find(name) != _childNames.end()) {
-                return _childNames[name];
-            } else {
-                _fillChildNames(name);
-                return _childNames[name];
-            }
+            return getChildNamesRef(name);
         }
 
+        /* map entries are never moved, so the reference remains valid until
+         * the tree is modified */
         std::vector<std::string> &getChildNamesRef(const std::string &name) const {
-            if (_childNames.find(name) != _childNames.end()) {
-                return _childNames[name];
+            std::lock_guard<std::mutex> lock(_childNamesMutex);
+            auto childNamesIt = _childNames.find(name);
+            if (childNamesIt != _childNames.end()) {
+                return childNamesIt->second;
             } else {
-                _fillChildNames(name);
-                return _childNames[name];
+                return _fillChildNames(name);
             }
         }
 
-        void _fillChildNames(const std::string &name) const {
+        /* _childNamesMutex must be held */
+        std::vector<std::string> &_fillChildNames(const std::string &name) const {
             stTree *node = getGenomeNode(name);
             std::vector<std::string> childNames;
             for (int64_t i = 0; i < stTree_getChildNumber(node); i++) {
                 const char *name = stTree_getLabel(stTree_getChild(node, i));
                 childNames.push_back(std::string(name));
             }
-            _childNames[name] = childNames;
+            return _childNames[name] = childNames;
         };
 
         std::vector<std::string> getLeafNamesBelow(const std::string &name) const {
@@ -195,7 +198,14 @@ namespace hal {
             return _file->isReadOnly();
         };
 
+        /* read-only files are safe to share between threads, see
+         * halAlignmentInstance.h */
+        bool supportsConcurrentReads() const {
+            return _file->isReadOnly();
+        }
+
         void replaceNewickTree(const std::string &newNewickString) {
+            clearMappingPaths();
             _data->setNewickString(this, newNewickString.c_str());
             loadTree();
         };
@@ -205,6 +215,12 @@ namespace hal {
         void create();
         void open();
         void addGenomeToNameHash(const MMapGenome *genome, vector<string> &existingNames);
+        MMapGenome *addNewGenome(const std::string &name);
+        void rebuildGenomeNameHash();
+        void removeFromGenomeArray(const std::string &name);
+        void removeChildFromBottomSegments(MMapGenome *parent, stTree *childNode);
+        void reloadOpenGenome(const std::string &name);
+        MMapGenomeData *getGenomeArray() const;
         Genome *_openGenome(const std::string &name) const;
         stTree *getGenomeNode(const std::string &name) const {
             stTree *node = stTree_findChild(_tree, name.c_str());
@@ -223,19 +239,31 @@ namespace hal {
             _tree = stTree_parseNewickString(_data->getNewickString(this));
         };
         void writeTree() {
-            _childNames.clear();
+            clearChildNames();
             char *newickString = stTree_getNewickTreeString(_tree);
             _data->setNewickString(this, newickString);
             free(newickString);
         };
+        void clearChildNames() {
+            std::lock_guard<std::mutex> lock(_childNamesMutex);
+            _childNames.clear();
+        }
+
+        /* Lazily filled caches are protected by mutexes to allow read-only
+         * alignments to be shared between threads.  All other state is
+         * either immutable after open or lives in the mapped file. */
+        mutable std::mutex _openGenomesMutex;
         mutable std::map<std::string, MMapGenome *> _openGenomes;
         std::string _alignmentPath;
         unsigned _mode;
         size_t _fileSize;
+        MMapDnaEncoding _dnaEncoding; // only used on create
+        MMapSegmentLayout _segmentLayout; // only used on create
         MMapFile *_file;
         MMapAlignmentData *_data;
         MMapPerfectHashTable *_genomeNameHash;
         stTree *_tree;
+        mutable std::mutex _childNamesMutex;
         mutable std::map<std::string, std::vector<std::string>> _childNames;
     };
 
@@ -10,18 +10,24 @@ namespace hal {
     class MMapBottomSegment : public BottomSegment {
       public:
         MMapBottomSegment(MMapGenome *genome, hal_index_t arrayIndex)
-            : BottomSegment(genome, arrayIndex), _data(genome->getBottomSegmentPointer(arrayIndex)) {
+            : BottomSegment(genome, arrayIndex), _columns(genome->getBottomSegmentColumns()),
+              _data(_columns.isColumnar() ? NULL : genome->getBottomSegmentPointer(arrayIndex)) {
         }
 
         // SEGMENT INTERFACE
         void setArrayIndex(Genome *genome, hal_index_t arrayIndex) {
-            _genome = genome;
-            _data = getMMapGenome()->getBottomSegmentPointer(arrayIndex);
+            if (genome != _genome) {
+                _genome = genome;
+                _columns = getMMapGenome()->getBottomSegmentColumns();
+            }
+            if (!_columns.isColumnar()) {
+                _data = getMMapGenome()->getBottomSegmentPointer(arrayIndex);
+            }
             _index = arrayIndex;
         };
         const Sequence *getSequence() const;
         hal_index_t getStartPosition() const {
-            return _data->getStartPosition();
+            return _columns.isColumnar() ? _columns.startPosition(_index) : _data->getStartPosition();
         };
         hal_index_t getEndPosition() const;
         hal_size_t getLength() const;
@@ -34,25 +40,40 @@ namespace hal {
         // BOTTOM SEGMENT INTERFACE
         hal_size_t getNumChildren() const;
         hal_index_t getChildIndex(hal_size_t i) const {
-            return _data->getChildIndex(i);
+            return _columns.isColumnar() ? _columns.childIndex(i, _index) : _data->getChildIndex(i);
         };
         hal_index_t getChildIndexG(const Genome *childGenome) const;
         bool hasChild(hal_size_t child) const;
         bool hasChildG(const Genome *childGenome) const;
         void setChildIndex(hal_size_t i, hal_index_t childIndex) {
-            _data->setChildIndex(i, childIndex);
+            if (_columns.isColumnar()) {
+                _columns.childIndex(i, _index) = childIndex;
+            } else {
+                _data->setChildIndex(i, childIndex);
+            }
         };
         bool getChildReversed(hal_size_t i) const {
+            if (_columns.isColumnar()) {
+                return _columns.getChildReversed(_genome->getNumChildren(), i, _index);
+            }
             return _data->getChildReversed(_genome->getNumChildren(), i);
         };
         void setChildReversed(hal_size_t child, bool isReversed) {
-            _data->setChildReversed(_genome->getNumChildren(), child, isReversed);
+            if (_columns.isColumnar()) {
+                _columns.setChildReversed(_genome->getNumChildren(), child, _index, isReversed);
+            } else {
+                _data->setChildReversed(_genome->getNumChildren(), child, isReversed);
+            }
         };
         hal_index_t getTopParseIndex() const {
-            return _data->getTopParseIndex();
+            return _columns.isColumnar() ? _columns.topParseIndex(_index) : _data->getTopParseIndex();
         };
         void setTopParseIndex(hal_index_t parseIndex) {
-            _data->setTopParseIndex(parseIndex);
+            if (_columns.isColumnar()) {
+                _columns.topParseIndex(_index) = parseIndex;
+            } else {
+                _data->setTopParseIndex(parseIndex);
+            }
         };
         hal_offset_t getTopParseOffset() const;
         bool hasParseUp() const;
@@ -68,7 +89,8 @@ namespace hal {
         MMapBottomSegmentData *getNextData() const {
             return (MMapBottomSegmentData *)(((char *)_data) + MMapBottomSegmentData::getSize(_genome));
         };
-        MMapBottomSegmentData *_data;
+        MMapBottomSegmentColumns _columns; // only used in the columnar layout
+        MMapBottomSegmentData *_data;      // only used in the row layout
     };
 
     inline hal_index_t MMapBottomSegment::getEndPosition() const {
@@ -76,6 +98,9 @@ namespace hal {
     }
 
     inline hal_size_t MMapBottomSegment::getLength() const {
+        if (_columns.isColumnar()) {
+            return _columns.startPosition(_index + 1) - _columns.startPosition(_index);
+        }
         return getNextData()->getStartPosition() - _data->getStartPosition();
     }
 
@@ -1,5 +1,6 @@
 #ifndef _MMAPBOTTOMSEGMENTDATA_H
 #define _MMAPBOTTOMSEGMENTDATA_H
+#include "mmapFile.h"
 
 namespace hal {
     class MMapBottomSegmentData {
@@ -50,6 +51,74 @@ namespace hal {
         hal_index_t _startPosition;
         hal_index_t _topParseIndex;
     };
+
+    /* Bottom segments of a genome in the MMAP_SEGMENTS_COLUMNAR layout, see
+     * MMapTopSegmentColumns.  The arrays are, in order:
+     *   start positions     hal_index_t[numSegments + 1]
+     *   top parse indexes   hal_index_t[numSegments]
+     *   child indexes       hal_index_t[numSegments] for each child
+     *   child reversed      one bit per segment, in uint64_t words, for each child
+     */
+    class MMapBottomSegmentColumns {
+      public:
+        MMapBottomSegmentColumns() : _file(NULL) {
+        }
+        MMapBottomSegmentColumns(MMapFile *file, size_t offset, hal_size_t numSegments) : _file(file) {
+            _numSegments = numSegments;
+            _startOffset = offset;
+            _topParseOffset = _startOffset + (numSegments + 1) * sizeof(hal_index_t);
+            _childIndexOffset = _topParseOffset + numSegments * sizeof(hal_index_t);
+        }
+
+        /* size of the block for numSegments and numChildren */
+        static size_t getSize(hal_size_t numSegments, hal_size_t numChildren) {
+            return ((2 + numChildren) * numSegments + 1) * sizeof(hal_index_t) +
+                   numChildren * getBitWords(numSegments) * sizeof(uint64_t);
+        }
+        static hal_size_t getBitWords(hal_size_t numSegments) {
+            return (numSegments + 63) / 64;
+        }
+
+        /* is this a view of columnar segments? */
+        bool isColumnar() const {
+            return _file != NULL;
+        }
+
+        hal_index_t &startPosition(hal_index_t index) const {
+            return field(_startOffset, index);
+        }
+        hal_index_t &topParseIndex(hal_index_t index) const {
+            return field(_topParseOffset, index);
+        }
+        hal_index_t &childIndex(hal_size_t child, hal_index_t index) const {
+            return field(_childIndexOffset + child * _numSegments * sizeof(hal_index_t), index);
+        }
+        bool getChildReversed(hal_size_t numChildren, hal_size_t child, hal_index_t index) const {
+            return (bitWord(numChildren, child, index) >> (index & 63)) & 1;
+        }
+        void setChildReversed(hal_size_t numChildren, hal_size_t child, hal_index_t index, bool reversed) const {
+            uint64_t &word = bitWord(numChildren, child, index);
+            uint64_t bit = uint64_t(1) << (index & 63);
+            word = reversed ? (word | bit) : (word & ~bit);
+        }
+
+      private:
+        hal_index_t &field(size_t columnOffset, hal_index_t index) const {
+            return *static_cast<hal_index_t *>(
+                _file->toPtr(columnOffset + index * sizeof(hal_index_t), sizeof(hal_index_t)));
+        }
+        uint64_t &bitWord(hal_size_t numChildren, hal_size_t child, hal_index_t index) const {
+            size_t offset = _childIndexOffset + numChildren * _numSegments * sizeof(hal_index_t) +
+                            (child * getBitWords(_numSegments) + index / 64) * sizeof(uint64_t);
+            return *static_cast<uint64_t *>(_file->toPtr(offset, sizeof(uint64_t)));
+        }
+
+        MMapFile *_file;
+        hal_size_t _numSegments;
+        size_t _startOffset;
+        size_t _topParseOffset;
+        size_t _childIndexOffset;
+    };
 }
 #endif
 // Local Variables:
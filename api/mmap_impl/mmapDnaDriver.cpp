@@ -11,11 +11,18 @@
 using namespace hal;
 
 static const int UDC_FETCH_SIZE = 64 * 1024; // size to bring in for UDC access
+static const int TWO_BIT_WINDOW_SIZE = 4096; // bases decoded at a time, power of 2
 
 MMapDnaAccess::MMapDnaAccess(MMapGenome *genome, hal_index_t index)
     : DnaAccess(0, 0, NULL), _genome(genome),
-      _isUdcProtocol(dynamic_cast<MMapAlignment *>(_genome->getAlignment())->getMMapFile()->isUdcProtocol()) {
-    if (_isUdcProtocol) {
+      _isUdcProtocol(dynamic_cast<MMapAlignment *>(_genome->getAlignment())->getMMapFile()->isUdcProtocol()),
+      _isTwoBitWindow(_genome->isTwoBitDna() && _genome->getAlignment()->isReadOnly()) {
+    if (_isTwoBitWindow) {
+        _window.resize(TWO_BIT_WINDOW_SIZE / 2);
+        if (_genome->getSequenceLength() > 0) {
+            fetch(std::min(index, hal_index_t(_genome->getSequenceLength() - 1)));
+        }
+    } else if (_isUdcProtocol) {
         fetch(index);
     } else {
         // for local mmap, just include the whole thing
@@ -25,14 +32,30 @@ MMapDnaAccess::MMapDnaAccess(MMapGenome *genome, hal_index_t index)
 }
 
 void MMapDnaAccess::flush() {
+    if (_dirty) {
+        if (_isTwoBitWindow) {
+            _dirty = false;
+            throw hal_exception("can't set DNA of genome " + _genome->getName() + " in read-only alignment");
+        } else if (_genome->isTwoBitDna()) {
+            _genome->setStagedDnaModified();
+        }
+    }
     // kernel handles page out
     _dirty = false;
 }
 
 void MMapDnaAccess::fetch(hal_index_t index) const {
-    if (_isUdcProtocol) {
+    if (_isTwoBitWindow) {
+        if ((index < 0) || (index >= (hal_index_t)_genome->getSequenceLength())) {
+            throw hal_exception("DNA index " + std::to_string(index) + " out of range for genome " + _genome->getName());
+        }
+        _startIndex = index & ~hal_index_t(TWO_BIT_WINDOW_SIZE - 1);
+        _endIndex = std::min(_startIndex + TWO_BIT_WINDOW_SIZE, hal_index_t(_genome->getSequenceLength()));
+        _genome->decodeTwoBitDna(_startIndex, _endIndex, _window.data());
+        _buffer = _window.data();
+    } else if (_isUdcProtocol) {
         _startIndex = 2 * (index / 2); // even boundary
-        _endIndex = std::max(hal_size_t(_startIndex + UDC_FETCH_SIZE), _genome->getSequenceLength());
+        _endIndex = std::min(hal_size_t(_startIndex + UDC_FETCH_SIZE), _genome->getSequenceLength());
         _buffer = _genome->getDNA(_startIndex / 2, (((_endIndex - _startIndex) + 1) / 2));
     } else {
         assert(false); // this should never be called for local
@@ -7,13 +7,17 @@
 #ifndef _MMAPDNADRIVER_H
 #define _MMAPDNADRIVER_H
 #include "halDnaDriver.h"
+#include <vector>
 
 namespace hal {
     class MMapGenome;
     class MMapAlignment;
 
     /**
-     * Mmap implementation of DnaAccess.
+     * Mmap implementation of DnaAccess.  Nibble-encoded DNA is accessed in
+     * place.  Two-bit DNA in read-only files is decoded a window at a time
+     * into a private nibble buffer, while in writable files the genome's
+     * in-memory nibble copy is used.
      */
     class MMapDnaAccess : public DnaAccess {
       public:
@@ -30,6 +34,8 @@ namespace hal {
       private:
         MMapGenome *_genome;
         bool _isUdcProtocol;
+        bool _isTwoBitWindow;
+        mutable std::vector<char> _window;
     };
 }
 
@@ -1,7 +1,12 @@
 #include "mmapFile.h"
 #include "halCommon.h"
+#include "halPerfStats.h"
+#include "mmapReadAhead.h"
+#include <algorithm>
 #include <errno.h>
 #include <fcntl.h>
+#include <memory>
+#include <mutex>
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/types.h>
@@ -16,12 +21,28 @@ extern "C" {
 /* constants for header */
 static const std::string FORMAT_NAME = "HAL-MMAP";
 
+/* Address space reserved for a file open for write access, which is how
+ * far it can grow without moving.  This is only address space, not memory
+ * or disk. */
+static const size_t MMAP_WRITE_ADDRESS_RESERVE = 16384 * GIGABYTE;
+
+/* Files grow by doubling, but by at least the minimum and at most the
+ * maximum, as the unused part is trimmed on close. */
+static const size_t MMAP_MIN_GROW_SIZE = GIGABYTE;
+static const size_t MMAP_MAX_GROW_SIZE = 64 * GIGABYTE;
+
 /* get current version as a string */
 static const std::string& getMmapApiVersion() {
-    static std::string version;
-    if (version == "") {
-        version = std::to_string(hal::MMAP_API_MAJOR_VERSION) + "." + std::to_string(hal::MMAP_API_MINOR_VERSION);
-    }
+    // initialization of local statics is thread-safe
+    static const std::string version =
+        std::to_string(hal::MMAP_API_MAJOR_VERSION) + "." + std::to_string(hal::MMAP_API_MINOR_VERSION);
+    return version;
+}
+
+/* get the version of files that 1.x readers can't read as a string */
+static const std::string& getMmapExtendedVersion() {
+    static const std::string version = std::to_string(hal::MMAP_API_EXTENDED_MAJOR_VERSION) + "." +
+                                       std::to_string(hal::MMAP_API_EXTENDED_MINOR_VERSION);
     return version;
 }
 
@@ -66,7 +87,7 @@ void hal::MMapFile::parseCheckVersion() {
                             + fileVersion.substr(0, 20));
     }
     
-    if (_majorVersion != MMAP_API_MAJOR_VERSION) {
+    if ((_majorVersion != MMAP_API_MAJOR_VERSION) && (_majorVersion != MMAP_API_EXTENDED_MAJOR_VERSION)) {
         throw hal_exception(_alignmentPath + ": incompatible mmap major versions: " + "file version " + _version +
                             ", mmap API version " + getMmapApiVersion());
     }
@@ -96,6 +117,14 @@ void hal::MMapFile::loadHeader(bool markDirty) {
     if (_header->dirty) {
         throw hal_exception(_alignmentPath + ": file is marked as dirty, most likely an inconsistent state.");
     }
+    if (_header->dnaEncoding > MMAP_DNA_TWO_BIT) {
+        throw hal_exception(_alignmentPath + ": unknown DNA encoding " + std::to_string(_header->dnaEncoding) +
+                            ", file was probably written by a newer version of HAL");
+    }
+    if (_header->segmentLayout > MMAP_SEGMENTS_COLUMNAR) {
+        throw hal_exception(_alignmentPath + ": unknown segment layout " + std::to_string(_header->segmentLayout) +
+                            ", file was probably written by a newer version of HAL");
+    }
     if (markDirty) {
         _header->dirty = true;
     }
@@ -107,13 +136,25 @@ void hal::MMapFile::createHeader() {
     setHeaderPtr();
     assert(FORMAT_NAME.size() < sizeof(_header->format));
     strncpy(_header->format, FORMAT_NAME.c_str(), sizeof(_header->format) - 1);
-    assert(getMmapApiVersion().size() < sizeof(_header->mmapVersion));
-    strncpy(_header->mmapVersion, getMmapApiVersion().c_str(), sizeof(_header->mmapVersion) - 1);
     assert(HAL_VERSION.size() < sizeof(_header->halVersion));
     strncpy(_header->halVersion, HAL_VERSION.c_str(), sizeof(_header->halVersion) - 1);
     _header->nextOffset = alignRound(sizeof(MMapHeader));
     _header->dirty = true;
+    _header->dnaEncoding = MMAP_DNA_NIBBLE;
+    _header->segmentLayout = MMAP_SEGMENTS_ROW;
     _header->nextOffset = _header->nextOffset;
+    setVersion();
+}
+
+/* write the version needed to read the file as it is encoded, so readers
+ * that can't read it reject it */
+void hal::MMapFile::setVersion() {
+    bool extended = (_header->dnaEncoding != MMAP_DNA_NIBBLE) || (_header->segmentLayout != MMAP_SEGMENTS_ROW);
+    const std::string &version = extended ? getMmapExtendedVersion() : getMmapApiVersion();
+    assert(version.size() < sizeof(_header->mmapVersion));
+    memset(_header->mmapVersion, 0, sizeof(_header->mmapVersion));
+    strncpy(_header->mmapVersion, version.c_str(), sizeof(_header->mmapVersion) - 1);
+    parseCheckVersion();
 }
 
 namespace hal {
@@ -127,22 +168,27 @@ namespace hal {
             return false;
         }
 
+      protected:
+        virtual void grow(size_t requiredSize);
+
       private:
         int openFile();
         void closeFile();
         void adjustFileSize(size_t size);
         void *mapFile(void *requiredAddr = NULL);
+        void reserveAddressSpace(size_t minSize);
         void unmapFile();
         void openRead();
         void openWrite(size_t fileSize);
 
-        int _fd; // open file descriptor
+        int _fd;          // open file descriptor
+        size_t _mapSize;  // size of address range mapped at _basePtr, at least _fileSize
     };
 }
 
 /* Constructor. Open or create the specified file. */
 hal::MMapFileLocal::MMapFileLocal(const std::string &alignmentPath, unsigned mode, size_t fileSize)
-    : MMapFile(alignmentPath, mode, false), _fd(-1) {
+    : MMapFile(alignmentPath, mode, false), _fd(-1), _mapSize(0) {
     if (_mode & WRITE_ACCESS) {
         openWrite(fileSize);
     } else {
@@ -194,9 +240,8 @@ void hal::MMapFileLocal::adjustFileSize(size_t size) {
     _fileSize = size;
 }
 
-/* map file into memory */
+/* map file into memory, replacing any existing mapping at requiredAddr */
 void *hal::MMapFileLocal::mapFile(void *requiredAddr) {
-    assert(_basePtr == NULL);
     unsigned prot = PROT_READ | ((_mode & WRITE_ACCESS) ? PROT_WRITE : 0);
     int flags = MAP_SHARED | MAP_FILE;
     if (requiredAddr != NULL) {
@@ -216,10 +261,40 @@ void *hal::MMapFileLocal::mapFile(void *requiredAddr) {
     return ptr;
 }
 
+/* Reserve inaccessible address space for the file to be mapped into and
+ * grow in.  If the full reservation isn't available (e.g. ulimit -v), try
+ * smaller ones, down to minSize. */
+void hal::MMapFileLocal::reserveAddressSpace(size_t minSize) {
+    assert(_basePtr == NULL);
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    _mapSize = std::max(minSize, MMAP_WRITE_ADDRESS_RESERVE);
+    _basePtr = mmap(NULL, _mapSize, PROT_NONE, flags, -1, 0);
+    while ((_basePtr == MAP_FAILED) && (_mapSize > minSize)) {
+        _mapSize = std::max(minSize, _mapSize / 2);
+        _basePtr = mmap(NULL, _mapSize, PROT_NONE, flags, -1, 0);
+    }
+    if (_basePtr == MAP_FAILED) {
+        _basePtr = NULL;
+        throw hal_errno_exception(_alignmentPath, "reserving address space failed", errno);
+    }
+}
+
+/* Grow the file, mapping the larger file over the same address, which is
+ * either the old mapping or the reserved space following it. */
+void hal::MMapFileLocal::grow(size_t requiredSize) {
+    size_t growSize = std::min(std::max(_fileSize, MMAP_MIN_GROW_SIZE), MMAP_MAX_GROW_SIZE);
+    size_t newSize = std::min(std::max(requiredSize, _fileSize + growSize), _mapSize);
+    if (newSize < requiredSize) {
+        MMapFile::grow(requiredSize);
+    }
+    adjustFileSize(newSize);
+    mapFile(_basePtr);
+}
+
 /* unmap file, if mapped */
 void hal::MMapFileLocal::unmapFile() {
     if (_basePtr != NULL) {
-        if (::munmap(const_cast<void *>(_basePtr), _fileSize) < 0) {
+        if (::munmap(const_cast<void *>(_basePtr), _mapSize) < 0) {
             throw hal_errno_exception(_alignmentPath, "munmap failed", errno);
         }
         _basePtr = NULL;
@@ -230,11 +305,13 @@ void hal::MMapFileLocal::unmapFile() {
 void hal::MMapFileLocal::openRead() {
     _fd = openFile();
     _fileSize = getFileStatSize(_fd);
+    _mapSize = _fileSize;
     _basePtr = mapFile();
     loadHeader(false);
 }
 
-/* open the file for write access */
+/* open the file for write access.  fileSize is the initial size, or the
+ * initial space to add to an existing file, as it grows on demand. */
 void hal::MMapFileLocal::openWrite(size_t fileSize) {
     _fd = openFile();
     if (_mode & CREATE_ACCESS) {
@@ -243,7 +320,8 @@ void hal::MMapFileLocal::openWrite(size_t fileSize) {
     } else if (_mode & WRITE_ACCESS) {
         adjustFileSize(getFileStatSize(_fd) + fileSize);
     }
-    _basePtr = mapFile();
+    reserveAddressSpace(_fileSize);
+    mapFile(_basePtr);
     if (_mode & CREATE_ACCESS) {
         createHeader();
     } else {
@@ -262,8 +340,18 @@ void hal::MMapFileLocal::closeFile() {
 }
 
 #ifdef ENABLE_UDC
+/* Read-ahead of UDC files, in UDC blocks.  Windows grow from 64kb to 2mb,
+ * fetched in requests of up to 256kb */
+static const size_t UDC_READ_AHEAD_THREADS = 4;
+static const size_t UDC_READ_AHEAD_INITIAL_WINDOW = 8;
+static const size_t UDC_READ_AHEAD_MAX_WINDOW = 256;
+static const size_t UDC_READ_AHEAD_MAX_REQUEST = 32;
+
 namespace hal {
-    /* Class that implements UDC file version of MMapFile */
+    /* Class that implements UDC file version of MMapFile.  Sequential access
+     * is read ahead by MMapReadAhead, whose threads each have their own
+     * handle on the URL.  The handles share the cache files, which are
+     * mapped shared, so whatever they fetch is seen through _udcFile. */
     class MMapFileUdc : public MMapFile {
       public:
         MMapFileUdc(const std::string &alignmentPath, unsigned mode, size_t fileSize);
@@ -277,7 +365,14 @@ namespace hal {
         virtual void fetch(size_t offset, size_t accessSize) const;
 
       private:
+        void startReadAhead();
+        void stopReadAhead();
+        static void udcFetch(struct udc2File *udcFile, size_t offset, size_t size, bool speculative);
+
         struct udc2File *_udcFile;
+        mutable std::mutex _fetchMutex; // UDC is not thread-safe, serialize concurrent readers
+        std::vector<struct udc2File *> _readAheadFiles;
+        std::unique_ptr<MMapReadAhead> _readAhead;
     };
 }
 
@@ -297,6 +392,35 @@ hal::MMapFileUdc::MMapFileUdc(const std::string &alignmentPath, unsigned mode, s
     _basePtr = udc2MMapFetch(_udcFile, 0, sizeof(MMapHeader));
     _fileSize = udc2SizeFromCache(const_cast<char *>(_alignmentPath.c_str()), NULL);
     loadHeader(false);
+    startReadAhead();
+}
+
+/* open a handle per read-ahead thread.  Read-ahead is skipped if they can't
+ * be opened, as it is only an optimization */
+void hal::MMapFileUdc::startReadAhead() {
+    for (size_t t = 0; t < UDC_READ_AHEAD_THREADS; ++t) {
+        struct udc2File *udcFile = udc2FileMayOpen(const_cast<char *>(_alignmentPath.c_str()), NULL, UDC_BLOCK_SIZE);
+        if (udcFile == NULL) {
+            stopReadAhead();
+            return;
+        }
+        udc2MMap(udcFile);
+        _readAheadFiles.push_back(udcFile);
+    }
+    _readAhead.reset(new MMapReadAhead(_fileSize, UDC_BLOCK_SIZE, UDC_READ_AHEAD_THREADS, UDC_READ_AHEAD_INITIAL_WINDOW,
+                                       UDC_READ_AHEAD_MAX_WINDOW, UDC_READ_AHEAD_MAX_REQUEST,
+                                       [this](size_t threadIdx, size_t offset, size_t size) {
+                                           udcFetch(_readAheadFiles[threadIdx], offset, size, true);
+                                       }));
+}
+
+/* stop the read-ahead threads before closing their handles */
+void hal::MMapFileUdc::stopReadAhead() {
+    _readAhead.reset();
+    for (size_t t = 0; t < _readAheadFiles.size(); ++t) {
+        udc2FileClose(&_readAheadFiles[t]);
+    }
+    _readAheadFiles.clear();
 }
 
 /* close file, marking as clean.  Don't  */
@@ -304,25 +428,50 @@ void hal::MMapFileUdc::close() {
     if (_basePtr == NULL) {
         throw hal_exception(_alignmentPath + ": MMapFile::close() called on closed file");
     }
+    stopReadAhead();
     udc2FileClose(&_udcFile);
 }
 
 /* Destructor. write fields to header and close.  If write access and close
  * has not been called, file will me left mark dirty */
 hal::MMapFileUdc::~MMapFileUdc() {
+    stopReadAhead();
     if (_udcFile != NULL) {
         udc2FileClose(&_udcFile);
     }
 }
 
-/* fetch into UDC cache */
+/* fetch into UDC cache, along with any queued read-ahead the access
+ * overlaps */
 void hal::MMapFileUdc::fetch(size_t offset, size_t accessSize) const {
+    perfCount(PERF_MMAP_FETCHES);
+    PerfTimerScope timer(PERF_TIME_MMAP_FETCH);
     if ((offset < _fileSize) and (offset + accessSize) > _fileSize) {
         // FIXME  - length off end, iterator does this
         accessSize = _fileSize - offset;
     }
+    if (_readAhead) {
+        _readAhead->access(offset, accessSize);
+    }
 
-    udc2MMapFetch(_udcFile, offset, accessSize);
+    std::lock_guard<std::mutex> lock(_fetchMutex);
+    udcFetch(_udcFile, offset, accessSize, false);
+}
+
+/* fetch a range with a handle, counting the bytes it reads over the
+ * network.  A failed speculative fetch is ignored rather than aborting, as
+ * the range is fetched again in the foreground if it is accessed */
+void hal::MMapFileUdc::udcFetch(struct udc2File *udcFile, size_t offset, size_t size, bool speculative) {
+    bits64 netBytesRead = udc2NetBytesRead(udcFile);
+    if (speculative) {
+        char *error = NULL;
+        if (!udc2MMapTryFetch(udcFile, offset, size, &error)) {
+            udc2FreeMem(error);
+        }
+    } else {
+        udc2MMapFetch(udcFile, offset, size);
+    }
+    perfCount(PERF_UDC_BYTES_FETCHED, udc2NetBytesRead(udcFile) - netBytesRead);
 }
 
 #endif
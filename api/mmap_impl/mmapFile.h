@@ -10,7 +10,13 @@
 namespace hal {
     /* Current API major and minor versions */
     static const unsigned MMAP_API_MAJOR_VERSION = 1;
-    static const unsigned MMAP_API_MINOR_VERSION = 1;
+    static const unsigned MMAP_API_MINOR_VERSION = 3;
+
+    /* Version of files that 1.x readers would misread, those using two-bit
+     * DNA or columnar segments.  Other files keep the current version, so
+     * old readers can still read them. */
+    static const unsigned MMAP_API_EXTENDED_MAJOR_VERSION = 2;
+    static const unsigned MMAP_API_EXTENDED_MINOR_VERSION = 0;
 
     /* get current mmap version as a string */
     const std::string& getMmapCurentVersion();
@@ -27,7 +33,9 @@ namespace hal {
         size_t nextOffset;
         size_t rootOffset;
         bool dirty;
-        char _reserved[256];   // 256 bytes of reserved added in mmap API 1.1
+        uint8_t dnaEncoding;   // MMapDnaEncoding, added in mmap API 1.2
+        uint8_t segmentLayout; // MMapSegmentLayout, added in mmap API 1.3
+        char _reserved[254];   // 256 bytes of reserved added in mmap API 1.1
     };
     typedef struct MMapHeader MMapHeader;
 
@@ -71,6 +79,24 @@ namespace hal {
         bool isReadOnly() const {
             return !(_mode & WRITE_ACCESS);
         };
+        /* encoding of DNA in this file, 0 (nibble) in files before 1.2 */
+        MMapDnaEncoding getDnaEncoding() const {
+            return MMapDnaEncoding(_header->dnaEncoding);
+        }
+        void setDnaEncoding(MMapDnaEncoding dnaEncoding) {
+            validateWriteAccess();
+            _header->dnaEncoding = dnaEncoding;
+            setVersion();
+        }
+        /* layout of segments in this file, 0 (row) in files before 1.3 */
+        MMapSegmentLayout getSegmentLayout() const {
+            return MMapSegmentLayout(_header->segmentLayout);
+        }
+        void setSegmentLayout(MMapSegmentLayout segmentLayout) {
+            validateWriteAccess();
+            _header->segmentLayout = segmentLayout;
+            setVersion();
+        }
         std::string getVersion() {
             return _header->halVersion;
         };
@@ -88,9 +114,15 @@ namespace hal {
         virtual void fetch(size_t offset, size_t accessSize) const {
             // no-op by default
         }
+        /* make the file at least requiredSize bytes, without moving the
+         * mapping, so pointers into the file stay valid */
+        virtual void grow(size_t requiredSize) {
+            throw hal_exception("mmap file is full, specify file size larger than " + std::to_string(_fileSize));
+        }
 
         void setHeaderPtr();
         void createHeader();
+        void setVersion();
         void loadHeader(bool markDirty);
         void validateWriteAccess() const;
         inline void fetchIfNeeded(size_t offset, size_t accessSize) const;
@@ -145,12 +177,12 @@ const void *hal::MMapFile::toPtr(size_t offset, size_t accessSize) const {
     return static_cast<const char *>(_basePtr) + offset;
 }
 
-/** Allocate new memory, resize file if necessary. If isRoot is specified, it
+/** Allocate new memory, growing the file if necessary. If isRoot is specified, it
  * is stored as the root used to find all object.  */
 size_t hal::MMapFile::allocMem(size_t size, bool isRoot) {
     validateWriteAccess();
     if (_header->nextOffset + size > _fileSize) {
-        throw hal_exception("mmap file is full, specify file size larger than " + std::to_string(_fileSize));
+        grow(_header->nextOffset + size);
     }
     size_t offset = _header->nextOffset;
     _header->nextOffset += alignRound(size);
@@ -11,6 +11,7 @@
 #include "mmapSequence.h"
 #include "mmapSequenceIterator.h"
 #include "mmapTopSegment.h"
+#include <cstring>
 using namespace hal;
 using namespace std;
 
@@ -19,7 +20,7 @@ MMapGenome::~MMapGenome() {
 }
 
 void MMapGenome::setDimensions(const vector<Sequence::Info> &sequenceDimensions, bool storeDNAArrays) {
-    _sequenceObjCache.resize(sequenceDimensions.size());
+    resizeSequenceCache(sequenceDimensions.size());
 
     // FIXME: should we check storeDNAArrays??
     hal_size_t totalSequenceLength = 0;
@@ -40,7 +41,16 @@ void MMapGenome::setDimensions(const vector<Sequence::Info> &sequenceDimensions,
     // Write the new DNA/sequence information, allocating one base per nibble
     hal_size_t dnaLength = (totalSequenceLength + 1) / 2;
     _data->_totalSequenceLength = totalSequenceLength;
-    _data->_dnaOffset = _alignment->allocateNewArray(dnaLength);
+    if (isTwoBitDna()) {
+        // staged as empty DNA when first accessed
+        _stagedDna.clear();
+        _stagedDna.shrink_to_fit();
+        _dnaStaged = false;
+        _stagedDnaModified = true;
+        _data->_dnaOffset = MMAP_NULL_OFFSET;
+    } else {
+        _data->_dnaOffset = _alignment->allocateNewArray(dnaLength);
+    }
     // Reverse space for the sequence data (plus an extra at the end
     // to indicate the end position of the sequence iterator).  FIXME: extra no longer needed
     _data->_sequencesOffset = _alignment->allocateNewArray(sizeof(MMapSequenceData) * sequenceDimensions.size() + 1);
@@ -63,6 +73,37 @@ void MMapGenome::setDimensions(const vector<Sequence::Info> &sequenceDimensions,
     createGenomeSiteMap(sequenceDimensions.size());
 }
 
+void MMapGenome::stageDna() {
+    if (!_dnaStaged) {
+        if (_alignment->getMMapFile()->isReadOnly()) {
+            throw hal_exception("genome " + _name + ": two-bit DNA is only staged in memory for writable files");
+        }
+        hal_size_t length = getSequenceLength();
+        _stagedDna.assign((length + 1) / 2, 0);
+        if (_data->_dnaOffset != MMAP_NULL_OFFSET) {
+            decodeTwoBitDna(0, length, _stagedDna.data());
+        }
+        _dnaStaged = true;
+    }
+}
+
+void MMapGenome::decodeTwoBitDna(hal_index_t start, hal_index_t end, char *nibbles) const {
+    MMapTwoBitDna::decode(_alignment->getMMapFile(), _data->_dnaOffset, start, end, nibbles);
+}
+
+void MMapGenome::encodeStagedDna() {
+    if (_stagedDnaModified) {
+        // new dimensions are encoded even if their DNA was never set
+        stageDna();
+        _data->_dnaOffset =
+            MMapTwoBitDna::encode(_alignment->getMMapFile(), _stagedDna.data(), getSequenceLength(), _data->_dnaOffset);
+        _stagedDnaModified = false;
+    }
+    _stagedDna.clear();
+    _stagedDna.shrink_to_fit();
+    _dnaStaged = false;
+}
+
 /* must be called after sequences are created */
 void MMapGenome::createSequenceNameHash(size_t numSequences) {
     // build perfect hash
@@ -81,7 +122,11 @@ void MMapGenome::createSequenceNameHash(size_t numSequences) {
 /* must be called after sequences are created */
 void MMapGenome::createGenomeSiteMap(size_t numSequences) {
     assert(_sequenceObjCache.size() == numSequences);
-    _data->_genomeSiteMapOffset = _genomeSiteMap.build(_sequenceObjCache);
+    vector<MMapSequence *> sequences(numSequences);
+    for (size_t i = 0; i < numSequences; i++) {
+        sequences[i] = _sequenceObjCache[i].load();
+    }
+    _data->_genomeSiteMapOffset = _genomeSiteMap.build(sequences);
 }
 
 void MMapGenome::setSequenceData(size_t i, hal_index_t startPos, hal_index_t topSegmentStartIndex,
@@ -138,7 +183,12 @@ void MMapGenome::updateTopDimensions(const vector<Sequence::UpdateInfo> &updated
     }
     _data->_numTopSegments = numTopSegments;
 
-    _data->_topSegmentsOffset = _alignment->allocateNewArray((_data->_numTopSegments + 1) * sizeof(MMapTopSegmentData));
+    if (isColumnarSegments()) {
+        _data->_topSegmentsOffset = _alignment->allocateNewArray(MMapTopSegmentColumns::getSize(_data->_numTopSegments));
+    } else {
+        _data->_topSegmentsOffset =
+            _alignment->allocateNewArray((_data->_numTopSegments + 1) * sizeof(MMapTopSegmentData));
+    }
     hal_index_t topSegmentStartIndex = 0;
     for (size_t i = 0; i < topDimensions.size(); i++) {
         MMapSequence seq(this, getSequenceData(i));
@@ -156,8 +206,13 @@ void MMapGenome::updateBottomDimensions(const vector<Sequence::UpdateInfo> &upda
         numBottomSegments += i._numSegments;
     }
     _data->_numBottomSegments = numBottomSegments;
-    _data->_bottomSegmentsOffset =
-        _alignment->allocateNewArray((_data->_numBottomSegments + 1) * MMapBottomSegmentData::getSize(this));
+    if (isColumnarSegments()) {
+        _data->_bottomSegmentsOffset =
+            _alignment->allocateNewArray(MMapBottomSegmentColumns::getSize(_data->_numBottomSegments, getNumChildren()));
+    } else {
+        _data->_bottomSegmentsOffset =
+            _alignment->allocateNewArray((_data->_numBottomSegments + 1) * MMapBottomSegmentData::getSize(this));
+    }
     hal_index_t bottomSegmentStartIndex = 0;
     for (size_t i = 0; i < bottomDimensions.size(); i++) {
         MMapSequence seq(this, getSequenceData(i));
@@ -173,10 +228,17 @@ hal_size_t MMapGenome::getNumSequences() const {
 }
 
 Sequence *MMapGenome::getSequenceByIndex(hal_index_t index) {
-    if (_sequenceObjCache[index] == NULL) {
-        _sequenceObjCache[index] = new MMapSequence(this, getSequenceData(index));
+    MMapSequence *sequence = _sequenceObjCache[index].load(std::memory_order_acquire);
+    if (sequence == NULL) {
+        // another thread may beat us to it, in which case theirs is used
+        MMapSequence *newSequence = new MMapSequence(this, getSequenceData(index));
+        if (_sequenceObjCache[index].compare_exchange_strong(sequence, newSequence, std::memory_order_acq_rel)) {
+            sequence = newSequence;
+        } else {
+            delete newSequence;
+        }
     }
-    return _sequenceObjCache[index];
+    return sequence;
 }
 
 const Sequence *MMapGenome::getSequenceByIndex(hal_index_t index) const {
@@ -239,6 +301,63 @@ Alignment *MMapGenome::getAlignment() {
     return _alignment;
 }
 
+bool MMapGenome::copyDnaArray(Genome *dest) const {
+    MMapGenome *mmapDest = dynamic_cast<MMapGenome *>(dest);
+    if (mmapDest == NULL || mmapDest->getSequenceLength() != getSequenceLength()) {
+        return false;
+    }
+    hal_size_t dnaLength = (getSequenceLength() + 1) / 2;
+    // for two-bit files, this is the in-memory copy
+    char *destDna = mmapDest->getDNA(0, dnaLength);
+    if (isTwoBitDna() && !_dnaStaged) {
+        if (_data->_dnaOffset != MMAP_NULL_OFFSET) {
+            decodeTwoBitDna(0, getSequenceLength(), destDna);
+        }
+    } else {
+        memcpy(destDna, const_cast<MMapGenome *>(this)->getDNA(0, dnaLength), dnaLength);
+    }
+    if (mmapDest->isTwoBitDna()) {
+        mmapDest->setStagedDnaModified();
+    }
+    return true;
+}
+
+/* copy size bytes of a segment array, the layouts must match */
+static void copySegmentArray(MMapAlignment *alignment, size_t offset, MMapAlignment *destAlignment, size_t destOffset,
+                             size_t size) {
+    memcpy(destAlignment->resolveOffset(destOffset, size), alignment->resolveOffset(offset, size), size);
+}
+
+bool MMapGenome::copyTopSegmentArray(Genome *dest) const {
+    MMapGenome *mmapDest = dynamic_cast<MMapGenome *>(dest);
+    if (mmapDest == NULL || mmapDest->getNumTopSegments() != getNumTopSegments() ||
+        mmapDest->isColumnarSegments() != isColumnarSegments()) {
+        return false;
+    }
+    // including the extra segment at the end of the row layout, which
+    // holds the end position of the last segment
+    hal_size_t numSegments = getNumTopSegments();
+    size_t size = isColumnarSegments() ? MMapTopSegmentColumns::getSize(numSegments)
+                                       : (numSegments + 1) * sizeof(MMapTopSegmentData);
+    copySegmentArray(_alignment, _data->_topSegmentsOffset, mmapDest->_alignment, mmapDest->_data->_topSegmentsOffset,
+                     size);
+    return true;
+}
+
+bool MMapGenome::copyBottomSegmentArray(Genome *dest) const {
+    MMapGenome *mmapDest = dynamic_cast<MMapGenome *>(dest);
+    if (mmapDest == NULL || mmapDest->getNumBottomSegments() != getNumBottomSegments() ||
+        mmapDest->getNumChildren() != getNumChildren() || mmapDest->isColumnarSegments() != isColumnarSegments()) {
+        return false;
+    }
+    hal_size_t numSegments = getNumBottomSegments();
+    size_t size = isColumnarSegments() ? MMapBottomSegmentColumns::getSize(numSegments, getNumChildren())
+                                       : (numSegments + 1) * MMapBottomSegmentData::getSize(this);
+    copySegmentArray(_alignment, _data->_bottomSegmentsOffset, mmapDest->_alignment,
+                     mmapDest->_data->_bottomSegmentsOffset, size);
+    return true;
+}
+
 // SEGMENTED SEQUENCE INTERFACE
 
 const string &MMapGenome::getName() const {
@@ -331,6 +450,16 @@ void MMapGenome::getSubString(string &outString, hal_size_t start, hal_size_t le
     dnaIt->readString(outString, length);
 }
 
+void MMapGenome::getSubString(char *outBuffer, hal_size_t start, hal_size_t length, bool reverseComplement,
+                              bool upperCase) const {
+    if (length == 0) {
+        return;
+    }
+    DnaIteratorPtr dnaIt(getDnaIterator(reverseComplement ? start + length - 1 : start));
+    dnaIt->setReversed(reverseComplement);
+    dnaIt->readBases(outBuffer, length, upperCase);
+}
+
 void MMapGenome::setSubString(const string &inString, hal_size_t start, hal_size_t length) {
     if (length != inString.length()) {
         throw hal_exception(string("setString: input string has differnt") + "length from target string in genome");
@@ -365,9 +494,22 @@ void MMapGenome::rename(const std::string &name) {
     _data->setName(_alignment, name);
 }
 
+/* resize, keeping existing sequence objects, as std::atomic can't be moved */
+void MMapGenome::resizeSequenceCache(size_t numSequences) {
+    vector<atomic<MMapSequence *>> sequenceObjCache(numSequences);
+    for (size_t i = 0; i < _sequenceObjCache.size(); i++) {
+        if (i < numSequences) {
+            sequenceObjCache[i] = _sequenceObjCache[i].load();
+        } else {
+            delete _sequenceObjCache[i].load();
+        }
+    }
+    _sequenceObjCache.swap(sequenceObjCache);
+}
+
 void MMapGenome::deleteSequenceCache() {
-    for (auto seq : _sequenceObjCache) {
-        delete seq;
+    for (auto &seq : _sequenceObjCache) {
+        delete seq.load();
     }
     _sequenceObjCache.clear();
 }
@@ -8,6 +8,8 @@
 #include "mmapPerfectHashTable.h"
 #include "mmapString.h"
 #include "mmapTopSegmentData.h"
+#include "mmapTwoBitDna.h"
+#include <atomic>
 #include <map>
 
 namespace hal {
@@ -51,16 +53,16 @@ namespace hal {
             : Genome(alignment, data->getName(alignment)), _alignment(alignment), _data(data), _arrayIndex(arrayIndex),
               _name(data->getName(_alignment)), _metaData(_alignment, _data->_metadataOffset),
               _sequenceNameHash(alignment->getMMapFile(), data->_sequenceHashOffset),
-              _genomeSiteMap(alignment->getMMapFile(), data->_genomeSiteMapOffset) {
-            _sequenceObjCache.resize(data->_numSequences);
+              _genomeSiteMap(alignment->getMMapFile(), data->_genomeSiteMapOffset),
+              _sequenceObjCache(data->_numSequences), _dnaStaged(false), _stagedDnaModified(false) {
         };
         MMapGenome(MMapAlignment *alignment, MMapGenomeData *data, size_t arrayIndex, const std::string &name)
             : Genome(alignment, name), _alignment(alignment), _data(data), _arrayIndex(arrayIndex), _name(name),
               _metaData(_alignment), _sequenceNameHash(alignment->getMMapFile(), data->_sequenceHashOffset),
-              _genomeSiteMap(alignment->getMMapFile(), data->_genomeSiteMapOffset) {
+              _genomeSiteMap(alignment->getMMapFile(), data->_genomeSiteMapOffset),
+              _sequenceObjCache(data->_numSequences), _dnaStaged(false), _stagedDnaModified(false) {
             _data->initializeName(_alignment, _name);
             _data->_metadataOffset = _metaData.getOffset();
-            _sequenceObjCache.resize(data->_numSequences);
         };
 
         virtual ~MMapGenome();
@@ -72,10 +74,35 @@ namespace hal {
             return _data->getBottomSegmentData(_alignment, this, index);
         };
 
+        bool isColumnarSegments() const {
+            return _alignment->getMMapFile()->getSegmentLayout() == MMAP_SEGMENTS_COLUMNAR;
+        }
+        /* views of the segment arrays in files with the columnar layout, or
+         * empty views in files with the row layout */
+        MMapTopSegmentColumns getTopSegmentColumns() {
+            if (!isColumnarSegments()) {
+                return MMapTopSegmentColumns();
+            }
+            return MMapTopSegmentColumns(_alignment->getMMapFile(), _data->_topSegmentsOffset, _data->_numTopSegments);
+        }
+        MMapBottomSegmentColumns getBottomSegmentColumns() {
+            if (!isColumnarSegments()) {
+                return MMapBottomSegmentColumns();
+            }
+            return MMapBottomSegmentColumns(_alignment->getMMapFile(), _data->_bottomSegmentsOffset,
+                                            _data->_numBottomSegments);
+        }
+
         void updateGenomeArrayBasePtr(MMapGenomeData *base) {
             _data = base + _arrayIndex;
         }
 
+        /* used when a genome before this one is removed from the array */
+        void updateArrayIndex(MMapGenomeData *base, size_t arrayIndex) {
+            _arrayIndex = arrayIndex;
+            _data = base + _arrayIndex;
+        }
+
         const std::string &getName() const;
 
         hal_index_t getArrayIndex() const {
@@ -118,6 +145,12 @@ namespace hal {
 
         void rename(const std::string &newName);
 
+        bool copyDnaArray(Genome *dest) const;
+
+        bool copyTopSegmentArray(Genome *dest) const;
+
+        bool copyBottomSegmentArray(Genome *dest) const;
+
         // SEGMENTED SEQUENCE INTERFACE
 
         hal_size_t getSequenceLength() const;
@@ -148,6 +181,9 @@ namespace hal {
 
         void getSubString(std::string &outString, hal_size_t start, hal_size_t length) const;
 
+        void getSubString(char *outBuffer, hal_size_t start, hal_size_t length, bool reverseComplement,
+                          bool upperCase) const;
+
         void setSubString(const std::string &intString, hal_size_t start, hal_size_t length);
 
         RearrangementPtr getRearrangement(hal_index_t position, hal_size_t gapLengthThreshold, double nThreshold,
@@ -161,9 +197,32 @@ namespace hal {
         MMapAlignment *_alignment;
         MMapSequenceData *getSequenceData(size_t i) const;
 
+        /* nibble-packed DNA starting at byte start.  For two-bit files
+         * open for writing, this is the in-memory copy */
         char *getDNA(size_t start, size_t length) {
+            if (isTwoBitDna()) {
+                stageDna();
+                return _stagedDna.data() + start;
+            }
             return _data->getDNA(_alignment, start, length);
         }
+
+        bool isTwoBitDna() const {
+            return _alignment->getMMapFile()->getDnaEncoding() == MMAP_DNA_TWO_BIT;
+        }
+
+        /* decode bases [start, end) of a two-bit genome into a nibble buffer,
+         * start must be a multiple of four */
+        void decodeTwoBitDna(hal_index_t start, hal_index_t end, char *nibbles) const;
+
+        /* note that the in-memory two-bit DNA was changed */
+        void setStagedDnaModified() {
+            _stagedDnaModified = true;
+        }
+
+        /* write modified in-memory DNA of a two-bit file to the file and
+         * free it */
+        void encodeStagedDna();
         void createSequenceNameHash(size_t numSequences);
 
       private:
@@ -172,7 +231,9 @@ namespace hal {
                              hal_index_t bottomSegmentStartIndex, const Sequence::Info &sequenceInfo);
         std::vector<Sequence::UpdateInfo> getCompleteInputDimensions(const std::vector<Sequence::UpdateInfo> &inputDimensions,
                                                                      bool isTop);
+        void resizeSequenceCache(size_t numSequences);
         void deleteSequenceCache();
+        void stageDna();
 
         MMapGenomeData *_data;
         size_t _arrayIndex; // Index within the alignment's genome array.
@@ -181,7 +242,17 @@ namespace hal {
         MMapPerfectHashTable _sequenceNameHash;
         MMapGenomeSiteMap _genomeSiteMap;
 
-        mutable std::vector<MMapSequence *> _sequenceObjCache;
+        /* Sequence objects are created on demand.  Atomic so that concurrent
+         * readers can fill in the cache without locking. */
+        mutable std::vector<std::atomic<MMapSequence *>> _sequenceObjCache;
+
+        /* Two-bit DNA can't be changed in place, so in writable files the
+         * genome's DNA is decoded to nibbles in memory on first access and
+         * encoded to the file when the genome or alignment is closed, if it
+         * was modified. */
+        std::vector<char> _stagedDna;
+        bool _dnaStaged;
+        bool _stagedDnaModified;
     };
 
     inline std::string MMapGenomeData::getName(MMapAlignment *alignment) const {
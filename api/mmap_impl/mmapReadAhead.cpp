@@ -0,0 +1,171 @@
+#include "mmapReadAhead.h"
+#include <algorithm>
+
+using namespace std;
+using namespace hal;
+
+/* number of sequential streams followed at once.  A column walk reads the
+ * segment arrays and DNA of several genomes in step, so this is well above
+ * the number of arrays in one genome */
+static const size_t MAX_STREAMS = 32;
+
+hal::MMapReadAhead::MMapReadAhead(size_t fileSize, size_t blockSize, size_t numThreads, size_t initialWindow,
+                                  size_t maxWindow, size_t maxRequest, const FetchFunc &fetchFunc)
+    : _fileSize(fileSize), _numBlocks((fileSize + blockSize - 1) / blockSize), _blockSize(blockSize),
+      _initialWindow(max(initialWindow, (size_t)1)), _maxWindow(max(maxWindow, initialWindow)),
+      _maxRequest(max(maxRequest, (size_t)1)), _fetchFunc(fetchFunc), _useCount(0), _running(numThreads),
+      _stopping(false), _numRequests(0), _numBlocksRequested(0), _numWaits(0) {
+    for (size_t t = 0; t < numThreads; ++t) {
+        _running[t]._start = _running[t]._end = 0;
+        _threads.push_back(thread(&MMapReadAhead::worker, this, t));
+    }
+}
+
+hal::MMapReadAhead::~MMapReadAhead() {
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stopping = true;
+        _queue.clear();
+        _queueReady.notify_all();
+    }
+    for (size_t t = 0; t < _threads.size(); ++t) {
+        _threads[t].join();
+    }
+}
+
+void hal::MMapReadAhead::access(size_t &offset, size_t &size) {
+    if (_threads.empty() || (size == 0) || (offset >= _fileSize)) {
+        return;
+    }
+    size_t startBlock = offset / _blockSize;
+    size_t endBlock = min(_numBlocks, (offset + size + _blockSize - 1) / _blockSize);
+    unique_lock<mutex> lock(_mutex);
+    ++_useCount;
+    Stream *stream = findStream(startBlock);
+    if (stream == NULL) {
+        // start following a new stream, in place of the least recently used
+        Stream newStream = {startBlock, endBlock, _initialWindow, endBlock, _useCount};
+        if (_streams.size() < MAX_STREAMS) {
+            _streams.push_back(newStream);
+        } else {
+            *min_element(_streams.begin(), _streams.end(),
+                         [](const Stream &a, const Stream &b) { return a._lastUse < b._lastUse; }) = newStream;
+        }
+    } else {
+        stream->_lastUse = _useCount;
+        if (endBlock > stream->_end) {
+            // the stream moved on, top up what is read ahead of it
+            stream->_start = startBlock;
+            stream->_end = endBlock;
+            stream->_aheadEnd = max(stream->_aheadEnd, endBlock);
+            if ((stream->_aheadEnd - endBlock < (stream->_window + 1) / 2) && (stream->_aheadEnd < _numBlocks)) {
+                size_t aheadEnd = min(_numBlocks, stream->_aheadEnd + stream->_window);
+                queueRange(stream->_aheadEnd, aheadEnd);
+                stream->_aheadEnd = aheadEnd;
+                stream->_window = min(2 * stream->_window, _maxWindow);
+            }
+        }
+    }
+
+    // queued ranges overlapping the access are taken back, so that they are
+    // fetched along with it rather than after it
+    for (deque<BlockRange>::iterator i = _queue.begin(); i != _queue.end();) {
+        if ((i->_start < endBlock) && (i->_end > startBlock)) {
+            startBlock = min(startBlock, i->_start);
+            endBlock = max(endBlock, i->_end);
+            i = _queue.erase(i);
+        } else {
+            ++i;
+        }
+    }
+    if (isRunning(startBlock, endBlock)) {
+        ++_numWaits;
+        _fetchDone.wait(lock, [this, startBlock, endBlock]() { return !isRunning(startBlock, endBlock); });
+    }
+    size_t endOffset = max(offset + size, min(_fileSize, endBlock * _blockSize));
+    offset = min(offset, startBlock * _blockSize);
+    size = endOffset - offset;
+}
+
+void hal::MMapReadAhead::drain() {
+    unique_lock<mutex> lock(_mutex);
+    _fetchDone.wait(lock, [this]() { return _queue.empty() && !isRunning(0, _numBlocks); });
+}
+
+size_t hal::MMapReadAhead::getNumRequests() const {
+    lock_guard<mutex> lock(_mutex);
+    return _numRequests;
+}
+
+size_t hal::MMapReadAhead::getNumBlocksRequested() const {
+    lock_guard<mutex> lock(_mutex);
+    return _numBlocksRequested;
+}
+
+size_t hal::MMapReadAhead::getNumWaits() const {
+    lock_guard<mutex> lock(_mutex);
+    return _numWaits;
+}
+
+/* the stream an access continues: one that it overlaps, or that it starts
+ * right after */
+hal::MMapReadAhead::Stream *hal::MMapReadAhead::findStream(size_t startBlock) {
+    for (size_t i = 0; i < _streams.size(); ++i) {
+        if ((startBlock >= _streams[i]._start) && (startBlock <= _streams[i]._end)) {
+            return &_streams[i];
+        }
+    }
+    return NULL;
+}
+
+/* queue blocks [startBlock, endBlock) in requests of at most _maxRequest
+ * blocks, extending a queued request that they follow if it has room */
+void hal::MMapReadAhead::queueRange(size_t startBlock, size_t endBlock) {
+    for (size_t i = 0; (i < _queue.size()) && (startBlock < endBlock); ++i) {
+        BlockRange &queued = _queue[i];
+        if ((queued._end == startBlock) && (queued._end - queued._start < _maxRequest)) {
+            queued._end = min(endBlock, queued._start + _maxRequest);
+            startBlock = queued._end;
+        }
+    }
+    while (startBlock < endBlock) {
+        BlockRange range = {startBlock, min(endBlock, startBlock + _maxRequest)};
+        _queue.push_back(range);
+        startBlock = range._end;
+    }
+    _queueReady.notify_all();
+}
+
+bool hal::MMapReadAhead::isRunning(size_t startBlock, size_t endBlock) const {
+    for (size_t t = 0; t < _running.size(); ++t) {
+        if ((_running[t]._start < endBlock) && (_running[t]._end > startBlock)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void hal::MMapReadAhead::worker(size_t threadIdx) {
+    unique_lock<mutex> lock(_mutex);
+    while (true) {
+        _queueReady.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+        if (_stopping) {
+            return;
+        }
+        BlockRange range = _queue.front();
+        _queue.pop_front();
+        _running[threadIdx] = range;
+        ++_numRequests;
+        _numBlocksRequested += range._end - range._start;
+        lock.unlock();
+        size_t offset = range._start * _blockSize;
+        try {
+            _fetchFunc(threadIdx, offset, min(_fileSize, range._end * _blockSize) - offset);
+        } catch (...) {
+            // only a hint, the foreground fetch reports any error
+        }
+        lock.lock();
+        _running[threadIdx]._start = _running[threadIdx]._end = 0;
+        _fetchDone.notify_all();
+    }
+}
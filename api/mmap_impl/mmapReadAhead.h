@@ -0,0 +1,104 @@
+#ifndef _MMAPREADAHEAD_H
+#define _MMAPREADAHEAD_H
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace hal {
+    /* Read-ahead for mmap files whose pages must be fetched before they are
+     * accessed, such as UDC-cached URLs.  Every access is reported with
+     * access().  Accesses that continue where an earlier one stopped, as
+     * when walking a segment or DNA array, form a sequential stream, and the
+     * blocks following a stream are fetched in the background by a small
+     * pool of threads.  The window fetched ahead of a stream starts small
+     * and doubles, up to a maximum, while the stream keeps going.  Queued
+     * ranges that touch are coalesced into one request, and a window larger
+     * than a request is split so that its requests are fetched in parallel.
+     *
+     * The fetch function is called from the pool threads with the index of
+     * the calling thread, so that each can have its own connection.  It must
+     * leave the range readable by the file's own fetch, and must return or
+     * throw rather than exit on an error.  Errors are ignored, as the range
+     * is fetched again in the foreground if it is accessed. */
+    class MMapReadAhead {
+      public:
+        typedef std::function<void(size_t threadIdx, size_t offset, size_t size)> FetchFunc;
+
+        /* blockSize is the unit of fetching, windows and requests are
+         * measured in blocks */
+        MMapReadAhead(size_t fileSize, size_t blockSize, size_t numThreads, size_t initialWindow, size_t maxWindow,
+                      size_t maxRequest, const FetchFunc &fetchFunc);
+        ~MMapReadAhead();
+
+        /* Note an access to [offset, offset + size), starting any read-ahead
+         * it triggers.  Read-ahead that is queued but not started and that
+         * overlaps the access is taken back and the range is widened to
+         * cover it, as it is quicker for the caller to fetch it along with
+         * the access.  Returns once no background fetch of the range is
+         * running, so the caller then fetches only what is still missing. */
+        void access(size_t &offset, size_t &size);
+
+        /* wait for all queued and running fetches */
+        void drain();
+
+        /* counters, for testing and tuning */
+        size_t getNumRequests() const;
+        size_t getNumBlocksRequested() const;
+        size_t getNumWaits() const;
+
+      private:
+        MMapReadAhead(const MMapReadAhead &);
+        MMapReadAhead &operator=(const MMapReadAhead &);
+
+        /* blocks [_start, _end) */
+        struct BlockRange {
+            size_t _start;
+            size_t _end;
+        };
+
+        /* a sequential stream: its last access, its window and the end of
+         * what has been queued for it */
+        struct Stream {
+            size_t _start;
+            size_t _end;
+            size_t _window;
+            size_t _aheadEnd;
+            size_t _lastUse;
+        };
+
+        Stream *findStream(size_t startBlock);
+        void queueRange(size_t startBlock, size_t endBlock);
+        bool isRunning(size_t startBlock, size_t endBlock) const;
+        void worker(size_t threadIdx);
+
+        const size_t _fileSize;
+        const size_t _numBlocks;
+        const size_t _blockSize;
+        const size_t _initialWindow;
+        const size_t _maxWindow;
+        const size_t _maxRequest;
+        FetchFunc _fetchFunc;
+
+        std::vector<Stream> _streams;
+        size_t _useCount;
+        std::deque<BlockRange> _queue;
+        std::vector<BlockRange> _running; // indexed by thread, empty if idle
+        bool _stopping;
+        size_t _numRequests;
+        size_t _numBlocksRequested;
+        size_t _numWaits;
+
+        mutable std::mutex _mutex;
+        std::condition_variable _queueReady;
+        std::condition_variable _fetchDone;
+        std::vector<std::thread> _threads;
+    };
+}
+#endif
+// Local Variables:
+// mode: c++
+// End:
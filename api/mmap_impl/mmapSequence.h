@@ -107,6 +107,9 @@ namespace hal {
 
         void getSubString(std::string &outString, hal_size_t start, hal_size_t length) const;
 
+        void getSubString(char *outBuffer, hal_size_t start, hal_size_t length, bool reverseComplement,
+                          bool upperCase) const;
+
         void setSubString(const std::string &intString, hal_size_t start, hal_size_t length);
 
         RearrangementPtr getRearrangement(hal_index_t position, hal_size_t gapLengthThreshold, double nThreshold,
@@ -10,18 +10,24 @@ namespace hal {
     class MMapTopSegment : public TopSegment {
       public:
         MMapTopSegment(MMapGenome *genome, hal_index_t arrayIndex)
-            : TopSegment(genome, arrayIndex), _data(getMMapGenome()->getTopSegmentPointer(arrayIndex)) {
+            : TopSegment(genome, arrayIndex), _columns(genome->getTopSegmentColumns()),
+              _data(_columns.isColumnar() ? NULL : genome->getTopSegmentPointer(arrayIndex)) {
         }
 
         // SEGMENT INTERFACE
         void setArrayIndex(Genome *genome, hal_index_t arrayIndex) {
-            _genome = genome;
-            _data = getMMapGenome()->getTopSegmentPointer(arrayIndex);
+            if (genome != _genome) {
+                _genome = genome;
+                _columns = getMMapGenome()->getTopSegmentColumns();
+            }
+            if (!_columns.isColumnar()) {
+                _data = getMMapGenome()->getTopSegmentPointer(arrayIndex);
+            }
             _index = arrayIndex;
         }
         const Sequence *getSequence() const;
         hal_index_t getStartPosition() const {
-            return _data->getStartPosition();
+            return _columns.isColumnar() ? _columns.startPosition(_index) : _data->getStartPosition();
         };
         hal_index_t getEndPosition() const;
         hal_size_t getLength() const;
@@ -33,32 +39,48 @@ namespace hal {
 
         // TOP SEGMENT INTERFACE
         hal_index_t getParentIndex() const {
-            return _data->getParentIndex();
+            return _columns.isColumnar() ? _columns.parentIndex(_index) : _data->getParentIndex();
         };
         bool hasParent() const;
         void setParentIndex(hal_index_t parIdx) {
-            _data->setParentIndex(parIdx);
+            if (_columns.isColumnar()) {
+                _columns.parentIndex(_index) = parIdx;
+            } else {
+                _data->setParentIndex(parIdx);
+            }
         };
         bool getParentReversed() const {
-            return _data->getReversed();
+            return _columns.isColumnar() ? _columns.getReversed(_index) : _data->getReversed();
         };
         void setParentReversed(bool isReversed) {
-            _data->setReversed(isReversed);
+            if (_columns.isColumnar()) {
+                _columns.setReversed(_index, isReversed);
+            } else {
+                _data->setReversed(isReversed);
+            }
         };
         hal_index_t getBottomParseIndex() const {
-            return _data->getBottomParseIndex();
+            return _columns.isColumnar() ? _columns.bottomParseIndex(_index) : _data->getBottomParseIndex();
         };
         void setBottomParseIndex(hal_index_t botParseIdx) {
-            _data->setBottomParseIndex(botParseIdx);
+            if (_columns.isColumnar()) {
+                _columns.bottomParseIndex(_index) = botParseIdx;
+            } else {
+                _data->setBottomParseIndex(botParseIdx);
+            }
         };
         hal_offset_t getBottomParseOffset() const;
         bool hasParseDown() const;
         hal_index_t getNextParalogyIndex() const {
-            return _data->getNextParalogyIndex();
+            return _columns.isColumnar() ? _columns.nextParalogyIndex(_index) : _data->getNextParalogyIndex();
         }
         bool hasNextParalogy() const;
         void setNextParalogyIndex(hal_index_t parIdx) {
-            _data->setNextParalogyIndex(parIdx);
+            if (_columns.isColumnar()) {
+                _columns.nextParalogyIndex(_index) = parIdx;
+            } else {
+                _data->setNextParalogyIndex(parIdx);
+            }
         };
         hal_index_t getLeftParentIndex() const;
         hal_index_t getRightParentIndex() const;
@@ -68,7 +90,8 @@ namespace hal {
         MMapGenome *getMMapGenome() const {
             return static_cast<MMapGenome *>(_genome);
         }
-        MMapTopSegmentData *_data;
+        MMapTopSegmentColumns _columns; // only used in the columnar layout
+        MMapTopSegmentData *_data;      // only used in the row layout
     };
 
     inline hal_index_t MMapTopSegment::getEndPosition() const {
@@ -76,6 +99,9 @@ namespace hal {
     }
 
     inline hal_size_t MMapTopSegment::getLength() const {
+        if (_columns.isColumnar()) {
+            return _columns.startPosition(_index + 1) - _columns.startPosition(_index);
+        }
         return (_data + 1)->getStartPosition() - _data->getStartPosition();
     }
 
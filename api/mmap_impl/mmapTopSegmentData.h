@@ -1,5 +1,6 @@
 #ifndef _MMAPTOPSEGMENTDATA_H
 #define _MMAPTOPSEGMENTDATA_H
+#include "mmapFile.h"
 
 namespace hal {
     class MMapTopSegmentData {
@@ -43,6 +44,77 @@ namespace hal {
         hal_index_t _parentIndex;
         bool _reversed;
     };
+
+    /* Top segments of a genome in the MMAP_SEGMENTS_COLUMNAR layout.  Each
+     * field is stored as its own array, so scans over one field only touch
+     * that field's memory.  The arrays are allocated as one block, in order:
+     *   start positions      hal_index_t[numSegments + 1]
+     *   parent indexes       hal_index_t[numSegments]
+     *   bottom parse indexes hal_index_t[numSegments]
+     *   paralogy indexes     hal_index_t[numSegments]
+     *   parent reversed      one bit per segment, in uint64_t words
+     * This class is a transient view of the block, it's not stored. */
+    class MMapTopSegmentColumns {
+      public:
+        MMapTopSegmentColumns() : _file(NULL) {
+        }
+        MMapTopSegmentColumns(MMapFile *file, size_t offset, hal_size_t numSegments) : _file(file) {
+            _startOffset = offset;
+            _parentOffset = _startOffset + (numSegments + 1) * sizeof(hal_index_t);
+            _bottomParseOffset = _parentOffset + numSegments * sizeof(hal_index_t);
+            _paralogyOffset = _bottomParseOffset + numSegments * sizeof(hal_index_t);
+            _reversedOffset = _paralogyOffset + numSegments * sizeof(hal_index_t);
+        }
+
+        /* size of the block for numSegments */
+        static size_t getSize(hal_size_t numSegments) {
+            return (4 * numSegments + 1) * sizeof(hal_index_t) + getBitWords(numSegments) * sizeof(uint64_t);
+        }
+        static hal_size_t getBitWords(hal_size_t numSegments) {
+            return (numSegments + 63) / 64;
+        }
+
+        /* is this a view of columnar segments? */
+        bool isColumnar() const {
+            return _file != NULL;
+        }
+
+        hal_index_t &startPosition(hal_index_t index) const {
+            return field(_startOffset, index);
+        }
+        hal_index_t &parentIndex(hal_index_t index) const {
+            return field(_parentOffset, index);
+        }
+        hal_index_t &bottomParseIndex(hal_index_t index) const {
+            return field(_bottomParseOffset, index);
+        }
+        hal_index_t &nextParalogyIndex(hal_index_t index) const {
+            return field(_paralogyOffset, index);
+        }
+        bool getReversed(hal_index_t index) const {
+            return (bitWord(index) >> (index & 63)) & 1;
+        }
+        void setReversed(hal_index_t index, bool reversed) const {
+            uint64_t bit = uint64_t(1) << (index & 63);
+            bitWord(index) = reversed ? (bitWord(index) | bit) : (bitWord(index) & ~bit);
+        }
+
+      private:
+        hal_index_t &field(size_t columnOffset, hal_index_t index) const {
+            return *static_cast<hal_index_t *>(
+                _file->toPtr(columnOffset + index * sizeof(hal_index_t), sizeof(hal_index_t)));
+        }
+        uint64_t &bitWord(hal_index_t index) const {
+            return *static_cast<uint64_t *>(_file->toPtr(_reversedOffset + (index / 64) * sizeof(uint64_t), sizeof(uint64_t)));
+        }
+
+        MMapFile *_file;
+        size_t _startOffset;
+        size_t _parentOffset;
+        size_t _bottomParseOffset;
+        size_t _paralogyOffset;
+        size_t _reversedOffset;
+    };
 }
 #endif
 // Local Variables:
@@ -0,0 +1,147 @@
+#include "mmapTwoBitDna.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+using namespace hal;
+
+/* nibble codes, see dnaPackMap */
+static const uint8_t NIBBLE_UPPER_BIT = 0x08;
+static const uint8_t NIBBLE_BASE_MASK = 0x07;
+static const uint8_t NIBBLE_N = 0x04;
+
+namespace {
+    /* map of one packed byte (four bases) to the two upper-case nibble
+     * bytes it decodes to */
+    struct TwoBitDecodeTable {
+        TwoBitDecodeTable() {
+            for (unsigned packed = 0; packed < 256; ++packed) {
+                for (unsigned i = 0; i < 4; ++i) {
+                    _nibbles[packed][i] = ((packed >> (6 - 2 * i)) & 0x3) | NIBBLE_UPPER_BIT;
+                }
+                _bytes[packed][0] = (_nibbles[packed][0] << 4) | _nibbles[packed][1];
+                _bytes[packed][1] = (_nibbles[packed][2] << 4) | _nibbles[packed][3];
+            }
+        }
+        uint8_t _nibbles[256][4];
+        uint8_t _bytes[256][2];
+    };
+}
+
+static const TwoBitDecodeTable twoBitDecodeTable;
+
+/* append base to the run list if it extends or starts a run */
+static void addToRun(vector<MMapDnaRun> &runs, hal_index_t pos) {
+    if (!runs.empty() && runs.back()._end == pos) {
+        runs.back()._end++;
+    } else {
+        runs.push_back({pos, pos + 1});
+    }
+}
+
+/* write runs over the oldNumRuns at oldOffset if they fit */
+static size_t writeRuns(MMapFile *file, const vector<MMapDnaRun> &runs, size_t oldOffset, hal_size_t oldNumRuns) {
+    if (runs.empty()) {
+        return MMAP_NULL_OFFSET;
+    }
+    size_t size = runs.size() * sizeof(MMapDnaRun);
+    size_t offset = runs.size() <= oldNumRuns ? oldOffset : file->allocMem(size);
+    memcpy(file->toPtr(offset, size), runs.data(), size);
+    return offset;
+}
+
+size_t MMapTwoBitDna::encode(MMapFile *file, const char *nibbles, hal_size_t length, size_t oldOffset) {
+    MMapTwoBitDna old;
+    memset(&old, 0, sizeof(MMapTwoBitDna));
+    if (oldOffset != MMAP_NULL_OFFSET) {
+        old = *static_cast<const MMapTwoBitDna *>(file->toPtr(oldOffset, sizeof(MMapTwoBitDna)));
+    }
+    bool sameLength = oldOffset != MMAP_NULL_OFFSET && old._length == length;
+    if (!sameLength) {
+        old._numNRuns = old._numMaskRuns = 0;
+    }
+    size_t offset = sameLength ? oldOffset : file->allocMem(sizeof(MMapTwoBitDna));
+    size_t packedOffset = sameLength ? old._packedOffset : file->allocMem(packedSize(length));
+    uint8_t *packed = static_cast<uint8_t *>(file->toPtr(packedOffset, packedSize(length)));
+    vector<MMapDnaRun> nRuns, maskRuns;
+    for (hal_size_t i = 0; i < length; ++i) {
+        uint8_t code = (i & 1) ? (nibbles[i / 2] & 0x0F) : ((uint8_t)nibbles[i / 2] >> 4);
+        uint8_t base = code & NIBBLE_BASE_MASK;
+        if (base >= NIBBLE_N) {
+            addToRun(nRuns, i);
+            base = 0;
+        }
+        if ((code & NIBBLE_UPPER_BIT) == 0) {
+            addToRun(maskRuns, i);
+        }
+        if ((i & 3) == 0) {
+            packed[i / 4] = 0;
+        }
+        packed[i / 4] |= base << (6 - 2 * (i & 3));
+    }
+
+    size_t nRunsOffset = writeRuns(file, nRuns, old._nRunsOffset, old._numNRuns);
+    size_t maskRunsOffset = writeRuns(file, maskRuns, old._maskRunsOffset, old._numMaskRuns);
+    MMapTwoBitDna *data = static_cast<MMapTwoBitDna *>(file->toPtr(offset, sizeof(MMapTwoBitDna)));
+    memset(data, 0, sizeof(MMapTwoBitDna));
+    data->_length = length;
+    data->_packedOffset = packedOffset;
+    data->_numNRuns = nRuns.size();
+    data->_nRunsOffset = nRunsOffset;
+    data->_numMaskRuns = maskRuns.size();
+    data->_maskRunsOffset = maskRunsOffset;
+    return offset;
+}
+
+/* apply func(pos) to each position of [start, end) covered by the runs */
+template <typename Func>
+static void applyRuns(const MMapFile *file, size_t runsOffset, hal_size_t numRuns, hal_index_t start, hal_index_t end,
+                      Func func) {
+    if (numRuns == 0) {
+        return;
+    }
+    const MMapDnaRun *runs = static_cast<const MMapDnaRun *>(file->toPtr(runsOffset, numRuns * sizeof(MMapDnaRun)));
+    // first run ending after start
+    const MMapDnaRun *run = upper_bound(runs, runs + numRuns, start,
+                                        [](hal_index_t pos, const MMapDnaRun &r) { return pos < r._end; });
+    for (; run < runs + numRuns && run->_start < end; ++run) {
+        hal_index_t last = min(run->_end, end);
+        for (hal_index_t pos = max(run->_start, start); pos < last; ++pos) {
+            func(pos);
+        }
+    }
+}
+
+void MMapTwoBitDna::decode(const MMapFile *file, size_t offset, hal_index_t start, hal_index_t end, char *nibbles) {
+    assert((start & 3) == 0);
+    const MMapTwoBitDna *data = static_cast<const MMapTwoBitDna *>(file->toPtr(offset, sizeof(MMapTwoBitDna)));
+    assert(end <= (hal_index_t)data->_length);
+    hal_size_t length = end - start;
+    const uint8_t *packed =
+        static_cast<const uint8_t *>(file->toPtr(data->_packedOffset + start / 4, packedSize(length)));
+    uint8_t *out = reinterpret_cast<uint8_t *>(nibbles);
+
+    // whole packed bytes, four bases at a time
+    hal_size_t numWhole = length / 4;
+    for (hal_size_t i = 0; i < numWhole; ++i) {
+        memcpy(out + 2 * i, twoBitDecodeTable._bytes[packed[i]], 2);
+    }
+    for (hal_size_t i = numWhole * 4; i < length; ++i) {
+        uint8_t code = twoBitDecodeTable._nibbles[packed[i / 4]][i & 3];
+        out[i / 2] = (i & 1) ? ((out[i / 2] & 0xF0) | code) : (code << 4);
+    }
+
+    // overlay N's, then lower case
+    auto setNibble = [&](hal_index_t pos, uint8_t clearBits, uint8_t setBits) {
+        hal_index_t rel = pos - start;
+        uint8_t shift = (rel & 1) ? 0 : 4;
+        uint8_t code = (out[rel / 2] >> shift) & 0x0F;
+        code = (code & ~clearBits) | setBits;
+        out[rel / 2] = (out[rel / 2] & ~(0x0F << shift)) | (code << shift);
+    };
+    applyRuns(file, data->_nRunsOffset, data->_numNRuns, start, end,
+              [&](hal_index_t pos) { setNibble(pos, NIBBLE_BASE_MASK, NIBBLE_N); });
+    applyRuns(file, data->_maskRunsOffset, data->_numMaskRuns, start, end,
+              [&](hal_index_t pos) { setNibble(pos, NIBBLE_UPPER_BIT, 0); });
+}
@@ -0,0 +1,51 @@
+#ifndef _MMAPTWOBITDNA_H
+#define _MMAPTWOBITDNA_H
+#include "mmapFile.h"
+
+namespace hal {
+    /* A run of N or soft-masked bases, [_start, _end) */
+    struct MMapDnaRun {
+        hal_index_t _start;
+        hal_index_t _end;
+    };
+
+    /* Per-genome DNA in the MMAP_DNA_TWO_BIT encoding.  Bases are packed four
+     * per byte (first base in the high bits) as A, C, G, T = 0..3, with N
+     * stored as 0.  N and lower-case bases are recorded as sorted runs in
+     * side tables and applied on decode.  When a file uses this encoding,
+     * the genome's DNA offset points at this structure.
+     *
+     * The encoding can't be updated in place, so genomes in writable files
+     * keep their DNA in memory in the nibble encoding and are encoded into
+     * the file when closed (see MMapGenome). */
+    class MMapTwoBitDna {
+      public:
+        /* encode length nibble-packed bases, returning the offset of the
+         * data.  The space of the encoding at oldOffset is reused where
+         * the new one fits in it. */
+        static size_t encode(MMapFile *file, const char *nibbles, hal_size_t length, size_t oldOffset = MMAP_NULL_OFFSET);
+
+        /* decode bases [start, end) into nibble-packed buffer, which must
+         * have room for (end - start + 1) / 2 bytes.  Start must be a multiple
+         * of four. */
+        static void decode(const MMapFile *file, size_t offset, hal_index_t start, hal_index_t end, char *nibbles);
+
+        /* size in bytes of the packed bases, excluding run tables */
+        static size_t packedSize(hal_size_t length) {
+            return (length + 3) / 4;
+        }
+
+      private:
+        hal_size_t _length;
+        size_t _packedOffset;
+        hal_size_t _numNRuns;
+        size_t _nRunsOffset;
+        hal_size_t _numMaskRuns;
+        size_t _maskRunsOffset;
+        char _reserved[64];
+    };
+}
+#endif
+// Local Variables:
+// mode: c++
+// End:
@@ -7,6 +7,8 @@
 
 #include "halApiTestSupport.h"
 #include "halAlignment.h"
+#include "halBottomSegmentIterator.h"
+#include "halCommon.h"
 #include "halGenome.h"
 #include <cstdlib>
 #include <iostream>
@@ -61,6 +63,126 @@ class AlignmentTestTrees : public AlignmentTest {
     }
 };
 
+/* remove a leaf, which drops its column from the parent's bottom segments,
+ * then insert a genome above another leaf */
+class AlignmentTestRemoveInsert : public AlignmentTest {
+  public:
+    void createCallBack(AlignmentPtr alignment) {
+        Genome *root = alignment->addRootGenome("Root", 0);
+        alignment->addLeafGenome("Leaf1", "Root", 1);
+        alignment->addLeafGenome("Leaf2", "Root", 2);
+        alignment->addLeafGenome("Leaf3", "Root", 3);
+        vector<Sequence::Info> seqVec(1);
+        seqVec[0] = Sequence::Info("Sequence", 100, 0, 10);
+        root->setDimensions(seqVec);
+        BottomSegmentIteratorPtr botIt = root->getBottomSegmentIterator();
+        for (; botIt->getArrayIndex() < 10; botIt->toRight()) {
+            hal_index_t i = botIt->getArrayIndex();
+            botIt->setCoordinates(i * 10, 10);
+            for (hal_size_t child = 0; child < 3; ++child) {
+                botIt->bseg()->setChildIndex(child, i + 10 * child);
+                botIt->bseg()->setChildReversed(child, (i + child) % 2 == 0);
+            }
+            botIt->bseg()->setTopParseIndex(NULL_INDEX);
+        }
+
+        alignment->removeGenome("Leaf2");
+        CuAssertTrue(_testCase, alignment->getNumGenomes() == 3);
+        CuAssertTrue(_testCase, alignment->openGenome("Leaf2") == NULL);
+        CuAssertTrue(_testCase, root->getNumChildren() == 2);
+        CuAssertTrue(_testCase, root->getChild(1)->getName() == "Leaf3");
+
+        Genome *mid = alignment->insertGenome("Mid", "Root", "Leaf3", 1);
+        CuAssertTrue(_testCase, mid != NULL);
+        CuAssertTrue(_testCase, alignment->getNumGenomes() == 4);
+        CuAssertTrue(_testCase, alignment->openGenome("Leaf3")->getParent() == mid);
+        CuAssertTrue(_testCase, root->getChild(1) == mid);
+    }
+
+    void checkCallBack(AlignmentConstPtr alignment) {
+        CuAssertTrue(_testCase, alignment->getNewickTree() == "(Leaf1:1,(Leaf3:2)Mid:1)Root;");
+        CuAssertTrue(_testCase, alignment->getNumGenomes() == 4);
+        CuAssertTrue(_testCase, alignment->openGenome("Leaf2") == NULL);
+        CuAssertTrue(_testCase, alignment->openGenome("Leaf1") != NULL);
+        CuAssertTrue(_testCase, alignment->openGenome("Mid") != NULL);
+        const Genome *root = alignment->openGenome("Root");
+        CuAssertTrue(_testCase, root->getNumChildren() == 2);
+        CuAssertTrue(_testCase, root->getNumBottomSegments() == 10);
+        BottomSegmentIteratorPtr botIt = root->getBottomSegmentIterator();
+        for (; botIt->getArrayIndex() < 10; botIt->toRight()) {
+            hal_index_t i = botIt->getArrayIndex();
+            CuAssertTrue(_testCase, botIt->getStartPosition() == i * 10);
+            CuAssertTrue(_testCase, botIt->getLength() == 10);
+            // the columns of Leaf1 and Leaf3 (formerly child 2)
+            CuAssertTrue(_testCase, botIt->bseg()->getChildIndex(0) == i);
+            CuAssertTrue(_testCase, botIt->bseg()->getChildReversed(0) == (i % 2 == 0));
+            CuAssertTrue(_testCase, botIt->bseg()->getChildIndex(1) == i + 20);
+            CuAssertTrue(_testCase, botIt->bseg()->getChildReversed(1) == (i % 2 == 0));
+        }
+    }
+};
+
+/* mapping paths match the MRCA and spanning trees, are computed once, and
+ * are recomputed after the tree changes */
+class AlignmentTestMappingPath : public AlignmentTest {
+  public:
+    void createCallBack(AlignmentPtr alignment) {
+        alignment->addRootGenome("Root", 0);
+        alignment->addLeafGenome("Mid", "Root", 1);
+        alignment->addLeafGenome("Leaf1", "Mid", 1);
+        alignment->addLeafGenome("Leaf2", "Mid", 1);
+        alignment->addLeafGenome("Leaf3", "Root", 1);
+        const Genome *root = alignment->openGenome("Root");
+        const Genome *mid = alignment->openGenome("Mid");
+        const Genome *leaf1 = alignment->openGenome("Leaf1");
+        const Genome *leaf2 = alignment->openGenome("Leaf2");
+
+        MappingPathConstPtr path = alignment->getMappingPath(leaf1, leaf2);
+        CuAssertTrue(_testCase, path->_mrca == mid);
+        CuAssertTrue(_testCase, path->_coalescenceLimit == mid);
+        CuAssertTrue(_testCase, path->_genomesOnPath == set<const Genome *>({mid, leaf2}));
+        CuAssertTrue(_testCase, alignment->getMappingPath(leaf1, leaf2) == path);
+
+        MappingPathConstPtr limitPath = alignment->getMappingPath(leaf1, leaf2, root);
+        CuAssertTrue(_testCase, limitPath->_mrca == mid);
+        CuAssertTrue(_testCase, limitPath->_coalescenceLimit == root);
+        CuAssertTrue(_testCase, limitPath->_genomesOnPath == set<const Genome *>({root, mid, leaf2}));
+
+        alignment->addLeafGenome("Leaf4", "Mid", 1);
+        MappingPathConstPtr newPath = alignment->getMappingPath(leaf1, leaf2);
+        CuAssertTrue(_testCase, newPath != path);
+        CuAssertTrue(_testCase, newPath->_genomesOnPath == path->_genomesOnPath);
+    }
+
+    void checkCallBack(AlignmentConstPtr alignment) {
+        const Genome *root = alignment->openGenome(alignment->getRootName());
+        set<const Genome *> genomes;
+        getGenomesInSubTree(root, genomes);
+        CuAssertTrue(_testCase, genomes.size() == 6);
+        for (const Genome *src : genomes) {
+            for (const Genome *tgt : genomes) {
+                set<const Genome *> inputSet = {src, tgt};
+                const Genome *mrca = getLowestCommonAncestor(inputSet);
+                set<const Genome *> spanningTree;
+                getGenomesInSpanningTree({mrca, tgt}, spanningTree);
+                MappingPathConstPtr path = alignment->getMappingPath(src, tgt);
+                CuAssertTrue(_testCase, path->_mrca == mrca);
+                CuAssertTrue(_testCase, path->_genomesOnPath == spanningTree);
+            }
+        }
+    }
+};
+
+static void halAlignmentTestMappingPath(CuTest *testCase) {
+    AlignmentTestMappingPath tester;
+    tester.check(testCase);
+}
+
+static void halAlignmentTestRemoveInsert(CuTest *testCase) {
+    AlignmentTestRemoveInsert tester;
+    tester.check(testCase);
+}
+
 static void halAlignmentTestTrees(CuTest *testCase) {
     AlignmentTestTrees tester;
     tester.check(testCase);
@@ -69,6 +191,8 @@ static void halAlignmentTestTrees(CuTest *testCase) {
 static CuSuite *halAlignmentTestSuite(void) {
     CuSuite *suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, halAlignmentTestTrees);
+    SUITE_ADD_TEST(suite, halAlignmentTestRemoveInsert);
+    SUITE_ADD_TEST(suite, halAlignmentTestMappingPath);
     return suite;
 }
 
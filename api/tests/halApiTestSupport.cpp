@@ -21,7 +21,8 @@ using namespace hal;
  */
 static string storageDriverToTest;
 
-AlignmentPtr getTestAlignmentInstances(const std::string &storageFormat, const std::string &alignmentPath, unsigned mode) {
+AlignmentPtr getTestAlignmentInstances(const std::string &storageFormat, const std::string &alignmentPath, unsigned mode,
+                                       MMapSegmentLayout segmentLayout) {
     if (storageFormat == STORAGE_FORMAT_HDF5) {
         return AlignmentPtr(hdf5AlignmentInstance(alignmentPath, mode, hdf5DefaultFileCreatPropList(), hdf5DefaultFileAccPropList(),
                                                   hdf5DefaultDSetCreatPropList()));
@@ -29,7 +30,7 @@ AlignmentPtr getTestAlignmentInstances(const std::string &storageFormat, const s
     } else if (storageFormat == hal::STORAGE_FORMAT_MMAP) {
         // We use a default init size of only 1GiB here, because the test
         // alignments we create are relatively small.
-        return AlignmentPtr(mmapAlignmentInstance(alignmentPath, mode, 1024 * 1024 * 1024));
+        return AlignmentPtr(mmapAlignmentInstance(alignmentPath, mode, 1024 * 1024 * 1024, MMAP_DNA_NIBBLE, segmentLayout));
     } else {
         throw hal_exception("invalid storage format: " + storageFormat);
     }
@@ -115,17 +116,18 @@ void AlignmentTest::check(CuTest *testCase) {
         }
         if (storageDriverToTest.empty() or (storageDriverToTest == STORAGE_FORMAT_MMAP)) {
             checkOne(testCase, STORAGE_FORMAT_MMAP);
+            checkOne(testCase, STORAGE_FORMAT_MMAP, MMAP_SEGMENTS_COLUMNAR);
         }
     } catch (const exception &e) {
         CuFail(testCase, stString_print("Caught exception while testing: %s", e.what()));
     }
 }
 
-void AlignmentTest::checkOne(CuTest *testCase, const string &storageFormat) {
+void AlignmentTest::checkOne(CuTest *testCase, const string &storageFormat, MMapSegmentLayout segmentLayout) {
     string alignmentPath = getTempFile();
 
     // test with created
-    AlignmentPtr calignment(getTestAlignmentInstances(storageFormat, alignmentPath, CREATE_ACCESS));
+    AlignmentPtr calignment(getTestAlignmentInstances(storageFormat, alignmentPath, CREATE_ACCESS, segmentLayout));
     _createPath = alignmentPath;
     createCallBack(calignment);
     calignment->close();
@@ -18,7 +18,8 @@ extern "C" {
 using namespace hal;
 using namespace std;
 
-AlignmentPtr getTestAlignmentInstances(const string &storageFormat, const string &alignmentPath, unsigned mode);
+AlignmentPtr getTestAlignmentInstances(const string &storageFormat, const string &alignmentPath, unsigned mode,
+                                       MMapSegmentLayout segmentLayout = MMAP_SEGMENTS_ROW);
 
 /** parse command line and run a test suite for the given storage driver,
  * return exit code  */
@@ -41,7 +42,7 @@ class AlignmentTest {
     string _createPath;
     string _checkPath;
     static string randomString(hal_size_t length);
-    void checkOne(CuTest *testCase, const string &storageFormat);
+    void checkOne(CuTest *testCase, const string &storageFormat, MMapSegmentLayout segmentLayout = MMAP_SEGMENTS_ROW);
 };
 
 
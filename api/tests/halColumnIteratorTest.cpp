@@ -953,6 +953,15 @@ struct ColumnIteratorPositionCacheTest : public AlignmentTest {
                 CuAssertTrue(_testCase, truth.size() == cache.size());
             }
             CuAssertTrue(_testCase, cache.check());
+            // the intervals cover exactly the inserted positions
+            set<hal_index_t>::const_iterator t = truth.begin();
+            const PositionCache::IntervalSet *intervals = cache.getIntervalSet();
+            for (PositionCache::IntervalSet::const_iterator k = intervals->begin(); k != intervals->end(); ++k) {
+                for (hal_index_t pos = k->second; pos <= k->first; ++pos, ++t) {
+                    CuAssertTrue(_testCase, t != truth.end() && *t == pos);
+                }
+            }
+            CuAssertTrue(_testCase, t == truth.end());
             for (size_t j = 0; j < entries * 2; ++j) {
                 hal_index_t val = (hal_index_t)rand() % sizes[i];
                 bool r = truth.find(val) != truth.end();
@@ -965,6 +974,43 @@ struct ColumnIteratorPositionCacheTest : public AlignmentTest {
     }
 };
 
+/* inserts the way a column walk does them: several fronts moving right or
+ * left, one base at a time, that meet and merge */
+struct ColumnIteratorPositionCacheWalkTest : public AlignmentTest {
+    void createCallBack(AlignmentPtr alignment) {
+        alignment->addRootGenome("foobar");
+    }
+
+    void checkCallBack(AlignmentConstPtr alignment) {
+        set<hal_index_t> truth;
+        PositionCache cache;
+        const hal_index_t numFronts = 8;
+        const hal_index_t spacing = 1000;
+        for (hal_index_t step = 0; step < spacing / 2; ++step) {
+            for (hal_index_t front = 0; front < numFronts; ++front) {
+                hal_index_t start = front * spacing;
+                hal_index_t pos = front % 2 == 0 ? start + step : start - 1 - step;
+                CuAssertTrue(_testCase, truth.insert(pos).second == cache.insert(pos));
+                // revisiting is a no-op
+                CuAssertTrue(_testCase, cache.insert(pos) == false);
+            }
+        }
+        CuAssertTrue(_testCase, cache.check());
+        CuAssertTrue(_testCase, cache.size() == truth.size());
+        // each pair of fronts met in the middle
+        CuAssertTrue(_testCase, cache.numIntervals() == (hal_size_t)numFronts / 2);
+        for (hal_index_t pos = -1; pos <= numFronts * spacing; ++pos) {
+            CuAssertTrue(_testCase, cache.find(pos) == (truth.find(pos) != truth.end()));
+        }
+        const PositionCache::IntervalSet *intervals = cache.getIntervalSet();
+        hal_index_t i = 0;
+        for (PositionCache::IntervalSet::const_iterator k = intervals->begin(); k != intervals->end(); ++k, ++i) {
+            CuAssertTrue(_testCase, k->second == i * 2 * spacing);
+            CuAssertTrue(_testCase, k->first == (i * 2 + 1) * spacing - 1);
+        }
+    }
+};
+
 static void halColumnIteratorBaseTest(CuTest *testCase) {
     ColumnIteratorBaseTest tester;
     tester.check(testCase);
@@ -1005,6 +1051,11 @@ static void halColumnIteratorPositionCacheTest(CuTest *testCase) {
     tester.check(testCase);
 }
 
+static void halColumnIteratorPositionCacheWalkTest(CuTest *testCase) {
+    ColumnIteratorPositionCacheWalkTest tester;
+    tester.check(testCase);
+}
+
 static CuSuite *halColumnIteratorTestSuite(void) {
     CuSuite *suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, halColumnIteratorBaseTest);
@@ -1015,6 +1066,7 @@ static CuSuite *halColumnIteratorTestSuite(void) {
     SUITE_ADD_TEST(suite, halColumnIteratorMultiGapTest);
     SUITE_ADD_TEST(suite, halColumnIteratorMultiGapInvTest);
     SUITE_ADD_TEST(suite, halColumnIteratorPositionCacheTest);
+    SUITE_ADD_TEST(suite, halColumnIteratorPositionCacheWalkTest);
     return suite;
 }
 
@@ -16,6 +16,7 @@
 #include <iostream>
 #include <stdio.h>
 #include <string>
+#include <unistd.h>
 extern "C" {
 #include "commonC.h"
 }
@@ -572,6 +573,195 @@ static void halGenomeDNAPackUnpackTest(CuTest *testCase) {
     }
 }
 
+static void halGenomeDNAUnpackRangeTest(CuTest *testCase) {
+    // long enough for several vector blocks, tested at all alignments
+    string dna = AlignmentTest::randomString(300);
+    vector<char> packed(dna.length() / 2 + 1);
+    for (size_t i = 0; i < dna.length(); i++) {
+        packed[i / 2] = dnaPack(dna[i], i, packed[i / 2]);
+    }
+    vector<char> out(dna.length());
+    for (hal_index_t start = 0; start < 70; ++start) {
+        for (hal_size_t length = 0; start + length <= dna.length(); length += 1 + length / 8) {
+            for (int flags = 0; flags < 4; ++flags) {
+                bool reversed = flags & 1, upper = flags & 2;
+                string expected = dna.substr(start, length);
+                if (reversed) {
+                    reverseComplement(expected);
+                }
+                if (upper) {
+                    for (size_t i = 0; i < expected.length(); ++i) {
+                        expected[i] = toupper(expected[i]);
+                    }
+                }
+                dnaUnpackRange(packed.data(), start, length, out.data(), reversed, upper);
+                CuAssertTrue(testCase, string(out.data(), length) == expected);
+            }
+        }
+    }
+}
+
+static long getFileSize(const string &path) {
+    FILE *file = fopen(path.c_str(), "r");
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fclose(file);
+    return fileSize;
+}
+
+/* mmap version string from the header of a file */
+static string getMmapFileVersion(const string &path) {
+    char header[64] = {0};
+    FILE *file = fopen(path.c_str(), "r");
+    size_t bytesRead = fread(header, 1, sizeof(header) - 1, file);
+    fclose(file);
+    return (bytesRead < 32) ? string() : string(header + 32);
+}
+
+/* mmap-only: DNA written with the two-bit encoding, read back read-only,
+ * then updated through write access */
+static void halGenomeTwoBitDnaTest(CuTest *testCase) {
+    string alignmentPath = getTempFile();
+    try {
+        hal_size_t seqLength = 100003;
+        // long N runs and mask runs, along with the random ones
+        string dna = AlignmentTest::randomString(seqLength);
+        dna.replace(5000, 9000, 9000, 'N');
+        dna.replace(20001, 5000, string(5000, 'a'));
+
+        AlignmentPtr calignment(mmapAlignmentInstance(alignmentPath, CREATE_ACCESS, 1024 * 1024 * 1024, MMAP_DNA_TWO_BIT));
+        Genome *genome = calignment->addRootGenome("AncGenome", 0);
+        vector<Sequence::Info> seqVec(1, Sequence::Info("Sequence", seqLength, 0, 0));
+        genome->setDimensions(seqVec);
+        genome->setString(dna);
+        calignment->close();
+        // 1.x readers must reject two-bit files rather than misread them
+        CuAssertStrEquals(testCase, "2.0", getMmapFileVersion(alignmentPath).c_str());
+
+        AlignmentPtr ralignment(mmapAlignmentInstance(alignmentPath, READ_ACCESS));
+        const Genome *rgenome = ralignment->openGenome("AncGenome");
+        string outString;
+        rgenome->getString(outString);
+        CuAssertTrue(testCase, outString == dna);
+        const Sequence *sequence = rgenome->getSequence("Sequence");
+        for (hal_size_t start : {0, 1, 4095, 4099, 13999, 25000, 99000}) {
+            sequence->getSubString(outString, start, seqLength - start < 3001 ? seqLength - start : 3001);
+            CuAssertTrue(testCase, outString == dna.substr(start, outString.length()));
+            vector<char> buffer(outString.length());
+            sequence->getSubString(buffer.data(), start, buffer.size(), true, false);
+            reverseComplement(outString);
+            CuAssertTrue(testCase, string(buffer.data(), buffer.size()) == outString);
+        }
+        ralignment->close();
+
+        AlignmentPtr walignment(mmapAlignmentInstance(alignmentPath, WRITE_ACCESS));
+        Sequence *wsequence = walignment->openGenome("AncGenome")->getSequence("Sequence");
+        dna.replace(4097, 7, "acgtNNA");
+        wsequence->setSubString("acgtNNA", 4097, 7);
+        walignment->close();
+
+        ralignment = AlignmentPtr(mmapAlignmentInstance(alignmentPath, READ_ACCESS));
+        ralignment->openGenome("AncGenome")->getString(outString);
+        CuAssertTrue(testCase, outString == dna);
+        ralignment->close();
+
+        // a change inside a masked run is encoded in the same space
+        long fileSize = getFileSize(alignmentPath);
+        walignment = AlignmentPtr(mmapAlignmentInstance(alignmentPath, WRITE_ACCESS));
+        dna.replace(22000, 4, "cgta");
+        walignment->openGenome("AncGenome")->getSequence("Sequence")->setSubString("cgta", 22000, 4);
+        walignment->close();
+        CuAssertTrue(testCase, getFileSize(alignmentPath) == fileSize);
+
+        // closing a genome encodes its DNA, which can still be read and
+        // written
+        walignment = AlignmentPtr(mmapAlignmentInstance(alignmentPath, WRITE_ACCESS));
+        Genome *wgenome = walignment->openGenome("AncGenome");
+        Genome *leafGenome = walignment->addLeafGenome("LeafGenome", "AncGenome", 1);
+        leafGenome->setDimensions(seqVec);
+        string leafDna = AlignmentTest::randomString(seqLength);
+        leafGenome->setString(leafDna);
+        walignment->closeGenome(leafGenome);
+        walignment->closeGenome(wgenome);
+        wgenome->getString(outString);
+        CuAssertTrue(testCase, outString == dna);
+        dna.replace(7, 3, "GGG");
+        wgenome->getSequence("Sequence")->setSubString("GGG", 7, 3);
+        walignment->close();
+
+        ralignment = AlignmentPtr(mmapAlignmentInstance(alignmentPath, READ_ACCESS));
+        ralignment->openGenome("AncGenome")->getString(outString);
+        CuAssertTrue(testCase, outString == dna);
+        ralignment->openGenome("LeafGenome")->getString(outString);
+        CuAssertTrue(testCase, outString == leafDna);
+        ralignment->close();
+    } catch (const exception &e) {
+        CuFail(testCase, stString_print("Caught exception while testing: %s", e.what()));
+    }
+    ::unlink(alignmentPath.c_str());
+}
+
+/* mmap-only: a file created far too small grows as genomes are added and
+ * is trimmed on close */
+static void halGenomeMMapGrowTest(CuTest *testCase) {
+    string alignmentPath = getTempFile();
+    try {
+        hal_size_t seqLength = 1000000;
+        AlignmentPtr calignment(mmapAlignmentInstance(alignmentPath, CREATE_ACCESS, 64 * 1024));
+        vector<string> dna;
+        for (int i = 0; i < 3; ++i) {
+            Genome *genome = i == 0 ? calignment->addRootGenome("Genome0", 0)
+                                    : calignment->addLeafGenome("Genome" + to_string(i), "Genome0", 1);
+            vector<Sequence::Info> seqVec(1, Sequence::Info("Sequence", seqLength, i == 0 ? 0 : 1000, i == 0 ? 1000 : 0));
+            genome->setDimensions(seqVec);
+            dna.push_back(AlignmentTest::randomString(seqLength));
+            genome->setString(dna.back());
+        }
+        calignment->close();
+        long fileSize = getFileSize(alignmentPath);
+        CuAssertTrue(testCase, fileSize > long(3 * seqLength / 2) && fileSize < long(3 * seqLength));
+        // nibble files stay readable by 1.x readers
+        CuAssertTrue(testCase, getMmapFileVersion(alignmentPath).compare(0, 2, "1.") == 0);
+
+        AlignmentPtr ralignment(mmapAlignmentInstance(alignmentPath, READ_ACCESS));
+        for (int i = 0; i < 3; ++i) {
+            string outString;
+            ralignment->openGenome("Genome" + to_string(i))->getString(outString);
+            CuAssertTrue(testCase, outString == dna[i]);
+        }
+        ralignment->close();
+    } catch (const exception &e) {
+        CuFail(testCase, stString_print("Caught exception while testing: %s", e.what()));
+    }
+    ::unlink(alignmentPath.c_str());
+}
+
+/* mmap-only: files with columnar segments are marked so that 1.x readers
+ * reject them, and are read back */
+static void halGenomeColumnarVersionTest(CuTest *testCase) {
+    string alignmentPath = getTempFile();
+    try {
+        AlignmentPtr calignment(
+            mmapAlignmentInstance(alignmentPath, CREATE_ACCESS, 1024 * 1024, MMAP_DNA_NIBBLE, MMAP_SEGMENTS_COLUMNAR));
+        Genome *genome = calignment->addRootGenome("Genome0", 0);
+        vector<Sequence::Info> seqVec(1, Sequence::Info("Sequence", 1000, 0, 10));
+        genome->setDimensions(seqVec);
+        calignment->close();
+        CuAssertStrEquals(testCase, "2.0", getMmapFileVersion(alignmentPath).c_str());
+
+        AlignmentPtr ralignment(mmapAlignmentInstance(alignmentPath, READ_ACCESS));
+        MMapDnaEncoding dnaEncoding;
+        MMapSegmentLayout segmentLayout;
+        getMMapAlignmentLayout(ralignment.get(), dnaEncoding, segmentLayout);
+        CuAssertTrue(testCase, segmentLayout == MMAP_SEGMENTS_COLUMNAR);
+        CuAssertTrue(testCase, ralignment->openGenome("Genome0")->getNumBottomSegments() == 10);
+        ralignment->close();
+    } catch (const exception &e) {
+        CuFail(testCase, stString_print("Caught exception while testing: %s", e.what()));
+    }
+    ::unlink(alignmentPath.c_str());
+}
+
 static CuSuite *halGenomeTestSuite(void) {
     CuSuite *suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, halGenomeMetaTest);
@@ -581,6 +771,10 @@ static CuSuite *halGenomeTestSuite(void) {
     SUITE_ADD_TEST(suite, halGenomeCopyTest);
     SUITE_ADD_TEST(suite, halGenomeCopySegmentsWhenSequencesOutOfOrderTest);
     SUITE_ADD_TEST(suite, halGenomeDNAPackUnpackTest);
+    SUITE_ADD_TEST(suite, halGenomeDNAUnpackRangeTest);
+    SUITE_ADD_TEST(suite, halGenomeTwoBitDnaTest);
+    SUITE_ADD_TEST(suite, halGenomeMMapGrowTest);
+    SUITE_ADD_TEST(suite, halGenomeColumnarVersionTest);
     return suite;
 }
 
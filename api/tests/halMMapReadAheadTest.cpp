@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "halApiTestSupport.h"
+#include "mmapReadAhead.h"
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+using namespace hal;
+
+static const size_t TEST_BLOCK_SIZE = 1024;
+
+/* Stand-in for a remote file behind a UDC cache.  Fetching a range requests
+ * each run of missing blocks in it from the "server" in one request, with
+ * some latency, and copies it into the cache, as UDC does. */
+class RangeServer {
+  public:
+    RangeServer(size_t fileSize) : _data(fileSize), _cache(fileSize, 0), _cached(numBlocks(), false), _numRequests(0) {
+        for (size_t i = 0; i < fileSize; ++i) {
+            _data[i] = (char)(i * 7 + i / 251);
+        }
+    }
+    size_t numBlocks() const {
+        return (_data.size() + TEST_BLOCK_SIZE - 1) / TEST_BLOCK_SIZE;
+    }
+    void fetch(size_t offset, size_t size) {
+        size_t endBlock = (offset + size + TEST_BLOCK_SIZE - 1) / TEST_BLOCK_SIZE;
+        for (size_t block = offset / TEST_BLOCK_SIZE; block < endBlock;) {
+            size_t runEnd = block;
+            {
+                lock_guard<mutex> lock(_mutex);
+                while ((runEnd < endBlock) && !_cached[runEnd]) {
+                    ++runEnd;
+                }
+                if (runEnd > block) {
+                    ++_numRequests;
+                }
+            }
+            if (runEnd == block) {
+                ++block;
+                continue;
+            }
+            this_thread::sleep_for(chrono::microseconds(200));
+            size_t start = block * TEST_BLOCK_SIZE;
+            size_t end = min(_data.size(), runEnd * TEST_BLOCK_SIZE);
+            lock_guard<mutex> lock(_mutex);
+            memcpy(&_cache[start], &_data[start], end - start);
+            for (size_t i = block; i < runEnd; ++i) {
+                _cached[i] = true;
+            }
+            block = runEnd;
+        }
+    }
+    /* check that [offset, offset + size) is in the cache and correct */
+    bool check(size_t offset, size_t size) {
+        lock_guard<mutex> lock(_mutex);
+        for (size_t block = offset / TEST_BLOCK_SIZE; block * TEST_BLOCK_SIZE < offset + size; ++block) {
+            if (!_cached[block]) {
+                return false;
+            }
+        }
+        return memcmp(&_cache[offset], &_data[offset], size) == 0;
+    }
+    size_t getNumRequests() {
+        lock_guard<mutex> lock(_mutex);
+        return _numRequests;
+    }
+
+  private:
+    vector<char> _data;
+    vector<char> _cache;
+    vector<bool> _cached;
+    size_t _numRequests;
+    mutex _mutex;
+};
+
+/* foreground access, as done by MMapFileUdc::fetch */
+static void readRange(MMapReadAhead &readAhead, RangeServer &server, size_t offset, size_t size) {
+    size_t fetchOffset = offset, fetchSize = size;
+    readAhead.access(fetchOffset, fetchSize);
+    server.fetch(fetchOffset, fetchSize);
+}
+
+static MMapReadAhead *newReadAhead(RangeServer &server, size_t fileSize, size_t numThreads) {
+    return new MMapReadAhead(fileSize, TEST_BLOCK_SIZE, numThreads, 4, 64, 16,
+                             [&server](size_t threadIdx, size_t offset, size_t size) { server.fetch(offset, size); });
+}
+
+/* walking an array of small records is read ahead, in requests of several
+ * blocks */
+static void halMMapReadAheadSequentialTest(CuTest *testCase) {
+    const size_t fileSize = 512 * TEST_BLOCK_SIZE + 100;
+    const size_t recordSize = 24;
+    RangeServer server(fileSize);
+    unique_ptr<MMapReadAhead> readAhead(newReadAhead(server, fileSize, 4));
+    for (size_t offset = 0; offset + recordSize <= fileSize; offset += recordSize) {
+        readRange(*readAhead, server, offset, recordSize);
+        CuAssertTrue(testCase, server.check(offset, recordSize));
+    }
+    readAhead->drain();
+    // without read-ahead, each block is a request
+    CuAssertTrue(testCase, server.getNumRequests() < server.numBlocks() / 4);
+    CuAssertTrue(testCase, readAhead->getNumRequests() > 0);
+    CuAssertTrue(testCase, readAhead->getNumBlocksRequested() > 2 * readAhead->getNumRequests());
+}
+
+/* two arrays walked in step, as in a column iterator, are both read ahead */
+static void halMMapReadAheadInterleavedTest(CuTest *testCase) {
+    const size_t fileSize = 1024 * TEST_BLOCK_SIZE;
+    const size_t secondStart = 600 * TEST_BLOCK_SIZE;
+    const size_t recordSize = 40;
+    RangeServer server(fileSize);
+    unique_ptr<MMapReadAhead> readAhead(newReadAhead(server, fileSize, 2));
+    for (size_t offset = 0; offset + recordSize <= 400 * TEST_BLOCK_SIZE; offset += recordSize) {
+        readRange(*readAhead, server, offset, recordSize);
+        readRange(*readAhead, server, secondStart + offset / 2, recordSize / 2);
+        CuAssertTrue(testCase, server.check(offset, recordSize));
+        CuAssertTrue(testCase, server.check(secondStart + offset / 2, recordSize / 2));
+    }
+    readAhead->drain();
+    CuAssertTrue(testCase, server.getNumRequests() < 600 / 4);
+}
+
+/* scattered access isn't read ahead */
+static void halMMapReadAheadRandomTest(CuTest *testCase) {
+    const size_t fileSize = 1024 * TEST_BLOCK_SIZE;
+    RangeServer server(fileSize);
+    unique_ptr<MMapReadAhead> readAhead(newReadAhead(server, fileSize, 4));
+    for (size_t i = 0; i < 200; ++i) {
+        size_t offset = ((i * 7919) % 1000) * TEST_BLOCK_SIZE + 10;
+        readRange(*readAhead, server, offset, 100);
+        CuAssertTrue(testCase, server.check(offset, 100));
+    }
+    readAhead->drain();
+    CuAssertTrue(testCase, readAhead->getNumRequests() == 0);
+}
+
+/* with no threads, access is passed through unchanged */
+static void halMMapReadAheadNoThreadsTest(CuTest *testCase) {
+    const size_t fileSize = 64 * TEST_BLOCK_SIZE;
+    RangeServer server(fileSize);
+    unique_ptr<MMapReadAhead> readAhead(newReadAhead(server, fileSize, 0));
+    for (size_t offset = 0; offset + 8 <= fileSize; offset += 8) {
+        size_t fetchOffset = offset, fetchSize = 8;
+        readAhead->access(fetchOffset, fetchSize);
+        CuAssertTrue(testCase, (fetchOffset == offset) && (fetchSize == 8));
+    }
+    CuAssertTrue(testCase, readAhead->getNumRequests() == 0);
+}
+
+static CuSuite *halMMapReadAheadTestSuite(void) {
+    CuSuite *suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, halMMapReadAheadSequentialTest);
+    SUITE_ADD_TEST(suite, halMMapReadAheadInterleavedTest);
+    SUITE_ADD_TEST(suite, halMMapReadAheadRandomTest);
+    SUITE_ADD_TEST(suite, halMMapReadAheadNoThreadsTest);
+    return suite;
+}
+
+int main(int argc, char *argv[]) {
+    return runHalTestSuite(argc, argv, halMMapReadAheadTestSuite());
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+/* Tests of mmap files read through UDC, with read-ahead, from a local HTTP
+ * server (tests/rangeHttpServer.py).  Only built with ENABLE_UDC. */
+
+#include "halApiTestSupport.h"
+#include "halRandNumberGen.h"
+#include "halRandomData.h"
+#include "udc2.h"
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+using namespace std;
+using namespace hal;
+
+/* URL of the server and the directory it serves, from the command line */
+static string serverUrl;
+static string serverDir;
+
+static AlignmentPtr createTestAlignment(const string &name) {
+    return getTestAlignmentInstances(STORAGE_FORMAT_MMAP, serverDir + "/" + name, CREATE_ACCESS);
+}
+
+static string readFile(const string &path) {
+    ifstream in(path.c_str(), ios::binary);
+    return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+/* compare a genome and its subtree read through UDC with the local file,
+ * walking DNA and segments in order, so that they are read ahead */
+static void checkGenome(CuTest *testCase, const Alignment *local, const Alignment *remote, const string &name) {
+    const Genome *localGenome = local->openGenome(name);
+    const Genome *remoteGenome = remote->openGenome(name);
+    CuAssertTrue(testCase, remoteGenome != NULL);
+    string localDna, remoteDna;
+    localGenome->getString(localDna);
+    remoteGenome->getString(remoteDna);
+    CuAssertTrue(testCase, remoteDna == localDna);
+
+    CuAssertTrue(testCase, remoteGenome->getNumTopSegments() == localGenome->getNumTopSegments());
+    if (localGenome->getNumTopSegments() > 0) {
+        TopSegmentIteratorPtr localTop = localGenome->getTopSegmentIterator();
+        TopSegmentIteratorPtr remoteTop = remoteGenome->getTopSegmentIterator();
+        for (; not localTop->atEnd(); localTop->toRight(), remoteTop->toRight()) {
+            CuAssertTrue(testCase, remoteTop->tseg()->getStartPosition() == localTop->tseg()->getStartPosition());
+            CuAssertTrue(testCase, remoteTop->tseg()->getParentIndex() == localTop->tseg()->getParentIndex());
+            CuAssertTrue(testCase, remoteTop->tseg()->getNextParalogyIndex() == localTop->tseg()->getNextParalogyIndex());
+        }
+    }
+    CuAssertTrue(testCase, remoteGenome->getNumBottomSegments() == localGenome->getNumBottomSegments());
+    if (localGenome->getNumBottomSegments() > 0) {
+        BottomSegmentIteratorPtr localBottom = localGenome->getBottomSegmentIterator();
+        BottomSegmentIteratorPtr remoteBottom = remoteGenome->getBottomSegmentIterator();
+        for (; not localBottom->atEnd(); localBottom->toRight(), remoteBottom->toRight()) {
+            CuAssertTrue(testCase, remoteBottom->bseg()->getStartPosition() == localBottom->bseg()->getStartPosition());
+            for (hal_size_t i = 0; i < localBottom->bseg()->getNumChildren(); ++i) {
+                CuAssertTrue(testCase, remoteBottom->bseg()->getChildIndex(i) == localBottom->bseg()->getChildIndex(i));
+            }
+        }
+    }
+
+    vector<string> childNames = local->getChildNames(name);
+    for (size_t i = 0; i < childNames.size(); ++i) {
+        checkGenome(testCase, local, remote, childNames[i]);
+    }
+}
+
+/* a random alignment read through UDC matches the local file */
+static void halMMapUdcReadAheadTest(CuTest *testCase) {
+    try {
+        RandNumberGen rng(false, 1);
+        AlignmentPtr created(createTestAlignment("random.hal"));
+        createRandomAlignment(rng, created, getRandomAlignmentPreset("medium"));
+        created->close();
+
+        AlignmentConstPtr local(openHalAlignment(serverDir + "/random.hal"));
+        AlignmentConstPtr remote(openHalAlignment(serverUrl + "/random.hal"));
+        checkGenome(testCase, local.get(), remote.get(), local->getRootName());
+    } catch (const exception &e) {
+        CuFail(testCase, stString_print("Caught exception while testing: %s", e.what()));
+    }
+}
+
+/* failed read-ahead fetches are ignored.  The server fails any request for
+ * the middle of a long DNA sequence, of which only the start and the end
+ * are read, so only requests read ahead of the start fail.  Requests in the
+ * foreground may be widened by up to a read-ahead request, so a margin of
+ * 512kb is left around the failing range. */
+static void halMMapUdcFailedReadAheadTest(CuTest *testCase) {
+    try {
+        const hal_size_t prefixLength = 4 * 1024 * 1024;
+        const hal_size_t restLength = 16 * 1024 * 1024;
+        const size_t margin = 512 * 1024;
+        string prefix = AlignmentTest::randomString(prefixLength);
+        for (size_t i = 0; i < prefix.length(); ++i) {
+            prefix[i] = toupper(prefix[i]) == 'N' ? 'A' : prefix[i];
+        }
+
+        // two files that differ only in the DNA after the prefix, the
+        // first and last bytes that differ bound it
+        const char restBases[2] = {'A', 'C'};
+        const string names[2] = {"failing.hal", "compare.hal"};
+        for (size_t f = 0; f < 2; ++f) {
+            AlignmentPtr created(createTestAlignment(names[f]));
+            Genome *genome = created->addRootGenome("root");
+            vector<Sequence::Info> dimensions(1, Sequence::Info("seq", prefixLength + restLength, 0, 0));
+            genome->setDimensions(dimensions);
+            genome->setString(prefix + string(restLength, restBases[f]));
+            created->close();
+        }
+        string failingBytes = readFile(serverDir + "/" + names[0]);
+        string compareBytes = readFile(serverDir + "/" + names[1]);
+        CuAssertTrue(testCase, failingBytes.size() == compareBytes.size());
+        size_t restStart = 0, restEnd = failingBytes.size();
+        while ((restStart < restEnd) && (failingBytes[restStart] == compareBytes[restStart])) {
+            ++restStart;
+        }
+        while ((restEnd > restStart) && (failingBytes[restEnd - 1] == compareBytes[restEnd - 1])) {
+            --restEnd;
+        }
+        CuAssertTrue(testCase, restEnd > restStart + 4 * margin);
+
+        AlignmentConstPtr remote(openHalAlignment(serverUrl + "/fail/" + std::to_string(restStart + margin) + "/" +
+                                                  std::to_string(restEnd - margin) + "/" + names[0]));
+        const Genome *genome = remote->openGenome("root");
+        string dna;
+        for (hal_size_t start = 0; start < prefixLength; start += 10000) {
+            hal_size_t length = min((hal_size_t)10000, prefixLength - start);
+            genome->getSubString(dna, start, length);
+            CuAssertTrue(testCase, dna == prefix.substr(start, length));
+        }
+        genome->getSubString(dna, prefixLength + restLength - 1000, 1000);
+        CuAssertTrue(testCase, dna == string(1000, 'A'));
+    } catch (const exception &e) {
+        CuFail(testCase, stString_print("Caught exception while testing: %s", e.what()));
+    }
+}
+
+static CuSuite *halMMapUdcTestSuite(void) {
+    CuSuite *suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, halMMapUdcReadAheadTest);
+    SUITE_ADD_TEST(suite, halMMapUdcFailedReadAheadTest);
+    return suite;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        cerr << "wrong # args: " << argv[0] << " serverUrl serverDir" << endl;
+        return 1;
+    }
+    serverUrl = argv[1];
+    serverDir = argv[2];
+    string cacheDir = serverDir + "/udcCache";
+    udc2SetDefaultDir(const_cast<char *>(cacheDir.c_str()));
+
+    CuSuite *suite = halMMapUdcTestSuite();
+    CuString *output = CuStringNew();
+    CuSuiteRun(suite);
+    CuSuiteSummary(suite, output);
+    CuSuiteDetails(suite, output);
+    cerr << argv[0] << output->buffer << endl;
+    return (suite->failCount > 0) ? 1 : 0;
+}
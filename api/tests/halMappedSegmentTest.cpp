@@ -9,12 +9,14 @@
 #include "hal.h"
 #include "halRandNumberGen.h"
 #include "halRandomData.h"
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <cstdlib>
 #include <ctime>
 #include <iostream>
 #include <string>
+#include <thread>
 
 using namespace std;
 using namespace hal;
@@ -796,6 +798,296 @@ struct MappedSegmentColCompareTest3 : public MappedSegmentColCompareTest {
     }
 };
 
+// map every top segment of every genome to the root from several threads
+// sharing one alignment and check that they all agree with a serial pass.
+struct MappedSegmentConcurrentReadTest : public AlignmentTest {
+    void createCallBack(AlignmentPtr alignment) {
+        createRandomAlignment(rng, alignment, 2, 0.1, 2, 6, 10, 1000, 5, 10);
+    }
+
+    static void mapGenome(const Genome *genome, const Genome *tgtGenome, vector<hal_size_t> *counts) {
+        TopSegmentIteratorPtr topSeg = genome->getTopSegmentIterator(0);
+        for (; topSeg->getArrayIndex() < (hal_index_t)genome->getNumTopSegments(); topSeg->toRight()) {
+            MappedSegmentSet results;
+            halMapSegmentSP(topSeg, results, tgtGenome);
+            hal_size_t total = 0;
+            for (MappedSegmentSet::iterator i = results.begin(); i != results.end(); ++i) {
+                total += (*i)->getStartPosition() + (*i)->getLength();
+            }
+            counts->push_back(total);
+        }
+    }
+
+    void checkCallBack(AlignmentConstPtr alignment) {
+        if (!alignment->supportsConcurrentReads() || alignment->getNumGenomes() == 0) {
+            return;
+        }
+        const Genome *root = alignment->openGenome(alignment->getRootName());
+        set<const Genome *> genomeSet;
+        hal::getGenomesInSubTree(root, genomeSet);
+        vector<const Genome *> genomes(genomeSet.begin(), genomeSet.end());
+
+        // threaded pass first, while the lazy genome and sequence caches are still cold
+        const size_t numThreads = 4;
+        vector<vector<vector<hal_size_t>>> parallel(numThreads, vector<vector<hal_size_t>>(genomes.size()));
+        vector<thread> threads;
+        for (size_t t = 0; t < numThreads; ++t) {
+            threads.push_back(thread([&, t]() {
+                for (size_t i = 0; i < genomes.size(); ++i) {
+                    size_t g = (i + t) % genomes.size();
+                    mapGenome(genomes[g], root, &parallel[t][g]);
+                }
+            }));
+        }
+        for (size_t t = 0; t < numThreads; ++t) {
+            threads[t].join();
+        }
+
+        vector<vector<hal_size_t>> serial(genomes.size());
+        for (size_t i = 0; i < genomes.size(); ++i) {
+            mapGenome(genomes[i], root, &serial[i]);
+        }
+        for (size_t t = 0; t < numThreads; ++t) {
+            for (size_t i = 0; i < genomes.size(); ++i) {
+                CuAssertTrue(_testCase, parallel[t][i].size() == serial[i].size());
+                CuAssertTrue(_testCase, parallel[t][i] == serial[i]);
+            }
+        }
+    }
+};
+
+// map random intervals between every pair of genomes with halMapIntervals and
+// check the results match mapping each interval's segment slices one at a
+// time with halMapSegment
+struct MappedSegmentMapIntervalsTest : public AlignmentTest {
+    void createCallBack(AlignmentPtr alignment) {
+        createRandomAlignment(rng, alignment, 2, 0.1, 2, 6, 10, 1000, 5, 10);
+    }
+
+    static void mapIntervalSlices(const Genome *srcGenome, const MapInterval &interval, const Genome *tgtGenome,
+                                  MappedSegmentSet &results) {
+        SegmentIteratorPtr segIt;
+        hal_index_t numSegments;
+        if (srcGenome->getNumTopSegments() > 0) {
+            segIt = srcGenome->getTopSegmentIterator();
+            numSegments = srcGenome->getNumTopSegments();
+        } else {
+            segIt = srcGenome->getBottomSegmentIterator();
+            numSegments = srcGenome->getNumBottomSegments();
+        }
+        segIt->toSite(interval._start, false);
+        hal_offset_t endOffset = 0;
+        if (interval._end <= segIt->getEndPosition()) {
+            endOffset = segIt->getEndPosition() - interval._end;
+        }
+        segIt->slice(interval._start - segIt->getStartPosition(), endOffset);
+        while (segIt->getArrayIndex() < numSegments && segIt->getStartPosition() <= interval._end) {
+            if (interval._reversed) {
+                segIt->toReverseInPlace();
+            }
+            halMapSegmentSP(segIt, results, tgtGenome);
+            if (interval._reversed) {
+                segIt->toReverseInPlace();
+            }
+            segIt->toRight(interval._end);
+        }
+    }
+
+    static bool sameMapping(const MappedSegmentPtr &ms1, const MappedSegmentPtr &ms2) {
+        return ms1->getSource()->getStartPosition() == ms2->getSource()->getStartPosition() &&
+               ms1->getSource()->getEndPosition() == ms2->getSource()->getEndPosition() &&
+               ms1->getStartPosition() == ms2->getStartPosition() && ms1->getEndPosition() == ms2->getEndPosition();
+    }
+
+    void checkCallBack(AlignmentConstPtr alignment) {
+        if (alignment->getNumGenomes() == 0) {
+            return;
+        }
+        const Genome *root = alignment->openGenome(alignment->getRootName());
+        set<const Genome *> genomeSet;
+        hal::getGenomesInSubTree(root, genomeSet);
+        for (const Genome *srcGenome : genomeSet) {
+            hal_index_t length = srcGenome->getSequenceLength();
+            if (length == 0) {
+                continue;
+            }
+            vector<MapInterval> intervals;
+            for (size_t i = 0; i < 50; ++i) {
+                hal_index_t start = rng.getRandInt(0, length - 1);
+                hal_index_t end = min(length - 1, start + rng.getRandInt(0, 100));
+                intervals.push_back({start, end, rng.getRandInt(1) == 1});
+            }
+            std::sort(intervals.begin(), intervals.end(),
+                      [](const MapInterval &i1, const MapInterval &i2) { return i1._start < i2._start; });
+            for (const Genome *tgtGenome : genomeSet) {
+                if (tgtGenome->getSequenceLength() == 0) {
+                    continue;
+                }
+                size_t numCalls = 0;
+                halMapIntervals(srcGenome, intervals, tgtGenome, [&](size_t i, MappedSegmentSet &results) {
+                    CuAssertTrue(_testCase, i == numCalls++);
+                    MappedSegmentSet expected;
+                    mapIntervalSlices(srcGenome, intervals[i], tgtGenome, expected);
+                    CuAssertTrue(_testCase, results.size() == expected.size());
+                    CuAssertTrue(_testCase, std::equal(results.begin(), results.end(), expected.begin(), sameMapping));
+                });
+                CuAssertTrue(_testCase, numCalls == intervals.size());
+            }
+        }
+    }
+};
+
+// map every segment of every genome to every genome with one SegmentMapper
+// and check that its flat ranges align the same bases as the segments
+// halMapSegment finds
+struct MappedSegmentFlatRangeTest : public AlignmentTest {
+    typedef set<pair<hal_index_t, hal_index_t>> BasePairs;
+
+    void createCallBack(AlignmentPtr alignment) {
+        createRandomAlignment(rng, alignment, 1.25, 0.7, 2, 8, 2, 50, 10, 500);
+    }
+
+    void checkRanges(const vector<MappedRange> &ranges, const Genome *tgtGenome, BasePairs &pairs) {
+        for (const MappedRange &range : ranges) {
+            CuAssertTrue(_testCase, range._genome == tgtGenome);
+            CuAssertTrue(_testCase, range._length > 0);
+            CuAssertTrue(_testCase, range._sequence == tgtGenome->getSequenceBySite(range._start));
+            CuAssertTrue(_testCase, range._start + (hal_index_t)range._length - 1 <= range._sequence->getEndPosition());
+            for (hal_index_t i = 0; i < (hal_index_t)range._length; ++i) {
+                hal_index_t tgtPos = range._reversed ? range._start + (hal_index_t)range._length - 1 - i : range._start + i;
+                pairs.insert(make_pair(range._srcStart + i, tgtPos));
+            }
+        }
+    }
+
+    static void getPairs(const MappedSegmentSet &results, BasePairs &pairs) {
+        for (const MappedSegmentPtr &mappedSeg : results) {
+            const SlicedSegment *source = mappedSeg->getSource();
+            for (hal_index_t i = 0; i < (hal_index_t)mappedSeg->getLength(); ++i) {
+                hal_index_t srcPos = source->getReversed() ? source->getStartPosition() - i : source->getStartPosition() + i;
+                hal_index_t tgtPos = mappedSeg->getReversed() ? mappedSeg->getStartPosition() - i
+                                                              : mappedSeg->getStartPosition() + i;
+                pairs.insert(make_pair(srcPos, tgtPos));
+            }
+        }
+    }
+
+    void checkCallBack(AlignmentConstPtr alignment) {
+        if (alignment->getNumGenomes() == 0) {
+            return;
+        }
+        const Genome *root = alignment->openGenome(alignment->getRootName());
+        set<const Genome *> genomeSet;
+        hal::getGenomesInSubTree(root, genomeSet);
+        SegmentMapper mapper;
+        vector<MappedRange> ranges;
+        for (const Genome *srcGenome : genomeSet) {
+            SegmentIteratorPtr segIt;
+            hal_index_t numSegments;
+            if (srcGenome->getNumTopSegments() > 0) {
+                segIt = srcGenome->getTopSegmentIterator();
+                numSegments = srcGenome->getNumTopSegments();
+            } else {
+                segIt = srcGenome->getBottomSegmentIterator();
+                numSegments = srcGenome->getNumBottomSegments();
+            }
+            for (; segIt->getArrayIndex() < numSegments; segIt->toRight()) {
+                for (const Genome *tgtGenome : genomeSet) {
+                    ranges.clear();
+                    hal_size_t numRanges = mapper.mapSegment(segIt.get(), ranges, tgtGenome);
+                    CuAssertTrue(_testCase, numRanges == ranges.size());
+                    MappedSegmentSet results;
+                    halMapSegmentSP(segIt, results, tgtGenome);
+                    BasePairs flatPairs, expectedPairs;
+                    checkRanges(ranges, tgtGenome, flatPairs);
+                    getPairs(results, expectedPairs);
+                    CuAssertTrue(_testCase, flatPairs == expectedPairs);
+                }
+            }
+        }
+    }
+};
+
+// map every segment of every genome to all genomes at once and check that
+// the results for each target are exactly those of mapping to it alone
+struct MappedSegmentToManyTest : public AlignmentTest {
+    void createCallBack(AlignmentPtr alignment) {
+        createRandomAlignment(rng, alignment, 1.25, 0.7, 2, 8, 2, 50, 10, 500);
+    }
+
+    static bool sameSlice(const SegmentSlice &s1, const SegmentSlice &s2) {
+        return s1._genome == s2._genome && s1._top == s2._top && s1._arrayIndex == s2._arrayIndex &&
+               s1._startOffset == s2._startOffset && s1._endOffset == s2._endOffset && s1._reversed == s2._reversed;
+    }
+
+    static bool sameRange(const MappedRange &r1, const MappedRange &r2) {
+        return sameSlice(r1._source, r2._source) && sameSlice(r1._target, r2._target);
+    }
+
+    static bool sameMapping(const MappedSegmentPtr &ms1, const MappedSegmentPtr &ms2) {
+        return ms1->getSource()->getStartPosition() == ms2->getSource()->getStartPosition() &&
+               ms1->getSource()->getEndPosition() == ms2->getSource()->getEndPosition() &&
+               ms1->getStartPosition() == ms2->getStartPosition() && ms1->getEndPosition() == ms2->getEndPosition();
+    }
+
+    void checkCallBack(AlignmentConstPtr alignment) {
+        if (alignment->getNumGenomes() == 0) {
+            return;
+        }
+        const Genome *root = alignment->openGenome(alignment->getRootName());
+        set<const Genome *> genomeSet;
+        hal::getGenomesInSubTree(root, genomeSet);
+        // a repeated target gets its own results
+        vector<const Genome *> targets(genomeSet.begin(), genomeSet.end());
+        targets.push_back(targets.front());
+        SegmentMapper manyMapper, mapper;
+        vector<vector<MappedRange>> manyRanges;
+        vector<MappedRange> ranges;
+        for (const Genome *srcGenome : genomeSet) {
+            SegmentIteratorPtr segIt;
+            hal_index_t numSegments;
+            if (srcGenome->getNumTopSegments() > 0) {
+                segIt = srcGenome->getTopSegmentIterator();
+                numSegments = srcGenome->getNumTopSegments();
+            } else {
+                segIt = srcGenome->getBottomSegmentIterator();
+                numSegments = srcGenome->getNumBottomSegments();
+            }
+            for (; segIt->getArrayIndex() < numSegments; segIt->toRight()) {
+                for (bool doDupes : {true, false}) {
+                    manyRanges.clear();
+                    hal_size_t numRanges = manyMapper.mapSegmentToMany(segIt.get(), targets, manyRanges, doDupes);
+                    CuAssertTrue(_testCase, manyRanges.size() == targets.size());
+                    hal_size_t expectedNumRanges = 0;
+                    for (size_t t = 0; t < targets.size(); ++t) {
+                        ranges.clear();
+                        expectedNumRanges += mapper.mapSegment(segIt.get(), ranges, targets[t], NULL, doDupes);
+                        CuAssertTrue(_testCase, manyRanges[t].size() == ranges.size());
+                        CuAssertTrue(_testCase,
+                                     std::equal(ranges.begin(), ranges.end(), manyRanges[t].begin(), sameRange));
+                    }
+                    CuAssertTrue(_testCase, numRanges == expectedNumRanges);
+                }
+            }
+
+            // the MappedSegmentSet version, for the last segment
+            if (numSegments == 0) {
+                continue;
+            }
+            segIt->toLeft();
+            vector<MappedSegmentSet> manyResults;
+            halMapSegmentToMany(segIt.get(), targets, manyResults);
+            CuAssertTrue(_testCase, manyResults.size() == targets.size());
+            for (size_t t = 0; t < targets.size(); ++t) {
+                MappedSegmentSet results;
+                halMapSegment(segIt.get(), results, targets[t]);
+                CuAssertTrue(_testCase, manyResults[t].size() == results.size());
+                CuAssertTrue(_testCase, std::equal(results.begin(), results.end(), manyResults[t].begin(), sameMapping));
+            }
+        }
+    }
+};
+
 static void halMappedSegmentMapUpTest(CuTest *testCase) {
     MappedSegmentMapUpTest tester;
     tester.check(testCase);
@@ -851,6 +1143,26 @@ static void halMappedSegmentColCompareTest3(CuTest *testCase) {
     tester.check(testCase);
 }
 
+static void halMappedSegmentConcurrentReadTest(CuTest *testCase) {
+    MappedSegmentConcurrentReadTest tester;
+    tester.check(testCase);
+}
+
+static void halMappedSegmentMapIntervalsTest(CuTest *testCase) {
+    MappedSegmentMapIntervalsTest tester;
+    tester.check(testCase);
+}
+
+static void halMappedSegmentFlatRangeTest(CuTest *testCase) {
+    MappedSegmentFlatRangeTest tester;
+    tester.check(testCase);
+}
+
+static void halMappedSegmentToManyTest(CuTest *testCase) {
+    MappedSegmentToManyTest tester;
+    tester.check(testCase);
+}
+
 static CuSuite *halMappedSegmentTestSuite(void) {
     CuSuite *suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, halMappedSegmentMapExtraParalogsTest);
@@ -862,6 +1174,10 @@ static CuSuite *halMappedSegmentTestSuite(void) {
     SUITE_ADD_TEST(suite, halMappedSegmentColCompareTestCheck1);
     SUITE_ADD_TEST(suite, halMappedSegmentColCompareTestCheck2);
     SUITE_ADD_TEST(suite, halMappedSegmentColCompareTest1);
+    SUITE_ADD_TEST(suite, halMappedSegmentConcurrentReadTest);
+    SUITE_ADD_TEST(suite, halMappedSegmentMapIntervalsTest);
+    SUITE_ADD_TEST(suite, halMappedSegmentFlatRangeTest);
+    SUITE_ADD_TEST(suite, halMappedSegmentToManyTest);
     // FIXME: why are these disabled?
     if (false) {
         SUITE_ADD_TEST(suite, halMappedSegmentColCompareTest2);
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "halApiTestSupport.h"
+#include "halPerfStats.h"
+#include "halRandNumberGen.h"
+#include "halRandomData.h"
+#include <sstream>
+#include <thread>
+
+using namespace std;
+using namespace hal;
+
+/* the expected change of a counter, which is always 0 if they are
+ * compiled out */
+static hal_size_t expectedCount(hal_size_t count) {
+#ifdef HAL_DISABLE_PERF_STATS
+    return 0;
+#else
+    return count;
+#endif
+}
+
+/* iterating segments and opening genomes is counted */
+struct PerfStatsIteratorTest : public AlignmentTest {
+    void createCallBack(AlignmentPtr alignment) {
+        RandNumberGen rng(false, 0);
+        createRandomAlignment(rng, alignment, getRandomAlignmentPreset("small"));
+    }
+
+    void checkCallBack(AlignmentConstPtr alignment) {
+        PerfStats before = getPerfStats();
+        const Genome *genome = alignment->openGenome(alignment->getRootName());
+        hal_size_t numMoves = 0;
+        BottomSegmentIteratorPtr botIt = genome->getBottomSegmentIterator();
+        for (; not botIt->atEnd(); botIt->toRight()) {
+            ++numMoves;
+        }
+        botIt->toSite(genome->getSequenceLength() / 2);
+        botIt->toSite(0);
+        alignment->closeGenome(genome);
+        PerfStats after = getPerfStats();
+
+        CuAssertTrue(_testCase, after._counts[PERF_SEGMENT_MOVES] - before._counts[PERF_SEGMENT_MOVES] ==
+                                    expectedCount(numMoves));
+        CuAssertTrue(_testCase, after._counts[PERF_SEGMENT_SITE_LOOKUPS] - before._counts[PERF_SEGMENT_SITE_LOOKUPS] ==
+                                    expectedCount(2));
+        CuAssertTrue(_testCase,
+                     after._counts[PERF_GENOME_OPENS] - before._counts[PERF_GENOME_OPENS] <= expectedCount(1));
+        CuAssertTrue(_testCase,
+                     after._counts[PERF_GENOME_CLOSES] - before._counts[PERF_GENOME_CLOSES] == expectedCount(1));
+    }
+};
+
+static void halPerfStatsIteratorTest(CuTest *testCase) {
+    PerfStatsIteratorTest tester;
+    tester.check(testCase);
+}
+
+/* counts made by threads are in the totals after the threads exit */
+static void halPerfStatsThreadTest(CuTest *testCase) {
+    const size_t numThreads = 4;
+    PerfStats before = getPerfStats();
+    vector<thread> threads;
+    for (size_t t = 0; t < numThreads; ++t) {
+        threads.push_back(thread([]() {
+            for (size_t i = 0; i < 1000; ++i) {
+                perfCount(PERF_DNA_FETCHES);
+            }
+            perfCount(PERF_UDC_BYTES_FETCHED, 4096);
+        }));
+    }
+    for (size_t t = 0; t < numThreads; ++t) {
+        threads[t].join();
+    }
+    perfCount(PERF_UDC_BYTES_FETCHED, 1);
+    PerfStats after = getPerfStats();
+    CuAssertTrue(testCase,
+                 after._counts[PERF_DNA_FETCHES] - before._counts[PERF_DNA_FETCHES] == expectedCount(numThreads * 1000));
+    CuAssertTrue(testCase, after._counts[PERF_UDC_BYTES_FETCHED] - before._counts[PERF_UDC_BYTES_FETCHED] ==
+                               expectedCount(numThreads * 4096 + 1));
+}
+
+/* both formats of the report have every statistic */
+static void halPerfStatsWriteTest(CuTest *testCase) {
+    for (const char *format : {"table", "json"}) {
+        stringstream report;
+        writePerfStats(report, format);
+        for (size_t i = 0; i < PERF_NUM_COUNTERS; ++i) {
+            CuAssertTrue(testCase, report.str().find(getPerfCounterName(PerfCounter(i))) != string::npos);
+        }
+        for (size_t i = 0; i < PERF_NUM_TIMERS; ++i) {
+            CuAssertTrue(testCase, report.str().find(getPerfTimerName(PerfTimer(i))) != string::npos);
+        }
+        CuAssertTrue(testCase, report.str().find("peakRssKb") != string::npos);
+    }
+    string json;
+    {
+        stringstream report;
+        writePerfStats(report, "json");
+        json = report.str();
+    }
+    CuAssertTrue(testCase, json.front() == '{' && json.find("}\n") == json.size() - 2);
+    try {
+        enablePerfStats("xml");
+        CuFail(testCase, "invalid format accepted");
+    } catch (const hal_exception &e) {
+    }
+}
+
+/* nothing is counted until enabled */
+static void halPerfStatsDisabledTest(CuTest *testCase) {
+    setPerfStatsEnabled(false);
+    PerfStats before = getPerfStats();
+    perfCount(PERF_DNA_FETCHES, 10);
+    PerfStats after = getPerfStats();
+    setPerfStatsEnabled(true);
+    CuAssertTrue(testCase, after._counts[PERF_DNA_FETCHES] == before._counts[PERF_DNA_FETCHES]);
+}
+
+static CuSuite *halPerfStatsTestSuite(void) {
+    CuSuite *suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, halPerfStatsIteratorTest);
+    SUITE_ADD_TEST(suite, halPerfStatsThreadTest);
+    SUITE_ADD_TEST(suite, halPerfStatsWriteTest);
+    SUITE_ADD_TEST(suite, halPerfStatsDisabledTest);
+    return suite;
+}
+
+int main(int argc, char *argv[]) {
+    setPerfStatsEnabled(true);
+    return runHalTestSuite(argc, argv, halPerfStatsTestSuite());
+}
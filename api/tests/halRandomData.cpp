@@ -59,6 +59,31 @@ static void createRandomAlignmentGenome(RandNumberGen &rng, AlignmentPtr newAlig
     newAlignment->closeGenome(genome);
 }
 
+static const RandomAlignmentParams presetSmall = {0.75, 0.1, 2, 5, 250, 1000, 5, 10};
+static const RandomAlignmentParams presetMedium = {1.25, 0.7, 8, 20, 500, 2000, 100, 500};
+static const RandomAlignmentParams presetBig = {2.00, 0.7, 20, 50, 1000, 8000, 400, 5000};
+static const RandomAlignmentParams presetLarge = {2.00, 1.0, 50, 100, 5000, 10000, 10000, 50000};
+
+const RandomAlignmentParams &hal::getRandomAlignmentPreset(const string &name) {
+    if (name == "small") {
+        return presetSmall;
+    } else if (name == "medium") {
+        return presetMedium;
+    } else if (name == "big") {
+        return presetBig;
+    } else if (name == "large") {
+        return presetLarge;
+    } else {
+        throw hal_exception("invalid random alignment preset: " + name + ", expected one of small, medium, big or large");
+    }
+}
+
+void hal::createRandomAlignment(RandNumberGen &rng, AlignmentPtr newAlignment, const RandomAlignmentParams &params) {
+    createRandomAlignment(rng, newAlignment, params._meanDegree, params._maxBranchLength, params._minGenomes,
+                          params._maxGenomes, params._minSegmentLength, params._maxSegmentLength, params._minSegments,
+                          params._maxSegments);
+}
+
 void hal::createRandomAlignment(RandNumberGen &rng, AlignmentPtr newAlignment, double meanDegree, double maxBranchLength,
                                 hal_size_t minGenomes, hal_size_t maxGenomes, hal_size_t minSegmentLength,
                                 hal_size_t maxSegmentLength, hal_size_t minSegments, hal_size_t maxSegments) {
@@ -10,14 +10,32 @@
 
 #include "hal.h"
 #include <set>
+#include <string>
 
 namespace hal {
     class RandNumberGen;
 
+    /* parameters of createRandomAlignment */
+    struct RandomAlignmentParams {
+        double _meanDegree;
+        double _maxBranchLength;
+        hal_size_t _minGenomes;
+        hal_size_t _maxGenomes;
+        hal_size_t _minSegmentLength;
+        hal_size_t _maxSegmentLength;
+        hal_size_t _minSegments;
+        hal_size_t _maxSegments;
+    };
+
+    /* the parameters of a named preset: small, medium, big or large */
+    const RandomAlignmentParams &getRandomAlignmentPreset(const std::string &name);
+
     void createRandomAlignment(RandNumberGen &rng, AlignmentPtr emptyAlignment, double meanDegree, double maxBranchLength,
                                hal_size_t minGenomes, hal_size_t maxGenomes, hal_size_t minSegmentLength,
                                hal_size_t maxSegmentLength, hal_size_t minSegments, hal_size_t maxSegments);
 
+    void createRandomAlignment(RandNumberGen &rng, AlignmentPtr emptyAlignment, const RandomAlignmentParams &params);
+
     void createRandomTree(RandNumberGen &rng, AlignmentPtr emptyAlignment, double meanDegree, double maxBranchLength,
                           hal_size_t minGenomes, hal_size_t maxGenomes);
 
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+# Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+#
+# Released under the MIT license, see LICENSE.txt
+
+"""HTTP server with byte range support, to test UDC access to HAL files.
+
+Serves the files in a directory.  A URL of the form
+/fail/<start>/<end>/<file> serves <file>, except that ranged GETs
+overlapping bytes [start, end) fail with 503, which is logged to stdout.
+The port is written to portFile once the server is listening."""
+
+import argparse
+import os
+import re
+import sys
+from email.utils import formatdate
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+FAIL_RE = re.compile(r"^/fail/(\d+)/(\d+)(/.*)$")
+RANGE_RE = re.compile(r"^bytes=(\d+)-(\d*)$")
+
+
+class RangeHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def parsePath(self):
+        """return the local path and the failing range, or None if there is none"""
+        path, failRange = self.path, None
+        match = FAIL_RE.match(path)
+        if match is not None:
+            failRange = (int(match.group(1)), int(match.group(2)))
+            path = match.group(3)
+        return os.path.join(self.server.dir, os.path.basename(path)), failRange
+
+    def sendHeaders(self, status, length, localPath, extra=()):
+        self.send_response(status)
+        self.send_header("Content-Length", str(length))
+        self.send_header("Last-Modified", formatdate(os.path.getmtime(localPath), usegmt=True))
+        self.send_header("Accept-Ranges", "bytes")
+        for key, value in extra:
+            self.send_header(key, value)
+        self.end_headers()
+
+    def sendError(self, status):
+        self.send_response(status)
+        self.send_header("Content-Length", "0")
+        self.end_headers()
+
+    def do_HEAD(self):
+        localPath, _ = self.parsePath()
+        if not os.path.isfile(localPath):
+            self.sendError(404)
+            return
+        self.sendHeaders(200, os.path.getsize(localPath), localPath)
+
+    def do_GET(self):
+        localPath, failRange = self.parsePath()
+        if not os.path.isfile(localPath):
+            self.sendError(404)
+            return
+        size = os.path.getsize(localPath)
+        start, end = 0, size
+        match = RANGE_RE.match(self.headers.get("Range", ""))
+        if match is not None:
+            start = int(match.group(1))
+            end = min(size, int(match.group(2)) + 1) if match.group(2) else size
+        if start >= end:
+            self.sendError(416)
+            return
+        if (failRange is not None) and (start < failRange[1]) and (end > failRange[0]):
+            print("failed {} bytes {}-{}".format(os.path.basename(localPath), start, end), flush=True)
+            self.sendError(503)
+            return
+        with open(localPath, "rb") as fh:
+            fh.seek(start)
+            data = fh.read(end - start)
+        if match is None:
+            self.sendHeaders(200, len(data), localPath)
+        else:
+            self.sendHeaders(206, len(data), localPath,
+                             [("Content-Range", "bytes {}-{}/{}".format(start, end - 1, size))])
+        self.wfile.write(data)
+
+    def log_message(self, format, *args):
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("dir", help="directory to serve")
+    parser.add_argument("portFile", help="file the port is written to")
+    args = parser.parse_args()
+    server = ThreadingHTTPServer(("localhost", 0), RangeHandler)
+    server.daemon_threads = True
+    server.dir = args.dir
+    with open(args.portFile + ".tmp", "w") as fh:
+        fh.write("{}\n".format(server.server_address[1]))
+    os.rename(args.portFile + ".tmp", args.portFile)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,650 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+/* Time the core HAL operations on random alignments generated with the
+ * halRandGen presets, in each storage format, and write the results as
+ * JSON.  Runs with the same options generate the same alignments, so the
+ * results can be compared across HAL versions to catch performance
+ * regressions. */
+
+#include "hal.h"
+#include "halBlockLiftover.h"
+#include "halCLParser.h"
+#include "halMafExport.h"
+#include "halRandNumberGen.h"
+#include "halRandomData.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+using namespace hal;
+
+static const string ALL_BENCHMARKS = "openGenomes,topSegments,bottomSegments,toSite,mapSegment,columnWalk,dnaDecode,"
+                                     "mafExport,pafExport,liftover";
+
+/* size of the buffer bases are decoded into */
+static const hal_size_t DECODE_CHUNK = 1000000;
+
+/* length of the intervals lifted over */
+static const hal_size_t LIFTOVER_INTERVAL = 1000;
+
+struct BenchOptions {
+    vector<string> _presets;
+    vector<string> _formats;
+    vector<string> _benchmarks;
+    int _seed;
+    size_t _repeat;
+    hal_size_t _numQueries;
+    string _workDir;
+    bool _keep;
+    bool _verbose;
+};
+
+/* result of one benchmark on one alignment, the best of its runs */
+struct BenchResult {
+    string _name;
+    string _unit;
+    hal_size_t _items;
+    double _seconds;
+    long _peakRssKb;
+    string _skipped;
+};
+
+/* Started by each benchmark once it's set up, so the timing is of the
+ * operation itself */
+class BenchTimer {
+  public:
+    BenchTimer() {
+        start();
+    }
+    void start() {
+        _start = chrono::steady_clock::now();
+    }
+    double seconds() const {
+        return chrono::duration<double>(chrono::steady_clock::now() - _start).count();
+    }
+
+  private:
+    chrono::steady_clock::time_point _start;
+};
+
+/* Output stream that counts and discards its output, so export
+ * benchmarks aren't timing disk writes */
+class CountingBuf : public streambuf {
+  public:
+    CountingBuf() : _count(0) {
+    }
+
+  protected:
+    virtual int_type overflow(int_type c) {
+        ++_count;
+        return traits_type::not_eof(c);
+    }
+    virtual streamsize xsputn(const char *s, streamsize n) {
+        _count += n;
+        return n;
+    }
+
+  private:
+    hal_size_t _count;
+};
+
+/* results the benchmarks compute and discard are stored here, so the
+ * compiler can't optimize the work away */
+static volatile hal_size_t benchSink;
+
+/* a benchmark runs on an open alignment and returns the number of items
+ * it processed */
+typedef function<hal_size_t(AlignmentConstPtr, BenchTimer &)> BenchFunction;
+
+static void initParser(CLParser &optionsParser) {
+    optionsParser.setDescription("Benchmark HAL operations on random alignments generated with the halRandGen presets, "
+                                 "writing the results as JSON");
+    optionsParser.addOption("presets", "comma-separated halRandGen presets to generate alignments from (small, medium, "
+                                       "big, large)",
+                            "small,medium");
+    optionsParser.addOption("formats", "comma-separated storage formats to benchmark (hdf5, mmap)", "hdf5,mmap");
+    optionsParser.addOption("benchmarks", "comma-separated benchmarks to run, of " + ALL_BENCHMARKS, ALL_BENCHMARKS);
+    optionsParser.addOption("seed", "random number seed, for the alignments and queries", 0);
+    optionsParser.addOption("repeat", "number of times each benchmark is run, the fastest run is reported", 3);
+    optionsParser.addOption("numQueries", "number of random positions for toSite", 100000);
+    optionsParser.addOption("workDir", "directory for the generated alignments", ".");
+    optionsParser.addOption("outJson", "output JSON file", "stdout");
+    optionsParser.addOptionFlag("keep", "keep the generated alignments", false);
+    optionsParser.addOptionFlag("verbose", "print progress to stderr", false);
+}
+
+/* genome names in breadth-first order from the root */
+static vector<string> getGenomeNames(AlignmentConstPtr alignment) {
+    vector<string> names(1, alignment->getRootName());
+    for (size_t i = 0; i < names.size(); ++i) {
+        vector<string> childs = alignment->getChildNames(names[i]);
+        names.insert(names.end(), childs.begin(), childs.end());
+    }
+    return names;
+}
+
+/* a source and target leaf for the pairwise benchmarks, the first and last
+ * leaves, or the root if there is only one */
+static void getLeafPair(AlignmentConstPtr alignment, const Genome *&srcGenome, const Genome *&tgtGenome) {
+    vector<string> leaves = alignment->getLeafNamesBelow(alignment->getRootName());
+    if (leaves.empty()) {
+        throw hal_exception("alignment has no leaf genomes");
+    }
+    srcGenome = alignment->openGenome(leaves.front());
+    tgtGenome = alignment->openGenome(leaves.size() > 1 ? leaves.back() : alignment->getRootName());
+}
+
+static hal_size_t benchOpenGenomes(AlignmentConstPtr alignment, BenchTimer &timer) {
+    vector<string> names = getGenomeNames(alignment);
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (alignment->openGenome(names[i]) == NULL) {
+            throw hal_exception("unable to open genome " + names[i]);
+        }
+    }
+    return names.size();
+}
+
+static hal_size_t benchTopSegments(AlignmentConstPtr alignment, BenchTimer &timer) {
+    vector<const Genome *> genomes;
+    for (const string &name : getGenomeNames(alignment)) {
+        genomes.push_back(alignment->openGenome(name));
+    }
+    timer.start();
+    hal_size_t numSegments = 0, numAligned = 0;
+    for (const Genome *genome : genomes) {
+        for (TopSegmentIteratorPtr topIt = genome->getTopSegmentIterator(); not topIt->atEnd(); topIt->toRight()) {
+            numAligned += topIt->tseg()->hasParent() ? 1 : 0;
+            ++numSegments;
+        }
+    }
+    benchSink = numAligned;
+    return numSegments;
+}
+
+static hal_size_t benchBottomSegments(AlignmentConstPtr alignment, BenchTimer &timer) {
+    vector<const Genome *> genomes;
+    for (const string &name : getGenomeNames(alignment)) {
+        genomes.push_back(alignment->openGenome(name));
+    }
+    timer.start();
+    hal_size_t numSegments = 0, numAligned = 0;
+    for (const Genome *genome : genomes) {
+        for (BottomSegmentIteratorPtr botIt = genome->getBottomSegmentIterator(); not botIt->atEnd(); botIt->toRight()) {
+            for (hal_size_t i = 0; i < botIt->bseg()->getNumChildren(); ++i) {
+                numAligned += botIt->bseg()->getChildIndex(i) != NULL_INDEX ? 1 : 0;
+            }
+            ++numSegments;
+        }
+    }
+    benchSink = numAligned;
+    return numSegments;
+}
+
+/* random positions, in genomes with top segments */
+static hal_size_t benchToSite(AlignmentConstPtr alignment, BenchTimer &timer, int seed, hal_size_t numQueries) {
+    vector<TopSegmentIteratorPtr> iterators;
+    for (const string &name : getGenomeNames(alignment)) {
+        const Genome *genome = alignment->openGenome(name);
+        if (genome->getNumTopSegments() > 0 && genome->getSequenceLength() > 0) {
+            iterators.push_back(genome->getTopSegmentIterator());
+        }
+    }
+    if (iterators.empty()) {
+        return 0;
+    }
+    RandNumberGen rng(false, seed);
+    vector<pair<size_t, hal_index_t>> queries(numQueries);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        size_t genomeIdx = rng.getRandInt(0, iterators.size() - 1);
+        hal_size_t length = iterators[genomeIdx]->getGenome()->getSequenceLength();
+        queries[i] = make_pair(genomeIdx, (hal_index_t)(rng.getRand() * length) % length);
+    }
+    timer.start();
+    hal_size_t sum = 0;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        iterators[queries[i].first]->toSite(queries[i].second, true);
+        sum += iterators[queries[i].first]->getArrayIndex();
+    }
+    benchSink = sum;
+    return queries.size();
+}
+
+/* every top segment of one leaf mapped to another */
+static hal_size_t benchMapSegment(AlignmentConstPtr alignment, BenchTimer &timer) {
+    const Genome *srcGenome, *tgtGenome;
+    getLeafPair(alignment, srcGenome, tgtGenome);
+    timer.start();
+    hal_size_t numSegments = 0, numMapped = 0;
+    MappedSegmentSet results;
+    for (TopSegmentIteratorPtr topIt = srcGenome->getTopSegmentIterator(); not topIt->atEnd(); topIt->toRight()) {
+        numMapped += halMapSegment(topIt.get(), results, tgtGenome, NULL, true);
+        results.clear();
+        ++numSegments;
+    }
+    benchSink = numMapped;
+    return numSegments;
+}
+
+/* the columns of a leaf, against all genomes */
+static hal_size_t benchColumnWalk(AlignmentConstPtr alignment, BenchTimer &timer) {
+    const Genome *srcGenome, *tgtGenome;
+    getLeafPair(alignment, srcGenome, tgtGenome);
+    set<const Genome *> targets;
+    getGenomesInSubTree(alignment->openGenome(alignment->getRootName()), targets);
+    timer.start();
+    hal_size_t numColumns = 0;
+    for (SequenceIteratorPtr seqIt = srcGenome->getSequenceIterator(); not seqIt->atEnd(); seqIt->toNext()) {
+        const Sequence *sequence = seqIt->getSequence();
+        if (sequence->getSequenceLength() == 0) {
+            continue;
+        }
+        ColumnIteratorPtr colIt = sequence->getColumnIterator(&targets);
+        while (true) {
+            numColumns += colIt->getColumnMap()->empty() ? 0 : 1;
+            if (colIt->lastColumn()) {
+                break;
+            }
+            colIt->toRight();
+        }
+    }
+    return numColumns;
+}
+
+/* all bases of all genomes */
+static hal_size_t benchDnaDecode(AlignmentConstPtr alignment, BenchTimer &timer) {
+    vector<const Genome *> genomes;
+    for (const string &name : getGenomeNames(alignment)) {
+        genomes.push_back(alignment->openGenome(name));
+    }
+    vector<char> buffer(DECODE_CHUNK);
+    timer.start();
+    hal_size_t numBases = 0;
+    for (const Genome *genome : genomes) {
+        hal_size_t length = genome->getSequenceLength();
+        for (hal_size_t start = 0; start < length; start += DECODE_CHUNK) {
+            hal_size_t chunkLength = min(DECODE_CHUNK, length - start);
+            genome->getSubString(buffer.data(), start, chunkLength);
+            numBases += chunkLength;
+            benchSink = buffer[chunkLength - 1];
+        }
+    }
+    return numBases;
+}
+
+/* MAF of a leaf against all genomes, counting the bases of the leaf */
+static hal_size_t benchMafExport(AlignmentConstPtr alignment, BenchTimer &timer) {
+    const Genome *srcGenome, *tgtGenome;
+    getLeafPair(alignment, srcGenome, tgtGenome);
+    set<const Genome *> targets;
+    getGenomesInSubTree(alignment->openGenome(alignment->getRootName()), targets);
+    CountingBuf countingBuf;
+    ostream mafStream(&countingBuf);
+    MafExport mafExport;
+    timer.start();
+    for (SequenceIteratorPtr seqIt = srcGenome->getSequenceIterator(); not seqIt->atEnd(); seqIt->toNext()) {
+        const Sequence *sequence = seqIt->getSequence();
+        if (sequence->getSequenceLength() > 0) {
+            mafExport.convertSequence(mafStream, alignment, sequence, 0, 0, targets);
+        }
+    }
+    return srcGenome->getSequenceLength();
+}
+
+/* the leaf split into intervals, lifted over to the other leaf */
+static hal_size_t benchLiftover(AlignmentConstPtr alignment, BenchTimer &timer) {
+    const Genome *srcGenome, *tgtGenome;
+    getLeafPair(alignment, srcGenome, tgtGenome);
+    stringstream bedStream;
+    hal_size_t numIntervals = 0;
+    for (SequenceIteratorPtr seqIt = srcGenome->getSequenceIterator(); not seqIt->atEnd(); seqIt->toNext()) {
+        const Sequence *sequence = seqIt->getSequence();
+        for (hal_size_t start = 0; start < sequence->getSequenceLength(); start += LIFTOVER_INTERVAL) {
+            hal_size_t end = min(start + LIFTOVER_INTERVAL, sequence->getSequenceLength());
+            bedStream << sequence->getName() << '\t' << start << '\t' << end << '\n';
+            ++numIntervals;
+        }
+    }
+    CountingBuf countingBuf;
+    ostream outStream(&countingBuf);
+    BlockLiftover liftover;
+    timer.start();
+    liftover.convert(alignment, srcGenome, &bedStream, tgtGenome, &outStream);
+    return numIntervals;
+}
+
+static long getPeakRssKb() {
+    ifstream statusFile("/proc/self/status");
+    string line;
+    while (getline(statusFile, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return atol(line.c_str() + 6);
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/* Run work in a child process and return the text it produces.  The
+ * parent never opens an alignment, so every run starts from the same small
+ * process, with no caches left by earlier runs, and the child's peak RSS,
+ * returned in peakRssKb, is that of the run. */
+static string runInChild(const function<string()> &work, long &peakRssKb) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        throw hal_exception("unable to create pipe");
+    }
+    cout.flush();
+    cerr.flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw hal_exception("fork failed");
+    } else if (pid == 0) {
+        close(fds[0]);
+        string output;
+        int status = 0;
+        try {
+            output = work();
+        } catch (exception &e) {
+            output = e.what();
+            status = 1;
+        }
+        output = std::to_string(getPeakRssKb()) + "\n" + output;
+        for (size_t written = 0; written < output.size();) {
+            ssize_t ret = write(fds[1], output.data() + written, output.size() - written);
+            if (ret <= 0) {
+                _exit(2);
+            }
+            written += ret;
+        }
+        _exit(status);
+    }
+    close(fds[1]);
+    string output;
+    char buffer[4096];
+    ssize_t ret;
+    while ((ret = read(fds[0], buffer, sizeof(buffer))) > 0) {
+        output.append(buffer, ret);
+    }
+    close(fds[0]);
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+        throw hal_exception("benchmark process failed");
+    }
+    size_t newline = output.find('\n');
+    peakRssKb = atol(output.substr(0, newline).c_str());
+    output = newline == string::npos ? "" : output.substr(newline + 1);
+    if (WEXITSTATUS(status) != 0) {
+        throw hal_exception(output.empty() ? "benchmark process failed" : output);
+    }
+    return output;
+}
+
+static string getBinDir() {
+    char path[4096];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len <= 0) {
+        return "";
+    }
+    string exePath(path, len);
+    return exePath.substr(0, exePath.rfind('/') + 1);
+}
+
+/* hal2paf's export isn't in a library, so PAF export runs hal2paf from the
+ * same bin directory, timing it with its own peak RSS.  Its output is
+ * discarded. */
+static BenchResult runPafExport(const string &halPath, hal_size_t numBases, const BenchOptions &options) {
+    BenchResult result = {"pafExport", "bases", numBases, 0., 0, ""};
+    string hal2paf = getBinDir() + "hal2paf";
+    if (access(hal2paf.c_str(), X_OK) != 0) {
+        result._skipped = hal2paf + " not found";
+        return result;
+    }
+    for (size_t i = 0; i < options._repeat; ++i) {
+        BenchTimer timer;
+        pid_t pid = fork();
+        if (pid < 0) {
+            throw hal_exception("fork failed running " + hal2paf);
+        } else if (pid == 0) {
+            int devNull = open("/dev/null", O_WRONLY);
+            dup2(devNull, STDOUT_FILENO);
+            execl(hal2paf.c_str(), hal2paf.c_str(), halPath.c_str(), (char *)NULL);
+            _exit(127);
+        }
+        int status;
+        struct rusage usage;
+        if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            throw hal_exception(hal2paf + " failed on " + halPath);
+        }
+        double seconds = timer.seconds();
+        if (i == 0 || seconds < result._seconds) {
+            result._seconds = seconds;
+        }
+        result._peakRssKb = max(result._peakRssKb, (long)usage.ru_maxrss);
+    }
+    return result;
+}
+
+/* run a benchmark options._repeat times, each on a newly opened alignment */
+static BenchResult runBenchmark(const string &name, const string &unit, const BenchFunction &benchFunction,
+                                const string &halPath, const CLParser &optionsParser, const BenchOptions &options) {
+    BenchResult result = {name, unit, 0, 0., 0, ""};
+    for (size_t i = 0; i < options._repeat; ++i) {
+        long peakRssKb;
+        string output = runInChild(
+            [&]() {
+                AlignmentConstPtr alignment(openHalAlignment(halPath, &optionsParser));
+                BenchTimer timer;
+                hal_size_t items = benchFunction(alignment, timer);
+                double seconds = timer.seconds();
+                alignment->close();
+                ostringstream outStream;
+                outStream.precision(17);
+                outStream << items << ' ' << seconds;
+                return outStream.str();
+            },
+            peakRssKb);
+        hal_size_t items;
+        double seconds;
+        istringstream(output) >> items >> seconds;
+        if (i > 0 && items != result._items) {
+            throw hal_exception("benchmark " + name + " isn't deterministic");
+        }
+        result._items = items;
+        if (i == 0 || seconds < result._seconds) {
+            result._seconds = seconds;
+        }
+        result._peakRssKb = max(result._peakRssKb, peakRssKb);
+    }
+    return result;
+}
+
+static string jsonString(const string &str) {
+    string out = "\"";
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out + "\"";
+}
+
+static void writeResult(ostream &jsonStream, const BenchResult &result) {
+    jsonStream << "        {\"name\": " << jsonString(result._name) << ", \"unit\": " << jsonString(result._unit);
+    if (!result._skipped.empty()) {
+        jsonStream << ", \"skipped\": " << jsonString(result._skipped) << "}";
+        return;
+    }
+    double throughput = result._seconds > 0. ? result._items / result._seconds : 0.;
+    jsonStream << ", \"items\": " << result._items << ", \"seconds\": " << result._seconds
+               << ", \"itemsPerSecond\": " << throughput << ", \"peakRssKb\": " << result._peakRssKb << "}";
+}
+
+/* generate the alignment of a preset, run the benchmarks on it and write
+ * them as a JSON object */
+static void benchDataset(ostream &jsonStream, const string &preset, const string &format, const CLParser &optionsParser,
+                         const BenchOptions &options) {
+    string halPath = options._workDir + "/halBench." + preset + "." + std::to_string(options._seed) + "." + format + ".hal";
+    if (options._verbose) {
+        cerr << "halBench: generating " << halPath << endl;
+    }
+    const RandomAlignmentParams &params = getRandomAlignmentPreset(preset);
+    long genPeakRssKb;
+    string output = runInChild(
+        [&]() {
+            BenchTimer genTimer;
+            RandNumberGen rng(false, options._seed);
+            AlignmentPtr newAlignment(openHalAlignment(halPath, &optionsParser, CREATE_ACCESS, format));
+            createRandomAlignment(rng, newAlignment, params);
+            newAlignment->close();
+            double genSeconds = genTimer.seconds();
+
+            hal_size_t numGenomes = 0, numBases = 0, numBranchBases = 0, numTopSegments = 0;
+            AlignmentConstPtr alignment(openHalAlignment(halPath, &optionsParser));
+            for (const string &name : getGenomeNames(alignment)) {
+                const Genome *genome = alignment->openGenome(name);
+                ++numGenomes;
+                numBases += genome->getSequenceLength();
+                numTopSegments += genome->getNumTopSegments();
+                if (genome->getParent() != NULL) {
+                    numBranchBases += genome->getSequenceLength();
+                }
+            }
+            alignment->close();
+            ostringstream outStream;
+            outStream.precision(17);
+            outStream << genSeconds << ' ' << numGenomes << ' ' << numBases << ' ' << numBranchBases << ' '
+                      << numTopSegments;
+            return outStream.str();
+        },
+        genPeakRssKb);
+    double genSeconds;
+    hal_size_t numGenomes, numBases, numBranchBases, numTopSegments;
+    istringstream(output) >> genSeconds >> numGenomes >> numBases >> numBranchBases >> numTopSegments;
+    struct stat fileStat;
+    hal_size_t fileBytes = stat(halPath.c_str(), &fileStat) == 0 ? fileStat.st_size : 0;
+
+    jsonStream << "    {\"preset\": " << jsonString(preset) << ", \"format\": " << jsonString(format)
+               << ", \"genomes\": " << numGenomes << ", \"bases\": " << numBases << ", \"topSegments\": " << numTopSegments
+               << ", \"fileBytes\": " << fileBytes << ", \"generateSeconds\": " << genSeconds
+               << ", \"generatePeakRssKb\": " << genPeakRssKb << ",\n"
+               << "     \"benchmarks\": [\n";
+    for (size_t i = 0; i < options._benchmarks.size(); ++i) {
+        const string &name = options._benchmarks[i];
+        if (options._verbose) {
+            cerr << "halBench: running " << name << " on " << halPath << endl;
+        }
+        BenchResult result;
+        if (name == "openGenomes") {
+            result = runBenchmark(name, "genomes", benchOpenGenomes, halPath, optionsParser, options);
+        } else if (name == "topSegments") {
+            result = runBenchmark(name, "segments", benchTopSegments, halPath, optionsParser, options);
+        } else if (name == "bottomSegments") {
+            result = runBenchmark(name, "segments", benchBottomSegments, halPath, optionsParser, options);
+        } else if (name == "toSite") {
+            BenchFunction toSite = [&options](AlignmentConstPtr alignment, BenchTimer &timer) {
+                return benchToSite(alignment, timer, options._seed, options._numQueries);
+            };
+            result = runBenchmark(name, "queries", toSite, halPath, optionsParser, options);
+        } else if (name == "mapSegment") {
+            result = runBenchmark(name, "segments", benchMapSegment, halPath, optionsParser, options);
+        } else if (name == "columnWalk") {
+            result = runBenchmark(name, "columns", benchColumnWalk, halPath, optionsParser, options);
+        } else if (name == "dnaDecode") {
+            result = runBenchmark(name, "bases", benchDnaDecode, halPath, optionsParser, options);
+        } else if (name == "mafExport") {
+            result = runBenchmark(name, "bases", benchMafExport, halPath, optionsParser, options);
+        } else if (name == "pafExport") {
+            result = runPafExport(halPath, numBranchBases, options);
+        } else if (name == "liftover") {
+            result = runBenchmark(name, "intervals", benchLiftover, halPath, optionsParser, options);
+        } else {
+            throw hal_exception("unknown benchmark " + name + ", expected one of " + ALL_BENCHMARKS);
+        }
+        writeResult(jsonStream, result);
+        jsonStream << (i + 1 < options._benchmarks.size() ? ",\n" : "\n");
+    }
+    jsonStream << "     ]}";
+
+    if (!options._keep) {
+        remove(halPath.c_str());
+    }
+}
+
+int main(int argc, char **argv) {
+    CLParser optionsParser(CREATE_ACCESS);
+    initParser(optionsParser);
+    BenchOptions options;
+    string outJsonPath;
+    try {
+        optionsParser.parseOptions(argc, argv);
+        options._presets = chopString(optionsParser.getOption<string>("presets"), ",");
+        options._formats = chopString(optionsParser.getOption<string>("formats"), ",");
+        options._benchmarks = chopString(optionsParser.getOption<string>("benchmarks"), ",");
+        options._seed = optionsParser.getOption<int>("seed");
+        options._repeat = optionsParser.getOption<size_t>("repeat");
+        options._numQueries = optionsParser.getOption<hal_size_t>("numQueries");
+        options._workDir = optionsParser.getOption<string>("workDir");
+        options._keep = optionsParser.getFlag("keep");
+        options._verbose = optionsParser.getFlag("verbose");
+        outJsonPath = optionsParser.getOption<string>("outJson");
+        if (options._seed < 0) {
+            throw hal_exception("--seed must be >= 0, so runs can be compared");
+        }
+        if (options._repeat == 0) {
+            throw hal_exception("--repeat must be > 0");
+        }
+        for (const string &preset : options._presets) {
+            getRandomAlignmentPreset(preset);
+        }
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        optionsParser.printUsage(cerr);
+        exit(1);
+    }
+
+    try {
+        ofstream outJsonFile;
+        if (outJsonPath != "stdout") {
+            outJsonFile.open(outJsonPath.c_str());
+            if (!outJsonFile) {
+                throw hal_exception("Error opening " + outJsonPath);
+            }
+        }
+        // results are collected before writing, so a failed run doesn't
+        // leave a truncated JSON file
+        stringstream jsonStream;
+        jsonStream << "{\"seed\": " << options._seed << ", \"repeat\": " << options._repeat << ",\n"
+                   << " \"datasets\": [\n";
+        for (size_t i = 0; i < options._presets.size(); ++i) {
+            for (size_t j = 0; j < options._formats.size(); ++j) {
+                benchDataset(jsonStream, options._presets[i], options._formats[j], optionsParser, options);
+                bool last = i + 1 == options._presets.size() && j + 1 == options._formats.size();
+                jsonStream << (last ? "\n" : ",\n");
+            }
+        }
+        jsonStream << " ]}" << endl;
+        (outJsonPath != "stdout" ? outJsonFile : cout) << jsonStream.str();
+    } catch (exception &e) {
+        cerr << "halBench: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
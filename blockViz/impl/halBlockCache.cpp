@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "halBlockCache.h"
+
+using namespace std;
+using namespace hal;
+
+/* default tile size, in bases */
+static const hal_size_t DEFAULT_TILE_SIZE = 100000;
+
+bool hal::BlockTileKey::operator<(const BlockTileKey &other) const {
+    if (_handle != other._handle) {
+        return _handle < other._handle;
+    }
+    if (_alignment != other._alignment) {
+        return _alignment < other._alignment;
+    }
+    if (_tile != other._tile) {
+        return _tile < other._tile;
+    }
+    if (_tChrom != other._tChrom) {
+        return _tChrom < other._tChrom;
+    }
+    if (_tSpecies != other._tSpecies) {
+        return _tSpecies < other._tSpecies;
+    }
+    if (_qSpecies != other._qSpecies) {
+        return _qSpecies < other._qSpecies;
+    }
+    if (_doDupes != other._doDupes) {
+        return _doDupes < other._doDupes;
+    }
+    if (_hasCoalescenceLimit != other._hasCoalescenceLimit) {
+        return _hasCoalescenceLimit < other._hasCoalescenceLimit;
+    }
+    return _coalescenceLimit < other._coalescenceLimit;
+}
+
+hal::BlockCache::BlockCache()
+    : _tileSize(DEFAULT_TILE_SIZE), _maxBytes(0), _numBytes(0), _numHits(0), _numMisses(0) {
+}
+
+void hal::BlockCache::configure(hal_size_t tileSize, hal_size_t maxBytes) {
+    lock_guard<mutex> lock(_mutex);
+    clear();
+    _numHits = _numMisses = 0;
+    _tileSize = tileSize > 0 ? tileSize : DEFAULT_TILE_SIZE;
+    _maxBytes = maxBytes;
+}
+
+bool hal::BlockCache::isEnabled() const {
+    lock_guard<mutex> lock(_mutex);
+    return _maxBytes > 0;
+}
+
+hal_size_t hal::BlockCache::getTileSize() const {
+    lock_guard<mutex> lock(_mutex);
+    return _tileSize;
+}
+
+BlockTilePtr hal::BlockCache::find(const BlockTileKey &key) {
+    lock_guard<mutex> lock(_mutex);
+    EntryMap::iterator entryIt = _entries.find(key);
+    if (entryIt == _entries.end()) {
+        ++_numMisses;
+        return BlockTilePtr();
+    }
+    ++_numHits;
+    _lru.splice(_lru.begin(), _lru, entryIt->second._lruIt);
+    return entryIt->second._tile;
+}
+
+void hal::BlockCache::insert(const BlockTileKey &key, const BlockTilePtr &tile) {
+    hal_size_t bytes = getNumBytes(key, *tile);
+    lock_guard<mutex> lock(_mutex);
+    if (bytes > _maxBytes || _entries.find(key) != _entries.end()) {
+        // too big, or added by another thread while this one mapped it
+        return;
+    }
+    while (_numBytes + bytes > _maxBytes) {
+        erase(_entries.find(_lru.back()));
+    }
+    _lru.push_front(key);
+    Entry entry = {tile, bytes, _lru.begin()};
+    _entries.insert(pair<BlockTileKey, Entry>(key, entry));
+    _numBytes += bytes;
+}
+
+void hal::BlockCache::removeHandle(int handle) {
+    lock_guard<mutex> lock(_mutex);
+    EntryMap::iterator entryIt = _entries.begin();
+    while (entryIt != _entries.end()) {
+        EntryMap::iterator next = entryIt;
+        ++next;
+        if (entryIt->first._handle == handle) {
+            erase(entryIt);
+        }
+        entryIt = next;
+    }
+}
+
+hal_size_t hal::BlockCache::getNumHits() const {
+    lock_guard<mutex> lock(_mutex);
+    return _numHits;
+}
+
+hal_size_t hal::BlockCache::getNumMisses() const {
+    lock_guard<mutex> lock(_mutex);
+    return _numMisses;
+}
+
+hal_size_t hal::BlockCache::getNumBytes() const {
+    lock_guard<mutex> lock(_mutex);
+    return _numBytes;
+}
+
+/* approximate memory used by a tile, including its key and map entry */
+hal_size_t hal::BlockCache::getNumBytes(const BlockTileKey &key, const BlockTile &tile) {
+    hal_size_t bytes = 2 * sizeof(BlockTileKey) + sizeof(Entry) + sizeof(BlockTile) + 64;
+    bytes += 2 * (key._qSpecies.size() + key._tSpecies.size() + key._tChrom.size() + key._coalescenceLimit.size());
+    for (size_t i = 0; i < tile._mappings.size(); ++i) {
+        bytes += sizeof(BlockMapper::SegmentMappings) + tile._mappings[i].capacity() * sizeof(MappedRange);
+    }
+    return bytes;
+}
+
+void hal::BlockCache::erase(EntryMap::iterator entryIt) {
+    _numBytes -= entryIt->second._bytes;
+    _lru.erase(entryIt->second._lruIt);
+    _entries.erase(entryIt);
+}
+
+void hal::BlockCache::clear() {
+    _entries.clear();
+    _lru.clear();
+    _numBytes = 0;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef _HALBLOCKCACHE_H
+#define _HALBLOCKCACHE_H
+#include "halBlockMapper.h"
+#include "halDefs.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace hal {
+    class Alignment;
+
+    /* The mappings of the whole reference segments that start in one tile
+     * of a target sequence, in array order from _firstIndex.  BlockMapper
+     * adds them to its map in place of mapping the segments again. */
+    struct BlockTile {
+        hal_index_t _firstIndex;
+        std::vector<BlockMapper::SegmentMappings> _mappings;
+    };
+    typedef std::shared_ptr<const BlockTile> BlockTilePtr;
+
+    /* Identifies a tile and the options it was mapped with.  The alignment
+     * is the level of detail the query was run on, it stays open until its
+     * handle is closed. */
+    struct BlockTileKey {
+        int _handle;
+        const Alignment *_alignment;
+        std::string _qSpecies;
+        std::string _tSpecies;
+        std::string _tChrom;
+        hal_index_t _tile;
+        bool _doDupes;
+        bool _hasCoalescenceLimit;
+        std::string _coalescenceLimit;
+
+        bool operator<(const BlockTileKey &other) const;
+    };
+
+    /* Least-recently-used cache of tiles of mappings, shared by the threads
+     * making browser queries.  Tiles are looked up and inserted under its
+     * own lock, so they are mapped without it.  Disabled until given a
+     * memory budget. */
+    class BlockCache {
+      public:
+        BlockCache();
+
+        /* Set the tile size and memory budget (0 disables the cache),
+         * emptying the cache and resetting its counters. */
+        void configure(hal_size_t tileSize, hal_size_t maxBytes);
+        bool isEnabled() const;
+        hal_size_t getTileSize() const;
+
+        /* the tile, or NULL if it is not cached */
+        BlockTilePtr find(const BlockTileKey &key);
+        /* add a tile, evicting the least recently used ones to fit it in
+         * the budget.  Tiles larger than the budget are not kept. */
+        void insert(const BlockTileKey &key, const BlockTilePtr &tile);
+        /* drop the tiles of a handle that is being closed */
+        void removeHandle(int handle);
+
+        /* counters, for testing and tuning */
+        hal_size_t getNumHits() const;
+        hal_size_t getNumMisses() const;
+        hal_size_t getNumBytes() const;
+
+      private:
+        typedef std::list<BlockTileKey> LruList;
+        struct Entry {
+            BlockTilePtr _tile;
+            hal_size_t _bytes;
+            LruList::iterator _lruIt;
+        };
+        typedef std::map<BlockTileKey, Entry> EntryMap;
+
+        static hal_size_t getNumBytes(const BlockTileKey &key, const BlockTile &tile);
+        void erase(EntryMap::iterator entryIt);
+        void clear();
+
+        hal_size_t _tileSize;
+        hal_size_t _maxBytes;
+        hal_size_t _numBytes;
+        hal_size_t _numHits;
+        hal_size_t _numMisses;
+        EntryMap _entries;
+        LruList _lru; // most recently used first
+        mutable std::mutex _mutex;
+    };
+}
+#endif
+// Local Variables:
+// mode: c++
+// End:
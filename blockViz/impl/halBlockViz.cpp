@@ -8,6 +8,7 @@
 #include "halBlockViz.h"
 #include "hal.h"
 #include "halAlignmentInstance.h"
+#include "halBlockCache.h"
 #include "halBlockMapper.h"
 #include "halLodManager.h"
 #include "halMafExport.h"
@@ -47,8 +48,44 @@ static inline void halUnlock() {
 using namespace std;
 using namespace hal;
 
+/* Holds HAL_MUTEX for the duration of a request.  Requests that only read
+ * from an alignment that supports concurrent reads release the lock once the
+ * handle has been resolved, so browser threads querying the same file no
+ * longer serialize on the mapping. */
+class HalLockGuard {
+  public:
+    HalLockGuard() : _locked(true) {
+        halLock();
+    }
+    ~HalLockGuard() {
+        if (_locked) {
+            try {
+                halUnlock();
+            } catch (...) {
+                // can't throw from destructor
+            }
+        }
+    }
+    void unlock() {
+        if (_locked) {
+            _locked = false;
+            halUnlock();
+        }
+    }
+    /* release the lock if all the (non-NULL) alignments allow it */
+    void unlockIfConcurrent(AlignmentConstPtr alignment, AlignmentConstPtr seqAlignment = AlignmentConstPtr()) {
+        if (alignment->supportsConcurrentReads() and ((seqAlignment == NULL) or seqAlignment->supportsConcurrentReads())) {
+            unlock();
+        }
+    }
+
+  private:
+    bool _locked;
+};
+
 typedef map<int, pair<string, LodManagerPtr>> HandleMap;
 static HandleMap handleMap;
+static BlockCache blockCache;
 
 static int openLodOrHal(char *inputPath, bool isLod, char **errStr);
 static void checkHandle(int handle);
@@ -63,6 +100,11 @@ static hal_block_results_t *readBlocks(AlignmentConstPtr seqAlignment, const Seq
                                        hal_index_t absEnd, bool tReversed, const Genome *qGenome, bool getSequenceString,
                                        bool doDupes, bool doTargetDupes, bool doAdjes, const char *coalescenceLimitName);
 
+static hal_block_results_t *readCachedBlocks(int halHandle, AlignmentConstPtr seqAlignment, const Sequence *tSequence,
+                                             hal_index_t absStart, hal_index_t absEnd, const Genome *qGenome,
+                                             bool getSequenceString, bool doDupes, bool doTargetDupes,
+                                             const char *coalescenceLimitName);
+
 static void readBlock(AlignmentConstPtr seqAlignment, hal_block_t *cur, vector<MappedSegmentPtr> &fragments,
                       bool getSequenceString, const string &genomeName);
 
@@ -170,6 +212,7 @@ extern "C" int halClose(int handle, char **errStr) {
             return -1;
         }
         handleMap.erase(mapIt);
+        blockCache.removeHandle(handle);
     } catch (exception &e) {
         halUnlock();
         handleError("halClose error on handle: " + std::to_string(handle) + ": " + e.what(), errStr);
@@ -221,24 +264,24 @@ extern "C" struct hal_block_results_t *halGetBlocksInTargetRange(int halHandle,
                                                                  hal_seqmode_type_t seqMode, hal_dup_type_t dupMode,
                                                                  int mapBackAdjacencies, const char *coalescenceLimitName,
                                                                  char **errStr) {
-    halLock();
+    HalLockGuard lock;
     hal_block_results_t *results = NULL;
     try {
         hal_int_t rangeLength = tEnd - tStart;
         if (rangeLength < 0) {
-            halUnlock();
+            lock.unlock();
             handleError("halGetBlocksInTargetRange invalid query range [" + std::to_string(tStart) + "," +
                             std::to_string(tEnd) + ")",
                         errStr);
             return NULL;
         }
         if (tReversed != 0 && mapBackAdjacencies != 0) {
-            halUnlock();
+            lock.unlock();
             handleError("halGetBlocksInTargetRange tReversed can only be set when mapBackAdjacencies is 0", errStr);
             return NULL;
         }
         if (tReversed != 0 && dupMode == HAL_QUERY_AND_TARGET_DUPS) {
-            halUnlock();
+            lock.unlock();
             handleError("tReversed cannot be set in conjunction with dupMode=HAL_QUERY_AND_TARGET_DUPS", errStr);
             return NULL;
         }
@@ -266,12 +309,12 @@ extern "C" struct hal_block_results_t *halGetBlocksInTargetRange(int halHandle,
         hal_index_t absStart = tSequence->getStartPosition() + tStart;
         hal_index_t absEnd = tSequence->getStartPosition() + myEnd - 1;
         if (absStart > absEnd) {
-            halUnlock();
+            lock.unlock();
             handleError("halGetBlocksInTargetRange invalid range", errStr);
             return NULL;
         }
         if (absEnd > tSequence->getEndPosition()) {
-            halUnlock();
+            lock.unlock();
             handleError("halGetBlocksInTargetRange target end position outside of target sequence", errStr);
             return NULL;
         }
@@ -294,19 +337,24 @@ extern "C" struct hal_block_results_t *halGetBlocksInTargetRange(int halHandle,
             seqAlignment = getExistingAlignment(halHandle, absEnd - absStart, true);
         }
 
-        results = readBlocks(seqAlignment, tSequence, absStart, absEnd, tReversed != 0, qGenome, getSequenceString,
-                             dupMode != HAL_NO_DUPS, dupMode == HAL_QUERY_AND_TARGET_DUPS, mapBackAdjacencies != 0,
-                             coalescenceLimitName);
+        lock.unlockIfConcurrent(alignment, seqAlignment);
+        if (blockCache.isEnabled() && tReversed == 0 && mapBackAdjacencies == 0) {
+            results = readCachedBlocks(halHandle, seqAlignment, tSequence, absStart, absEnd, qGenome, getSequenceString,
+                                       dupMode != HAL_NO_DUPS, dupMode == HAL_QUERY_AND_TARGET_DUPS, coalescenceLimitName);
+        } else {
+            results = readBlocks(seqAlignment, tSequence, absStart, absEnd, tReversed != 0, qGenome, getSequenceString,
+                                 dupMode != HAL_NO_DUPS, dupMode == HAL_QUERY_AND_TARGET_DUPS, mapBackAdjacencies != 0,
+                                 coalescenceLimitName);
+        }
     } catch (exception &e) {
-        halUnlock();
+        lock.unlock();
         handleError("halGetBlocksInTargetRange error reading blocks: " + string(e.what()), errStr);
         return NULL;
     } catch (...) {
-        halUnlock();
+        lock.unlock();
         handleError("halGetBlocksInTargetRange error reading blocks: unknown exception", errStr);
         return NULL;
     }
-    halUnlock();
     return results;
 }
 
@@ -379,15 +427,32 @@ halGetBlocksInTargetRange_filterByChrom(int halHandle, char *qSpecies, char *tSp
     return results;
 }
 
+extern "C" int halSetBlockCache(hal_int_t tileSize, hal_int_t maxBytes, char **errStr) {
+    if (tileSize < 0 || maxBytes < 0) {
+        handleError("halSetBlockCache invalid tile size " + std::to_string(tileSize) + " or memory budget " +
+                        std::to_string(maxBytes),
+                    errStr);
+        return -1;
+    }
+    blockCache.configure(hal_size_t(tileSize), hal_size_t(maxBytes));
+    return 0;
+}
+
+extern "C" void halGetBlockCacheStats(hal_int_t *numHits, hal_int_t *numMisses, hal_int_t *numBytes) {
+    *numHits = (hal_int_t)blockCache.getNumHits();
+    *numMisses = (hal_int_t)blockCache.getNumMisses();
+    *numBytes = (hal_int_t)blockCache.getNumBytes();
+}
+
 extern "C" hal_int_t halGetMaf(FILE *outFile, int halHandle, hal_species_t *qSpeciesNames, char *tSpecies, char *tChrom,
                                hal_int_t tStart, hal_int_t tEnd, int maxRefGap, int maxBlockLength, int doDupes,
                                char **errStr) {
-    halLock();
+    HalLockGuard lock;
     hal_int_t numBytes = 0;
     try {
         hal_int_t rangeLength = tEnd - tStart;
         if (rangeLength < 0) {
-            halUnlock();
+            lock.unlock();
             handleError("halGetMaf invalid query range [" + std::to_string(tStart) + "," + std::to_string(tEnd) + ")", errStr);
             return -1;
         }
@@ -407,16 +472,17 @@ extern "C" hal_int_t halGetMaf(FILE *outFile, int halHandle, hal_species_t *qSpe
         hal_index_t absStart = tSequence->getStartPosition() + tStart;
         hal_index_t absEnd = tSequence->getStartPosition() + myEnd - 1;
         if (absStart > absEnd) {
-            halUnlock();
+            lock.unlock();
             handleError("halGetMaf invalid range", errStr);
             return -1;
         }
         if (absEnd > tSequence->getEndPosition()) {
-            halUnlock();
+            lock.unlock();
             handleError("halGetMaf target end position outside of target sequence", errStr);
             return -1;
         }
 
+        lock.unlockIfConcurrent(alignment);
         stringstream mafBuffer;
         MafExport mafExport;
         mafExport.setNoDupes(doDupes == 0);
@@ -434,15 +500,14 @@ extern "C" hal_int_t halGetMaf(FILE *outFile, int halHandle, hal_species_t *qSpe
             numBytes = (hal_int_t)fwrite(mafStringBuffer.c_str(), mafStringBuffer.length(), sizeof(char), outFile);
         }
     } catch (exception &e) {
-        halUnlock();
+        lock.unlock();
         handleError("halGetMaf error writing MAF blocks: " + string(e.what()), errStr);
         return -1;
     } catch (...) {
-        halUnlock();
+        lock.unlock();
         handleError("halGetMaf error writing MAF blocks: unknown exception", errStr);
         return -1;
     }
-    halUnlock();
     return numBytes;
 }
 
@@ -614,13 +679,13 @@ extern "C" struct hal_chromosome_t *halGetChroms(int halHandle, char *speciesNam
 }
 
 extern "C" char *halGetDna(int halHandle, char *speciesName, char *chromName, hal_int_t start, hal_int_t end, char **errStr) {
-    halLock();
+    HalLockGuard lock;
     char *dna = NULL;
     try {
         AlignmentConstPtr alignment = getExistingAlignment(halHandle, 0, true);
         const Genome *genome = alignment->openGenome(speciesName);
         if (genome == NULL) {
-            halUnlock();
+            lock.unlock();
             handleError("halGetChroms: species with name " + string(speciesName) + " not found in alignment with handle " +
                         std::to_string(halHandle),
                         errStr);
@@ -628,13 +693,13 @@ extern "C" char *halGetDna(int halHandle, char *speciesName, char *chromName, ha
         }
         const Sequence *sequence = genome->getSequence(chromName);
         if (sequence == NULL) {
-            halUnlock();
+            lock.unlock();
             handleError("halGetDna: chromosome with name " + string(chromName) + " not found in species " + speciesName,
                         errStr);
             return NULL;
         }
         if (start > end || end > (hal_index_t)sequence->getSequenceLength()) {
-            halUnlock();
+            lock.unlock();
             handleError("halGetDna: specified range [" + std::to_string(start) + "," + std::to_string(end) + ") is invalid " +
                             "for chromsome " + chromName + " in species " + speciesName + " which is of length " +
                             std::to_string(sequence->getSequenceLength()),
@@ -642,19 +707,21 @@ extern "C" char *halGetDna(int halHandle, char *speciesName, char *chromName, ha
             return NULL;
         }
 
-        string buffer;
-        sequence->getSubString(buffer, start, end - start);
-        dna = copyCString(buffer);
+        lock.unlockIfConcurrent(alignment);
+        dna = (char *)malloc(end - start + 1);
+        sequence->getSubString(dna, start, end - start);
+        dna[end - start] = '\0';
     } catch (exception &e) {
-        halUnlock();
+        lock.unlock();
+        free(dna);
         handleError("halGetDna: " + string(e.what()), errStr);
         return NULL;
     } catch (...) {
-        halUnlock();
+        lock.unlock();
+        free(dna);
         handleError("halGetDna: unknown exception", errStr);
         return NULL;
     }
-    halUnlock();
     return dna;
 }
 
@@ -731,13 +798,10 @@ static char *copyCString(const string &inString) {
     return outString;
 }
 
-static hal_block_results_t *readBlocks(AlignmentConstPtr seqAlignment, const Sequence *tSequence, hal_index_t absStart,
-                                       hal_index_t absEnd, bool tReversed, const Genome *qGenome, bool getSequenceString,
-                                       bool doDupes, bool doTargetDupes, bool doAdjes, const char *coalescenceLimitName) {
+static void initBlockMapper(BlockMapper &blockMapper, const Sequence *tSequence, hal_index_t absStart, hal_index_t absEnd,
+                            bool tReversed, const Genome *qGenome, bool doDupes, bool doAdjes,
+                            const char *coalescenceLimitName) {
     const Genome *tGenome = tSequence->getGenome();
-    string qGenomeName = qGenome->getName();
-    hal_block_t *prev = NULL;
-    BlockMapper blockMapper;
     if (qGenome == tGenome && coalescenceLimitName == NULL) {
         // By default, for self-alignment tracks, walk all the way back to
         // the root finding paralogies.
@@ -760,7 +824,13 @@ static hal_block_results_t *readBlocks(AlignmentConstPtr seqAlignment, const Seq
 
         blockMapper.init(tGenome, qGenome, absStart, absEnd, tReversed, doDupes, 0, doAdjes, coalescenceLimit);
     }
-    blockMapper.map();
+}
+
+/* make the blocks of a mapper that has been run */
+static hal_block_results_t *extractBlocks(BlockMapper &blockMapper, AlignmentConstPtr seqAlignment, const Genome *tGenome,
+                                          const Genome *qGenome, bool getSequenceString, bool doDupes, bool doTargetDupes) {
+    string qGenomeName = qGenome->getName();
+    hal_block_t *prev = NULL;
     MappedSegmentSet paraSet;
     hal_size_t totalLength = 0;
     hal_size_t reversedLength = 0;
@@ -800,6 +870,73 @@ static hal_block_results_t *readBlocks(AlignmentConstPtr seqAlignment, const Seq
     return results;
 }
 
+static hal_block_results_t *readBlocks(AlignmentConstPtr seqAlignment, const Sequence *tSequence, hal_index_t absStart,
+                                       hal_index_t absEnd, bool tReversed, const Genome *qGenome, bool getSequenceString,
+                                       bool doDupes, bool doTargetDupes, bool doAdjes, const char *coalescenceLimitName) {
+    BlockMapper blockMapper;
+    initBlockMapper(blockMapper, tSequence, absStart, absEnd, tReversed, qGenome, doDupes, doAdjes, coalescenceLimitName);
+    blockMapper.map();
+    return extractBlocks(blockMapper, seqAlignment, tSequence->getGenome(), qGenome, getSequenceString, doDupes,
+                         doTargetDupes);
+}
+
+/* As readBlocks, but the whole target segments in the range are mapped in
+ * fixed-size tiles of tSequence, and only the tiles that aren't cached are
+ * mapped.  The blocks are then cut from the map exactly as readBlocks cuts
+ * them, so the results are the same. */
+static hal_block_results_t *readCachedBlocks(int halHandle, AlignmentConstPtr seqAlignment, const Sequence *tSequence,
+                                             hal_index_t absStart, hal_index_t absEnd, const Genome *qGenome,
+                                             bool getSequenceString, bool doDupes, bool doTargetDupes,
+                                             const char *coalescenceLimitName) {
+    BlockMapper blockMapper;
+    initBlockMapper(blockMapper, tSequence, absStart, absEnd, false, qGenome, doDupes, false, coalescenceLimitName);
+
+    hal_index_t tileSize = (hal_index_t)blockCache.getTileSize();
+    hal_index_t seqStart = tSequence->getStartPosition();
+    hal_index_t seqLength = (hal_index_t)tSequence->getSequenceLength();
+    hal_index_t firstTile = (absStart - seqStart) / tileSize;
+    hal_index_t lastTile = (absEnd - seqStart) / tileSize;
+
+    BlockTileKey key;
+    key._handle = halHandle;
+    key._alignment = tSequence->getGenome()->getAlignment();
+    key._qSpecies = qGenome->getName();
+    key._tSpecies = tSequence->getGenome()->getName();
+    key._tChrom = tSequence->getName();
+    key._doDupes = doDupes;
+    key._hasCoalescenceLimit = coalescenceLimitName != NULL;
+    key._coalescenceLimit = coalescenceLimitName != NULL ? coalescenceLimitName : "";
+
+    vector<BlockTilePtr> tiles;
+    for (key._tile = firstTile; key._tile <= lastTile; ++key._tile) {
+        BlockTilePtr tile = blockCache.find(key);
+        if (tile.get() == NULL) {
+            hal_index_t tileStart = seqStart + key._tile * tileSize;
+            hal_index_t tileLast = seqStart + min(seqLength, (key._tile + 1) * tileSize) - 1;
+            BlockTile *newTile = new BlockTile();
+            tile.reset(newTile);
+            newTile->_firstIndex = blockMapper.mapWholeSegments(tileStart, tileLast, newTile->_mappings);
+            blockCache.insert(key, tile);
+        }
+        tiles.push_back(tile);
+    }
+
+    blockMapper.map([&](hal_index_t arrayIndex, hal_index_t startPosition) -> const BlockMapper::SegmentMappings * {
+        hal_index_t tile = (startPosition - seqStart) / tileSize;
+        if (tile < firstTile || tile > lastTile) {
+            return NULL;
+        }
+        const BlockTile &blockTile = *tiles[tile - firstTile];
+        hal_index_t i = arrayIndex - blockTile._firstIndex;
+        if (i < 0 || i >= (hal_index_t)blockTile._mappings.size()) {
+            return NULL;
+        }
+        return &blockTile._mappings[i];
+    });
+    return extractBlocks(blockMapper, seqAlignment, tSequence->getGenome(), qGenome, getSequenceString, doDupes,
+                         doTargetDupes);
+}
+
 static void readBlock(AlignmentConstPtr seqAlignment, hal_block_t *cur, vector<MappedSegmentPtr> &fragments,
                       bool getSequenceString, const string &genomeName) {
     MappedSegmentPtr firstQuerySeg = fragments.front();
@@ -816,8 +953,6 @@ static void readBlock(AlignmentConstPtr seqAlignment, hal_block_t *cur, vector<M
     cur->next = NULL;
 
     string seqBuffer = qSequence->getName();
-    string qDnaBuffer;
-    string tDnaBuffer;
     size_t prefix = seqBuffer.find(genomeName + '.') != 0 ? 0 : genomeName.length() + 1;
     cur->qChrom = (char *)malloc(seqBuffer.length() + 1 - prefix);
     strcpy(cur->qChrom, seqBuffer.c_str() + prefix);
@@ -862,15 +997,12 @@ static void readBlock(AlignmentConstPtr seqAlignment, hal_block_t *cur, vector<M
             throw hal_exception("Unable to open sequence " + tSequence->getName() + " for DNA sequence extraction");
         }
 
-        qSeqSequence->getSubString(qDnaBuffer, cur->qStart, cur->size);
-        tSeqSequence->getSubString(tDnaBuffer, cur->tStart, cur->size);
-        if (cur->strand == '-') {
-            reverseComplement(qDnaBuffer);
-        }
-        cur->qSequence = (char *)malloc(qDnaBuffer.length() * sizeof(char) + 1);
-        cur->tSequence = (char *)malloc(tDnaBuffer.length() * sizeof(char) + 1);
-        strcpy(cur->qSequence, qDnaBuffer.c_str());
-        strcpy(cur->tSequence, tDnaBuffer.c_str());
+        cur->qSequence = (char *)malloc(cur->size * sizeof(char) + 1);
+        cur->tSequence = (char *)malloc(cur->size * sizeof(char) + 1);
+        qSeqSequence->getSubString(cur->qSequence, cur->qStart, cur->size, cur->strand == '-');
+        tSeqSequence->getSubString(cur->tSequence, cur->tStart, cur->size);
+        cur->qSequence[cur->size] = '\0';
+        cur->tSequence[cur->size] = '\0';
     }
 }
 
@@ -256,6 +256,29 @@ struct hal_block_results_t *halGetBlocksInTargetRange_filterByChrom(int halHandl
                                                                     int mapBackAdjacencies, char *qChrom,
                                                                     const char *coalescenceLimitName, char **errStr);
 
+/** Cache the work of halGetBlocksInTargetRange, to speed up overlapping
+ * queries such as when panning and zooming.  Target sequences are split
+ * into tiles of tileSize bases, and the mappings of the target segments
+ * starting in each tile are kept for each handle, query and target
+ * species, level of detail, dupMode and coalescence limit.  A query reuses
+ * the mappings of the tiles covering it, mapping only those not already
+ * cached, and cuts its blocks from them as an uncached query does, so the
+ * results are the same.  The least recently used tiles are dropped to keep
+ * the cache under maxBytes of memory.  Queries with tReversed or
+ * mapBackAdjacencies bypass the cache.  The cache is disabled by default.
+ *
+ * @param tileSize size of tiles in bases (0 for the default of 100000)
+ * @param maxBytes memory budget for the cache (0 to disable and empty it)
+ * @param errStr pointer to a string that contains an error message on
+ * failure. If NULL, throws an exception on failure instead.
+ * @return 0: success -1: failure
+ */
+int halSetBlockCache(hal_int_t tileSize, hal_int_t maxBytes, char **errStr);
+
+/** Get the number of tiles found in and missing from the block cache and
+ * the memory it uses, for testing and tuning. */
+void halGetBlockCacheStats(hal_int_t *numHits, hal_int_t *numMisses, hal_int_t *numBytes);
+
 /** Read alignment into an output file in MAF format.  Interface very
  * similar to halGetBlocksInTargetRange except multiple query species
  * can be specified
@@ -4,6 +4,7 @@
  */
 #include "halBlockViz.h"
 #include "halCLParser.h"
+#include <algorithm>
 #include <stdexcept>
 #include <stdio.h>
 #include <stdlib.h>
@@ -35,6 +36,7 @@ struct bv_args_t {
     int doSeq;
     int doDupes;
     int numThreads;
+    int cacheTileSize;
     char *coalescenceLimit;
     int verbose;
     int udcVerbose;
@@ -46,6 +48,9 @@ static void initParser(hal::CLParser &optionsParser) {
     optionsParser.addOptionFlag("doSeq", "get seqeuence", false);
     optionsParser.addOptionFlag("doDupes", "get duplicate regions", false);
     optionsParser.addOption("numThreads", "number of threads for thread tests", 10);
+    optionsParser.addOption("cacheTileSize", "if not 0, check that queries with the block cache and this tile size "
+                                             "give the same blocks as without",
+                            0);
     optionsParser.addOption("coalescenceLimit", "coalescence limit specices, default is none", "");
     optionsParser.addArgument("halLodPath", "path to HAL or LOD file");
     optionsParser.addArgument("qSpecies", "query species name");
@@ -90,6 +95,7 @@ static bool parseArgs(int argc, char **argv, bv_args_t *args) {
     args->doSeq = optionsParser.get<bool>("doSeq");
     args->doDupes = optionsParser.get<bool>("doDupes");
     args->numThreads = optionsParser.get<int>("numThreads");
+    args->cacheTileSize = optionsParser.get<int>("cacheTileSize");
     args->coalescenceLimit = optionStrOrNull(optionsParser, "coalescenceLimit");
     args->verbose = optionsParser.get<bool>("verbose");
     return true;
@@ -128,6 +134,138 @@ static bool checkCoalescenceLimit(int handle, struct bv_args_t *args) {
     return found;
 }
 
+static bool equalStrings(const char *s1, const char *s2) {
+    return (s1 == NULL) ? (s2 == NULL) : ((s2 != NULL) && (strcmp(s1, s2) == 0));
+}
+
+static bool equalBlocks(struct hal_block_t *b1, struct hal_block_t *b2) {
+    for (; (b1 != NULL) && (b2 != NULL); b1 = b1->next, b2 = b2->next) {
+        if ((strcmp(b1->qChrom, b2->qChrom) != 0) || (b1->tStart != b2->tStart) || (b1->qStart != b2->qStart) ||
+            (b1->size != b2->size) || (b1->strand != b2->strand) || !equalStrings(b1->qSequence, b2->qSequence) ||
+            !equalStrings(b1->tSequence, b2->tSequence)) {
+            fprintf(stderr, "cached block differs:\n");
+            printBlock(stderr, b1);
+            printBlock(stderr, b2);
+            return false;
+        }
+    }
+    if ((b1 != NULL) || (b2 != NULL)) {
+        fprintf(stderr, "cached block count differs\n");
+        return false;
+    }
+    return true;
+}
+
+static bool equalDupeLists(struct hal_target_dupe_list_t *d1, struct hal_target_dupe_list_t *d2) {
+    for (; (d1 != NULL) && (d2 != NULL); d1 = d1->next, d2 = d2->next) {
+        struct hal_target_range_t *r1 = d1->tRange;
+        struct hal_target_range_t *r2 = d2->tRange;
+        for (; (r1 != NULL) && (r2 != NULL); r1 = r1->next, r2 = r2->next) {
+            if ((r1->tStart != r2->tStart) || (r1->size != r2->size)) {
+                break;
+            }
+        }
+        if ((d1->id != d2->id) || (strcmp(d1->qChrom, d2->qChrom) != 0) || (r1 != NULL) || (r2 != NULL)) {
+            fprintf(stderr, "cached target dupe list differs:\n");
+            printDupeList(stderr, d1);
+            printDupeList(stderr, d2);
+            return false;
+        }
+    }
+    if ((d1 != NULL) || (d2 != NULL)) {
+        fprintf(stderr, "cached target dupe list count differs\n");
+        return false;
+    }
+    return true;
+}
+
+static bool equalResults(struct hal_block_results_t *r1, struct hal_block_results_t *r2) {
+    return (r1 != NULL) && (r2 != NULL) && equalBlocks(r1->mappedBlocks, r2->mappedBlocks) &&
+           equalDupeLists(r1->targetDupeBlocks, r2->targetDupeBlocks);
+}
+
+/* query [tStart, tEnd) without and with the cache, cold then warm, which
+ * must give the same results.  Queries mapping back adjacencies must not
+ * use the cache. */
+static bool checkCachedRange(bv_args_t *args, int handle, char *qSpecies, char *tSpecies, char *tChrom, hal_int_t tStart,
+                             hal_int_t tEnd, hal_dup_type_t dupMode, int mapBackAdjacencies) {
+    hal_seqmode_type_t sm = (args->doSeq != 0) ? HAL_LOD0_SEQUENCE : HAL_NO_SEQUENCE;
+    halSetBlockCache(args->cacheTileSize, 0, NULL);
+    struct hal_block_results_t *expected = halGetBlocksInTargetRange(
+        handle, qSpecies, tSpecies, tChrom, tStart, tEnd, 0, sm, dupMode, mapBackAdjacencies, args->coalescenceLimit, NULL);
+    halSetBlockCache(args->cacheTileSize, 1 << 30, NULL);
+    bool same = true;
+    for (int i = 0; (i < 2) && same; ++i) {
+        // cold then warm
+        struct hal_block_results_t *cached = halGetBlocksInTargetRange(
+            handle, qSpecies, tSpecies, tChrom, tStart, tEnd, 0, sm, dupMode, mapBackAdjacencies, args->coalescenceLimit, NULL);
+        same = equalResults(expected, cached);
+        halFreeBlockResults(cached);
+    }
+    hal_int_t numHits, numMisses, numBytes;
+    halGetBlockCacheStats(&numHits, &numMisses, &numBytes);
+    halSetBlockCache(0, 0, NULL);
+    halFreeBlockResults(expected);
+    bool statsOk = (mapBackAdjacencies != 0) ? ((numHits == 0) && (numMisses == 0) && (numBytes == 0))
+                                             : ((numHits > 0) && (numHits == numMisses) && (numBytes > 0));
+    if (same && !statsOk) {
+        fprintf(stderr, "unexpected block cache stats: hits %ld misses %ld bytes %ld\n", numHits, numMisses, numBytes);
+        same = false;
+    }
+    if (!same) {
+        fprintf(stderr, "block cache test failed: %s %s %s %ld %ld dupMode %d mapBackAdjacencies %d tile size %d\n", qSpecies,
+                tSpecies, tChrom, tStart, tEnd, (int)dupMode, mapBackAdjacencies, args->cacheTileSize);
+    }
+    return same;
+}
+
+/* check a range in every dupMode, and with adjacencies */
+static bool checkCachedRangeModes(bv_args_t *args, int handle, char *qSpecies, char *tSpecies, char *tChrom,
+                                  hal_int_t tStart, hal_int_t tEnd) {
+    return checkCachedRange(args, handle, qSpecies, tSpecies, tChrom, tStart, tEnd, HAL_NO_DUPS, 0) &&
+           checkCachedRange(args, handle, qSpecies, tSpecies, tChrom, tStart, tEnd, HAL_QUERY_DUPS, 0) &&
+           checkCachedRange(args, handle, qSpecies, tSpecies, tChrom, tStart, tEnd, HAL_QUERY_AND_TARGET_DUPS, 0) &&
+           checkCachedRange(args, handle, qSpecies, tSpecies, tChrom, tStart, tEnd, HAL_QUERY_DUPS, 1);
+}
+
+/* check the cache on the query range, on a range that starts and ends
+ * inside tiles, and on random ranges of every target sequence against
+ * every query species */
+static bool runCacheTest(bv_args_t *args, int handle) {
+    const int numRandomRanges = 2;
+    const hal_int_t maxRandomLength = 30000;
+    hal_int_t tileSize = args->cacheTileSize;
+    fprintf(stderr, "\nTesting block cache with tile size %d\n", args->cacheTileSize);
+    if (!checkCachedRangeModes(args, handle, args->qSpecies, args->tSpecies, args->tChrom, args->tStart, args->tEnd) ||
+        !checkCachedRangeModes(args, handle, args->qSpecies, args->tSpecies, args->tChrom, args->tStart + tileSize / 2,
+                               args->tEnd - tileSize / 3)) {
+        return false;
+    }
+    srand(0);
+    bool ok = true;
+    hal_species_t *species = halGetSpecies(handle, NULL);
+    for (hal_species_t *tSpecies = species; (tSpecies != NULL) && ok; tSpecies = tSpecies->next) {
+        hal_chromosome_t *chroms = halGetChroms(handle, tSpecies->name, NULL);
+        for (hal_chromosome_t *chrom = chroms; (chrom != NULL) && ok; chrom = chrom->next) {
+            for (hal_species_t *qSpecies = species; (qSpecies != NULL) && ok; qSpecies = qSpecies->next) {
+                if ((qSpecies == tSpecies) && (tSpecies->parentName == NULL)) {
+                    // the root has no top segments to self-align
+                    continue;
+                }
+                for (int i = 0; (i < numRandomRanges) && ok; ++i) {
+                    hal_int_t tStart = rand() % chrom->length;
+                    hal_int_t maxLength = std::min(chrom->length - tStart, maxRandomLength);
+                    hal_int_t tEnd = tStart + 1 + rand() % maxLength;
+                    ok = checkCachedRangeModes(args, handle, qSpecies->name, tSpecies->name, chrom->name, tStart, tEnd);
+                }
+            }
+        }
+        halFreeChromList(chroms);
+    }
+    halFreeSpeciesList(species);
+    return ok;
+}
+
 #ifdef ENABLE_UDC
 static bool someThreadsFailed = false;
 
@@ -228,6 +366,11 @@ static bool runTest(bv_args_t *args, int handle) {
     if (!runSingleTest(args, handle)) {
         return false;
     }
+    if (args->cacheTileSize > 0) {
+        if (!runCacheTest(args, handle)) {
+            return false;
+        }
+    }
 #ifdef ENABLE_UDC
     if (args->numThreads > 0) {
         if (!runThreadTest(args)) {
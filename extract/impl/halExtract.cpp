@@ -6,25 +6,43 @@
  */
 
 #include "hal.h"
+#include "halAlignmentInstance.h"
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
 using namespace std;
 using namespace hal;
 
 static void getDimensions(AlignmentConstPtr outAlignment, const Genome *genome, vector<Sequence::Info> &dimensions);
 
+static void copyTopSegments(const Genome *inGenome, Genome *outGenome);
+
+static void copyBottomSegments(const Genome *inGenome, Genome *outGenome);
+
 static void copyGenome(const Genome *inGenome, Genome *outGenome);
 
 static void extractTree(AlignmentConstPtr inAlignment, AlignmentPtr outAlignment, const string &rootName);
 
 static void extract(AlignmentConstPtr inAlignment, AlignmentPtr outAlignment, const string &rootName);
 
+static size_t getExtractThreads(const Alignment *inAlignment, const Alignment *outAlignment, size_t requested);
+
+static void extractParallel(AlignmentConstPtr inAlignment, AlignmentPtr outAlignment, const string &rootName,
+                            const string &inHalPath, CLParser &optionsParser, size_t numThreads);
+
 static void initParser(CLParser &optionsParser) {
     optionsParser.addArgument("inHalPath", "input hal file");
     optionsParser.addArgument("outHalPath", "output hal file");
     optionsParser.addOption("outputFormat", "format for output hal file (same as input file by default)", "");
     optionsParser.addOption("root", "root of subtree to extract", "\"\"");
+    addNumThreadsOption(optionsParser);
+    optionsParser.setDescription("Extract a subtree of an alignment into a new file, possibly in another format.  "
+                                 "With more than one thread, which requires mmap output, all genomes are laid out "
+                                 "in the output first and then filled in in parallel.  HDF5 input is then opened "
+                                 "once per thread, which requires an HDF5 library built thread-safe.");
 }
 
 int main(int argc, char **argv) {
@@ -35,12 +53,14 @@ int main(int argc, char **argv) {
     string outHalPath;
     string rootName;
     string outputFormat;
+    size_t numThreads;
     try {
         optionsParser.parseOptions(argc, argv);
         inHalPath = optionsParser.getArgument<string>("inHalPath");
         outHalPath = optionsParser.getArgument<string>("outHalPath");
         rootName = optionsParser.getOption<string>("root");
         outputFormat = optionsParser.getOption<string>("outputFormat");
+        numThreads = optionsParser.getOption<size_t>("numThreads");
     } catch (exception &e) {
         cerr << e.what() << endl;
         optionsParser.printUsage(cerr);
@@ -69,7 +89,12 @@ int main(int argc, char **argv) {
         }
 
         extractTree(inAlignment, outAlignment, rootName);
-        extract(inAlignment, outAlignment, rootName);
+        numThreads = getExtractThreads(inAlignment.get(), outAlignment.get(), numThreads);
+        if (numThreads > 1) {
+            extractParallel(inAlignment, outAlignment, rootName, inHalPath, optionsParser, numThreads);
+        } else {
+            extract(inAlignment, outAlignment, rootName);
+        }
         outAlignment->close();
     } catch (hal_exception &e) {
         cerr << "hal exception caught: " << e.what() << endl;
@@ -95,52 +120,59 @@ void getDimensions(AlignmentConstPtr outAlignment, const Genome *genome, vector<
     }
 }
 
-void copyGenome(const Genome *inGenome, Genome *outGenome) {
-    DnaIteratorPtr inDna = inGenome->getDnaIterator();
-    DnaIteratorPtr outDna = outGenome->getDnaIterator();
-    hal_size_t n = inGenome->getSequenceLength();
-    assert(n == outGenome->getSequenceLength());
-    for (; (hal_size_t)inDna->getArrayIndex() < n; inDna->toRight(), outDna->toRight()) {
-        outDna->setBase(inDna->getBase());
-    }
-    outDna->flush();
-
-    TopSegmentIteratorPtr inTop = inGenome->getTopSegmentIterator();
-    TopSegmentIteratorPtr outTop = outGenome->getTopSegmentIterator();
-    n = outGenome->getNumTopSegments();
-    assert(n == 0 || n == inGenome->getNumTopSegments());
-    for (; (hal_size_t)inTop->getArrayIndex() < n; inTop->toRight(), outTop->toRight()) {
-        outTop->setCoordinates(inTop->getStartPosition(), inTop->getLength());
-        outTop->tseg()->setParentIndex(inTop->tseg()->getParentIndex());
-        outTop->tseg()->setParentReversed(inTop->tseg()->getParentReversed());
-        outTop->tseg()->setBottomParseIndex(inTop->tseg()->getBottomParseIndex());
-        outTop->tseg()->setNextParalogyIndex(inTop->tseg()->getNextParalogyIndex());
+/* The output genome has the same sequences, in the same order, as the
+ * input genome, so the segment indices can be copied as they are, and the
+ * arrays can be copied as blocks when the formats are the same. */
+void copyTopSegments(const Genome *inGenome, Genome *outGenome) {
+    if (!inGenome->copyTopSegmentArray(outGenome)) {
+        TopSegmentIteratorPtr inTop = inGenome->getTopSegmentIterator();
+        TopSegmentIteratorPtr outTop = outGenome->getTopSegmentIterator();
+        hal_size_t n = outGenome->getNumTopSegments();
+        assert(n == 0 || n == inGenome->getNumTopSegments());
+        for (; (hal_size_t)inTop->getArrayIndex() < n; inTop->toRight(), outTop->toRight()) {
+            outTop->setCoordinates(inTop->getStartPosition(), inTop->getLength());
+            outTop->tseg()->setParentIndex(inTop->tseg()->getParentIndex());
+            outTop->tseg()->setParentReversed(inTop->tseg()->getParentReversed());
+            outTop->tseg()->setBottomParseIndex(inTop->tseg()->getBottomParseIndex());
+            outTop->tseg()->setNextParalogyIndex(inTop->tseg()->getNextParalogyIndex());
+        }
     }
+}
 
+void copyBottomSegments(const Genome *inGenome, Genome *outGenome) {
     BottomSegmentIteratorPtr inBot = inGenome->getBottomSegmentIterator();
     BottomSegmentIteratorPtr outBot = outGenome->getBottomSegmentIterator();
-    n = outGenome->getNumBottomSegments();
+    hal_size_t n = outGenome->getNumBottomSegments();
     assert(n == 0 || n == inGenome->getNumBottomSegments());
     hal_size_t nc = inGenome->getNumChildren();
     assert(nc == outGenome->getNumChildren());
-    for (; (hal_size_t)inBot->getArrayIndex() < n; inBot->toRight(), outBot->toRight()) {
-        outBot->setCoordinates(inBot->getStartPosition(), inBot->getLength());
-        for (hal_size_t child = 0; child < nc; ++child) {
-            outBot->bseg()->setChildIndex(child, inBot->bseg()->getChildIndex(child));
-            outBot->bseg()->setChildReversed(child, inBot->bseg()->getChildReversed(child));
-        }
-        if (outGenome->getAlignment()->getRootName() == outGenome->getName()) {
+    // the new root has no parse info
+    bool outRoot = outGenome->getAlignment()->getRootName() == outGenome->getName();
+    if (inGenome->copyBottomSegmentArray(outGenome)) {
+        for (; outRoot && (hal_size_t)outBot->getArrayIndex() < n; outBot->toRight()) {
             outBot->bseg()->setTopParseIndex(NULL_INDEX);
-        } else {
-            outBot->bseg()->setTopParseIndex(inBot->bseg()->getTopParseIndex());
+        }
+    } else {
+        for (; (hal_size_t)inBot->getArrayIndex() < n; inBot->toRight(), outBot->toRight()) {
+            outBot->setCoordinates(inBot->getStartPosition(), inBot->getLength());
+            for (hal_size_t child = 0; child < nc; ++child) {
+                outBot->bseg()->setChildIndex(child, inBot->bseg()->getChildIndex(child));
+                outBot->bseg()->setChildReversed(child, inBot->bseg()->getChildReversed(child));
+            }
+            if (outRoot) {
+                outBot->bseg()->setTopParseIndex(NULL_INDEX);
+            } else {
+                outBot->bseg()->setTopParseIndex(inBot->bseg()->getTopParseIndex());
+            }
         }
     }
+}
 
-    const map<string, string> &meta = inGenome->getMetaData()->getMap();
-    map<string, string>::const_iterator i = meta.begin();
-    for (; i != meta.end(); ++i) {
-        outGenome->getMetaData()->set(i->first, i->second);
-    }
+void copyGenome(const Genome *inGenome, Genome *outGenome) {
+    inGenome->copySequence(outGenome);
+    copyTopSegments(inGenome, outGenome);
+    copyBottomSegments(inGenome, outGenome);
+    inGenome->copyMetadata(outGenome);
 }
 
 static void extractTree(AlignmentConstPtr inAlignment, AlignmentPtr outAlignment, const string &rootName) {
@@ -188,3 +220,155 @@ void extract(AlignmentConstPtr inAlignment, AlignmentPtr outAlignment, const str
         extract(inAlignment, outAlignment, childNames[i]);
     }
 }
+
+/* Only the mmap format can be written from several threads, once its
+ * genomes are laid out.  HDF5 input is read through one alignment per
+ * thread, which needs a thread-safe HDF5 library. */
+size_t getExtractThreads(const Alignment *inAlignment, const Alignment *outAlignment, size_t requested) {
+    size_t numThreads = requested;
+    if (numThreads == 0) {
+        numThreads = max(thread::hardware_concurrency(), 1u);
+    }
+    if ((numThreads > 1) && (outAlignment->getStorageFormat() != STORAGE_FORMAT_MMAP)) {
+        cerr << "halExtract: warning: only mmap output can be written by more than one thread, "
+             << "using a single thread" << endl;
+        numThreads = 1;
+    }
+    if ((numThreads > 1) && !inAlignment->supportsConcurrentReads() && !hdf5IsThreadSafe()) {
+        cerr << "halExtract: warning: the HDF5 library is not thread-safe, using a single thread" << endl;
+        numThreads = 1;
+    }
+    return numThreads;
+}
+
+static void getTreeOrder(AlignmentConstPtr alignment, const string &name, vector<string> &names) {
+    names.push_back(name);
+    vector<string> childNames = alignment->getChildNames(name);
+    for (size_t i = 0; i < childNames.size(); ++i) {
+        getTreeOrder(alignment, childNames[i], names);
+    }
+}
+
+/* Input alignments for the copying threads.  An alignment that supports
+ * concurrent reads is shared, otherwise each thread takes one of its own
+ * from the pool for the length of a task. */
+class InputPool {
+  public:
+    InputPool(AlignmentConstPtr inAlignment, const string &inHalPath, CLParser &optionsParser, size_t numThreads)
+        : _shared(inAlignment->supportsConcurrentReads()) {
+        _free.push_back(inAlignment);
+        for (size_t i = 1; !_shared && (i < numThreads); ++i) {
+            _free.push_back(AlignmentConstPtr(openHalAlignment(inHalPath, &optionsParser)));
+        }
+    }
+    ~InputPool() {
+        for (size_t i = 1; i < _free.size(); ++i) {
+            _free[i]->close();
+        }
+    }
+    bool isShared() const {
+        return _shared;
+    }
+    AlignmentConstPtr take() {
+        lock_guard<mutex> lock(_mutex);
+        assert(!_free.empty());
+        AlignmentConstPtr alignment = _shared ? _free.front() : _free.back();
+        if (!_shared) {
+            _free.pop_back();
+        }
+        return alignment;
+    }
+    void give(AlignmentConstPtr alignment) {
+        if (!_shared) {
+            lock_guard<mutex> lock(_mutex);
+            _free.push_back(alignment);
+        }
+    }
+
+  private:
+    bool _shared;
+    vector<AlignmentConstPtr> _free;
+    mutex _mutex;
+};
+
+enum ExtractPart { EXTRACT_SEQUENCE, EXTRACT_TOP_SEGMENTS, EXTRACT_BOTTOM_SEGMENTS };
+
+struct ExtractTask {
+    size_t _genomeIdx;
+    ExtractPart _part;
+    hal_size_t _cost; // rough number of bytes written
+};
+
+/* All genomes are created and given their dimensions first, which is the
+ * only step that allocates space in the output file.  Each genome's DNA,
+ * top segments and bottom segments then go to separate regions of the file,
+ * so they are copied as independent tasks, largest first.  Metadata is
+ * allocated as it is written, so it is copied at the end, in one thread. */
+void extractParallel(AlignmentConstPtr inAlignment, AlignmentPtr outAlignment, const string &rootName,
+                     const string &inHalPath, CLParser &optionsParser, size_t numThreads) {
+    vector<string> names;
+    getTreeOrder(inAlignment, rootName, names);
+    vector<Genome *> outGenomes;
+    vector<ExtractTask> tasks;
+    for (size_t i = 0; i < names.size(); ++i) {
+        const Genome *genome = inAlignment->openGenome(names[i]);
+        Genome *newGenome = outAlignment->openGenome(names[i]);
+        assert(newGenome != NULL);
+        vector<Sequence::Info> dimensions;
+        getDimensions(inAlignment, genome, dimensions);
+        newGenome->setDimensions(dimensions);
+        outGenomes.push_back(newGenome);
+
+        ExtractTask sequenceTask = {i, EXTRACT_SEQUENCE, newGenome->getSequenceLength()};
+        ExtractTask topTask = {i, EXTRACT_TOP_SEGMENTS, newGenome->getNumTopSegments() * 4 * sizeof(hal_index_t)};
+        ExtractTask bottomTask = {i, EXTRACT_BOTTOM_SEGMENTS,
+                                  newGenome->getNumBottomSegments() * (2 + 2 * newGenome->getNumChildren()) *
+                                      sizeof(hal_index_t)};
+        tasks.push_back(sequenceTask);
+        tasks.push_back(topTask);
+        tasks.push_back(bottomTask);
+        inAlignment->closeGenome(genome);
+    }
+    stable_sort(tasks.begin(), tasks.end(), [](const ExtractTask &a, const ExtractTask &b) { return a._cost > b._cost; });
+
+    InputPool inputs(inAlignment, inHalPath, optionsParser, numThreads);
+    vector<bool> started(names.size(), false);
+    mutex outputMutex;
+    parallelFor(tasks.size(), numThreads, [&](size_t t) {
+        const ExtractTask &task = tasks[t];
+        {
+            lock_guard<mutex> lock(outputMutex);
+            if (!started[task._genomeIdx]) {
+                started[task._genomeIdx] = true;
+                cout << "Extracting " << names[task._genomeIdx] << endl;
+            }
+        }
+        AlignmentConstPtr input = inputs.take();
+        try {
+            const Genome *genome = input->openGenome(names[task._genomeIdx]);
+            Genome *newGenome = outGenomes[task._genomeIdx];
+            if (task._part == EXTRACT_SEQUENCE) {
+                genome->copySequence(newGenome);
+            } else if (task._part == EXTRACT_TOP_SEGMENTS) {
+                copyTopSegments(genome, newGenome);
+            } else {
+                copyBottomSegments(genome, newGenome);
+            }
+            if (!inputs.isShared()) {
+                // keeps at most one genome per thread in memory
+                input->closeGenome(genome);
+            }
+        } catch (...) {
+            inputs.give(input);
+            throw;
+        }
+        inputs.give(input);
+    });
+
+    for (size_t i = 0; i < names.size(); ++i) {
+        const Genome *genome = inAlignment->openGenome(names[i]);
+        genome->copyMetadata(outGenomes[i]);
+        inAlignment->closeGenome(genome);
+        outAlignment->closeGenome(outGenomes[i]);
+    }
+}
@@ -15,14 +15,13 @@
 using namespace std;
 using namespace hal;
 
-static void printSequenceLine(ostream &outStream, const Sequence *sequence, hal_size_t start, hal_size_t length,
-                              string &buffer, bool upper);
 static void printSequence(ostream &outStream, const Sequence *sequence, hal_size_t lineWidth, hal_size_t start,
                           hal_size_t length, bool fullNames, bool upper);
 static void printGenome(ostream &outStream, const Genome *genome, const Sequence *sequence, hal_size_t lineWidth,
                         hal_size_t start, hal_size_t length, bool fullNames, bool upper);
 
-static const hal_size_t StringBufferSize = 1024;
+/* bases decoded at a time, rounded down to whole lines */
+static const hal_size_t StringBufferSize = 1024 * 1024;
 
 static void initParser(CLParser &optionsParser) {
     optionsParser.addArgument("inHalPath", "input hal file");
@@ -75,6 +74,10 @@ int main(int argc, char **argv) {
         subtree = optionsParser.getFlag("subtree");
         upper = optionsParser.getFlag("upper");
 
+        if (lineWidth == 0) {
+            throw hal_exception("--lineWidth must be greater than 0");
+        }
+
         if (subtree) {
             if (start != 0) {
                 throw hal_exception("--start cannot be used with --subtree");
@@ -148,21 +151,6 @@ int main(int argc, char **argv) {
     return 0;
 }
 
-void printSequenceLine(ostream &outStream, const Sequence *sequence, hal_size_t start, hal_size_t length, string &buffer, bool upper) {
-    hal_size_t last = start + length;
-    hal_size_t readLen;
-    for (hal_size_t i = start; i < last; i += StringBufferSize) {
-        readLen = std::min(StringBufferSize, last - i);
-        sequence->getSubString(buffer, i, readLen);
-        if (upper) {
-            for (int j = 0; j < buffer.size(); ++j) {
-                buffer[j] = std::toupper(buffer[j]);
-            }
-        }
-        outStream << buffer;
-    }
-}
-
 void printSequence(ostream &outStream, const Sequence *sequence, hal_size_t lineWidth, hal_size_t start, hal_size_t length, bool fullNames, bool upper) {
     hal_size_t seqLen = sequence->getSequenceLength();
     if (length == 0) {
@@ -175,12 +163,15 @@ void printSequence(ostream &outStream, const Sequence *sequence, hal_size_t line
                             std::to_string(seqLen));
     }
     outStream << '>' << (fullNames ? sequence->getFullName() : sequence->getName()) << '\n';
-    hal_size_t readLen;
-    string buffer;
-    for (hal_size_t i = start; i < last; i += lineWidth) {
-        readLen = std::min(lineWidth, last - i);
-        printSequenceLine(outStream, sequence, i, readLen, buffer, upper);
-        outStream << '\n';
+    hal_size_t bufferLen = std::max(lineWidth, StringBufferSize - StringBufferSize % lineWidth);
+    vector<char> buffer(bufferLen);
+    for (hal_size_t i = start; i < last; i += bufferLen) {
+        hal_size_t readLen = std::min(bufferLen, last - i);
+        sequence->getSubString(buffer.data(), i, readLen, false, upper);
+        for (hal_size_t j = 0; j < readLen; j += lineWidth) {
+            outStream.write(buffer.data() + j, std::min(lineWidth, readLen - j));
+            outStream << '\n';
+        }
     }
 }
 
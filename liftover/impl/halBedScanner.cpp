@@ -44,14 +44,9 @@ void BedScanner::scan(istream *is, int bedType) {
         throw hal_exception("Error reading bed input stream");
     }
     string lineBuffer;
-    _lineNumber = 0;
     try {
-        skipWhiteSpaces(_bedStream);
-        while (_bedStream->good()) {
-            ++_lineNumber;
-            _bedLine.read(*_bedStream, lineBuffer, bedType);
+        for (_lineNumber = 1; readLine(_bedStream, _bedLine, lineBuffer, bedType); ++_lineNumber) {
             visitLine();
-            skipWhiteSpaces(_bedStream);
         }
     } catch (hal_exception &e) {
         throw hal_exception(string(e.what()) + " in input bed line " + std::to_string(_lineNumber));
@@ -63,6 +58,15 @@ void BedScanner::scan(istream *is, int bedType) {
 size_t BedScanner::getNumColumns(const string &bedLine) {
     return chopString(bedLine, "\t").size();
 }
+bool BedScanner::readLine(istream *bedStream, BedLine &bedLine, string &lineBuffer, int bedType) {
+    skipWhiteSpaces(bedStream);
+    if (!bedStream->good()) {
+        return false;
+    }
+    bedLine.read(*bedStream, lineBuffer, bedType);
+    return true;
+}
+
 void BedScanner::visitBegin() {
 }
 
@@ -7,7 +7,6 @@
 
 #include "halBlockLiftover.h"
 #include "halBlockMapper.h"
-#include "halSegmentMapper.h"
 #include <cassert>
 #include <deque>
 
@@ -21,26 +20,9 @@ BlockLiftover::~BlockLiftover() {
 }
 
 void BlockLiftover::visitBegin() {
-    if (_srcGenome->getNumTopSegments() > 0) {
-        _refSeg = _srcGenome->getTopSegmentIterator();
-        _lastIndex = (hal_index_t)_srcGenome->getNumTopSegments();
-    } else {
-        _refSeg = _srcGenome->getBottomSegmentIterator();
-        _lastIndex = (hal_index_t)_srcGenome->getNumBottomSegments();
-    }
-
-    set<const Genome *> inputSet;
-    inputSet.insert(_srcGenome);
-    inputSet.insert(_tgtGenome);
-    _mrca = getLowestCommonAncestor(inputSet);
-    if (_coalescenceLimit == NULL) {
-        _coalescenceLimit = _mrca;
-    }
-
-    inputSet.clear();
-    inputSet.insert(_coalescenceLimit);
-    inputSet.insert(_tgtGenome);
-    getGenomesInSpanningTree(inputSet, _downwardPath);
+    // input is usually sorted, so consecutive lines tend to fall in the same
+    // source segments, whose mappings the IntervalMapper keeps
+    _mapper.reset(new IntervalMapper(_srcGenome, _tgtGenome, _traverseDupes, 0, _coalescenceLimit));
 }
 
 void BlockLiftover::liftInterval(BedList &mappedBedLines) {
@@ -49,27 +31,7 @@ void BlockLiftover::liftInterval(BedList &mappedBedLines) {
     hal_index_t globalEnd = _bedLine._end - 1 + _srcSequence->getStartPosition();
     bool flip = _bedLine._strand == '-';
 
-    _refSeg->toSite(globalStart, false);
-    hal_offset_t startOffset = globalStart - _refSeg->getStartPosition();
-    hal_offset_t endOffset = 0;
-    if (globalEnd <= _refSeg->getEndPosition()) {
-        endOffset = _refSeg->getEndPosition() - globalEnd;
-    }
-    _refSeg->slice(startOffset, endOffset);
-
-    assert(_refSeg->getStartPosition() == globalStart);
-    assert(_refSeg->getEndPosition() <= globalEnd);
-
-    while (_refSeg->getArrayIndex() < _lastIndex && _refSeg->getStartPosition() <= globalEnd) {
-        if (flip == true) {
-            _refSeg->toReverseInPlace();
-        }
-        halMapSegment(_refSeg.get(), _mappedSegments, _tgtGenome, &_downwardPath, _traverseDupes, 0, _coalescenceLimit, _mrca);
-        if (flip == true) {
-            _refSeg->toReverseInPlace();
-        }
-        _refSeg->toRight(globalEnd);
-    }
+    _mapper->mapInterval(globalStart, globalEnd, flip, _mappedSegments);
 
     vector<MappedSegmentPtr> fragments;
     MappedSegmentSet emptySet;
@@ -48,10 +48,8 @@ void BlockMapper::init(const Genome *refGenome, const Genome *queryGenome, hal_i
     assert(_refSequence == refGenome->getSequenceBySite(_absRefLast));
     _queryGenome = queryGenome;
 
-    set<const Genome *> inputSet;
-    inputSet.insert(_refGenome);
-    inputSet.insert(_queryGenome);
-    _mrca = getLowestCommonAncestor(inputSet);
+    const Alignment *alignment = _refGenome->getAlignment();
+    _mrca = alignment->getMappingPath(_refGenome, _queryGenome)->_mrca;
 
     if (coalescenceLimit == NULL) {
         _coalescenceLimit = _mrca;
@@ -62,28 +60,31 @@ void BlockMapper::init(const Genome *refGenome, const Genome *queryGenome, hal_i
     // The path between the coalescence limit (the highest point in the
     // tree) and the query genome is needed to traverse down into the
     // correct children.
-    inputSet.clear();
-    inputSet.insert(_queryGenome);
-    inputSet.insert(_coalescenceLimit);
-    getGenomesInSpanningTree(inputSet, _downwardPath);
+    _downwardPath = alignment->getMappingPath(_refGenome, _queryGenome, _coalescenceLimit)->_genomesOnPath;
 
     // similarly, the upward path is needed to get the adjacencies properly.
-    inputSet.clear();
-    inputSet.insert(_refGenome);
-    inputSet.insert(_coalescenceLimit);
-    getGenomesInSpanningTree(inputSet, _upwardPath);
+    _upwardPath = alignment->getMappingPath(_queryGenome, _refGenome, _coalescenceLimit)->_genomesOnPath;
 }
 
-void BlockMapper::map() {
-    SegmentIteratorPtr refSeg;
-    hal_index_t lastIndex;
+/* the reference segments that are mapped, and the end of their array */
+SegmentIteratorPtr BlockMapper::getRefSegmentIterator(hal_index_t &lastIndex) const {
     if ((_mrca == _refGenome) && (_refGenome != _queryGenome)) {
-        refSeg = _refGenome->getBottomSegmentIterator();
         lastIndex = _refGenome->getNumBottomSegments();
+        return _refGenome->getBottomSegmentIterator();
     } else {
-        refSeg = _refGenome->getTopSegmentIterator();
         lastIndex = _refGenome->getNumTopSegments();
+        return _refGenome->getTopSegmentIterator();
     }
+}
+
+void BlockMapper::map() {
+    map(MappingLookup());
+}
+
+void BlockMapper::map(const MappingLookup &lookup) {
+    assert(!lookup || (_targetReversed == false && _mapAdj == false));
+    hal_index_t lastIndex;
+    SegmentIteratorPtr refSeg = getRefSegmentIterator(lastIndex);
 
     refSeg->toSite(_absRefFirst, false);
     hal_offset_t startOffset = _absRefFirst - refSeg->getStartPosition();
@@ -97,12 +98,23 @@ void BlockMapper::map() {
     assert(refSeg->getEndPosition() <= _absRefLast);
 
     while (refSeg->getArrayIndex() < lastIndex && refSeg->getStartPosition() <= _absRefLast) {
-        if (_targetReversed == true) {
-            refSeg->toReverseInPlace();
+        const SegmentMappings *mappings = NULL;
+        if (lookup && refSeg->getStartOffset() == 0 && refSeg->getEndOffset() == 0) {
+            mappings = lookup(refSeg->getArrayIndex(), refSeg->getStartPosition());
         }
-        halMapSegment(refSeg.get(), _segSet, _queryGenome, &_downwardPath, _doDupes, _minLength, _coalescenceLimit, _mrca);
-        if (_targetReversed == true) {
-            refSeg->toReverseInPlace();
+        if (mappings != NULL) {
+            for (size_t i = 0; i < mappings->size(); ++i) {
+                halAddMappedRange((*mappings)[i], _segSet);
+            }
+        } else {
+            if (_targetReversed == true) {
+                refSeg->toReverseInPlace();
+            }
+            _segmentMapper.mapSegment(refSeg.get(), _segSet, _queryGenome, &_downwardPath, _doDupes, _minLength,
+                                      _coalescenceLimit, _mrca);
+            if (_targetReversed == true) {
+                refSeg->toReverseInPlace();
+            }
         }
         refSeg->toRight(_absRefLast);
     }
@@ -118,6 +130,24 @@ void BlockMapper::map() {
     }
 }
 
+hal_index_t BlockMapper::mapWholeSegments(hal_index_t absFirst, hal_index_t absLast, vector<SegmentMappings> &outMappings) {
+    assert(_targetReversed == false);
+    hal_index_t lastIndex;
+    SegmentIteratorPtr refSeg = getRefSegmentIterator(lastIndex);
+    refSeg->toSite(absFirst, false);
+    if (refSeg->getStartPosition() < absFirst) {
+        refSeg->toRight();
+    }
+    hal_index_t firstIndex = refSeg->getArrayIndex();
+    while (refSeg->getArrayIndex() < lastIndex && refSeg->getStartPosition() <= absLast) {
+        outMappings.push_back(SegmentMappings());
+        _segmentMapper.mapSegment(refSeg.get(), outMappings.back(), _queryGenome, &_downwardPath, _doDupes, _minLength,
+                                  _coalescenceLimit, _mrca);
+        refSeg->toRight();
+    }
+    return firstIndex;
+}
+
 void BlockMapper::extractReferenceParalogies(MappedSegmentSet &outParalogies) {
     MappedSegmentSet::iterator i = _segSet.begin();
     MappedSegmentSet::iterator j = _segSet.end();
@@ -216,7 +246,7 @@ void BlockMapper::mapAdjacencies(MappedSegmentSet::const_iterator segIt) {
         }
         size_t backSize = backResults.size();
         assert(queryIt->getArrayIndex() >= 0);
-        halMapSegment(queryIt.get(), backResults, _refGenome, &_upwardPath, _doDupes, _minLength);
+        _segmentMapper.mapSegment(queryIt.get(), backResults, _refGenome, &_upwardPath, _doDupes, _minLength);
         // something was found, that's good enough.
         if (backResults.size() > backSize) {
             break;
@@ -246,7 +276,7 @@ void BlockMapper::mapAdjacencies(MappedSegmentSet::const_iterator segIt) {
             break;
         }
         size_t backSize = backResults.size();
-        halMapSegment(queryIt.get(), backResults, _refGenome, &_upwardPath, _doDupes, _minLength);
+        _segmentMapper.mapSegment(queryIt.get(), backResults, _refGenome, &_upwardPath, _doDupes, _minLength);
         // something was found, that's good enough.
         if (backResults.size() > backSize) {
             break;
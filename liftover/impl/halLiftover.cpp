@@ -14,7 +14,7 @@ using namespace hal;
 
 Liftover::Liftover()
     : _outBedStream(NULL), _outPSL(false), _outPSLWithName(false), _srcGenome(NULL),
-      _tgtGenome(NULL) {
+      _tgtGenome(NULL), _missedSet(new MissedSet()) {
 }
 
 Liftover::~Liftover() {
@@ -23,6 +23,38 @@ Liftover::~Liftover() {
 void Liftover::convert(AlignmentConstPtr alignment, const Genome *srcGenome, istream *inBedStream, const Genome *tgtGenome,
                        ostream *outBedStream, int bedType, bool traverseDupes,
                        bool outPSL, bool outPSLWithName, const Genome *coalescenceLimit) {
+    assert(inBedStream && outBedStream);
+    setParameters(alignment, srcGenome, tgtGenome, outBedStream, bedType, traverseDupes, outPSL, outPSLWithName,
+                  coalescenceLimit);
+    scan(inBedStream, bedType);
+}
+
+void Liftover::prepare(AlignmentConstPtr alignment, const Genome *srcGenome, const Genome *tgtGenome, int bedType,
+                       bool traverseDupes, bool outPSL, bool outPSLWithName, const Genome *coalescenceLimit) {
+    setParameters(alignment, srcGenome, tgtGenome, NULL, bedType, traverseDupes, outPSL, outPSLWithName,
+                  coalescenceLimit);
+    visitBegin();
+}
+
+void Liftover::convertBedLine(const BedLine &bedLine, ostream &outStream) {
+    _bedLine = bedLine;
+    _outBedStream = &outStream;
+    visitLine();
+}
+
+void Liftover::shareMissedSet(const Liftover &other) {
+    _missedSet = other._missedSet;
+}
+
+void Liftover::clearMissedSet() {
+    lock_guard<mutex> lock(_missedSet->_mutex);
+    _missedSet->_names.clear();
+}
+
+void Liftover::setParameters(AlignmentConstPtr alignment, const Genome *srcGenome, const Genome *tgtGenome,
+                             ostream *outBedStream, int bedType, bool traverseDupes, bool outPSL,
+                             bool outPSLWithName, const Genome *coalescenceLimit) {
+    _alignment = alignment;
     _srcGenome = srcGenome;
     _tgtGenome = tgtGenome;
     _coalescenceLimit = coalescenceLimit;
@@ -31,13 +63,11 @@ void Liftover::convert(AlignmentConstPtr alignment, const Genome *srcGenome, ist
     _traverseDupes = traverseDupes;
     _outPSL = outPSL;
     _outPSLWithName = outPSLWithName;
-    _missedSet.clear();
+    clearMissedSet();
     _tgtSet.clear();
-    assert(_srcGenome && inBedStream && tgtGenome && outBedStream);
+    assert(_srcGenome && tgtGenome);
 
     _tgtSet.insert(tgtGenome);
-
-    scan(inBedStream, bedType);
 }
 
 void Liftover::visitBegin() {
@@ -51,7 +81,8 @@ void Liftover::visitLine() {
     _outBedLines.clear();
     _srcSequence = _srcGenome->getSequence(_bedLine._chrName);
     if (_srcSequence == NULL) {
-        pair<set<string>::iterator, bool> result = _missedSet.insert(_bedLine._chrName);
+        lock_guard<mutex> lock(_missedSet->_mutex);
+        pair<set<string>::iterator, bool> result = _missedSet->_names.insert(_bedLine._chrName);
         if (result.second == true) {
             std::cerr << "Unable to find sequence " << _bedLine._chrName << " in genome " << _srcGenome->getName() << endl;
         }
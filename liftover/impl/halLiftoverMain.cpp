@@ -7,13 +7,18 @@
 
 #include "halBlockLiftover.h"
 #include "halColumnLiftover.h"
+#include "halParallel.h"
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 
 using namespace std;
 using namespace hal;
 
+/* number of input lines read and lifted as one parallel task */
+static const size_t LIFTOVER_BATCH_SIZE = 1000;
+
 static void initParser(CLParser &optionsParser) {
     optionsParser.addArgument("halFile", "input hal file");
     optionsParser.addArgument("srcGenome", "source genome name");
@@ -39,10 +44,81 @@ static void initParser(CLParser &optionsParser) {
     optionsParser.addOption("bedType", "number of standard columns (3 to 12), columns beyond this are passed "
                             "through.  This only needs to be specified for BEDs with less than 12 columns and "
                             "having non-standard extra columns.", 0);
+    addNumThreadsOption(optionsParser);
     optionsParser.setDescription("Map BED or PSL genome interval coordinates between "
                                  "two genomes.");
 }
 
+namespace {
+    /* a batch of input lines and the number of the first one */
+    struct BedBatch {
+        hal_size_t _firstLineNumber;
+        vector<BedLine> _lines;
+    };
+}
+
+/* Lift the input with numThreads threads.  Batches of lines are read in
+ * order, lifted in parallel, each thread with its own BlockLiftover, and
+ * written in input order, so the output is the same as for one thread and
+ * both input and output can be streams. */
+static void parallelLiftover(AlignmentConstPtr alignment, const Genome *srcGenome, istream *srcBed,
+                             const Genome *tgtGenome, ostream *tgtBed, int bedType, bool traverseDupes, bool outPSL,
+                             bool outPSLWithName, const Genome *coalescenceLimit, size_t numThreads) {
+    // liftovers not in use by a task
+    vector<unique_ptr<BlockLiftover>> liftovers;
+    mutex liftoversMutex;
+    for (size_t t = 0; t < numThreads; ++t) {
+        liftovers.push_back(unique_ptr<BlockLiftover>(new BlockLiftover()));
+        if (t > 0) {
+            // so a missing sequence is reported once, not by every thread
+            liftovers.back()->shareMissedSet(*liftovers.front());
+        }
+        liftovers.back()->prepare(alignment, srcGenome, tgtGenome, bedType, traverseDupes, outPSL, outPSLWithName,
+                                  coalescenceLimit);
+    }
+
+    vector<BedBatch> batches(getOrderedWindow(numThreads));
+    string lineBuffer;
+    hal_size_t lineNumber = 0;
+    auto readBatch = [&](size_t i) {
+        BedBatch &batch = batches[i % batches.size()];
+        batch._firstLineNumber = lineNumber + 1;
+        batch._lines.resize(LIFTOVER_BATCH_SIZE);
+        size_t numLines = 0;
+        try {
+            while (numLines < LIFTOVER_BATCH_SIZE &&
+                   BedScanner::readLine(srcBed, batch._lines[numLines], lineBuffer, bedType)) {
+                ++numLines;
+                ++lineNumber;
+            }
+        } catch (hal_exception &e) {
+            throw hal_exception(string(e.what()) + " in input bed line " + std::to_string(lineNumber + 1));
+        }
+        batch._lines.resize(numLines);
+        return numLines > 0;
+    };
+    auto liftBatch = [&](size_t i, ostream &outStream) {
+        unique_ptr<BlockLiftover> liftover;
+        {
+            lock_guard<mutex> lock(liftoversMutex);
+            liftover = std::move(liftovers.back());
+            liftovers.pop_back();
+        }
+        const BedBatch &batch = batches[i % batches.size()];
+        for (size_t j = 0; j < batch._lines.size(); ++j) {
+            try {
+                liftover->convertBedLine(batch._lines[j], outStream);
+            } catch (hal_exception &e) {
+                throw hal_exception(string(e.what()) + " in input bed line " +
+                                    std::to_string(batch._firstLineNumber + j));
+            }
+        }
+        lock_guard<mutex> lock(liftoversMutex);
+        liftovers.push_back(std::move(liftover));
+    };
+    parallelOrderedStream(numThreads, readBatch, liftBatch, *tgtBed);
+}
+
 int main(int argc, char **argv) {
     CLParser optionsParser;
     initParser(optionsParser);
@@ -58,6 +134,7 @@ int main(int argc, char **argv) {
     int bedType;
     bool outPSL;
     bool outPSLWithName;
+    size_t numThreads;
     try {
         optionsParser.parseOptions(argc, argv);
         halPath = optionsParser.getArgument<string>("halFile");
@@ -78,6 +155,7 @@ int main(int argc, char **argv) {
         }
         outPSL = optionsParser.getFlag("outPSL");
         outPSLWithName = optionsParser.getFlag("outPSLWithName");
+        numThreads = optionsParser.getOption<size_t>("numThreads");
     } catch (exception &e) {
         cerr << e.what() << endl;
         optionsParser.printUsage(cerr);
@@ -135,9 +213,15 @@ int main(int argc, char **argv) {
             }
         }
 
-        BlockLiftover liftover;
-        liftover.convert(alignment, srcGenome, srcBedPtr, tgtGenome, tgtBedPtr, bedType,
-                         !noDupes, outPSL, outPSLWithName, coalescenceLimit);
+        numThreads = getNumThreads(alignment.get(), numThreads, "halLiftover");
+        if (numThreads > 1) {
+            parallelLiftover(alignment, srcGenome, srcBedPtr, tgtGenome, tgtBedPtr, bedType, !noDupes, outPSL,
+                             outPSLWithName, coalescenceLimit, numThreads);
+        } else {
+            BlockLiftover liftover;
+            liftover.convert(alignment, srcGenome, srcBedPtr, tgtGenome, tgtBedPtr, bedType,
+                             !noDupes, outPSL, outPSLWithName, coalescenceLimit);
+        }
 
 
     } catch (hal_exception &e) {
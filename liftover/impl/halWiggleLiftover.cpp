@@ -6,10 +6,9 @@
  */
 
 #include "halWiggleLiftover.h"
-#include "halBlockMapper.h"
 #include "halWiggleLoader.h"
+#include <algorithm>
 #include <cassert>
-#include <deque>
 
 using namespace std;
 using namespace hal;
@@ -119,49 +118,31 @@ void WiggleLiftover::mapSegment() {
         _segment->slice(_segment->getStartOffset(), eo);
     }
 
-    _mappedSegments.clear();
+    _ranges.clear();
     while (_segment->getArrayIndex() < _lastIndex && _segment->getStartPosition() <= (_cvals.back()._last)) {
-        halMapSegment(_segment.get(), _mappedSegments, _tgtGenome, &_tgtSet, _traverseDupes);
+        _segmentMapper.mapSegment(_segment.get(), _ranges, _tgtGenome, &_tgtSet, _traverseDupes);
         _segment->toRight(_cvals.back()._last);
     }
-
-    vector<MappedSegmentPtr> fragments;
-    MappedSegmentSet emptySet;
-    set<hal_index_t> queryCutSet;
-    set<hal_index_t> targetCutSet;
-
-    for (std::set<MappedSegmentPtr>::iterator i = _mappedSegments.begin(); i != _mappedSegments.end(); ++i) {
-        BlockMapper::extractSegment(i, emptySet, fragments, &_mappedSegments, targetCutSet, queryCutSet);
-        mapFragments(fragments);
+    for (size_t i = 0; i < _ranges.size(); ++i) {
+        mapRange(_ranges[i]);
     }
     _cvals.clear();
 }
 
-void WiggleLiftover::mapFragments(vector<MappedSegmentPtr> &fragments) {
-    sort(fragments.begin(), fragments.end(), MappedSegment::LessSourcePtr());
-    _cvIdx = 0;
-
-    for (size_t i = 0; i < fragments.size() && _cvIdx < _cvals.size(); ++i) {
-        MappedSegmentPtr &seg = fragments[i];
-        for (size_t j = 0; j < seg->getLength() && _cvIdx < _cvals.size(); ++j) {
-            hal_index_t pos = seg->getSource()->getStartPosition() + j;
-            while (_cvIdx < _cvals.size() && _cvals[_cvIdx]._last < pos) {
-                ++_cvIdx;
-            }
-            if (pos >= _cvals[_cvIdx]._first && pos <= _cvals[_cvIdx]._last) {
-                assert(_cvals[_cvIdx]._first <= pos);
-                hal_index_t mpos;
-
-                if (seg->getReversed() == false) {
-                    mpos = seg->getStartPosition() + j;
-                } else {
-                    mpos = seg->getStartPosition() - j;
-                }
-                if (_cvIdx < _cvals.size() && _cvals[_cvIdx]._first <= pos && _cvals[_cvIdx]._last >= pos) {
-                    double val = std::max(_cvals[_cvIdx]._val, _outVals.get(mpos));
-                    _outVals.set(mpos, val);
-                }
-            }
+// each target base gets the largest value of the source bases aligned to it
+void WiggleLiftover::mapRange(const MappedRange &range) {
+    hal_index_t srcLast = range._srcStart + (hal_index_t)range._length - 1;
+    ValVec::const_iterator cv =
+        lower_bound(_cvals.begin(), _cvals.end(), range._srcStart,
+                    [](const CoordVal &coordVal, hal_index_t pos) { return coordVal._last < pos; });
+    for (; cv != _cvals.end() && cv->_first <= srcLast; ++cv) {
+        hal_index_t first = max(cv->_first, range._srcStart);
+        hal_index_t last = min(cv->_last, srcLast);
+        for (hal_index_t pos = first; pos <= last; ++pos) {
+            hal_index_t offset = pos - range._srcStart;
+            hal_index_t mpos = range._reversed == false ? range._start + offset
+                                                         : range._start + (hal_index_t)range._length - 1 - offset;
+            _outVals.set(mpos, std::max(cv->_val, _outVals.get(mpos)));
         }
     }
 }
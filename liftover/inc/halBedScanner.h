@@ -29,6 +29,10 @@ namespace hal {
 
         static size_t getNumColumns(const std::string &bedLine);
 
+        /** Read the next line of bedStream into bedLine, skipping blank
+         * space.  Returns false at the end of the stream. */
+        static bool readLine(std::istream *bedStream, BedLine &bedLine, std::string &lineBuffer, int bedType = 0);
+
       protected:
         virtual void visitBegin();
         virtual void visitLine();
@@ -9,8 +9,10 @@
 #define _HALBLOCKLIFTOVER_H
 
 #include "halLiftover.h"
+#include "halSegmentMapper.h"
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -30,10 +32,7 @@ namespace hal {
 
       protected:
         MappedSegmentSet _mappedSegments;
-        SegmentIteratorPtr _refSeg;
-        hal_index_t _lastIndex;
-        std::set<const Genome *> _downwardPath;
-        const Genome *_mrca;
+        std::shared_ptr<IntervalMapper> _mapper;
     };
 }
 #endif
@@ -10,6 +10,7 @@
 
 #include "hal.h"
 #include "halMappedSegmentContainers.h"
+#include <functional>
 #include <iostream>
 #include <map>
 #include <set>
@@ -27,10 +28,30 @@ namespace hal {
         BlockMapper();
         virtual ~BlockMapper();
 
+        /* The mappings of one whole reference segment, in the order map()
+         * adds them to the map */
+        typedef std::vector<MappedRange> SegmentMappings;
+
+        /* Returns the kept mappings of the whole reference segment at
+         * arrayIndex, which starts at startPosition, or NULL if there are
+         * none */
+        typedef std::function<const SegmentMappings *(hal_index_t arrayIndex, hal_index_t startPosition)> MappingLookup;
+
         void init(const Genome *refGenome, const Genome *queryGenome, hal_index_t absRefFirst, hal_index_t absRefLast,
                   bool targetReversed, bool doDupes, hal_size_t minLength, bool mapTargetAdjacencies,
                   const Genome *coalescenceLimit = NULL);
         void map();
+
+        /** As map(), but the mappings of whole reference segments are taken
+         * from lookup where it has them, giving the same map as mapping
+         * them again.  Not for a reversed target or target adjacencies. */
+        void map(const MappingLookup &lookup);
+
+        /** Map each whole reference segment that starts in [absFirst,
+         * absLast], appending their mappings to outMappings, for map() to
+         * reuse on other ranges with the same parameters.  Returns the
+         * array index of the first segment. */
+        hal_index_t mapWholeSegments(hal_index_t absFirst, hal_index_t absLast, std::vector<SegmentMappings> &outMappings);
         void extractReferenceParalogies(MappedSegmentSet &outParalogies);
 
         const MappedSegmentSet &getMap() const;
@@ -45,6 +66,7 @@ namespace hal {
 
       protected:
         void erase();
+        SegmentIteratorPtr getRefSegmentIterator(hal_index_t &lastIndex) const;
         void mapAdjacencies(MappedSegmentSet::const_iterator setIt);
 
         static SegmentIteratorPtr makeIterator(MappedSegmentPtr &mappedSegment, hal_index_t &minIndex, hal_index_t &maxIndex);
@@ -58,6 +80,7 @@ namespace hal {
         MappedSegmentSet _adjSet;
         std::set<const Genome *> _downwardPath;
         std::set<const Genome *> _upwardPath;
+        SegmentMapper _segmentMapper;
         const Genome *_refGenome;
         const Sequence *_refSequence;
         const Genome *_queryGenome;
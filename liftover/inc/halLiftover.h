@@ -12,6 +12,8 @@
 #include <fstream>
 #include <iostream>
 #include <locale>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -27,9 +29,34 @@ namespace hal {
                      bool traverseDupes = true, bool outPSL = false, bool outPSLWithName = false,
                      const Genome *coalescenceLimit = NULL);
 
+        /** Set up to lift individual lines with convertBedLine(), which
+         * is how lines read elsewhere, say by another thread, are lifted.
+         * Parameters are as for convert(). */
+        void prepare(AlignmentConstPtr alignment, const Genome *srcGenome, const Genome *tgtGenome, int bedType = 0,
+                     bool traverseDupes = true, bool outPSL = false, bool outPSLWithName = false,
+                     const Genome *coalescenceLimit = NULL);
+
+        /** Lift one line, writing the results to outStream */
+        void convertBedLine(const BedLine &bedLine, std::ostream &outStream);
+
+        /** Share other's set of missing source sequences, so liftovers
+         * working on the same input in different threads warn about each
+         * one only once */
+        void shareMissedSet(const Liftover &other);
+
       protected:
         typedef std::list<BedLine> BedList;
 
+        /* source sequences already reported missing */
+        struct MissedSet {
+            std::mutex _mutex;
+            std::set<std::string> _names;
+        };
+
+        void setParameters(AlignmentConstPtr alignment, const Genome *srcGenome, const Genome *tgtGenome,
+                           std::ostream *outputFile, int bedType, bool traverseDupes, bool outPSL, bool outPSLWithName,
+                           const Genome *coalescenceLimit);
+        void clearMissedSet();
         virtual void visitBegin();
         virtual void visitLine();
         virtual void visitEOF();
@@ -61,7 +88,7 @@ namespace hal {
         std::set<const Genome *> _tgtSet;
 
         ColumnIteratorPtr _colIt;
-        std::set<std::string> _missedSet;
+        std::shared_ptr<MissedSet> _missedSet;
     };
 }
 #endif
@@ -36,7 +36,7 @@ namespace hal {
         virtual void visitEOF();
 
         void mapSegment();
-        void mapFragments(std::vector<MappedSegmentPtr> &fragments);
+        void mapRange(const MappedRange &range);
         void write();
 
       protected:
@@ -57,13 +57,13 @@ namespace hal {
         const Genome *_tgtGenome;
         const Sequence *_srcSequence;
         std::set<const Genome *> _tgtSet;
-        MappedSegmentSet _mappedSegments;
+        SegmentMapper _segmentMapper;
+        std::vector<MappedRange> _ranges;
         hal_index_t _lastIndex;
 
         SegmentIteratorPtr _segment;
         ValVec _cvals;
         WiggleTiles<double> _outVals;
-        hal_index_t _cvIdx;
     };
 }
 #endif
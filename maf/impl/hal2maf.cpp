@@ -7,6 +7,7 @@
 
 #include "halMafBed.h"
 #include "halMafExport.h"
+#include "halParallel.h"
 #include <cstdio>
 #include <cstdlib>
 #include <fstream>
@@ -63,6 +64,7 @@ static void initParser(CLParser &optionsParser) {
                                 false);
     optionsParser.addOptionFlag("keepEmptyRefBlocks", "keep blocks that contain no reference sequence",
                                 false);
+    addNumThreadsOption(optionsParser);
 
     optionsParser.setDescription("Convert hal database to maf.");
 }
@@ -90,6 +92,7 @@ class MafOptions {
     bool onlyOrthologs;
     bool keepEmptyRefBlocks;
     hal_index_t maxBlockLen;
+    size_t numThreads;
 };
 
 /* This empty string options specified using the old convention of '""' rather than
@@ -103,18 +106,16 @@ static string fixString(const string &s) {
     }
 }
 
-static void hal2mafWithTargets(const MafOptions &opts, AlignmentConstPtr alignment, const Genome *refGenome,
-                               set<const Genome *> &targetSet, MafExport &mafExport, ostream &mafStream) {
+static void readRefTargets(const MafOptions &opts, const Genome *refGenome, vector<MafExport::RefRange> &refRanges) {
     ifstream bedFileStream;
-    ifstream refTargetsStream;
     if (opts.refTargetsPath != "stdin") {
         bedFileStream.open(opts.refTargetsPath);
-        if (!refTargetsStream) {
+        if (!bedFileStream) {
             throw hal_exception("Error opening " + opts.refTargetsPath);
         }
     }
     istream &bedStream = opts.refTargetsPath != "stdin" ? bedFileStream : cin;
-    MafBed mafBed(mafStream, alignment, refGenome, targetSet, mafExport);
+    MafBed mafBed(refGenome, refRanges);
     mafBed.scan(&bedStream);
 }
 
@@ -193,16 +194,26 @@ static void hal2maf(AlignmentConstPtr alignment, const MafOptions &opts) {
     mafExport.setOnlyOrthologs(opts.onlyOrthologs);
     mafExport.setKeepEmptyRefBlocks(opts.keepEmptyRefBlocks);
 
-    if (opts.refTargetsPath != "") {
-        hal2mafWithTargets(opts, alignment, refGenome, targetSet, mafExport, mafStream);
-    } else if (opts.global) {
+    if (opts.global && (opts.refTargetsPath == "")) {
         mafExport.convertEntireAlignment(mafStream, alignment);
-    } else if (refSequence != NULL) {
-        mafExport.convertSequence(mafStream, alignment, refSequence, opts.start, opts.length, targetSet);
     } else {
-        for (SequenceIteratorPtr seqIt(refGenome->getSequenceIterator()); not seqIt->atEnd(); seqIt->toNext()) {
-            mafExport.convertSequence(mafStream, alignment, seqIt->getSequence(), opts.start, opts.length, targetSet);
+        // each bed interval or reference sequence is converted independently,
+        // which is what is spread over the threads
+        vector<MafExport::RefRange> refRanges;
+        if (opts.refTargetsPath != "") {
+            readRefTargets(opts, refGenome, refRanges);
+        } else if (refSequence != NULL) {
+            refRanges.push_back(MafExport::RefRange(refSequence, opts.start, opts.length));
+        } else {
+            // the iterator's sequence object is reused, so look up one that
+            // outlives it
+            for (SequenceIteratorPtr seqIt(refGenome->getSequenceIterator()); not seqIt->atEnd(); seqIt->toNext()) {
+                const Sequence *sequence = refGenome->getSequence(seqIt->getSequence()->getName());
+                refRanges.push_back(MafExport::RefRange(sequence, opts.start, opts.length));
+            }
         }
+        size_t numThreads = getNumThreads(alignment.get(), opts.numThreads, "hal2maf");
+        mafExport.convertSequences(mafStream, alignment, refRanges, targetSet, numThreads);
     }
     if (opts.mafPath != "stdout") {
         // dont want to leave a size 0 file when there's not ouput because
@@ -242,6 +253,7 @@ int main(int argc, char **argv) {
         opts.maxBlockLen = optionsParser.getOption<hal_index_t>("maxBlockLen");
         opts.onlyOrthologs = optionsParser.getFlag("onlyOrthologs");
         opts.keepEmptyRefBlocks = optionsParser.getFlag("keepEmptyRefBlocks");
+        opts.numThreads = optionsParser.getOption<size_t>("numThreads");
 
         if (((opts.length != 0) || (opts.start != 0)) && (opts.refSequenceName == "")) {
             throw hal_exception("--start and --length require --refSequenceName");
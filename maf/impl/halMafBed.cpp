@@ -12,10 +12,8 @@
 using namespace std;
 using namespace hal;
 
-MafBed::MafBed(std::ostream &mafStream, AlignmentConstPtr alignment, const Genome *refGenome,
-               std::set<const Genome *> &targetSet, MafExport &mafExport)
-    : BedScanner(), _mafStream(mafStream), _alignment(alignment), _refGenome(refGenome), _targetSet(targetSet),
-      _mafExport(mafExport) {
+MafBed::MafBed(const Genome *refGenome, vector<MafExport::RefRange> &refRanges)
+    : BedScanner(), _refGenome(refGenome), _refRanges(refRanges) {
 }
 
 MafBed::~MafBed() {
@@ -34,7 +32,7 @@ void MafBed::visitLine() {
         } else {
             hal_index_t start = _bedLine._start;
             hal_index_t end = _bedLine._end;
-            _mafExport.convertSequence(_mafStream, _alignment, refSequence, start, end - start, _targetSet);
+            _refRanges.push_back(MafExport::RefRange(refSequence, start, end - start));
         }
     } else {
         for (size_t i = 0; i < _bedLine._blocks.size(); ++i) {
@@ -45,7 +43,7 @@ void MafBed::visitLine() {
             } else {
                 hal_index_t start = _bedLine._start + _bedLine._blocks[i]._start;
                 hal_index_t end = _bedLine._start + _bedLine._blocks[i]._start + _bedLine._blocks[i]._length;
-                _mafExport.convertSequence(_mafStream, _alignment, refSequence, start, end - start, _targetSet);
+                _refRanges.push_back(MafExport::RefRange(refSequence, start, end - start));
             }
         }
     }
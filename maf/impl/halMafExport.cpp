@@ -6,6 +6,7 @@
  */
 
 #include "halMafExport.h"
+#include "halParallel.h"
 #include <cassert>
 #include <deque>
 
@@ -86,6 +87,46 @@ void MafExport::convertSequence(ostream &mafStream, AlignmentConstPtr alignment,
     }
 }
 
+void MafExport::copyOptions(const MafExport &other) {
+    _maxRefGap = other._maxRefGap;
+    _noDupes = other._noDupes;
+    _noAncestors = other._noAncestors;
+    _ucscNames = other._ucscNames;
+    _unique = other._unique;
+    _append = other._append;
+    _printTree = other._printTree;
+    _onlyOrthologs = other._onlyOrthologs;
+    _keepEmptyRefBlocks = other._keepEmptyRefBlocks;
+    _mafBlock.setMaxLength(other._mafBlock.getMaxLength());
+}
+
+void MafExport::convertSequences(ostream &mafStream, AlignmentConstPtr alignment, const vector<RefRange> &ranges,
+                                 const set<const Genome *> &targets, size_t numThreads) {
+    if ((numThreads <= 1) || (ranges.size() <= 1)) {
+        for (size_t i = 0; i < ranges.size(); ++i) {
+            convertSequence(mafStream, alignment, ranges[i]._sequence, ranges[i]._start, ranges[i]._length, targets);
+        }
+        return;
+    }
+    // the header only ever goes at the start of the real stream, so write it
+    // here and never from the tasks, whose buffers would otherwise all be at
+    // position 0
+    _mafStream = &mafStream;
+    _alignment = alignment;
+    if (!_append) {
+        writeHeader();
+    }
+    parallelOrderedOutput(ranges.size(), numThreads,
+                          [&](size_t i, ostream &taskStream) {
+                              MafExport taskExport;
+                              taskExport.copyOptions(*this);
+                              taskExport.setAppend(true);
+                              taskExport.convertSequence(taskStream, alignment, ranges[i]._sequence, ranges[i]._start,
+                                                         ranges[i]._length, targets);
+                          },
+                          mafStream);
+}
+
 void MafExport::convertEntireAlignment(ostream &mafStream, AlignmentConstPtr alignment) {
     hal_size_t appendCount = 0;
     size_t numBlocks = 0;
@@ -17,12 +17,12 @@
 
 namespace hal {
 
-    /** Use the halBedScanner to parse a bed file, running mafExport on each
-     * line */
+    /** Use the halBedScanner to parse a bed file, collecting the reference
+     * range of each line (or each block of a bed12 line) to be passed to
+     * MafExport::convertSequences */
     class MafBed : public BedScanner {
       public:
-        MafBed(std::ostream &mafStream, AlignmentConstPtr alignment, const Genome *refGenome,
-               std::set<const Genome *> &targetSet, MafExport &mafExport);
+        MafBed(const Genome *refGenome, std::vector<MafExport::RefRange> &refRanges);
         virtual ~MafBed();
 
         void run(std::istream *bedStream);
@@ -31,14 +31,8 @@ namespace hal {
         virtual void visitLine();
 
       protected:
-        std::ostream &_mafStream;
-        AlignmentConstPtr _alignment;
         const Genome *_refGenome;
-        const Sequence *_refSequence;
-        hal_index_t _refStart;
-        hal_size_t _refLength;
-        std::set<const Genome *> &_targetSet;
-        MafExport &_mafExport;
+        std::vector<MafExport::RefRange> &_refRanges;
     };
 }
 
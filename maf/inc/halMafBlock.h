@@ -132,6 +132,9 @@ namespace hal {
         inline void setMaxLength(hal_index_t maxLen) {
             _maxLength = maxLen;
         }
+        inline hal_index_t getMaxLength() const {
+            return _maxLength;
+        }
 
         bool referenceIsAllGaps() const {
             return (_reference != NULL) and (_reference->allGaps());
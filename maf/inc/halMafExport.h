@@ -27,9 +27,32 @@ namespace hal {
         virtual ~MafExport() {
         }
 
+        /* A range of a reference sequence, as passed to convertSequence.  A
+         * length of 0 means up to the end of the sequence. */
+        struct RefRange {
+            RefRange(const Sequence *sequence, hal_index_t start, hal_size_t length)
+                : _sequence(sequence), _start(start), _length(length) {
+            }
+            const Sequence *_sequence;
+            hal_index_t _start;
+            hal_size_t _length;
+        };
+
         void convertSequence(std::ostream &mafStream, AlignmentConstPtr alignment, const Sequence *seq,
                              hal_index_t startPosition, hal_size_t length, const std::set<const Genome *> &targets);
 
+        // Convert a list of reference ranges.  The output is the same as
+        // calling convertSequence on each range in turn, regardless of the
+        // number of threads.  Ranges are the unit of parallelism: each is
+        // converted by its own column iterator into its own buffer, and
+        // the buffers are written in the order given.  A single range is never
+        // split, as MAF block boundaries and duplicate-column suppression
+        // depend on the column iterator's state over the whole range.
+        // More than one thread requires an alignment that supports concurrent
+        // reads.
+        void convertSequences(std::ostream &mafStream, AlignmentConstPtr alignment, const std::vector<RefRange> &ranges,
+                              const std::set<const Genome *> &targets, size_t numThreads = 1);
+
         // Convert all columns in the leaf genomes to MAF. Each column is
         // reported exactly once regardless of the unique setting, although
         // this may change in the future. Likewise, maxRefGap has no
@@ -69,6 +92,7 @@ namespace hal {
 
       protected:
         void writeHeader();
+        void copyOptions(const MafExport &other);
 
       protected:
         AlignmentConstPtr _alignment;
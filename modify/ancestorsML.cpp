@@ -3,6 +3,7 @@
 #include "ancestorsML.h"
 #include "hal.h"
 #include "halBedScanner.h"
+#include "halParallel.h"
 #include "sonLibTree.h"
 #include "string.h"
 extern "C" {
@@ -15,9 +16,6 @@ extern "C" {
 using namespace std;
 using namespace hal;
 
-// globals -- for convenience
-static double outValue; // for wigs
-
 // sum log-transformed probabilities.
 static inline double log_space_add(double x, double y) {
     if (x == -INFINITY) {
@@ -122,14 +120,16 @@ void removeAndPrune(stTree *tree) {
 
 // Build site-specific tree below this genome.
 void buildTree(AlignmentConstPtr alignment, const Genome *genome, hal_index_t pos, stTree *tree, bool reversed,
-               map<string, int> *nameToId = NULL) {
+               const map<string, int> *nameToId = NULL) {
     stTree_setLabel(tree, genome->getName().c_str());
     felsensteinData *data = (felsensteinData *)malloc(sizeof(felsensteinData));
     memset(data, 0, sizeof(felsensteinData));
     data->pos = pos;
     data->reversed = reversed;
     if (nameToId != NULL) {
-        data->phastId = (*nameToId)[genome->getName()];
+        // the map is shared by the threads, so it's not added to
+        map<string, int>::const_iterator id = nameToId->find(genome->getName());
+        data->phastId = id != nameToId->end() ? id->second : 0;
     }
     stTree_setClientData(tree, data);
     if (genome->getNumChildren() == 0) {
@@ -210,152 +210,196 @@ bool pruneTree(stTree *tree) {
     return false;
 }
 
-double probTransition(TreeModel *mod, int childId, int parentId, char childDNA, char parentDNA) {
+BranchMatrices::BranchMatrices(TreeModel *mod) : _logProbs(mod->tree->nnodes * 16, -INFINITY) {
     assert(mod->nratecats == 1);
-    assert(mod->P[childId][0] != NULL);
-    MarkovMatrix *substMatrix = mod->P[childId][0];
-    return mm_get_by_state(substMatrix, parentDNA, childDNA);
+    for (int id = 0; id < mod->tree->nnodes; id++) {
+        MarkovMatrix *substMatrix = mod->P[id][0];
+        if (substMatrix == NULL) {
+            // the root has no branch above it
+            continue;
+        }
+        for (int parentDna = 0; parentDna < 4; parentDna++) {
+            for (int childDna = 0; childDna < 4; childDna++) {
+                _logProbs[id * 16 + parentDna * 4 + childDna] =
+                    log(mm_get_by_state(substMatrix, indexToChar(parentDna), indexToChar(childDna)));
+            }
+        }
+    }
 }
 
-void doFelsenstein(stTree *node, TreeModel *mod) {
+static void flattenNode(stTree *node, flatTree &flat) {
     felsensteinData *data = (felsensteinData *)stTree_getClientData(node);
-    if (data->done) {
-        return;
+    int numChildren = (int)stTree_getChildNumber(node);
+    flatNode flatNode;
+    flatNode.node = node;
+    flatNode.phastId = data->phastId;
+    flatNode.leafDna = numChildren == 0 && data->dna != 'N' && data->dna != 'n' ? charToIndex(data->dna) : -1;
+    flatNode.dna = data->dna;
+    flatNode.firstChild = (int)flat.childIndices.size();
+    flatNode.numChildren = numChildren;
+    flatNode.post = 0.0;
+    flat.nodes.push_back(flatNode);
+    flat.childIndices.resize(flat.childIndices.size() + numChildren);
+    for (int i = 0; i < numChildren; i++) {
+        flat.childIndices[flatNode.firstChild + i] = (int)flat.nodes.size();
+        flattenNode(stTree_getChild(node, i), flat);
     }
-    if (stTree_getChildNumber(node) == 0) {
-        if (data->dna == 'N' || data->dna == 'n') {
-            for (int dna = 0; dna < 4; ++dna) {
-                data->pLeaves[dna] = log(0.25);
-            }
-        } else {
-            for (int dna = 0; dna < 4; ++dna) {
-                if (dna == charToIndex(data->dna)) {
-                    data->pLeaves[dna] = log(1.0);
+}
+
+void flattenTree(stTree *tree, flatTree &flat) {
+    flat.nodes.clear();
+    flat.childIndices.clear();
+    flattenNode(tree, flat);
+}
+
+void felsensteinUp(flatTree &flat, const BranchMatrices &matrices) {
+    // children come after their parents, so go backwards
+    for (int n = (int)flat.nodes.size() - 1; n >= 0; n--) {
+        flatNode &node = flat.nodes[n];
+        if (node.numChildren == 0) {
+            for (int dna = 0; dna < 4; dna++) {
+                if (node.leafDna == -1) {
+                    node.pLeaves[dna] = log(0.25);
                 } else {
-                    data->pLeaves[dna] = -INFINITY;
+                    node.pLeaves[dna] = dna == node.leafDna ? log(1.0) : -INFINITY;
                 }
             }
+            continue;
         }
-    } else {
-        for (int64_t childIdx = 0; childIdx < stTree_getChildNumber(node); childIdx++) {
-            doFelsenstein(stTree_getChild(node, childIdx), mod);
-        }
-
         for (int dna = 0; dna < 4; dna++) {
             double prob = 0.0;
-            for (int64_t childIdx = 0; childIdx < stTree_getChildNumber(node); childIdx++) {
+            for (int c = 0; c < node.numChildren; c++) {
                 // sum over the possibile assignments for this node
-                stTree *childNode = stTree_getChild(node, childIdx);
-                felsensteinData *childData = (felsensteinData *)stTree_getClientData(childNode);
+                const flatNode &child = flat.nodes[flat.childIndices[node.firstChild + c]];
                 double probSubtree = -INFINITY;
                 for (int childDna = 0; childDna < 4; childDna++) {
-                    double probBranch =
-                        log(probTransition(mod, childData->phastId, data->phastId, indexToChar(childDna), indexToChar(dna)));
-                    probSubtree = log_space_add(probSubtree, childData->pLeaves[childDna] + probBranch);
+                    probSubtree = log_space_add(probSubtree, child.pLeaves[childDna] +
+                                                                 matrices.logProb(child.phastId, dna, childDna));
                 }
                 prob += probSubtree;
             }
-            data->pLeaves[dna] = prob;
+            node.pLeaves[dna] = prob;
         }
     }
-    data->done = true;
 }
 
-// Assign nucleotides to each node in the tree.
-void walkFelsenstein(TreeModel *mod, stTree *tree, char assignment, double threshold) {
-    felsensteinData *data = (felsensteinData *)stTree_getClientData(tree);
-    data->dna = assignment;
-    for (int64_t i = 0; i < stTree_getChildNumber(tree); i++) {
-        stTree *childNode = stTree_getChild(tree, i);
-        if (stTree_getChildNumber(childNode) != 0) {
-            felsensteinData *childData = (felsensteinData *)stTree_getClientData(childNode);
+bool felsensteinDown(flatTree &flat, const BranchMatrices &matrices, double logThreshold) {
+    bool deterministic = true;
+    // Find assignment for root node that maximizes P(leaves)
+    // For prob(tree|char) -> prob(char|tree) (there is only one possible tree)
+    flatNode &root = flat.nodes[0];
+    double totalProbTree = -INFINITY;
+    double maxProb = -INFINITY;
+    int maxDna = -1;
+    for (int dna = 0; dna < 4; dna++) {
+        root.pOtherLeaves[dna] = log(0.25);
+        totalProbTree = log_space_add(totalProbTree, root.pLeaves[dna]);
+        if (root.pLeaves[dna] > maxProb) {
+            maxDna = dna;
+            maxProb = root.pLeaves[dna];
+        }
+    }
+    root.post = maxProb - totalProbTree;
+    if (maxDna == -1) {
+        root.dna = randNuc();
+        deterministic = false;
+    } else if (root.post < logThreshold) {
+        root.dna = 'N';
+    } else {
+        root.dna = indexToChar(maxDna);
+    }
 
+    // parents come before their children
+    for (size_t n = 0; n < flat.nodes.size(); n++) {
+        const flatNode &node = flat.nodes[n];
+        for (int i = 0; i < node.numChildren; i++) {
+            flatNode &child = flat.nodes[flat.childIndices[node.firstChild + i]];
+            if (child.numChildren == 0) {
+                continue;
+            }
             // Find posterior probability of this base.
             double totalProb = -INFINITY;
             // trick found from phast code -- saves us some compute time
             double temp[4];
             for (int thisDna = 0; thisDna < 4; thisDna++) {
                 temp[thisDna] = -INFINITY;
-                for (int64_t j = 0; j < stTree_getChildNumber(tree); j++) {
+                for (int j = 0; j < node.numChildren; j++) {
                     if (i == j) {
                         continue;
                     }
-                    stTree *siblingNode = stTree_getChild(tree, j);
-                    felsensteinData *siblingData = (felsensteinData *)stTree_getClientData(siblingNode);
+                    const flatNode &sibling = flat.nodes[flat.childIndices[node.firstChild + j]];
                     for (int siblingDna = 0; siblingDna < 4; siblingDna++) {
-                        temp[thisDna] = log_space_add(temp[thisDna],
-                                                      data->pOtherLeaves[thisDna] + siblingData->pLeaves[siblingDna] +
-                                                          log(probTransition(mod, siblingData->phastId, data->phastId,
-                                                                             indexToChar(siblingDna), indexToChar(thisDna))));
+                        temp[thisDna] = log_space_add(temp[thisDna], node.pOtherLeaves[thisDna] + sibling.pLeaves[siblingDna] +
+                                                                         matrices.logProb(sibling.phastId, thisDna, siblingDna));
                     }
                 }
-                if (stTree_getChildNumber(tree) == 1) {
+                if (node.numChildren == 1) {
                     // Special case -- the sibling isn't in this tree.
-                    temp[thisDna] = data->pOtherLeaves[thisDna];
+                    temp[thisDna] = node.pOtherLeaves[thisDna];
                 }
             }
             for (int childDna = 0; childDna < 4; childDna++) {
-                childData->pOtherLeaves[childDna] = -INFINITY;
+                child.pOtherLeaves[childDna] = -INFINITY;
                 for (int thisDna = 0; thisDna < 4; thisDna++) {
-                    childData->pOtherLeaves[childDna] =
-                        log_space_add(childData->pOtherLeaves[childDna],
-                                      temp[thisDna] + log(probTransition(mod, childData->phastId, data->phastId,
-                                                                         indexToChar(childDna), indexToChar(thisDna))));
+                    child.pOtherLeaves[childDna] = log_space_add(
+                        child.pOtherLeaves[childDna], temp[thisDna] + matrices.logProb(child.phastId, thisDna, childDna));
                 }
-                totalProb = log_space_add(totalProb, childData->pOtherLeaves[childDna] + childData->pLeaves[childDna]);
+                totalProb = log_space_add(totalProb, child.pOtherLeaves[childDna] + child.pLeaves[childDna]);
             }
             int maxDna = -1;
             double maxProb = -INFINITY;
             for (int childDna = 0; childDna < 4; childDna++) {
-                double post = childData->pOtherLeaves[childDna] + childData->pLeaves[childDna] - totalProb;
+                double post = child.pOtherLeaves[childDna] + child.pLeaves[childDna] - totalProb;
                 if (post > maxProb) {
                     maxDna = childDna;
                     maxProb = post;
                 }
             }
-            char childAssignment;
             if (maxDna == -1) {
-                childAssignment = randNuc();
+                child.dna = randNuc();
+                deterministic = false;
             } else {
-                childAssignment = indexToChar(maxDna);
+                child.dna = indexToChar(maxDna);
             }
-            childData->post = maxProb;
-            if (maxProb < threshold) {
-                childAssignment = 'N';
+            child.post = maxProb;
+            if (maxProb < logThreshold) {
+                child.dna = 'N';
             }
-            walkFelsenstein(mod, childNode, childAssignment, threshold);
         }
     }
+    return deterministic;
 }
 
-void writeNucleotides(stTree *tree, AlignmentConstPtr alignment, const Genome *target, hal_index_t targetPos,
-                      bool printWrites = false) {
-    felsensteinData *data = (felsensteinData *)stTree_getClientData(tree);
-    if (stTree_getChildNumber(tree) == 0) {
-        return;
-    }
-    const Genome *genome = alignment->openGenome(stTree_getLabel(tree));
-    assert(genome != NULL);
-    DnaIteratorPtr dnaIt = genome->getDnaIterator(data->pos);
-    if (data->reversed) {
-        dnaIt->toReverse();
-    }
-    char dna = fastUpper(dnaIt->getBase());
-    if (data->dna != dna) {
-        if (printWrites) {
-            cout << genome->getName() << "\t" << data->pos << "\t" << string(1, dna) << "\t" << string(1, data->dna) << endl;
-        }
-    }
-    if (genome == target && data->pos == targetPos) {
-        // correct genome and correct position
-        outValue = data->post;
+void doFelsenstein(stTree *node, TreeModel *mod) {
+    BranchMatrices matrices(mod);
+    flatTree flat;
+    flattenTree(node, flat);
+    felsensteinUp(flat, matrices);
+    for (size_t n = 0; n < flat.nodes.size(); n++) {
+        felsensteinData *data = (felsensteinData *)stTree_getClientData(flat.nodes[n].node);
+        memcpy(data->pLeaves, flat.nodes[n].pLeaves, sizeof(data->pLeaves));
+        data->done = true;
     }
-    for (int64_t i = 0; i < stTree_getChildNumber(tree); i++) {
-        stTree *childNode = stTree_getChild(tree, i);
-        writeNucleotides(childNode, alignment, target, targetPos, printWrites);
+}
+
+// The result of a site depends only on its pattern: the shape of its tree,
+// the model node of each tree node and the bases of the leaves.
+static void getPattern(const flatTree &flat, string &pattern) {
+    pattern.clear();
+    for (size_t n = 0; n < flat.nodes.size(); n++) {
+        const flatNode &node = flat.nodes[n];
+        pattern.append((const char *)&node.phastId, sizeof(node.phastId));
+        pattern.append((const char *)&node.numChildren, sizeof(node.numChildren));
+        pattern.push_back((char)node.leafDna);
     }
 }
 
+// assigned base and posterior of each node of a site
+typedef vector<pair<char, double>> siteResult;
+
+// maximum number of patterns whose results are kept by a tile
+static const size_t MaxCachedPatterns = 100000;
+
 void freeClientData(stTree *tree) {
     felsensteinData *data = (felsensteinData *)stTree_getClientData(tree);
     if (stTree_getChildNumber(tree)) {
@@ -371,25 +415,36 @@ void freeClientData(stTree *tree) {
     free(data);
 }
 
-void reEstimate(TreeModel *mod, AlignmentConstPtr alignment, const Genome *genome, hal_index_t startPos, hal_index_t endPos,
-                map<string, int> &nameToId, double threshold, bool printWrites, bool writePosts) {
+/** A tile of a reEstimate range, computed independently. */
+typedef struct {
+    hal_index_t start;
+    hal_index_t end;
+    bool first; // print the wiggle header
+} estimateTile;
+
+static void reEstimateTile(const BranchMatrices &matrices, AlignmentConstPtr alignment, const Genome *genome,
+                           const estimateTile &tile, const map<string, int> &nameToId, double threshold, bool printWrites,
+                           bool writePosts, ostream &outStream) {
     threshold = log(threshold);
-    stTree *tree = NULL;
-    bool firstRun = true;
-    for (hal_index_t pos = startPos; pos < endPos; pos++) {
-        outValue = 0.0;
-        if (writePosts && firstRun) {
+    flatTree flat;
+    string pattern;
+    unordered_map<string, siteResult> results;
+    siteResult computed;
+    for (hal_index_t pos = tile.start; pos < tile.end; pos++) {
+        double outValue = 0.0;
+        if (writePosts && tile.first && pos == tile.start) {
             const Sequence *seq = genome->getSequenceBySite(pos);
             // position + 1 because wigs are 1-based.
-            cout << "fixedStep chrom=" << seq->getName() << " start=" << pos - seq->getStartPosition() + 1 << " step=1" << endl;
-            firstRun = false;
+            outStream << "fixedStep chrom=" << seq->getName() << " start=" << pos - seq->getStartPosition() + 1 << " step=1"
+                      << endl;
         }
-        tree = stTree_construct();
+        stTree *tree = stTree_construct();
         // Find root of tree
         rootInfo *rootInfo = findRoot(genome, pos);
         const Genome *root = rootInfo->rootGenome;
         hal_index_t rootPos = rootInfo->pos;
         bool rootReversed = rootInfo->reversed;
+        free(rootInfo);
         buildTree(alignment, root, rootPos, tree, rootReversed, &nameToId);
         pruneTree(tree);
         if (stTree_getChildNumber(tree) == 0) {
@@ -400,40 +455,84 @@ void reEstimate(TreeModel *mod, AlignmentConstPtr alignment, const Genome *genom
             if (writePosts) {
                 // need to keep the wig in order
                 outValue = -INFINITY;
-                cout << outValue << endl;
+                outStream << outValue << endl;
             }
             continue;
         }
-        doFelsenstein(tree, mod);
-        // Find assignment for root node that maximizes P(leaves)
-        felsensteinData *rootData = (felsensteinData *)stTree_getClientData(tree);
-        // For prob(tree|char) -> prob(char|tree) (there is only one possible tree)
-        double totalProbTree = -INFINITY;
-        double maxProb = -INFINITY;
-        int maxDna = -1;
-        for (int dna = 0; dna < 4; dna++) {
-            rootData->pOtherLeaves[dna] = log(0.25);
-            totalProbTree = log_space_add(totalProbTree, rootData->pLeaves[dna]);
-            if (rootData->pLeaves[dna] > maxProb) {
-                maxDna = dna;
-                maxProb = rootData->pLeaves[dna];
+        flattenTree(tree, flat);
+        getPattern(flat, pattern);
+        unordered_map<string, siteResult>::const_iterator cached = results.find(pattern);
+        const siteResult *resultPtr = &computed;
+        if (cached != results.end()) {
+            resultPtr = &cached->second;
+        } else {
+            felsensteinUp(flat, matrices);
+            bool deterministic = felsensteinDown(flat, matrices, threshold);
+            computed.clear();
+            for (size_t n = 0; n < flat.nodes.size(); n++) {
+                computed.push_back(make_pair(flat.nodes[n].dna, flat.nodes[n].post));
+            }
+            // a random base must be drawn again for other sites
+            if (deterministic) {
+                if (results.size() >= MaxCachedPatterns) {
+                    results.clear();
+                }
+                resultPtr = &(results[pattern] = computed);
             }
         }
-        rootData->post = maxProb - totalProbTree;
-        char assignment;
-        if (maxDna == -1) {
-            assignment = randNuc();
-        } else if (rootData->post < threshold) {
-            assignment = 'N';
-        } else {
-            assignment = indexToChar(maxDna);
+        const siteResult &result = *resultPtr;
+
+        // the ancestors' changes, in pre-order
+        for (size_t n = 0; n < flat.nodes.size(); n++) {
+            if (flat.nodes[n].numChildren == 0) {
+                continue;
+            }
+            stTree *node = flat.nodes[n].node;
+            felsensteinData *data = (felsensteinData *)stTree_getClientData(node);
+            const Genome *nodeGenome = alignment->openGenome(stTree_getLabel(node));
+            assert(nodeGenome != NULL);
+            DnaIteratorPtr dnaIt = nodeGenome->getDnaIterator(data->pos);
+            if (data->reversed) {
+                dnaIt->toReverse();
+            }
+            char dna = fastUpper(dnaIt->getBase());
+            if (result[n].first != dna && printWrites) {
+                outStream << nodeGenome->getName() << "\t" << data->pos << "\t" << string(1, dna) << "\t"
+                          << string(1, result[n].first) << endl;
+            }
+            if (nodeGenome == genome && data->pos == pos) {
+                // correct genome and correct position
+                outValue = result[n].second;
+            }
         }
-        walkFelsenstein(mod, tree, assignment, threshold);
-        writeNucleotides(tree, alignment, genome, pos, printWrites);
         freeClientData(tree);
         stTree_destruct(tree);
         if (writePosts) {
-            cout << outValue << endl;
+            outStream << outValue << endl;
+        }
+    }
+}
+
+void reEstimate(TreeModel *mod, AlignmentConstPtr alignment, const Genome *genome, hal_index_t startPos, hal_index_t endPos,
+                const map<string, int> &nameToId, double threshold, bool printWrites, bool writePosts, ostream &outStream,
+                size_t numThreads, hal_size_t tileSize) {
+    BranchMatrices matrices(mod);
+    vector<estimateTile> tiles;
+    for (hal_index_t start = startPos; start < endPos; start += (hal_index_t)tileSize) {
+        estimateTile tile = {start, min(endPos, start + (hal_index_t)tileSize), start == startPos};
+        tiles.push_back(tile);
+    }
+    if (numThreads > 1) {
+        parallelOrderedOutput(tiles.size(), numThreads,
+                              [&](size_t i, ostream &tileStream) {
+                                  reEstimateTile(matrices, alignment, genome, tiles[i], nameToId, threshold, printWrites,
+                                                 writePosts, tileStream);
+                              },
+                              outStream);
+    } else {
+        for (size_t i = 0; i < tiles.size(); ++i) {
+            reEstimateTile(matrices, alignment, genome, tiles[i], nameToId, threshold, printWrites, writePosts,
+                           outStream);
         }
     }
 }
@@ -5,6 +5,10 @@
 #include "halGenome.h"
 #include "sonLibTree.h"
 #include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
 extern "C" {
 #include "tree_model.h"
 }
@@ -40,10 +44,68 @@ typedef struct {
 
 using namespace hal;
 
+// Log probabilities of the substitutions along each branch of the model,
+// taken from its substitution matrices once rather than for every site.
+class BranchMatrices {
+  public:
+    BranchMatrices(TreeModel *mod);
+    // log P(childDna | parentDna) on the branch above the node with this
+    // phast ID, with bases indexed as by charToIndex
+    double logProb(int phastId, int parentDna, int childDna) const {
+        return _logProbs[phastId * 16 + parentDna * 4 + childDna];
+    }
+
+  private:
+    std::vector<double> _logProbs;
+};
+
+// One node of a site's tree.
+typedef struct {
+    // The node in the site's stTree, with its felsensteinData.
+    stTree *node;
+    int phastId;
+    // Base index of a leaf, -1 for N.
+    int leafDna;
+    // Base assigned to an ancestor.
+    char dna;
+    // Children are childIndices[firstChild, firstChild + numChildren).
+    int firstChild;
+    int numChildren;
+    double pLeaves[4];
+    double pOtherLeaves[4];
+    double post;
+} flatNode;
+
+// A site's tree in flat arrays, in pre-order (each node before its
+// children, the root first), so that the Felsenstein passes are loops
+// over the arrays rather than recursions over the stTree.
+typedef struct {
+    std::vector<flatNode> nodes;
+    std::vector<int> childIndices;
+} flatTree;
+
+void flattenTree(stTree *tree, flatTree &flat);
+
+// Probability of the leaves below each node given each base.
+void felsensteinUp(flatTree &flat, const BranchMatrices &matrices);
+
+// Assign the root the most likely base, then each ancestor the base
+// with the highest posterior, or N if the log posterior is below
+// logThreshold.  Returns false if any base had to be chosen at random,
+// as no base had a finite probability, so the result is not a function
+// of the site's pattern.
+bool felsensteinDown(flatTree &flat, const BranchMatrices &matrices, double logThreshold);
+
 void doFelsenstein(stTree *node, TreeModel *mod);
 
+// Re-estimate the ancestral bases of genome in [startPos, endPos), writing
+// any changes and posteriors to outStream.  The range is split into tiles
+// of tileSize bases that are computed by numThreads threads, with the
+// output kept in order.  Sites whose trees have the same shape and leaf
+// bases have the same result, which is computed once per tile.
 void reEstimate(TreeModel *mod, AlignmentConstPtr alignment, const Genome *genome, hal_index_t startPos, hal_index_t endPos,
-                std::map<std::string, int> &nameToId, double threshold, bool printWrites, bool outputPosts);
+                const std::map<std::string, int> &nameToId, double threshold, bool printWrites, bool outputPosts,
+                std::ostream &outStream, size_t numThreads = 1, hal_size_t tileSize = 1000000);
 
 #endif
 // Local Variables:
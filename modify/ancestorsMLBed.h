@@ -10,18 +10,21 @@ using namespace hal;
 
 class AncestorsMLBed : public hal::BedScanner {
   public:
-    AncestorsMLBed(TreeModel *mod, AlignmentConstPtr alignment, const Genome *genome, std::map<std::string, int> &nameToId,
-                   double threshold, bool printWrites, bool outputPosts)
+    AncestorsMLBed(TreeModel *mod, AlignmentConstPtr alignment, const Genome *genome,
+                   const std::map<std::string, int> &nameToId, double threshold, bool printWrites, bool outputPosts,
+                   size_t numThreads, hal_size_t tileSize)
         : _mod(mod), _alignment(alignment), _genome(genome), _nameToId(nameToId), _threshold(threshold),
-          _printWrites(printWrites), _outputPosts(outputPosts){};
+          _printWrites(printWrites), _outputPosts(outputPosts), _numThreads(numThreads), _tileSize(tileSize){};
     void visitLine();
     TreeModel *_mod;
     AlignmentConstPtr _alignment;
     const Genome *_genome;
-    std::map<std::string, int> &_nameToId;
+    const std::map<std::string, int> &_nameToId;
     double _threshold;
     bool _printWrites;
     bool _outputPosts;
+    size_t _numThreads;
+    hal_size_t _tileSize;
 };
 // Local Variables:
 // mode: c++
@@ -1,6 +1,7 @@
 #include "ancestorsML.h"
 #include "ancestorsMLBed.h"
 #include "hal.h"
+#include "halParallel.h"
 
 using namespace std;
 using namespace hal;
@@ -23,6 +24,10 @@ static void initParser(CLParser &optionsParser) {
                                                " format",
                                 false);
     optionsParser.addOptionFlag("printWrites", "print base changes", false);
+    optionsParser.addOption("tileSize", "with --numThreads > 1, each range is split into tiles of this many bases "
+                                        "that are estimated in parallel",
+                            (hal_size_t)1000000);
+    addNumThreadsOption(optionsParser);
 }
 
 int main(int argc, char *argv[]) {
@@ -33,6 +38,8 @@ int main(int argc, char *argv[]) {
     hal_index_t startPos = 0;
     hal_index_t endPos = -1;
     double threshold = 0.0;
+    hal_size_t tileSize = 0;
+    size_t numThreads = 1;
     try {
         optParser.parseOptions(argc, argv);
         halPath = optParser.getArgument<string>("halFile");
@@ -45,6 +52,11 @@ int main(int argc, char *argv[]) {
         bedPath = optParser.getOption<string>("bed");
         outputPosts = optParser.getFlag("outputPosts");
         printWrites = optParser.getFlag("printWrites");
+        tileSize = optParser.getOption<hal_size_t>("tileSize");
+        numThreads = optParser.getOption<size_t>("numThreads");
+        if (tileSize == 0) {
+            throw hal_exception("--tileSize must be positive");
+        }
     } catch (exception &e) {
         optParser.printUsage(cerr);
         return 1;
@@ -72,9 +84,11 @@ int main(int argc, char *argv[]) {
     if (genome->getNumChildren() == 0) {
         throw hal_exception("Genome " + genomeName + " is a leaf genome.");
     }
+    numThreads = getNumThreads(alignment.get(), numThreads, "ancestorsML");
 
     if (bedPath != "") {
-        AncestorsMLBed bedScanner(mod, alignment, genome, nameToId, threshold, printWrites, outputPosts);
+        AncestorsMLBed bedScanner(mod, alignment, genome, nameToId, threshold, printWrites, outputPosts, numThreads,
+                                  tileSize);
         bedScanner.scan(bedPath);
         return 0;
     }
@@ -95,7 +109,8 @@ int main(int argc, char *argv[]) {
     if (endPos == -1 || endPos > genome->getSequenceLength()) {
         endPos = genome->getSequenceLength();
     }
-    reEstimate(mod, alignment, genome, startPos, endPos, nameToId, threshold, printWrites, outputPosts);
+    reEstimate(mod, alignment, genome, startPos, endPos, nameToId, threshold, printWrites, outputPosts, cout, numThreads,
+               tileSize);
     alignment->close();
     return 0;
 }
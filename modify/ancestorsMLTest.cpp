@@ -1,6 +1,12 @@
 #include "ancestorsML.h"
 #include "hal.h"
+#include "halApiTestSupport.h"
+#include "halRandNumberGen.h"
+#include "halRandomData.h"
 #include <cstdio>
+#include <deque>
+#include <sstream>
+#include <unistd.h>
 
 extern "C" {
 #include "CuTest.h"
@@ -20,15 +26,15 @@ static void labelTestTreeNode(stTree *node, map<string, int> *nameToId, char dna
     stTree_setClientData(node, data);
 }
 
-static void doFelsensteinWorkedExampleTest(CuTest *testCase) {
-    // Set up the PHAST substitution model.
+// Set up the PHAST substitution model of the mammals tree.
+static TreeModel *loadTestModel(map<string, int> &nameToId) {
     FILE *modFile = fopen("../testdata/mammals.mod", "r");
     if (modFile == NULL) {
         throw hal_exception("can't find ../testdata/mammals.mod");
     }
     TreeModel *mod = tm_new_from_file(modFile, true);
+    fclose(modFile);
     // Map names to phast model IDs.
-    map<string, int> nameToId;
     List *phastList = tr_postorder(mod->tree);
     for (int i = 0; i < mod->tree->nnodes; i++) {
         TreeNode *n = (TreeNode *)lst_get_ptr(phastList, i);
@@ -36,6 +42,12 @@ static void doFelsensteinWorkedExampleTest(CuTest *testCase) {
     }
     lst_free(phastList);
     tm_set_subst_matrices(mod);
+    return mod;
+}
+
+static void doFelsensteinWorkedExampleTest(CuTest *testCase) {
+    map<string, int> nameToId;
+    TreeModel *mod = loadTestModel(nameToId);
 
     // Generate and label test tree with data A,G,A,A,C
     stTree *tree = stTree_parseNewickString("(((rat:0.2,mouse:0.2)mr:0.1,human:0.1)e:0.1,(cow:0.1,pig:0.1)l:0.1)b;");
@@ -61,10 +73,67 @@ static void doFelsensteinWorkedExampleTest(CuTest *testCase) {
     CuAssertDblEquals(testCase, -12.253583, log2(likelihood), 0.001);
 }
 
+// Create a random alignment with the genomes of the mammals tree.
+static void createMammalsAlignment(AlignmentPtr alignment) {
+    RandNumberGen rng(false, 0);
+    alignment->addRootGenome("b");
+    alignment->addLeafGenome("e", "b", 0.029297);
+    alignment->addLeafGenome("l", "b", 0.029297);
+    alignment->addLeafGenome("human", "e", 0.123671);
+    alignment->addLeafGenome("mr", "e", 0.24383);
+    alignment->addLeafGenome("mouse", "mr", 0.0750111);
+    alignment->addLeafGenome("rat", "mr", 0.0890998);
+    alignment->addLeafGenome("pig", "l", 0.175296);
+    alignment->addLeafGenome("cow", "l", 0.145418);
+    createRandomDimensions(rng, alignment, 5, 50, 20, 40);
+    deque<string> genomeNames(1, alignment->getRootName());
+    while (not genomeNames.empty()) {
+        Genome *genome = alignment->openGenome(genomeNames.front());
+        genomeNames.pop_front();
+        createRandomGenome(rng, alignment, genome);
+        vector<string> childNames = alignment->getChildNames(genome->getName());
+        genomeNames.insert(genomeNames.end(), childNames.begin(), childNames.end());
+        if (genome->getParent() != NULL) {
+            alignment->closeGenome(genome->getParent());
+        }
+        alignment->closeGenome(genome);
+    }
+}
+
+// Tiles of one site reuse no results, so they estimate each site on its
+// own.  Reusing the results of repeated patterns over a whole range, and
+// splitting it into tiles computed by several threads, must not change the
+// writes or posteriors.
+static void reEstimateTilingTest(CuTest *testCase) {
+    map<string, int> nameToId;
+    TreeModel *mod = loadTestModel(nameToId);
+    string path = getTempFile();
+    AlignmentPtr created(getTestAlignmentInstances(STORAGE_FORMAT_MMAP, path, CREATE_ACCESS));
+    createMammalsAlignment(created);
+    created->close();
+
+    AlignmentConstPtr alignment(openHalAlignment(path));
+    const char *ancestors[] = {"b", "e", "mr", "l"};
+    for (size_t i = 0; i < sizeof(ancestors) / sizeof(ancestors[0]); i++) {
+        const Genome *genome = alignment->openGenome(ancestors[i]);
+        hal_index_t length = genome->getSequenceLength();
+        ostringstream perSite, wholeRange, tiled;
+        reEstimate(mod, alignment, genome, 0, length, nameToId, 0.9, true, true, perSite, 1, 1);
+        reEstimate(mod, alignment, genome, 0, length, nameToId, 0.9, true, true, wholeRange, 1, length);
+        reEstimate(mod, alignment, genome, 0, length, nameToId, 0.9, true, true, tiled, 4, 97);
+        CuAssertTrue(testCase, !perSite.str().empty());
+        CuAssertStrEquals(testCase, perSite.str().c_str(), wholeRange.str().c_str());
+        CuAssertStrEquals(testCase, perSite.str().c_str(), tiled.str().c_str());
+    }
+    alignment->close();
+    ::unlink(path.c_str());
+}
+
 int main(int argc, char *argv[]) {
     CuString *output = CuStringNew();
     CuSuite *suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, doFelsensteinWorkedExampleTest);
+    SUITE_ADD_TEST(suite, reEstimateTilingTest);
     CuSuiteRun(suite);
     CuSuiteSummary(suite, output);
     CuSuiteDetails(suite, output);
@@ -101,4 +101,6 @@ int main(int argc, char *argv[]) {
     if (!noMarkAncestors) {
         markAncestorsForUpdate(mainAlignment, insertName);
     }
+    // mmap files are only consistent once closed
+    mainAlignment->close();
 }
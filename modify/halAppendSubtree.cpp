@@ -113,5 +113,7 @@ int main(int argc, char *argv[]) {
     if (!noMarkAncestors) {
         markAncestorsForUpdate(mainAlignment, rootName);
     }
+    // mmap files are only consistent once closed
+    mainAlignment->close();
     return 0;
 }
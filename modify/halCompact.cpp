@@ -0,0 +1,107 @@
+#include "hal.h"
+#include "halAlignmentInstance.h"
+#include <cerrno>
+#include <cstdio>
+
+using namespace std;
+using namespace hal;
+
+static void initParser(CLParser &optionsParser) {
+    optionsParser.addArgument("inFile", "mmap hal file to compact");
+    optionsParser.addOption("outFile", "write the compacted alignment to this file instead of replacing inFile", "");
+    optionsParser.setDescription("Rewrite an mmap hal file without the space left behind by removed genomes and "
+                                 "replaced arrays.  Each genome's data is written in one piece, in tree order "
+                                 "(parents before children).  The DNA encoding and segment layout are kept.");
+}
+
+/* genome names with each parent before its children */
+static void getTreeOrder(AlignmentConstPtr alignment, const string &name, vector<string> &names) {
+    names.push_back(name);
+    vector<string> childNames = alignment->getChildNames(name);
+    for (size_t i = 0; i < childNames.size(); ++i) {
+        getTreeOrder(alignment, childNames[i], names);
+    }
+}
+
+/* The segment counts are kept as they are, unlike Genome::copyDimensions,
+ * which drops the bottom segments of leaves.  A genome whose last child was
+ * removed still has them, and its top segments' parse indices refer to them. */
+static void getDimensions(const Genome *genome, vector<Sequence::Info> &dimensions) {
+    for (SequenceIteratorPtr seqIt = genome->getSequenceIterator(); not seqIt->atEnd(); seqIt->toNext()) {
+        const Sequence *sequence = seqIt->getSequence();
+        dimensions.push_back(Sequence::Info(sequence->getName(), sequence->getSequenceLength(),
+                                            sequence->getNumTopSegments(), sequence->getNumBottomSegments()));
+    }
+}
+
+static void compact(AlignmentConstPtr inAlignment, AlignmentPtr outAlignment) {
+    vector<string> names;
+    getTreeOrder(inAlignment, inAlignment->getRootName(), names);
+    for (size_t i = 0; i < names.size(); ++i) {
+        string parentName = inAlignment->getParentName(names[i]);
+        if (parentName.empty()) {
+            outAlignment->addRootGenome(names[i]);
+        } else {
+            outAlignment->addLeafGenome(names[i], parentName, inAlignment->getBranchLength(parentName, names[i]));
+        }
+    }
+    // all dimensions first, so that segment indices into the parent and
+    // children are known to be the same and the arrays are copied as blocks
+    for (size_t i = 0; i < names.size(); ++i) {
+        vector<Sequence::Info> dimensions;
+        getDimensions(inAlignment->openGenome(names[i]), dimensions);
+        outAlignment->openGenome(names[i])->setDimensions(dimensions);
+    }
+    for (size_t i = 0; i < names.size(); ++i) {
+        const Genome *inGenome = inAlignment->openGenome(names[i]);
+        Genome *outGenome = outAlignment->openGenome(names[i]);
+        inGenome->copySequence(outGenome);
+        inGenome->copyTopSegments(outGenome);
+        inGenome->copyBottomSegments(outGenome);
+        inGenome->copyMetadata(outGenome);
+        // lets a two-bit output encode the genome's DNA and free it
+        inAlignment->closeGenome(inGenome);
+        outAlignment->closeGenome(outGenome);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    CLParser optionsParser;
+    initParser(optionsParser);
+    string inPath, outPath;
+    try {
+        optionsParser.parseOptions(argc, argv);
+        inPath = optionsParser.getArgument<string>("inFile");
+        outPath = optionsParser.getOption<string>("outFile");
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        optionsParser.printUsage(cerr);
+        return 1;
+    }
+    try {
+        AlignmentConstPtr inAlignment(openHalAlignment(inPath, &optionsParser));
+        if (inAlignment->getStorageFormat() != STORAGE_FORMAT_MMAP) {
+            throw hal_exception(inPath + " is not an mmap hal file (HDF5 files can be compacted with h5repack)");
+        }
+        MMapDnaEncoding dnaEncoding;
+        MMapSegmentLayout segmentLayout;
+        getMMapAlignmentLayout(inAlignment.get(), dnaEncoding, segmentLayout);
+
+        bool inPlace = outPath.empty();
+        string writePath = inPlace ? inPath + ".compact.tmp" : outPath;
+        AlignmentPtr outAlignment(mmapAlignmentInstance(writePath, READ_ACCESS | WRITE_ACCESS | CREATE_ACCESS,
+                                                        MMAP_DEFAULT_FILE_SIZE, dnaEncoding, segmentLayout));
+        compact(inAlignment, outAlignment);
+        outAlignment->close();
+        if (inPlace && rename(writePath.c_str(), inPath.c_str()) != 0) {
+            throw hal_errno_exception(writePath, "can't rename to " + inPath, errno);
+        }
+    } catch (hal_exception &e) {
+        cerr << "hal exception caught: " << e.what() << endl;
+        return 1;
+    } catch (exception &e) {
+        cerr << "Exception caught: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
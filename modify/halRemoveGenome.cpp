@@ -32,5 +32,7 @@ int main(int argc, char *argv[]) {
         markAncestorsForUpdate(alignment, deleteNode);
     }
     alignment->removeGenome(deleteNode);
+    // mmap files are only consistent once closed
+    alignment->close();
     return 0;
 }
@@ -154,4 +154,6 @@ int main(int argc, char *argv[]) {
     if (!noMarkAncestors) {
         markAncestorsForUpdate(mainAlignment, genomeName);
     }
+    // mmap files are only consistent once closed
+    mainAlignment->close();
 }
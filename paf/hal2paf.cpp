@@ -7,16 +7,45 @@
 
 #include "hal.h"
 #include "halCLParser.h"
+#include "halParallel.h"
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <unordered_set>
 
 using namespace std;
 using namespace hal;
 
-static void genome2PAF(ostream& outStream, const Genome* genome, bool fullNames);
+/* genomes with at least this many top segments per thread are split at
+ * sequence boundaries when running with more than one thread */
+static const hal_size_t MIN_CHUNK_SEGMENTS = 10000;
+
+/* a branch (child genome) being converted, possibly in several chunks */
+struct PafBranch {
+    PafBranch(const string &name) : _name(name), _chunksLeft(0), _foundMatch(false) {
+    }
+    string _name;
+    // top segments of canonical paralogs, computed by the first chunk to need it
+    once_flag _parentSetOnce;
+    unordered_set<hal_index_t> _parentSet;
+    atomic<size_t> _chunksLeft;
+    atomic<bool> _foundMatch;
+};
+
+/* a range of top segments of a branch, bounded by sequences, so no paf
+ * line can cross it */
+struct PafChunk {
+    PafBranch *_branch;
+    hal_index_t _firstSegment;
+    hal_index_t _endSegment;
+};
+
+static void getParentSet(const Genome *genome, unordered_set<hal_index_t> &parentSet);
+static bool genome2PAF(ostream &outStream, const Genome *genome, bool fullNames, hal_index_t firstSegment,
+                       hal_index_t endSegment, const unordered_set<hal_index_t> &parentSet);
 
 static void initParser(CLParser &optionsParser) {
     optionsParser.addArgument("inHalPath", "input hal file");
@@ -28,6 +57,7 @@ static void initParser(CLParser &optionsParser) {
                                 "for output names.  By default, the UCSC convention of Genome.Sequence "
                                 "is used",
                                 false);
+    addNumThreadsOption(optionsParser);
     optionsParser.setDescription("Export pairwise alignment (with no softclips) of each branch to PAF");
 }
 
@@ -38,12 +68,14 @@ int main(int argc, char **argv) {
     string halPath;
     string rootGenomeName;
     bool fullNames;
+    size_t numThreads;
 
     try {
         optionsParser.parseOptions(argc, argv);
         halPath = optionsParser.getArgument<string>("inHalPath");
         rootGenomeName = optionsParser.getOption<string>("rootGenome");
         fullNames = !optionsParser.getFlag("onlySequenceNames");
+        numThreads = optionsParser.getOption<size_t>("numThreads");
     } catch (exception &e) {
         cerr << e.what() << endl;
         optionsParser.printUsage(cerr);
@@ -68,30 +100,77 @@ int main(int argc, char **argv) {
             throw hal_exception(string("Root genome, ") + rootGenomeName + 
                                 ", not found in alignment");
         }
-        const Genome* parentGenome = rootGenome;
+        numThreads = getNumThreads(alignment.get(), numThreads, "hal2paf");
 
+        // branches in breadth-first order, which is the order of the output
+        deque<PafBranch> branches;
         vector<string> childs = alignment->getChildNames(rootGenome->getName());
         deque<string> queue(childs.begin(), childs.end());
-
         while (!queue.empty()) {
             string childName = queue.front();
             queue.pop_front();
-            const Genome* childGenome = alignment->openGenome(childName);
-            string parentName = alignment->getParentName(childName);
-            if (parentName != parentGenome->getName()) {
-                alignment->closeGenome(parentGenome);
-                parentGenome = childGenome->getParent();
-            }
-
-            genome2PAF(cout, childGenome, fullNames);
-
+            branches.emplace_back(childName);
             childs = alignment->getChildNames(childName);
             for (int i = 0; i < childs.size(); ++i) {
                 queue.push_back(childs[i]);
             }
+        }
 
-            alignment->closeGenome(childGenome);
+        // with one thread, each genome is a single chunk and is opened only
+        // when converted, so it can be closed right after
+        vector<PafChunk> chunks;
+        for (PafBranch &branch : branches) {
+            if (numThreads == 1) {
+                chunks.push_back({&branch, 0, NULL_INDEX});
+            } else {
+                const Genome *childGenome = alignment->openGenome(branch._name);
+                hal_size_t chunkSize = max(MIN_CHUNK_SEGMENTS, childGenome->getNumTopSegments() / numThreads);
+                hal_index_t firstSegment = 0;
+                for (SequenceIteratorPtr seqIt = childGenome->getSequenceIterator(); not seqIt->atEnd(); seqIt->toNext()) {
+                    const Sequence *sequence = seqIt->getSequence();
+                    hal_index_t endSegment = sequence->getTopSegmentArrayIndex() + sequence->getNumTopSegments();
+                    if (endSegment - firstSegment >= (hal_index_t)chunkSize) {
+                        chunks.push_back({&branch, firstSegment, endSegment});
+                        firstSegment = endSegment;
+                    }
+                }
+                if (firstSegment < (hal_index_t)childGenome->getNumTopSegments() || firstSegment == 0) {
+                    chunks.push_back({&branch, firstSegment, (hal_index_t)childGenome->getNumTopSegments()});
+                }
+            }
+        }
+        for (PafChunk &chunk : chunks) {
+            chunk._branch->_chunksLeft++;
         }
+
+        const Genome *parentGenome = rootGenome;
+        parallelOrderedOutput(chunks.size(), numThreads,
+                              [&](size_t i, ostream &outStream) {
+                                  PafChunk &chunk = chunks[i];
+                                  PafBranch &branch = *chunk._branch;
+                                  const Genome *childGenome = alignment->openGenome(branch._name);
+                                  if (numThreads == 1 && alignment->getParentName(branch._name) != parentGenome->getName()) {
+                                      alignment->closeGenome(parentGenome);
+                                      parentGenome = childGenome->getParent();
+                                  }
+                                  call_once(branch._parentSetOnce, getParentSet, childGenome, ref(branch._parentSet));
+                                  hal_index_t endSegment =
+                                      chunk._endSegment == NULL_INDEX ? childGenome->getNumTopSegments() : chunk._endSegment;
+                                  if (genome2PAF(outStream, childGenome, fullNames, chunk._firstSegment, endSegment,
+                                                 branch._parentSet)) {
+                                      branch._foundMatch = true;
+                                  }
+                                  if (--branch._chunksLeft == 0) {
+                                      if (!branch._foundMatch) {
+                                          cerr << "Warning [hal2paf]: no alignment blocks found for genome " << branch._name
+                                               << endl;
+                                      }
+                                      if (numThreads == 1) {
+                                          alignment->closeGenome(childGenome);
+                                      }
+                                  }
+                              },
+                              cout);
     }
     catch(exception& e) {
         cerr << e.what() << endl;
@@ -102,15 +181,15 @@ int main(int argc, char **argv) {
     return 0;
 }
 
-/// scan to next match, returning false if not found
+/// scan to next match before endSegment, returning false if not found
 static bool nextMatch(const TopSegmentIteratorPtr& topIt1, const BottomSegmentIteratorPtr& botIt1,
-                      TopSegmentIteratorPtr& topIt2,  BottomSegmentIteratorPtr& botIt2) {
+                      TopSegmentIteratorPtr& topIt2,  BottomSegmentIteratorPtr& botIt2, hal_index_t endSegment) {
     // set the second iterators to match the first, without re-allocating
     topIt2->copy(topIt1);
     botIt2->copy(botIt2);
 
     // scan til next match
-    for (topIt2->toRight(); not topIt2->atEnd(); topIt2->toRight()) {
+    for (topIt2->toRight(); topIt2->getArrayIndex() < endSegment; topIt2->toRight()) {
         if (topIt2->tseg()->hasParent()) {
             // return on any kind of match
             botIt2->toParent(topIt2);
@@ -179,24 +258,30 @@ static char blockCat(const TopSegmentIteratorPtr& topIt1, const BottomSegmentIte
 }
 
 
-void genome2PAF(ostream& outStream, const Genome* genome, bool fullNames) {
-    TopSegmentIteratorPtr topIt1 = genome->getTopSegmentIterator();
-    TopSegmentIteratorPtr topIt2 = genome->getTopSegmentIterator();
-    TopSegmentIteratorPtr topIt3 = genome->getTopSegmentIterator();
+/// remember which bottom segments have children in presence of duplications
+static void getParentSet(const Genome *genome, unordered_set<hal_index_t> &parentSet) {
+    for (TopSegmentIteratorPtr topIt = genome->getTopSegmentIterator(); not topIt->atEnd(); topIt->toRight()) {
+        if (topIt->tseg()->hasNextParalogy() && topIt->tseg()->isCanonicalParalog()) {
+            parentSet.insert(topIt->tseg()->getParentIndex());
+        }
+    }
+}
+
+/// write the paf lines for the top segments [firstSegment, endSegment) of genome,
+/// returning false if there were none.  The range must not split a sequence.
+static bool genome2PAF(ostream &outStream, const Genome *genome, bool fullNames, hal_index_t firstSegment,
+                       hal_index_t endSegment, const unordered_set<hal_index_t> &parentSet) {
+    if (firstSegment >= endSegment) {
+        return false;
+    }
+    TopSegmentIteratorPtr topIt1 = genome->getTopSegmentIterator(firstSegment);
+    TopSegmentIteratorPtr topIt2 = genome->getTopSegmentIterator(firstSegment);
+    TopSegmentIteratorPtr topIt3 = genome->getTopSegmentIterator(firstSegment);
     BottomSegmentIteratorPtr botIt1 = genome->getParent()->getBottomSegmentIterator();
     BottomSegmentIteratorPtr botIt2 = genome->getParent()->getBottomSegmentIterator();
     BottomSegmentIteratorPtr botIt3 = genome->getParent()->getBottomSegmentIterator();
     bool found_match = false;
 
-    // this is used to remember which bottom segments have children in presence of duplications
-    unordered_set<hal_index_t> parentSet;
-    for (; not topIt1->atEnd(); topIt1->toRight()) {
-        if (topIt1->tseg()->hasNextParalogy() && topIt1->tseg()->isCanonicalParalog()) {
-            parentSet.insert(topIt1->tseg()->getParentIndex());
-        }
-    }
-    topIt1->copy(topIt2);
-
     // find the first match
     if (topIt1->tseg()->hasParent()) {
         // it's either at position 0
@@ -208,11 +293,10 @@ void genome2PAF(ostream& outStream, const Genome* genome, bool fullNames) {
     }
     if (!found_match) {
         // or we have to seek for it
-        found_match = nextMatch(topIt1, botIt1, topIt2, botIt2);
+        found_match = nextMatch(topIt1, botIt1, topIt2, botIt2, endSegment);
         if (!found_match) {
-            cerr << "Warning [hal2paf]: no alignment blocks found for genome " << genome->getName() << endl;
             // don't bother printing out empty records
-            return;
+            return false;
         }
         topIt1->copy(topIt2);
         botIt1->copy(botIt2);
@@ -240,7 +324,7 @@ void genome2PAF(ostream& outStream, const Genome* genome, bool fullNames) {
         cerr << "t2 " << *topIt2 << endl;
         cerr << "b2 " << *botIt2 << endl;        
 #endif
-        found_match = nextMatch(topIt1, botIt1, topIt2, botIt2);
+        found_match = nextMatch(topIt1, botIt1, topIt2, botIt2, endSegment);
         bool newLine = !found_match;
         char cat = 'o';
         if (!newLine) {
@@ -345,4 +429,5 @@ void genome2PAF(ostream& outStream, const Genome* genome, bool fullNames) {
         topIt1->copy(topIt2);
         botIt1->copy(botIt2);
     }
+    return true;
 }
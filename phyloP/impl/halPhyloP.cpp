@@ -12,7 +12,8 @@ using namespace std;
 using namespace hal;
 
 PhyloP::PhyloP()
-    : _mod(NULL), _softMaskDups(false), _maskAllDups(false), _seqnameHash(NULL), _colfitdata(NULL), _mode(CONACC), _msa(NULL) {
+    : _mod(NULL), _softMaskDups(false), _maskAllDups(false), _seqnameHash(NULL), _colfitdata(NULL), _mode(CONACC), _msa(NULL),
+      _maxCacheSize(0) {
 }
 
 PhyloP::~PhyloP() {
@@ -30,14 +31,16 @@ void PhyloP::clear() {
         hsh_free(_seqnameHash);
     }
     _targetSet.clear();
+    _pvalCache.clear();
 
     // need to free _mod?
 }
 
 void PhyloP::init(AlignmentConstPtr alignment, const string &modFilePath, ostream *outStream, bool softMaskDups,
-                  const string &dupType, const string &phyloPMode, const string &subtree) {
+                  const string &dupType, const string &phyloPMode, const string &subtree, hal_size_t maxCacheSize) {
     clear();
     _alignment = alignment;
+    _maxCacheSize = maxCacheSize;
     _softMaskDups = (int)softMaskDups;
     _outStream = outStream;
 
@@ -176,9 +179,12 @@ void PhyloP::processSequence(const Sequence *sequence, hal_index_t start, hal_si
                             std::to_string(seqLen));
     }
 
-    const Genome *genome = sequence->getGenome();
-    string sequenceName = sequence->getName();
-    string genomeName = genome->getName();
+    processTile(*_outStream, sequence, start, length, step, true, true);
+}
+
+void PhyloP::processTile(ostream &outStream, const Sequence *sequence, hal_size_t start, hal_size_t length,
+                         hal_size_t step, bool firstTile, bool lastTile) {
+    hal_size_t last = start + length;
 
     /** The ColumnIterator is fundamental structure used in this example to
      * traverse the alignment.  It essientially generates the multiple alignment
@@ -190,22 +196,24 @@ void PhyloP::processSequence(const Sequence *sequence, hal_index_t start, hal_si
     hal_size_t pos = start;
     ColumnIteratorPtr colIt = sequence->getColumnIterator(&_targetSet, 0, pos, last - 1);
 
-    // note wig coordinates are 1-based for some reason so we shift to right
-    *_outStream << "fixedStep chrom=" << sequenceName << " start=" << start + 1 << " step=" << step << "\n";
+    if (firstTile) {
+        // note wig coordinates are 1-based for some reason so we shift to right
+        outStream << "fixedStep chrom=" << sequence->getName() << " start=" << start + 1 << " step=" << step << "\n";
+    }
 
     /** Since the column iterator stores coordinates in Genome coordinates
      * internally, we have to switch back to genome coordinates.  */
     // convert to genome coordinates
     pos += sequence->getStartPosition();
     last += sequence->getStartPosition();
-    while (pos <= last) {
+    while (lastTile ? pos <= last : pos < last) {
         /** ColumnIterator::ColumnMap maps a Sequence to a list of bases
          * the bases in the map form the alignment column.  Some sequences
          * in the map can have no bases (for efficiency reasons) */
         const ColumnIterator::ColumnMap *cmap = colIt->getColumnMap();
         double pval = this->pval(cmap);
 
-        *_outStream << pval << '\n';
+        outStream << pval << '\n';
 
         /** lastColumn checks if we are at the last column (inclusive)
          * in range.  So we need to check at end of iteration instead
@@ -229,7 +237,11 @@ void PhyloP::processSequence(const Sequence *sequence, hal_index_t start, hal_si
                 colIt->defragment();
             }
         } else {
-            /** Reset the iterator to a non-contiguous position */
+            /** Reset the iterator to a non-contiguous position, unless we
+             * have stepped into the next tile */
+            if (!lastTile && pos >= last) {
+                break;
+            }
             colIt->toSite(pos, last - 1);
         }
     }
@@ -237,6 +249,29 @@ void PhyloP::processSequence(const Sequence *sequence, hal_index_t start, hal_si
 
 // compute phyloP score for a particular alignment column, return pval
 double PhyloP::pval(const ColumnIterator::ColumnMap *cmap) {
+    if (!fillColumn(cmap)) {
+        return 0.0;
+    }
+    if (_maxCacheSize == 0) {
+        return computePval();
+    }
+    // the masking options are fixed, so the tuple determines the score
+    _cacheKey.assign(_msa->ss->col_tuples[0], _msa->nseqs);
+    unordered_map<string, double>::const_iterator cached = _pvalCache.find(_cacheKey);
+    if (cached != _pvalCache.end()) {
+        return cached->second;
+    }
+    double pval = computePval();
+    if (_pvalCache.size() >= _maxCacheSize) {
+        _pvalCache.clear();
+    }
+    _pvalCache.insert(make_pair(_cacheKey, pval));
+    return pval;
+}
+
+// fill in the column tuple, one base per species, with N for missing and
+// soft-masked duplicated bases.  Returns false if the column is hard-masked.
+bool PhyloP::fillColumn(const ColumnIterator::ColumnMap *cmap) {
     for (int i = 0; i < _msa->nseqs; i++) {
         _msa->ss->col_tuples[0][i] = '*';
     }
@@ -256,12 +291,12 @@ double PhyloP::pval(const ColumnIterator::ColumnMap *cmap) {
                 _msa->ss->col_tuples[0][spec] = base;
             } else {
                 if (_maskAllDups && _softMaskDups == 0) { // hard mask, all dups
-                    return 0.0;                           // duplication; mask this base
+                    return false;                         // duplication; mask this base
                 } else if (_maskAllDups) {                // soft mask, all dups
                     _msa->ss->col_tuples[0][spec] = 'N';
                 } else if (_msa->ss->col_tuples[0][spec] != base) {
                     if (_softMaskDups == 0) {
-                        return 0.0;
+                        return false;
                     } else {
                         _msa->ss->col_tuples[0][spec] = 'N';
                     }
@@ -277,7 +312,10 @@ double PhyloP::pval(const ColumnIterator::ColumnMap *cmap) {
             _msa->ss->col_tuples[0][i] = 'N';
         }
     }
+    return true;
+}
 
+double PhyloP::computePval() {
     // finally, compute the score!
     double alt_lnl, null_lnl, this_scale, delta_lnl, pval;
     int sigfigs = 4; // same value used in phyloP code
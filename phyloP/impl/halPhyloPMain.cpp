@@ -8,19 +8,60 @@
 
 #include "halPhyloP.h"
 #include "halPhyloPBed.h"
+#include "halParallel.h"
 #include <algorithm>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 
 #undef min
 using namespace std;
 using namespace hal;
 
-/** If given genome-relative coordinates, map them to a series of
- * sequence subranges */
-static void printGenome(PhyloP *phyloP, const Genome *genome, const Sequence *sequence, hal_size_t start, hal_size_t length,
-                        hal_size_t step);
+/** A subrange of a sequence whose wiggle is computed independently. */
+struct PhyloPTile {
+    const Sequence *_sequence;
+    hal_size_t _start;
+    hal_size_t _length;
+    bool _first; // print the wiggle header
+    bool _last;  // last tile of the range
+};
+
+/** Get the tiles for a range of the reference genome, or of sequence if
+ * it isn't NULL.  Genome-relative coordinates are mapped to a series of
+ * sequence subranges, and each is split into tiles of tileSize bases
+ * (which must be a multiple of step), or not split if tileSize is 0. */
+static void getGenomeTiles(const Genome *genome, const Sequence *sequence, hal_size_t start, hal_size_t length,
+                           hal_size_t tileSize, vector<PhyloPTile> &tiles);
+
+/* default --tileSize */
+static const hal_size_t DefaultTileSize = 1000000;
+
+/* PhyloP objects for the threads, each used by one tile at a time */
+class PhyloPPool {
+  public:
+    PhyloP *acquire() {
+        lock_guard<mutex> lock(_mutex);
+        PhyloP *phyloP = _free.back();
+        _free.pop_back();
+        return phyloP;
+    }
+    void release(PhyloP *phyloP) {
+        lock_guard<mutex> lock(_mutex);
+        _free.push_back(phyloP);
+    }
+    void add(PhyloP *phyloP) {
+        _phyloPs.push_back(unique_ptr<PhyloP>(phyloP));
+        _free.push_back(phyloP);
+    }
+
+  private:
+    vector<unique_ptr<PhyloP>> _phyloPs;
+    vector<PhyloP *> _free;
+    mutex _mutex;
+};
 
 static void initParser(CLParser &optionsParser) {
     /** It is convenient to use the HAL command line parser for the command
@@ -65,6 +106,13 @@ static void initParser(CLParser &optionsParser) {
                                        "relative to the rest of the tree",
                             "\"\"");
     optionsParser.addOption("prec", "Number of decimal places in wig output", 3);
+    optionsParser.addOption("cacheSize", "Number of distinct alignment columns whose scores are "
+                                         "kept for reuse by each thread (0 to disable)",
+                            100000);
+    optionsParser.addOption("tileSize", "with --numThreads > 1, the reference is split into tiles of about this "
+                                        "many bases, which are computed in parallel (not used with --refBed)",
+                            DefaultTileSize);
+    addNumThreadsOption(optionsParser);
 
     optionsParser.setDescription("Make PhyloP wiggle plot for a genome.");
 }
@@ -85,6 +133,9 @@ int main(int argc, char **argv) {
     hal_size_t step;
     string refBedPath;
     hal_size_t prec;
+    hal_size_t cacheSize;
+    hal_size_t tileSize;
+    size_t numThreads;
     try {
         optionsParser.parseOptions(argc, argv);
         modPath = optionsParser.getArgument<string>("modPath");
@@ -101,6 +152,12 @@ int main(int argc, char **argv) {
         std::transform(dupMask.begin(), dupMask.end(), dupMask.begin(), ::tolower);
         refBedPath = optionsParser.getOption<string>("refBed");
         prec = optionsParser.getOption<hal_size_t>("prec");
+        cacheSize = optionsParser.getOption<hal_size_t>("cacheSize");
+        tileSize = optionsParser.getOption<hal_size_t>("tileSize");
+        numThreads = optionsParser.getOption<size_t>("numThreads");
+        if (tileSize == 0) {
+            throw hal_exception("--tileSize must be positive");
+        }
     } catch (exception &e) {
         cerr << e.what() << endl;
         optionsParser.printUsage(cerr);
@@ -152,8 +209,14 @@ int main(int argc, char **argv) {
         outStream.setf(ios::fixed, ios::floatfield);
         outStream.precision(prec);
 
-        PhyloP phyloP;
-        phyloP.init(alignment, modPath, &outStream, dupMask == "soft", dupType, "CONACC", subtree);
+        // a bed is scanned in one thread
+        numThreads = refBedPath != "\"\"" ? 1 : getNumThreads(alignment.get(), numThreads, "halPhyloP");
+        PhyloPPool phyloPPool;
+        for (size_t i = 0; i < numThreads; ++i) {
+            PhyloP *threadPhyloP = new PhyloP();
+            phyloPPool.add(threadPhyloP);
+            threadPhyloP->init(alignment, modPath, &outStream, dupMask == "soft", dupType, "CONACC", subtree, cacheSize);
+        }
 
         ifstream refBedStream;
         if (refBedPath != "\"\"") {
@@ -165,10 +228,40 @@ int main(int argc, char **argv) {
                 }
             }
             istream &bedStream = refBedPath != "stdin" ? bedFileStream : cin;
-            PhyloPBed phyloPBed(alignment, refGenome, refSequence, start, length, step, phyloP, outStream);
+            PhyloP *phyloP = phyloPPool.acquire();
+            PhyloPBed phyloPBed(alignment, refGenome, refSequence, start, length, step, *phyloP, outStream);
             phyloPBed.scan(&bedStream);
+            phyloPPool.release(phyloP);
         } else {
-            printGenome(&phyloP, refGenome, refSequence, start, length, step);
+            // tiles start on a step, so the same positions are scored as in one pass
+            hal_size_t stepTileSize = numThreads > 1 ? max(tileSize / step, (hal_size_t)1) * step : 0;
+            vector<PhyloPTile> tiles;
+            getGenomeTiles(refGenome, refSequence, start, length, stepTileSize, tiles);
+            if (numThreads > 1) {
+                parallelOrderedOutput(tiles.size(), numThreads,
+                                      [&](size_t i, ostream &tileStream) {
+                                          tileStream.flags(outStream.flags());
+                                          tileStream.precision(outStream.precision());
+                                          PhyloP *phyloP = phyloPPool.acquire();
+                                          try {
+                                              phyloP->processTile(tileStream, tiles[i]._sequence, tiles[i]._start,
+                                                                  tiles[i]._length, step, tiles[i]._first,
+                                                                  tiles[i]._last);
+                                          } catch (...) {
+                                              phyloPPool.release(phyloP);
+                                              throw;
+                                          }
+                                          phyloPPool.release(phyloP);
+                                      },
+                                      outStream);
+            } else {
+                PhyloP *phyloP = phyloPPool.acquire();
+                for (size_t i = 0; i < tiles.size(); ++i) {
+                    phyloP->processTile(outStream, tiles[i]._sequence, tiles[i]._start, tiles[i]._length, step,
+                                        tiles[i]._first, tiles[i]._last);
+                }
+                phyloPPool.release(phyloP);
+            }
         }
     } catch (hal_exception &e) {
         cerr << "hal exception caught: " << e.what() << endl;
@@ -181,6 +274,32 @@ int main(int argc, char **argv) {
     return 0;
 }
 
+/** Split a (sequence-relative) range of a sequence into tiles */
+static void getSequenceTiles(const Sequence *sequence, hal_size_t start, hal_size_t length, hal_size_t tileSize,
+                             vector<PhyloPTile> &tiles) {
+    hal_size_t seqLen = sequence->getSequenceLength();
+    if (seqLen == 0) {
+        return;
+    }
+    /** If the length is 0, we do from the start position until the end
+     * of the sequence */
+    if (length == 0) {
+        length = seqLen - start;
+    }
+    if (start + length > seqLen) {
+        throw hal_exception("Specified range [" + std::to_string(start) + "," + std::to_string(length) +
+                            "] is out of range for sequence " + sequence->getName() + ", which has length " +
+                            std::to_string(seqLen));
+    }
+    if (tileSize == 0) {
+        tileSize = length;
+    }
+    for (hal_size_t offset = 0; offset < length; offset += tileSize) {
+        hal_size_t tileLength = min(tileSize, length - offset);
+        tiles.push_back({sequence, start + offset, tileLength, offset == 0, offset + tileLength == length});
+    }
+}
+
 /** Map a range of genome-level coordinates to potentially multiple sequence
  * ranges.  For example, if a genome contains two chromosomes ChrA and ChrB,
  * both of which are of length 500, then the genome-coordinates would be
@@ -189,10 +308,10 @@ int main(int argc, char **argv) {
  * for the hal::Sequence interface.  We can convert between the two by
  * adding or subtracting the sequence start position (in the example it woudl
  * be 0 for ChrA and 500 for ChrB) */
-void printGenome(PhyloP *phyloP, const Genome *genome, const Sequence *sequence, hal_size_t start, hal_size_t length,
-                 hal_size_t step) {
+void getGenomeTiles(const Genome *genome, const Sequence *sequence, hal_size_t start, hal_size_t length,
+                    hal_size_t tileSize, vector<PhyloPTile> &tiles) {
     if (sequence != NULL) {
-        phyloP->processSequence(sequence, start, length, step);
+        getSequenceTiles(sequence, start, length, tileSize, tiles);
     } else {
         if (start + length > genome->getSequenceLength()) {
             throw hal_exception("Specified range [" + std::to_string(start) + "," + std::to_string(length) + "] is" +
@@ -213,7 +332,8 @@ void printGenome(PhyloP *phyloP, const Genome *genome, const Sequence *sequence,
                 hal_size_t readStart = seqStart >= start ? 0 : start - seqStart;
                 hal_size_t readLen = min(seqLen - readStart, length);
                 readLen = min(readLen, length - runningLength);
-                phyloP->processSequence(sequence, readStart, readLen, step);
+                // the iterator's sequence doesn't outlive it, the genome's does
+                getSequenceTiles(genome->getSequence(sequence->getName()), readStart, readLen, tileSize, tiles);
                 runningLength += readLen;
             }
         }
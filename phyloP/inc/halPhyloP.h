@@ -12,6 +12,7 @@
 #include "hal.h"
 #include <cstdlib>
 #include <string>
+#include <unordered_map>
 
 #undef __cplusplus
 extern "C" {
@@ -44,17 +45,38 @@ namespace hal {
          * entire tree. Otherwise, subtree names a branch to perform test on
          * subtree relative to rest of tree. The subtree includes all children
          * of the named node as well as the branch leading to the node.
+         * @param maxCacheSize Number of distinct columns whose scores are
+         * kept, as deep alignments repeat a few columns (such as fully
+         * conserved ones) over and over.  The cache is emptied when it is
+         * full.  0 disables it.
          */
         void init(AlignmentConstPtr alignment, const std::string &modFilePath, std::ostream *outStream,
                   bool softMaskDups = true, const std::string &dupType = "ambiguous", const std::string &phyloPMode = "CONACC",
-                  const std::string &subtree = "\"\"");
+                  const std::string &subtree = "\"\"", hal_size_t maxCacheSize = 100000);
 
         void processSequence(const Sequence *sequence, hal_index_t start, hal_size_t length, hal_size_t step);
 
+        /** Print the wiggle of one tile of a sequence range to outStream.
+         * The header is only printed for the first tile, and the range's
+         * end is only handled by the last, so consecutive tiles (starting
+         * on a step) print the same positions as processSequence on the
+         * whole range.  Each tile has its own column iterator, so a column
+         * of a duplication that crosses a tile boundary is not guaranteed
+         * to be built as in one pass.  Each thread needs its own PhyloP,
+         * as the Phast state is changed by every column. */
+        void processTile(std::ostream &outStream, const Sequence *sequence, hal_size_t start, hal_size_t length,
+                         hal_size_t step, bool firstTile, bool lastTile);
+
       protected:
         // return phyloP score
         double pval(const ColumnIterator::ColumnMap *cmap);
 
+        // fill the column tuple from cmap, returning false if it is masked
+        bool fillColumn(const ColumnIterator::ColumnMap *cmap);
+
+        // compute the phyloP score of the column tuple
+        double computePval();
+
         void clear();
 
       protected:
@@ -76,6 +98,11 @@ namespace hal {
         List *_outsideNodes;
         mode_type _mode;
         MSA *_msa;
+
+        // scores of the columns seen, keyed by column tuple
+        std::unordered_map<std::string, double> _pvalCache;
+        hal_size_t _maxCacheSize;
+        std::string _cacheKey;
     };
 }
 #endif
@@ -0,0 +1,10 @@
+ALPHABET: A C G T 
+ORDER: 0
+SUBST_MOD: REV
+BACKGROUND: 0.295000 0.205000 0.205000 0.295000 
+RATE_MAT:
+  -0.976030    0.165175    0.539722    0.271133 
+   0.237691   -0.990352    0.189637    0.563024 
+   0.776673    0.189637   -1.248143    0.281833 
+   0.271133    0.391254    0.195849   -0.858237 
+TREE: ((Genome_2:0.1,Genome_3:0.2)Genome_1:0.05,Genome_0:0.1);
@@ -18,25 +18,14 @@ using namespace std;
 using namespace hal;
 
 struct RandOptions {
-    double _meanDegree;
-    double _maxBranchLength;
-    hal_size_t _minGenomes;
-    hal_size_t _maxGenomes;
-    hal_size_t _minSegmentLength;
-    hal_size_t _maxSegmentLength;
-    hal_size_t _minSegments;
-    hal_size_t _maxSegments;
+    RandomAlignmentParams _params;
     int _seed;
     bool _testRand;
     string _halFile;
 };
 
-static const RandOptions defaultSm = {0.75, 0.1, 2, 5, 250, 1000, 5, 10, -1, false, ""};
-static const RandOptions defaultMed = {1.25, 0.7, 8, 20, 500, 2000, 100, 500, -1, false, ""};
-static const RandOptions defaultBig = {2.00, 0.7, 20, 50, 1000, 8000, 400, 5000, -1, false, ""};
-static const RandOptions defaultLrg = {2.00, 1.0, 50, 100, 5000, 10000, 10000, 50000, -1, false, ""};
-
 static void initParser(CLParser &optionsParser) {
+    const RandomAlignmentParams &defaultMed = getRandomAlignmentPreset("medium");
     optionsParser.setDescription("Generate a random HAL alignment file");
     optionsParser.addOption("preset", "one of small, medium, big, large [medium]", "medium");
     optionsParser.addOption("meanDegree", "[" + std::to_string(defaultMed._meanDegree) + "]", defaultMed._meanDegree);
@@ -61,31 +50,19 @@ template <typename T> void updateOption(const CLParser *parser, const string &na
     }
 }
 
-static RandOptions getPresetDefault(const CLParser *optionsParser) {
-    const string preset = optionsParser->getOption<string>("preset");
-    if (preset == "small") {
-        return defaultSm;
-    } else if (preset == "medium") {
-        return defaultMed;
-    } else if (preset == "big") {
-        return defaultBig;
-    } else if (preset == "large") {
-        return defaultLrg;
-    } else {
-        throw hal_exception(" invalid --preset value: " + preset);
-    }
-}
-
 static RandOptions parseProgOptions(const CLParser *optionsParser) {
-    RandOptions options = getPresetDefault(optionsParser);
-    updateOption(optionsParser, "meanDegree", options._meanDegree);
-    updateOption(optionsParser, "maxBranchLength", options._maxBranchLength);
-    updateOption(optionsParser, "minGenomes", options._minGenomes);
-    updateOption(optionsParser, "maxGenomes", options._maxGenomes);
-    updateOption(optionsParser, "minSegmentLength", options._minSegmentLength);
-    updateOption(optionsParser, "maxSegmentLength", options._maxSegmentLength);
-    updateOption(optionsParser, "minSegments", options._minSegments);
-    updateOption(optionsParser, "maxSegments", options._maxSegments);
+    RandOptions options;
+    options._params = getRandomAlignmentPreset(optionsParser->getOption<string>("preset"));
+    options._seed = -1;
+    options._testRand = false;
+    updateOption(optionsParser, "meanDegree", options._params._meanDegree);
+    updateOption(optionsParser, "maxBranchLength", options._params._maxBranchLength);
+    updateOption(optionsParser, "minGenomes", options._params._minGenomes);
+    updateOption(optionsParser, "maxGenomes", options._params._maxGenomes);
+    updateOption(optionsParser, "minSegmentLength", options._params._minSegmentLength);
+    updateOption(optionsParser, "maxSegmentLength", options._params._maxSegmentLength);
+    updateOption(optionsParser, "minSegments", options._params._minSegments);
+    updateOption(optionsParser, "maxSegments", options._params._maxSegments);
     updateOption(optionsParser, "seed", options._seed);
     if (optionsParser->getFlag("testRand")) {
         options._testRand = true;
@@ -112,9 +89,7 @@ int main(int argc, char **argv) {
     try {
         AlignmentPtr alignment(openHalAlignment(options._halFile, &optionsParser, hal::CREATE_ACCESS));
         // call the crappy unit-test simulator
-        createRandomAlignment(rng, alignment, options._meanDegree, options._maxBranchLength, options._minGenomes,
-                              options._maxGenomes, options._minSegmentLength, options._maxSegmentLength, options._minSegments,
-                              options._maxSegments);
+        createRandomAlignment(rng, alignment, options._params);
 
         alignment->close();
     } catch (hal_exception &e) {
@@ -45,16 +45,19 @@ int main(int argc, char **argv) {
 
     hal_size_t maxDepth = 0;
 
+    SegmentMapper mapper;
+    vector<MappedSegmentSet> leafSegments;
     for (hal_size_t i = 0; i < numSamples; i++) {
         // Sample (with replacement) a random position in the reference genome.
         hal_index_t pos = st_randomInt64(0, ref->getSequenceLength());
         SegmentIteratorPtr refSeg = ref->getTopSegmentIterator();
         refSeg->toSite(pos, true);
         assert(refSeg->getLength() == 1);
+        leafSegments.clear();
+        mapper.mapSegmentToMany(refSeg.get(), leafGenomes, leafSegments);
         for (size_t j = 0; j < leafGenomes.size(); j++) {
             const Genome *leafGenome = leafGenomes[j];
-            MappedSegmentSet segments;
-            halMapSegmentSP(refSeg, segments, leafGenome, NULL, true, 0, NULL, NULL);
+            const MappedSegmentSet &segments = leafSegments[j];
             vector<hal_size_t> &histogram = coverage[leafGenome];
             hal_size_t depth = segments.size();
             if (depth > maxDepth) {
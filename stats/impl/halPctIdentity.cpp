@@ -44,6 +44,8 @@ int main(int argc, char **argv) {
         idStats.insert(make_pair(leafGenomes[i], make_pair(0, 0)));
     }
 
+    SegmentMapper mapper;
+    vector<MappedSegmentSet> leafSegments;
     for (hal_size_t i = 0; i < numSamples; i++) {
         // Sample (with replacement) a random position in the reference genome.
         hal_index_t pos = st_randomInt64(0, ref->getSequenceLength());
@@ -56,10 +58,11 @@ int main(int argc, char **argv) {
         if (toupper(refString[0]) == 'N') {
             continue;
         }
+        leafSegments.clear();
+        mapper.mapSegmentToMany(refSeg.get(), leafGenomes, leafSegments);
         for (size_t j = 0; j < leafGenomes.size(); j++) {
             const Genome *leafGenome = leafGenomes[j];
-            MappedSegmentSet segments;
-            halMapSegmentSP(refSeg, segments, leafGenome, NULL, true, 0, NULL, NULL);
+            const MappedSegmentSet &segments = leafSegments[j];
             if (segments.size() == 1) {
                 auto i = segments.begin();
                 string tgtString;
@@ -26,7 +26,7 @@ std::vector<PslBlock> Hal2Psl::convert2psl(AlignmentConstPtr alignment, const Ge
         _tgtGenome = tgtGenome;
         _coalescenceLimit = NULL;
         _traverseDupes = true;
-        _missedSet.clear();
+        clearMissedSet();
         _tgtSet.clear();
         _tgtSet.insert(tgtGenome);
         for (SequenceIteratorPtr seqIt = srcGenome->getSequenceIterator(); not seqIt->atEnd(); seqIt->toNext()) {
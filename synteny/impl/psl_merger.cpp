@@ -13,6 +13,10 @@ bool is_not_overlapping_ordered_pair(const PslBlock &a, const PslBlock &b, const
 std::vector<int> get_next(const int pos, const std::vector<PslBlock> &queryGroup, const hal_size_t maxAnchorDistance) {
     std::vector<int> f;
     for (auto i = pos + 1; i < (int)queryGroup.size(); ++i) {
+        // the group is sorted by qStart, so nothing further is close enough
+        if (queryGroup[i].qStart >= queryGroup[pos].qEnd + maxAnchorDistance) {
+            break;
+        }
         if (is_not_overlapping_ordered_pair(queryGroup[pos], queryGroup[i], maxAnchorDistance)) {
             if (f.empty())
                 f.push_back(i);
@@ -29,74 +33,104 @@ std::vector<int> get_next(const int pos, const std::vector<PslBlock> &queryGroup
     return f;
 }
 
-// *dag* is represented as a map:  vertex -> its possible next vertices;
-// *hidden_vertices* is a set of vertices that are already in paths;
-// Weight of an edge equals length of the next psl block;
-// Weight of a vertex equals estimated weight:
-// w_j < w_i + w_e(ij) => w_j must be updated
-// Also keeps track of how we came to this state:
-// (prev_vertex, weight)
-std::map<int, std::pair<int, hal_size_t>> weigh_dag(const std::vector<PslBlock> &group, std::map<int, std::vector<int>> &dag,
-                                                    const std::set<int> &hiddenVertices, const hal_size_t maxAnchorDistance) {
-    std::map<int, std::pair<int, hal_size_t>> weightedDag;
+ChainGraph::ChainGraph(const std::vector<PslBlock> &group, const hal_size_t maxAnchorDistance)
+    : group(group), nextStarts(group.size() + 1, 0), prevStarts(group.size() + 1, 0), weights(group.size()),
+      prevVertex(group.size()), hidden(group.size(), false) {
+    for (int i = 0; i < (int)group.size(); ++i) {
+        auto f = get_next(i, group, maxAnchorDistance);
+        nexts.insert(nexts.end(), f.begin(), f.end());
+        nextStarts[i + 1] = nexts.size();
+        for (auto j : f) {
+            ++prevStarts[j + 1];
+        }
+    }
+    // prevs of each vertex, in increasing order
+    for (size_t i = 0; i < group.size(); ++i) {
+        prevStarts[i + 1] += prevStarts[i];
+    }
+    prevs.resize(nexts.size());
+    std::vector<size_t> fill(prevStarts.begin(), prevStarts.end() - 1);
+    for (int i = 0; i < (int)group.size(); ++i) {
+        for (size_t e = nextStarts[i]; e < nextStarts[i + 1]; ++e) {
+            prevs[fill[nexts[e]]++] = i;
+        }
+    }
     for (int i = 0; i < (int)group.size(); ++i) {
-        if (hiddenVertices.count(i))
+        weigh(i);
+        byWeight.insert(std::make_pair(weights[i], i));
+    }
+}
+
+// The weight of a vertex is its size plus the largest weight of the visible
+// vertices before it, the first of them on ties, as weighing the vertices in
+// order and relaxing each edge would give.
+void ChainGraph::weigh(int vertex) {
+    weights[vertex] = group[vertex].size;
+    prevVertex[vertex] = -1;
+    for (size_t e = prevStarts[vertex]; e < prevStarts[vertex + 1]; ++e) {
+        int prev = prevs[e];
+        if (hidden[prev]) {
             continue;
-        std::vector<int> nexts;
-        if (not dag.count(i)) {
-            nexts = get_next(i, group, maxAnchorDistance);
-            dag[i] = nexts;
-        } else {
-            nexts = dag[i];
         }
-        // If this vertex was never visited then its weight equals to its size.
-        // Intuition: otherwise we will never count its size
-        if (not weightedDag.count(i))
-            weightedDag[i] = std::make_pair(-1, group[i].size);
-        for (auto j : nexts) {
-            if (hiddenVertices.count(j))
-                continue;
-            auto alternativeWeight = weightedDag[i].second + group[j].size;
-            if (not weightedDag.count(j) or weightedDag[j].second < alternativeWeight)
-                // Remembers previous vertex itself and
-                // its corresponding weight:
-                // previous vertex w_i + weight of the next edge
-                weightedDag[j] = std::make_pair(i, alternativeWeight);
+        auto alternativeWeight = weights[prev] + group[vertex].size;
+        if (prevVertex[vertex] == -1 or weights[vertex] < alternativeWeight) {
+            weights[vertex] = alternativeWeight;
+            prevVertex[vertex] = prev;
         }
     }
-    return weightedDag;
 }
 
-int get_maxed_vertex(const std::map<int, std::pair<int, hal_size_t>> &weightedDag) {
-    hal_size_t maxWeight = weightedDag.cbegin()->second.second;
-    int maxPos = weightedDag.cbegin()->first;
-    for (auto it = weightedDag.cbegin(); it != weightedDag.cend(); ++it) {
-        if (it->second.second >= maxWeight) {
-            maxWeight = it->second.second;
-            maxPos = it->first;
+// Hiding vertices can only lower weights, so a vertex needs weighing again
+// only if the vertex its best chain came from was hidden or got lighter.
+// Vertices are weighed again in order, after all of their prevs.
+void ChainGraph::reweigh(std::set<int> &dirty) {
+    while (not dirty.empty()) {
+        int i = *dirty.begin();
+        dirty.erase(dirty.begin());
+        auto oldWeight = weights[i];
+        weigh(i);
+        if (weights[i] == oldWeight) {
+            continue;
+        }
+        byWeight.erase(std::make_pair(oldWeight, i));
+        byWeight.insert(std::make_pair(weights[i], i));
+        for (size_t e = nextStarts[i]; e < nextStarts[i + 1]; ++e) {
+            int next = nexts[e];
+            if (not hidden[next] and prevVertex[next] == i) {
+                dirty.insert(next);
+            }
         }
     }
-    return maxPos;
 }
 
-std::vector<PslBlock> traceback(std::map<int, std::pair<int, hal_size_t>> &weightedDag, std::set<int> &hiddenVertices,
-                                const std::vector<PslBlock> &group) {
-    // Chooses the path of the heaviest weight
-    auto startVertex = get_maxed_vertex(weightedDag);
-    std::vector<int> path = {startVertex};
-    auto prevVertex = weightedDag[startVertex].first;
-    while (prevVertex != -1) {
-        path.push_back(prevVertex);
-        prevVertex = weightedDag[prevVertex].first;
+bool ChainGraph::next_chain(std::vector<int> &chain) {
+    chain.clear();
+    if (byWeight.empty()) {
+        return false;
     }
-    hiddenVertices.insert(path.begin(), path.end());
-    std::vector<PslBlock> pslBlockPath;
-    std::transform(path.begin(), path.end(), std::back_inserter(pslBlockPath), [group](int x) -> PslBlock { return group[x]; });
-    std::reverse(pslBlockPath.begin(), pslBlockPath.end());
-    return pslBlockPath;
+    for (int i = byWeight.rbegin()->second; i != -1; i = prevVertex[i]) {
+        chain.push_back(i);
+    }
+    std::reverse(chain.begin(), chain.end());
+    for (auto i : chain) {
+        hidden[i] = true;
+        byWeight.erase(std::make_pair(weights[i], i));
+    }
+    std::set<int> dirty;
+    for (auto i : chain) {
+        for (size_t e = nextStarts[i]; e < nextStarts[i + 1]; ++e) {
+            int next = nexts[e];
+            if (not hidden[next] and prevVertex[next] == i) {
+                dirty.insert(next);
+            }
+        }
+    }
+    reweigh(dirty);
+    return true;
 }
+
 struct {
-    bool operator()(PslBlock a, PslBlock b) const {
+    bool operator()(const PslBlock &a, const PslBlock &b) const {
         if (a.qStart < b.qStart)
             return true;
         else if (a.qStart == b.qStart) {
@@ -109,25 +143,22 @@ struct {
 std::vector<std::vector<PslBlock>> dag_merge(const std::vector<PslBlock> &blocks, const hal_size_t minBlockBreath,
                                              const hal_size_t maxAnchorDistance) {
     std::map<std::string, std::vector<PslBlock>> blocksByQName;
-    for (auto block : blocks)
+    for (const auto &block : blocks)
         blocksByQName[block.qName].push_back(block);
     std::vector<std::vector<PslBlock>> paths;
-    for (auto pairs : blocksByQName) {
-        std::vector<PslBlock> group = pairs.second;
-        std::string qName = pairs.first;
-        std::map<int, std::vector<int>> dag;
-        std::set<int> hiddenVertices;
+    for (auto &pairs : blocksByQName) {
+        std::vector<PslBlock> &group = pairs.second;
         std::sort(group.begin(), group.end(), qStartLess);
-        while (hiddenVertices.size() != group.size()) {
-            auto weightedDag = weigh_dag(group, dag, hiddenVertices, maxAnchorDistance);
-            auto path = traceback(weightedDag, hiddenVertices, group);
-            if (path.empty()) {
-                break;
-            }
-            auto qLen = path.back().qEnd - path[0].qStart;
-            auto tLen = path.back().tEnd - path[0].tStart;
+        ChainGraph graph(group, maxAnchorDistance);
+        std::vector<int> chain;
+        while (graph.next_chain(chain)) {
+            auto qLen = group[chain.back()].qEnd - group[chain[0]].qStart;
+            auto tLen = group[chain.back()].tEnd - group[chain[0]].tStart;
             if (qLen >= minBlockBreath && tLen >= minBlockBreath) {
-                // if (qLen >= minBlockBreath && tLen >= minBlockBreath){
+                std::vector<PslBlock> path;
+                for (auto i : chain) {
+                    path.push_back(group[i]);
+                }
                 paths.push_back(path);
             }
         }
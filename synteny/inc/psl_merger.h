@@ -29,13 +29,38 @@ bool is_not_overlapping_ordered_pair(const PslBlock &a, const PslBlock &b, const
 
 std::vector<int> get_next(const int pos, const std::vector<PslBlock> &queryGroup, const hal_size_t maxAnchorDistance = 5000);
 
-std::map<int, std::pair<int, hal_size_t>> weigh_dag(const std::vector<PslBlock> &group, std::map<int, std::vector<int>> &dag,
-                                                    const std::set<int> &hiddenVertices, const hal_size_t maxAnchorDistance);
+/* The anchor graph of one query sequence's blocks, sorted by qStart, with
+ * the heaviest chain ending at each block.  The edges out of each block are
+ * those found by get_next, and a chain weighs the total size of its blocks.
+ * The graph is built once.  next_chain() takes the heaviest chain, ending at
+ * the highest block on ties, and hides its blocks.  Only the blocks whose
+ * best chain went through a hidden block are weighed again, in block order,
+ * instead of weighing the whole graph for each chain. */
+class ChainGraph {
+  public:
+    ChainGraph(const std::vector<PslBlock> &group, const hal_size_t maxAnchorDistance);
 
-int get_maxed_vertex(const std::map<int, std::pair<int, int>> &weightedDag);
+    /* set chain to the blocks of the next heaviest chain, in order, and
+     * hide them.  Returns false once all blocks are hidden. */
+    bool next_chain(std::vector<int> &chain);
 
-std::vector<PslBlock> traceback(std::map<int, std::pair<int, hal_size_t>> &weightedDag, std::set<int> &hiddenVertices,
-                                const std::vector<PslBlock> &group);
+  private:
+    void weigh(int vertex);
+    void reweigh(std::set<int> &dirty);
+
+    const std::vector<PslBlock> &group;
+    // edges as ranges of nexts and prevs, indexed by vertex
+    std::vector<size_t> nextStarts;
+    std::vector<int> nexts;
+    std::vector<size_t> prevStarts;
+    std::vector<int> prevs;
+    // best chain ending at each vertex: its weight and previous vertex
+    std::vector<hal_size_t> weights;
+    std::vector<int> prevVertex;
+    std::vector<bool> hidden;
+    // (weight, vertex) of the vertices not hidden
+    std::set<std::pair<hal_size_t, int>> byWeight;
+};
 
 std::vector<std::vector<PslBlock>> dag_merge(const std::vector<PslBlock> &blocks, const hal_size_t minBlockBreath,
                                              const hal_size_t maxAnchorDistance);